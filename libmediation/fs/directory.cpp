@@ -0,0 +1,28 @@
+#include "directory.h"
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+
+#include "file.h"
+
+bool createTempFile(File& file, const std::string& prefix, const unsigned int oflag, std::string& fileName)
+{
+    static std::atomic<unsigned> counter{0};
+    std::error_code error;
+    const std::filesystem::path dir = std::filesystem::temp_directory_path(error);
+    if (error)
+        return false;
+    // the file is created exclusively, so a name taken by another process or object is skipped
+    for (int attempt = 0; attempt < 100; ++attempt)
+    {
+        const auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+        fileName = (dir / (prefix + std::to_string(now) + "_" + std::to_string(counter++) + ".tmp")).string();
+        if (file.open(fileName.c_str(), oflag | File::ofCreateNew))
+            return true;
+        if (!fileExists(fileName))
+            break;
+    }
+    fileName.clear();
+    return false;
+}
@@ -20,4 +20,10 @@ bool deleteFile(const std::string& fileName);
 
 bool findFilesRecursive(const std::string& path, const std::string& mask, std::vector<std::string>* fileList);
 
+class File;
+
+/** create and open with oflag a file that did not exist before, in the temporary directory. The name starts with
+ * prefix and is returned in fileName. */
+bool createTempFile(File& file, const std::string& prefix, unsigned int oflag, std::string& fileName);
+
 #endif  // directory_h
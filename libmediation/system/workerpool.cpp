@@ -0,0 +1,85 @@
+#include "workerpool.h"
+
+#include <utility>
+
+WorkerPool& WorkerPool::instance()
+{
+    static WorkerPool pool(std::thread::hardware_concurrency() > 1 ? std::thread::hardware_concurrency() - 1 : 0);
+    return pool;
+}
+
+WorkerPool::WorkerPool(const unsigned threads)
+    : m_task(nullptr), m_count(0), m_next(0), m_done(0), m_terminate(false)
+{
+    for (unsigned i = 0; i < threads; ++i) m_threads.emplace_back([this]() { thread_main(); });
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard lock(m_mtx);
+        m_terminate = true;
+    }
+    m_workCond.notify_all();
+    for (auto& thread : m_threads) thread.join();
+}
+
+void WorkerPool::parallelFor(const size_t count, const std::function<void(size_t)>& task)
+{
+    if (count <= 1 || m_threads.empty())
+    {
+        for (size_t i = 0; i < count; ++i) task(i);
+        return;
+    }
+
+    std::lock_guard callLock(m_callMtx);
+    std::unique_lock lock(m_mtx);
+    m_task = &task;
+    m_count = count;
+    m_next = 0;
+    m_done = 0;
+    m_error = nullptr;
+    m_workCond.notify_all();
+
+    runTasks(lock);
+    m_doneCond.wait(lock, [this]() { return m_done == m_count; });
+    m_task = nullptr;
+    if (m_error)
+        std::rethrow_exception(std::exchange(m_error, nullptr));
+}
+
+void WorkerPool::runTasks(std::unique_lock<std::mutex>& lock)
+{
+    while (m_task && m_next < m_count)
+    {
+        const auto task = m_task;
+        const size_t i = m_next++;
+        lock.unlock();
+        std::exception_ptr error;
+        try
+        {
+            (*task)(i);
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+        lock.lock();
+        if (error && !m_error)
+            m_error = error;
+        if (++m_done == m_count)
+            m_doneCond.notify_all();
+    }
+}
+
+void WorkerPool::thread_main()
+{
+    std::unique_lock lock(m_mtx);
+    while (true)
+    {
+        m_workCond.wait(lock, [this]() { return m_terminate || (m_task && m_next < m_count); });
+        if (m_terminate)
+            return;
+        runTasks(lock);
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//! A fixed set of threads for splitting CPU-bound work into independent tasks.
+class WorkerPool
+{
+   public:
+    //! Process-wide pool with one thread per additional hardware thread. Created on first use.
+    static WorkerPool& instance();
+
+    explicit WorkerPool(unsigned threads);
+    //! Stops and joins all worker threads.
+    ~WorkerPool();
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    //! Number of tasks that can run at the same time, the calling thread included.
+    [[nodiscard]] unsigned concurrency() const { return static_cast<unsigned>(m_threads.size()) + 1; }
+
+    //! Runs task(0) ... task(count - 1) on the workers and the calling thread, and returns when all of them are done.
+    //! The first exception thrown by a task is rethrown here. Must not be called from inside a task.
+    void parallelFor(size_t count, const std::function<void(size_t)>& task);
+
+   private:
+    void thread_main();
+    void runTasks(std::unique_lock<std::mutex>& lock);
+
+    std::vector<std::thread> m_threads;
+    std::mutex m_callMtx;  // serializes parallelFor() callers
+    std::mutex m_mtx;
+    std::condition_variable m_workCond;
+    std::condition_variable m_doneCond;
+    const std::function<void(size_t)>* m_task;
+    size_t m_count;
+    size_t m_next;
+    size_t m_done;
+    std::exception_ptr m_error;
+    bool m_terminate;
+};
+
+#endif  // WORKER_POOL_H
@@ -34,7 +34,7 @@ bool AACCodec::decodeFrame(uint8_t* buffer, const uint8_t* end)
     try
     {
         bits.setBuffer(buffer, end);
-        if (bits.getBits(12) != 0xfff)  // sync bytes
+        if (bits.getBits<12>() != 0xfff)  // sync bytes
             return false;
 
         m_id = bits.getBit();               /* 0: MPEG-4, 1: MPEG-2*/
@@ -56,7 +56,7 @@ bool AACCodec::decodeFrame(uint8_t* buffer, const uint8_t* end)
         bits.skipBit();                                    /* copyright_identification_bit */
         bits.skipBit();                                    /* copyright_identification_start */
         const auto frameSize = bits.getBits<uint16_t>(13); /* aac_frame_length */
-        bits.skipBits(11);                                 /* adts_buffer_fullness */
+        bits.skipBits<11>();                               /* adts_buffer_fullness */
         m_rdb = bits.getBits<uint8_t>(2);                  /* number_of_raw_data_blocks_in_frame */
 
         m_channels = aac_channels[m_channels_index];
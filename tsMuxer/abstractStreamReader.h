@@ -7,6 +7,7 @@
 #include "avPacket.h"
 #include "pesPacket.h"
 #include "streamDiscoveryData.h"
+#include "v3State.h"
 
 // Abstract class for reading codec data from a file
 // Used to synchronize and mux data streams
@@ -45,7 +46,8 @@ class AbstractStreamReader : public BaseAbstractStreamReader
           m_streamIndex(0),
           m_tmpBufferLen(0),
           m_demuxMode(false),
-          m_secondary(false)
+          m_secondary(false),
+          m_v3State(&m_ownV3State)
     {
     }
 
@@ -77,6 +79,9 @@ class AbstractStreamReader : public BaseAbstractStreamReader
     void setIsSecondary(const bool value) { m_secondary = value; }
     void setPipParams(const PIPParams& params) { m_pipParams = params; }
     [[nodiscard]] PIPParams getPipParams() const { return m_pipParams; }
+    // V3/HDR state of the title the stream belongs to. A reader that is not part of a title keeps its own.
+    void setV3State(V3State* v3State) { m_v3State = v3State; }
+    [[nodiscard]] const V3State& getV3State() const { return *m_v3State; }
 
     /// Pre-populate internal state from discovery-phase metadata so that
     /// getTSDescriptor(), getStreamInfo(), etc. return correct values from the
@@ -94,8 +99,12 @@ class AbstractStreamReader : public BaseAbstractStreamReader
     int64_t m_tmpBufferLen;
     bool m_demuxMode;
     bool m_secondary;
+    V3State* m_v3State;
 
     PIPParams m_pipParams;
+
+   private:
+    V3State m_ownV3State;
 };
 
 #endif
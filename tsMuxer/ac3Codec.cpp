@@ -4,6 +4,7 @@
 
 #include "avCodecs.h"
 #include "bitStream.h"
+#include "crc.h"
 #include "vod_common.h"
 
 #define max(a, b) ((a) > (b) ? (a) : (b))
@@ -37,28 +38,6 @@ static constexpr uint16_t ff_ac3_frame_sizes[38][3] = {
     {1152, 1254, 1728}, {1280, 1393, 1920}, {1280, 1394, 1920},
 };
 
-static const uint16_t ctx[256] = {
-    0x0000, 0x0580, 0x0F80, 0x0A00, 0x1B80, 0x1E00, 0x1400, 0x1180, 0x3380, 0x3600, 0x3C00, 0x3980, 0x2800, 0x2D80,
-    0x2780, 0x2200, 0x6380, 0x6600, 0x6C00, 0x6980, 0x7800, 0x7D80, 0x7780, 0x7200, 0x5000, 0x5580, 0x5F80, 0x5A00,
-    0x4B80, 0x4E00, 0x4400, 0x4180, 0xC380, 0xC600, 0xCC00, 0xC980, 0xD800, 0xDD80, 0xD780, 0xD200, 0xF000, 0xF580,
-    0xFF80, 0xFA00, 0xEB80, 0xEE00, 0xE400, 0xE180, 0xA000, 0xA580, 0xAF80, 0xAA00, 0xBB80, 0xBE00, 0xB400, 0xB180,
-    0x9380, 0x9600, 0x9C00, 0x9980, 0x8800, 0x8D80, 0x8780, 0x8200, 0x8381, 0x8601, 0x8C01, 0x8981, 0x9801, 0x9D81,
-    0x9781, 0x9201, 0xB001, 0xB581, 0xBF81, 0xBA01, 0xAB81, 0xAE01, 0xA401, 0xA181, 0xE001, 0xE581, 0xEF81, 0xEA01,
-    0xFB81, 0xFE01, 0xF401, 0xF181, 0xD381, 0xD601, 0xDC01, 0xD981, 0xC801, 0xCD81, 0xC781, 0xC201, 0x4001, 0x4581,
-    0x4F81, 0x4A01, 0x5B81, 0x5E01, 0x5401, 0x5181, 0x7381, 0x7601, 0x7C01, 0x7981, 0x6801, 0x6D81, 0x6781, 0x6201,
-    0x2381, 0x2601, 0x2C01, 0x2981, 0x3801, 0x3D81, 0x3781, 0x3201, 0x1001, 0x1581, 0x1F81, 0x1A01, 0x0B81, 0x0E01,
-    0x0401, 0x0181, 0x0383, 0x0603, 0x0C03, 0x0983, 0x1803, 0x1D83, 0x1783, 0x1203, 0x3003, 0x3583, 0x3F83, 0x3A03,
-    0x2B83, 0x2E03, 0x2403, 0x2183, 0x6003, 0x6583, 0x6F83, 0x6A03, 0x7B83, 0x7E03, 0x7403, 0x7183, 0x5383, 0x5603,
-    0x5C03, 0x5983, 0x4803, 0x4D83, 0x4783, 0x4203, 0xC003, 0xC583, 0xCF83, 0xCA03, 0xDB83, 0xDE03, 0xD403, 0xD183,
-    0xF383, 0xF603, 0xFC03, 0xF983, 0xE803, 0xED83, 0xE783, 0xE203, 0xA383, 0xA603, 0xAC03, 0xA983, 0xB803, 0xBD83,
-    0xB783, 0xB203, 0x9003, 0x9583, 0x9F83, 0x9A03, 0x8B83, 0x8E03, 0x8403, 0x8183, 0x8002, 0x8582, 0x8F82, 0x8A02,
-    0x9B82, 0x9E02, 0x9402, 0x9182, 0xB382, 0xB602, 0xBC02, 0xB982, 0xA802, 0xAD82, 0xA782, 0xA202, 0xE382, 0xE602,
-    0xEC02, 0xE982, 0xF802, 0xFD82, 0xF782, 0xF202, 0xD002, 0xD582, 0xDF82, 0xDA02, 0xCB82, 0xCE02, 0xC402, 0xC182,
-    0x4382, 0x4602, 0x4C02, 0x4982, 0x5802, 0x5D82, 0x5782, 0x5202, 0x7002, 0x7582, 0x7F82, 0x7A02, 0x6B82, 0x6E02,
-    0x6402, 0x6182, 0x2002, 0x2582, 0x2F82, 0x2A02, 0x3B82, 0x3E02, 0x3402, 0x3182, 0x1382, 0x1602, 0x1C02, 0x1982,
-    0x0802, 0x0D82, 0x0782, 0x0202,
-};
-
 static constexpr int AC3_ACMOD_MONO = 1;
 static constexpr int AC3_ACMOD_STEREO = 2;
 
@@ -74,16 +53,9 @@ const CodecInfo& AC3Codec::getCodecInfo()
 // returns true if ok, or false if error
 bool AC3Codec::crc32(const uint8_t* buf, const int length)
 {
-    const uint8_t* end = buf + length;
-
-    int crc = 0;
-    while (buf < end) crc = ctx[static_cast<uint8_t>(crc) ^ *buf++] ^ (crc >> 8);
-
     // the last word of the frame is crc2 = crc for the whole frame except sync_byte
-    if (crc != buf[0] + (buf[1] << 8))
-        return false;
-
-    return true;
+    const uint16_t crc = crc::crc16(buf, length);
+    return crc == (buf[length] << 8 | buf[length + 1]);
 }
 
 // returns NO_ERROR, or type of error
@@ -123,7 +95,7 @@ AC3Codec::AC3ParseError AC3Codec::parseHeader(uint8_t* buf, const uint8_t* end)
         if (m_strmtyp == 3)
             return AC3ParseError::SYNC;  // invalid stream type
 
-        gbc.skipBits(14);  // substreamid, frmsize
+        gbc.skipBits<14>();  // substreamid, frmsize
 
         const auto fscod = gbc.getBits<uint8_t>(2);
 
@@ -149,12 +121,12 @@ AC3Codec::AC3ParseError AC3Codec::parseHeader(uint8_t* buf, const uint8_t* end)
         m_samples = eac3_blocks[numblkscod] << 8;
         m_bit_rateExt = m_frame_size * m_sample_rate * 8 / m_samples;
 
-        gbc.skipBits(5);  // skip bsid, already got it
+        gbc.skipBits<5>();  // skip bsid, already got it
         for (int i = 0; i < (acmod ? 1 : 2); i++)
         {
-            gbc.skipBits(5);  // skip dialog normalization
+            gbc.skipBits<5>();  // skip dialog normalization
             if (gbc.getBit())
-                gbc.skipBits(8);  // skip Compression gain word
+                gbc.skipBits<8>();  // skip Compression gain word
         }
 
         if (m_strmtyp == 1)  // dependent EAC3 frame
@@ -170,85 +142,85 @@ AC3Codec::AC3ParseError AC3Codec::parseHeader(uint8_t* buf, const uint8_t* end)
         if (gbc.getBit())  // mixing metadata
         {
             if (acmod > 2)
-                gbc.skipBits(2);  // dmixmod
+                gbc.skipBits<2>();  // dmixmod
             if (acmod & 1 && acmod > 0x2)
-                gbc.skipBits(6);  // ltrtcmixlev, lorocmixlev
+                gbc.skipBits<6>();  // ltrtcmixlev, lorocmixlev
             if (acmod & 4)
-                gbc.skipBits(6);  // ltrtsurmixlev, lorosurmixlev
+                gbc.skipBits<6>();  // ltrtsurmixlev, lorosurmixlev
             if (lfeon && gbc.getBit())
-                gbc.skipBits(5);  // lfemixlevcod
-            if (m_strmtyp == 0)   // independent EAC3 frame
+                gbc.skipBits<5>();  // lfemixlevcod
+            if (m_strmtyp == 0)     // independent EAC3 frame
             {
                 pgmscle = gbc.getBit();
                 if (pgmscle)
-                    gbc.skipBits(6);  // pgmscl
+                    gbc.skipBits<6>();  // pgmscl
                 if (acmod == 0 && gbc.getBit())
-                    gbc.skipBits(6);  // pgmscl2
+                    gbc.skipBits<6>();  // pgmscl2
                 extpgmscle = gbc.getBit();
                 if (extpgmscle)
-                    gbc.skipBits(6);  // extpgmscl
+                    gbc.skipBits<6>();  // extpgmscl
                 mixdef = gbc.getBits<uint8_t>(2);
                 if (mixdef == 1)
-                    gbc.skipBits(5);  // premixcmpsel, drcsrc, premixcmpscl
+                    gbc.skipBits<5>();  // premixcmpsel, drcsrc, premixcmpscl
                 else if (mixdef == 2)
-                    gbc.skipBits(12);  // mixdata
+                    gbc.skipBits<12>();  // mixdata
                 else if (mixdef == 3)
                 {
                     const auto mixdeflen = gbc.getBits<uint8_t>(5);
                     if (gbc.getBit())  // mixdata2e
                     {
-                        gbc.skipBits(5);  // premixcmpsel, drcsrc, premixcmpscl
+                        gbc.skipBits<5>();  // premixcmpsel, drcsrc, premixcmpscl
                         if (gbc.getBit())
-                            gbc.skipBits(4);  // extpgmlscl
+                            gbc.skipBits<4>();  // extpgmlscl
                         if (gbc.getBit())
-                            gbc.skipBits(4);  // extpgmcscl
+                            gbc.skipBits<4>();  // extpgmcscl
                         if (gbc.getBit())
-                            gbc.skipBits(4);  // extpgmrscl
+                            gbc.skipBits<4>();  // extpgmrscl
                         if (gbc.getBit())
-                            gbc.skipBits(4);  // extpgmlscl
+                            gbc.skipBits<4>();  // extpgmlscl
                         if (gbc.getBit())
-                            gbc.skipBits(4);  // extpgmrsscl
+                            gbc.skipBits<4>();  // extpgmrsscl
                         if (gbc.getBit())
-                            gbc.skipBits(4);  // extpgmlfescl
+                            gbc.skipBits<4>();  // extpgmlfescl
                         if (gbc.getBit())
-                            gbc.skipBits(4);  // dmixscl
-                        if (gbc.getBit())     // addch exist
+                            gbc.skipBits<4>();  // dmixscl
+                        if (gbc.getBit())       // addch exist
                         {
-                            if (gbc.getBit())     // extpgmaux1scl exist
-                                gbc.skipBits(4);  // extpgmaux1scl
-                            if (gbc.getBit())     // extpgmaux2scl exist
-                                gbc.skipBits(4);  // extpgmaux2scl
+                            if (gbc.getBit())       // extpgmaux1scl exist
+                                gbc.skipBits<4>();  // extpgmaux1scl
+                            if (gbc.getBit())       // extpgmaux2scl exist
+                                gbc.skipBits<4>();  // extpgmaux2scl
                         }
                     }
                     if (gbc.getBit())  // mixdata3e
                     {
-                        gbc.skipBits(5);   // spchdat
-                        if (gbc.getBit())  // addspchdat exist
+                        gbc.skipBits<5>();  // spchdat
+                        if (gbc.getBit())   // addspchdat exist
                         {
-                            gbc.skipBits(7);      // spchdat1, spchan1att
-                            if (gbc.getBit())     // addspchdat2 exist
-                                gbc.skipBits(7);  // spchdat2, spchan2att
+                            gbc.skipBits<7>();      // spchdat1, spchan1att
+                            if (gbc.getBit())       // addspchdat2 exist
+                                gbc.skipBits<7>();  // spchdat2, spchan2att
                         }
                     }
-                    for (int i = 0; i < mixdeflen + 2; i++) gbc.skipBits(8);  // mixdata
-                    gbc.alignByte();                                          // mixdatafill
+                    for (int i = 0; i < mixdeflen + 2; i++) gbc.skipBits<8>();  // mixdata
+                    gbc.alignByte();                                            // mixdatafill
                 }
                 if (acmod < 2)
                 {
                     paninfoe = gbc.getBit();
                     if (paninfoe)
-                        gbc.skipBits(14);  // panmean, paninfo
+                        gbc.skipBits<14>();  // panmean, paninfo
                     if (acmod == 0 && gbc.getBit())
-                        gbc.skipBits(14);  // panmean2, paninfo2
+                        gbc.skipBits<14>();  // panmean2, paninfo2
                 }
                 if (gbc.getBit())
                 {
                     if (numblkscod == 0)
-                        gbc.skipBits(5);  // blkmixcfginfo[0]
+                        gbc.skipBits<5>();  // blkmixcfginfo[0]
                     else
                         for (int blk = 0; blk < number_of_blocks_per_syncframe; blk++)
                             if (gbc.getBit())
-                                gbc.skipBits(5);  // blkmixcfginfo[blk]
+                                gbc.skipBits<5>();  // blkmixcfginfo[blk]
                 }
             }
         }
@@ -256,20 +228,20 @@ AC3Codec::AC3ParseError AC3Codec::parseHeader(uint8_t* buf, const uint8_t* end)
         if (gbc.getBit()) /* informational metadata */
         {
             bsmod = gbc.getBits<uint8_t>(3);
-            gbc.skipBits(2);  // copyrightb, origbs
+            gbc.skipBits<2>();  // copyrightb, origbs
             if (acmod == 2)
             {
                 dsurmod = gbc.getBits<uint8_t>(2);
-                gbc.skipBits(2);  // dheadphonmod
+                gbc.skipBits<2>();  // dheadphonmod
             }
-            else if (acmod >= 6)  /* if both surround channels exist */
-                gbc.skipBits(2);  // dsurexmod
-            if (gbc.getBit())     // audprodie
-                gbc.skipBits(8);  // mixlevel, roomtype, adconvtyp
-            if (acmod == 0)       /* if 1+1 mode (dual mono, so some items need a second value) */
+            else if (acmod >= 6)    /* if both surround channels exist */
+                gbc.skipBits<2>();  // dsurexmod
+            if (gbc.getBit())       // audprodie
+                gbc.skipBits<8>();  // mixlevel, roomtype, adconvtyp
+            if (acmod == 0)         /* if 1+1 mode (dual mono, so some items need a second value) */
             {
-                if (gbc.getBit())     // audprodi2e
-                    gbc.skipBits(8);  // mixlevel2, roomtype2, adconvtyp2
+                if (gbc.getBit())       // audprodi2e
+                    gbc.skipBits<8>();  // mixlevel2, roomtype2, adconvtyp2
             }
             if (fscod < 3)      /* if not half sample rate */
                 gbc.skipBit();  // sourcefscod
@@ -281,21 +253,21 @@ AC3Codec::AC3ParseError AC3Codec::parseHeader(uint8_t* buf, const uint8_t* end)
         if (m_strmtyp == 2) /* if bit stream converted from AC-3 */
         {
             if (numblkscod == 3 || gbc.getBit())  // blkid
-                gbc.skipBits(6);                  // frmsizecod
+                gbc.skipBits<6>();                // frmsizecod
         }
 
         if (gbc.getBit())  // addbsi exist
         {
-            if (gbc.getBits(6) == 1)  // addbsi length
+            if (gbc.getBits<6>() == 1)  // addbsi length
             {
                 // ETSI TS 103 420 - Backwards-compatible object audio carriage using Enhanced AC-3
                 // para. 8.3: Extensions contained in the addbsi bitstream field.
                 // Per the spec, flag_ec3_extension_type_a == 1 signals a Type A extension (Atmos),
                 // and complexity_index_type_a in [0..16] confirms a valid Atmos complexity index.
-                const auto flag_ec3_extension_type_a = gbc.getBits(8) == 1;
+                const auto flag_ec3_extension_type_a = gbc.getBits<8>() == 1;
                 if (flag_ec3_extension_type_a)
                 {
-                    const auto complexity_index_type_a = gbc.getBits(8);
+                    const auto complexity_index_type_a = gbc.getBits<8>();
                     if (complexity_index_type_a <= 16)
                         m_isAtmos = true;
                 }
@@ -339,13 +311,13 @@ AC3Codec::AC3ParseError AC3Codec::parseHeader(uint8_t* buf, const uint8_t* end)
         m_strmtyp = 2;
         m_samples = AC3_FRAME_SIZE;
 
-        gbc.skipBits(5);  // skip bsid, already got it
+        gbc.skipBits<5>();  // skip bsid, already got it
         m_bsmod = gbc.getBits<uint8_t>(3);
         m_acmod = gbc.getBits<uint8_t>(3);
         if ((m_acmod & 1) && m_acmod != AC3_ACMOD_MONO)  // 3 front channels
-            gbc.skipBits(2);                             // m_cmixlev
+            gbc.skipBits<2>();                           // m_cmixlev
         if (m_acmod & 4)                                 // surround channel exists
-            gbc.skipBits(2);                             // m_surmixlev
+            gbc.skipBits<2>();                           // m_surmixlev
         if (m_acmod == AC3_ACMOD_STEREO)
             m_dsurmod = gbc.getBits<uint8_t>(2);
         m_lfeon = gbc.getBits<uint8_t>(1);
@@ -476,7 +448,7 @@ AC3Codec::AC3ParseError AC3Codec::testParseHeader(uint8_t* buf, uint8_t* end) co
     {
         return AC3ParseError::SYNC;  // doesn't used for EAC3
     }
-    gbc.skipBits(16);  // test_crc1
+    gbc.skipBits<16>();  // test_crc1
     const auto test_fscod = gbc.getBits<uint8_t>(2);
     if (test_fscod == 3)
         return AC3ParseError::SAMPLE_RATE;
@@ -485,7 +457,7 @@ AC3Codec::AC3ParseError AC3Codec::testParseHeader(uint8_t* buf, uint8_t* end) co
     if (test_frmsizecod > 37)
         return AC3ParseError::FRAME_SIZE;
 
-    gbc.skipBits(5);  // skip bsid, already got it
+    gbc.skipBits<5>();  // skip bsid, already got it
 
     const auto test_bsmod = gbc.getBits<uint8_t>(3);
     const auto test_acmod = gbc.getBits<uint8_t>(3);
@@ -495,10 +467,10 @@ AC3Codec::AC3ParseError AC3Codec::testParseHeader(uint8_t* buf, uint8_t* end) co
         return AC3ParseError::SYNC;
 
     if ((test_acmod & 1) && test_acmod != AC3_ACMOD_MONO)
-        gbc.skipBits(2);  // test_cmixlev
+        gbc.skipBits<2>();  // test_cmixlev
 
     if (m_acmod & 4)
-        gbc.skipBits(2);  // test_surmixlev
+        gbc.skipBits<2>();  // test_surmixlev
 
     if (m_acmod == AC3_ACMOD_STEREO)
     {
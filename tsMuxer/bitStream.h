@@ -5,6 +5,8 @@
 #include <limits.h>
 #include <types/types.h>
 
+#include <bit>
+
 static constexpr unsigned INT_BIT = CHAR_BIT * sizeof(unsigned);
 
 class BitStreamException final : public std::exception
@@ -15,11 +17,29 @@ class BitStreamException final : public std::exception
 
 #define THROW_BITSTREAM_ERR throw BitStreamException()
 
+// Byte-order independent big-endian accessors; compilers reduce them to a single load/store plus byte swap.
+inline uint64_t loadBE64(const uint8_t* ptr)
+{
+    return static_cast<uint64_t>(ptr[0]) << 56 | static_cast<uint64_t>(ptr[1]) << 48 |
+           static_cast<uint64_t>(ptr[2]) << 40 | static_cast<uint64_t>(ptr[3]) << 32 |
+           static_cast<uint64_t>(ptr[4]) << 24 | static_cast<uint64_t>(ptr[5]) << 16 |
+           static_cast<uint64_t>(ptr[6]) << 8 | static_cast<uint64_t>(ptr[7]);
+}
+
+inline void storeBE32(void* dst, const uint32_t value)
+{
+    const auto ptr = static_cast<uint8_t*>(dst);
+    ptr[0] = static_cast<uint8_t>(value >> 24);
+    ptr[1] = static_cast<uint8_t>(value >> 16);
+    ptr[2] = static_cast<uint8_t>(value >> 8);
+    ptr[3] = static_cast<uint8_t>(value);
+}
+
 class BitStream
 {
    public:
-    BitStream() : m_totalBits(0), m_buffer(nullptr), m_initBuffer(nullptr) {}
-    [[nodiscard]] uint8_t* getBuffer() const { return reinterpret_cast<uint8_t*>(m_initBuffer); }
+    BitStream() : m_totalBits(0), m_initBuffer(nullptr) {}
+    [[nodiscard]] uint8_t* getBuffer() const { return m_initBuffer; }
     [[nodiscard]] unsigned getBitsLeft() const { return m_totalBits; }
 
    protected:
@@ -28,11 +48,10 @@ class BitStream
         if (buffer >= end)
             THROW_BITSTREAM_ERR;
         m_totalBits = static_cast<unsigned>(end - buffer) * 8;
-        m_initBuffer = m_buffer = reinterpret_cast<unsigned*>(buffer);
+        m_initBuffer = buffer;
     }
     unsigned m_totalBits;
-    unsigned* m_buffer;
-    unsigned* m_initBuffer;
+    uint8_t* m_initBuffer;
 
     static constexpr unsigned int m_masks[] = {
         0x00000000, 0x00000001, 0x00000003, 0x00000007, 0x0000000f, 0x0000001f, 0x0000003f, 0x0000007f, 0x000000ff,
@@ -41,17 +60,22 @@ class BitStream
         0x07ffffff, 0x0fffffff, 0x1fffffff, 0x3fffffff, 0x7fffffff, UINT_MAX};
 };
 
+// MSB-first reader over a 64-bit cache. The cache is refilled with one unaligned 8-byte load while at least
+// 8 bytes of input remain and byte by byte at the tail, so the reader never touches memory past the buffer end.
+// Bits in the cache below m_cacheBits are either zero or already the next bits of the stream.
 class BitStreamReader : public BitStream
 {
    public:
-    BitStreamReader() : m_curVal(0), m_bitLeft(0) {}
+    BitStreamReader() : m_cache(0), m_cacheBits(0), m_ptr(nullptr), m_end(nullptr) {}
 
     void setBuffer(uint8_t* buffer, const uint8_t* end)
     {
         BitStream::setBuffer(buffer, end);
-        m_bitLeft = 0;
-        m_curVal = getCurVal(m_buffer);
-        m_bitLeft = INT_BIT;
+        m_ptr = buffer;
+        m_end = end;
+        m_cache = 0;
+        m_cacheBits = 0;
+        refill();
     }
 
     template <typename T>
@@ -64,126 +88,158 @@ class BitStreamReader : public BitStream
     {
         if (num > INT_BIT || m_totalBits < num)
             THROW_BITSTREAM_ERR;
-        unsigned prevVal = 0;
-        if (num <= m_bitLeft)
-            m_bitLeft -= num;
-        else
-        {
-            if (m_bitLeft != 0)
-                prevVal = (m_curVal & m_masks[m_bitLeft]) << (num - m_bitLeft);
-            m_buffer++;
-            m_curVal = getCurVal(m_buffer);
-            m_bitLeft += INT_BIT - num;
-        }
-        m_totalBits -= num;
-        return prevVal + (m_curVal >> m_bitLeft) & m_masks[num];
+        if (num == 0)
+            return 0;
+        if (m_cacheBits < num)
+            refill();
+        const auto rez = static_cast<unsigned>(m_cache >> (64 - num));
+        consume(num);
+        return rez;
+    }
+
+    // fixed-width read, the width check is done at compile time
+    template <unsigned N>
+    [[nodiscard]] unsigned getBits()
+    {
+        static_assert(N > 0 && N <= INT_BIT, "invalid bit count");
+        if (m_totalBits < N)
+            THROW_BITSTREAM_ERR;
+        if (m_cacheBits < N)
+            refill();
+        const auto rez = static_cast<unsigned>(m_cache >> (64 - N));
+        consume(N);
+        return rez;
     }
 
     [[nodiscard]] int showBits(const unsigned num) const
     {
         if (num > INT_BIT - 1 || m_totalBits < num)
             THROW_BITSTREAM_ERR;
-        unsigned prevVal = 0;
-        unsigned bitLeft = m_bitLeft;
-        unsigned curVal = m_curVal;
-        if (num <= bitLeft)
-            bitLeft -= num;
-        else
-        {
-            prevVal = (curVal & m_masks[bitLeft]) << (num - bitLeft);
-            curVal = getCurVal(m_buffer + 1);
-            bitLeft += INT_BIT - num;
-        }
-        return static_cast<int>(prevVal + (curVal >> bitLeft) & m_masks[num]);
+        if (num == 0)
+            return 0;
+        uint64_t cache = m_cache;
+        const uint8_t* ptr = m_ptr;
+        for (unsigned cacheBits = m_cacheBits; cacheBits < num; cacheBits += 8)
+            cache |= static_cast<uint64_t>(*ptr++) << (56 - cacheBits);
+        return static_cast<int>(cache >> (64 - num));
     }
 
     [[nodiscard]] bool getBit()
     {
         if (m_totalBits < 1)
             THROW_BITSTREAM_ERR;
-        if (m_bitLeft > 0)
-            m_bitLeft--;
-        else
-        {
-            m_buffer++;
-            m_curVal = getCurVal(m_buffer);
-            m_bitLeft = INT_BIT - 1;
-        }
-        m_totalBits--;
-        return m_curVal >> m_bitLeft & 1;
+        if (m_cacheBits == 0)
+            refill();
+        const bool rez = m_cache >> 63;
+        consume(1);
+        return rez;
     }
 
-    void skipBits(const unsigned num)
+    void skipBits(unsigned num)
     {
         if (m_totalBits < num)
             THROW_BITSTREAM_ERR;
-        assert(num <= INT_BIT);
-        if (num <= m_bitLeft)
-            m_bitLeft -= num;
-        else
+        if (num > m_cacheBits)
         {
-            m_buffer++;
-            m_curVal = getCurVal(m_buffer);
-            m_bitLeft += INT_BIT - num;
+            const unsigned skipBytes = (num - m_cacheBits) / 8;
+            num -= m_cacheBits + skipBytes * 8;
+            m_totalBits -= m_cacheBits + skipBytes * 8;
+            m_ptr += skipBytes;
+            m_cache = 0;
+            m_cacheBits = 0;
+            refill();
         }
-        m_totalBits -= num;
+        consume(num);
+    }
+
+    template <unsigned N>
+    void skipBits()
+    {
+        static_assert(N <= INT_BIT, "invalid bit count");
+        if (m_totalBits < N)
+            THROW_BITSTREAM_ERR;
+        if (m_cacheBits < N)
+            refill();
+        consume(N);
     }
 
     void skipBit()
     {
         if (m_totalBits < 1)
             THROW_BITSTREAM_ERR;
-        if (m_bitLeft > 0)
-            m_bitLeft--;
-        else
-        {
-            m_buffer++;
-            m_curVal = getCurVal(m_buffer);
-            m_bitLeft = INT_BIT - 1;
-        }
-        m_totalBits--;
+        if (m_cacheBits == 0)
+            refill();
+        consume(1);
     }
 
-    void alignByte()
+    // ue(v) Exp-Golomb code. Codes that fit into the cache are decoded with a single count-leading-zeros.
+    [[nodiscard]] unsigned getUEGolombCode()
     {
-        const unsigned tmp = m_bitLeft & 0b111;
-        if (tmp > 0)
-            skipBits(8 - tmp);
+        if (m_cacheBits <= 56)
+            refill();
+        const auto leadingZeros = static_cast<unsigned>(std::countl_zero(m_cache));
+        if (leadingZeros * 2 < m_cacheBits)
+        {
+            const unsigned len = leadingZeros * 2 + 1;
+            const auto rez = static_cast<unsigned>(m_cache >> (64 - len)) - 1;
+            consume(len);
+            return rez;
+        }
+        unsigned cnt = 0;
+        for (; !getBit(); cnt++);
+        if (cnt > INT_BIT)
+            THROW_BITSTREAM_ERR;
+        return static_cast<unsigned>((1ull << cnt) - 1 + getBits(cnt));
     }
 
+    void alignByte() { skipBits((8 - getBitsCount() % 8) % 8); }
+
     [[nodiscard]] int getBitsCount() const
     {
-        return static_cast<int>((m_buffer - m_initBuffer) * INT_BIT + INT_BIT - m_bitLeft);
+        return static_cast<int>((m_ptr - m_initBuffer) * 8 - m_cacheBits);
     }
 
    private:
-    unsigned m_curVal;
-    unsigned m_bitLeft;
+    uint64_t m_cache;
+    unsigned m_cacheBits;
+    const uint8_t* m_ptr;
+    const uint8_t* m_end;
 
-    unsigned getCurVal(unsigned* buff) const
+    void consume(const unsigned num)
     {
-        const auto tmpBuf = reinterpret_cast<uint8_t*>(buff);
-        if (m_totalBits - m_bitLeft >= 32)
-            return my_ntohl(*buff);
-        if (m_totalBits - m_bitLeft >= 24)
-            return (tmpBuf[0] << 24) + (tmpBuf[1] << 16) + (tmpBuf[2] << 8);
-        if (m_totalBits - m_bitLeft >= 16)
-            return (tmpBuf[0] << 24) + (tmpBuf[1] << 16);
-        if (m_totalBits - m_bitLeft >= 8)
-            return tmpBuf[0] << 24;
+        m_cache <<= num;
+        m_cacheBits -= num;
+        m_totalBits -= num;
+    }
 
-        THROW_BITSTREAM_ERR;
+    // requires m_cacheBits <= 56
+    void refill()
+    {
+        if (m_end - m_ptr >= 8)
+        {
+            m_cache |= loadBE64(m_ptr) >> m_cacheBits;
+            m_ptr += (63 - m_cacheBits) >> 3;
+            m_cacheBits |= 56;
+        }
+        else
+        {
+            for (; m_cacheBits <= 56 && m_ptr < m_end; m_cacheBits += 8)
+                m_cache |= static_cast<uint64_t>(*m_ptr++) << (56 - m_cacheBits);
+        }
     }
 };
 
+// MSB-first writer. Bits are collected in a 64-bit accumulator and stored as big-endian 32-bit words once a
+// word is complete, so putBits needs no split between the current and the next word.
 class BitStreamWriter : public BitStream
 {
    public:
-    BitStreamWriter() : m_curVal(0), m_bitWrited(0) {}
+    BitStreamWriter() : m_buffer(nullptr), m_curVal(0), m_bitWrited(0) {}
 
     void setBuffer(uint8_t* buffer, const uint8_t* end)
     {
         BitStream::setBuffer(buffer, end);
+        m_buffer = reinterpret_cast<unsigned*>(buffer);
         m_curVal = 0;
         m_bitWrited = 0;
     }
@@ -196,52 +252,46 @@ class BitStreamWriter : public BitStream
         putBits(cnt, reader.getBits(cnt));
     }
 
-    void putBits(const unsigned num, unsigned value)
+    void putBits(const unsigned num, const unsigned value)
     {
         if (m_totalBits < num)
             THROW_BITSTREAM_ERR;
-        value &= m_masks[num];
-        if (m_bitWrited + num < INT_BIT)
-        {
-            m_bitWrited += num;
-            m_curVal <<= num;
-            m_curVal += value;
-        }
-        else
+        m_curVal = (m_curVal << num) | (value & m_masks[num]);
+        m_bitWrited += num;
+        if (m_bitWrited >= INT_BIT)
         {
-            if (m_bitWrited != 0)
-            {
-                m_curVal <<= (INT_BIT - m_bitWrited);
-            }
-            m_bitWrited += num - INT_BIT;
-            m_curVal += value >> m_bitWrited;
-            *m_buffer++ = my_htonl(m_curVal);
-            m_curVal = value & m_masks[m_bitWrited];
+            m_bitWrited -= INT_BIT;
+            storeBE32(m_buffer++, static_cast<unsigned>(m_curVal >> m_bitWrited));
         }
         m_totalBits -= num;
     }
 
+    template <unsigned N>
+    void putBits(const unsigned value)
+    {
+        static_assert(N > 0 && N <= INT_BIT, "invalid bit count");
+        putBits(N, value);
+    }
+
     void putBit(const unsigned value) { putBits(1, value); }
 
     void flushBits()
     {
-        if (m_bitWrited != 0)
-        {
-            m_curVal <<= (INT_BIT - m_bitWrited);
-        }
+        const auto curVal = static_cast<unsigned>(m_curVal << (INT_BIT - m_bitWrited));
         unsigned prevVal = my_ntohl(*m_buffer);
         prevVal &= m_masks[INT_BIT - m_bitWrited];
-        prevVal |= m_curVal;
+        prevVal |= curVal;
         *m_buffer = my_htonl(prevVal);
     }
 
     [[nodiscard]] int getBitsCount() const
     {
-        return static_cast<int>((m_buffer - m_initBuffer) * INT_BIT + m_bitWrited);
+        return static_cast<int>((reinterpret_cast<uint8_t*>(m_buffer) - m_initBuffer) * 8 + m_bitWrited);
     }
 
    private:
-    unsigned m_curVal;
+    unsigned* m_buffer;
+    uint64_t m_curVal;  // only the low m_bitWrited bits are pending
     unsigned m_bitWrited;
 };
 
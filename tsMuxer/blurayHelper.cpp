@@ -3,6 +3,7 @@
 #include <fs/directory.h>
 #include <fs/systemlog.h>
 #include <array>
+#include <memory>
 
 #include "iso_writer.h"
 #include "muxerManager.h"
@@ -203,15 +204,28 @@ NavigationCommand makeDefaultTrackCommand(int audioTrackIdx, int subTrackIdx,
     return cmd;
 }
 
-bool writeBdMovieObjectData(const MuxerManager& muxer, AbstractOutputStream* file, const std::string& prefix,
-                            const DiskType diskType, const bool usedBlankPL, const int mplsNum, const int blankNum)
+bool writeBdMovieObjectData(const std::vector<BluRayTitle>& titles, AbstractOutputStream* file,
+                            const std::string& prefix, const DiskType diskType, const int blankNum, const bool isV3)
 {
+    const auto titleObject = [blankNum](const BluRayTitle& title) {
+        MovieObject movieObject = {
+            {{0x50, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x0A, 0x00, 0x00, 0x00, 0x00},
+             {0x50, 0x40, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+             title.usedBlankPL ? makeBlankPLCommand(blankNum) : makeNoBlankCommand(),
+             makeMplsCommand(title.mplsNum),
+             {0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}}};
+        if (title.defaultAudioIdx != -1 || title.defaultSubIdx != -1)
+        {
+            auto&& navCmds = movieObject.navigationCommands;
+            navCmds.insert(std::begin(navCmds) + 2,
+                           makeDefaultTrackCommand(title.defaultAudioIdx, title.defaultSubIdx, title.subTrackMode));
+        }
+        return movieObject;
+    };
+
+    // object 0 plays the first title, 1 and 2 are the top menu and first playback ones, the other titles follow
     std::vector<MovieObject> movieObjects = {
-        {{{0x50, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x0A, 0x00, 0x00, 0x00, 0x00},
-          {0x50, 0x40, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
-          usedBlankPL ? makeBlankPLCommand(blankNum) : makeNoBlankCommand(),
-          makeMplsCommand(mplsNum),
-          {0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}}},
+        titleObject(titles.front()),
         {{{0x50, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x0A, 0x00, 0x00, 0x00, 0x03},
           {0x50, 0x40, 0x00, 0x01, 0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0xFF, 0xFF},
           {0x48, 0x40, 0x03, 0x00, 0x00, 0x00, 0x00, 0x0A, 0x00, 0x00, 0xFF, 0xFF},
@@ -226,20 +240,12 @@ bool writeBdMovieObjectData(const MuxerManager& muxer, AbstractOutputStream* fil
           {0x50, 0x40, 0x00, 0x01, 0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0xFF, 0xFF},
           {0x50, 0x40, 0x00, 0x01, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00},
           {0x21, 0x81, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}}}};
+    for (size_t i = 1; i < titles.size(); ++i) movieObjects.push_back(titleObject(titles[i]));
 
     BDMV_VersionNumber num = BDMV_VersionNumber::Version1;
     if (diskType == DiskType::BLURAY)
     {
-        num = isV3() ? BDMV_VersionNumber::Version3 : BDMV_VersionNumber::Version2;
-    }
-    const auto defaultAudioIdx = muxer.getDefaultAudioTrackIdx();
-    MuxerManager::SubTrackMode mode;
-    const auto defaultSubIdx = muxer.getDefaultSubTrackIdx(mode);
-    if (defaultAudioIdx != -1 || defaultSubIdx != -1)
-    {
-        auto&& navCmds = movieObjects[0].navigationCommands;
-        movieObjects[0].navigationCommands.insert(std::begin(navCmds) + 2,
-                                                  makeDefaultTrackCommand(defaultAudioIdx, defaultSubIdx, mode));
+        num = isV3 ? BDMV_VersionNumber::Version3 : BDMV_VersionNumber::Version2;
     }
     const auto objectData = makeBdMovieObjectData(num, movieObjects);
     if (!file->open((prefix + "BDMV/MovieObject.bdmv").c_str(), File::ofWrite))
@@ -266,31 +272,33 @@ bool writeBdMovieObjectData(const MuxerManager& muxer, AbstractOutputStream* fil
 
 BlurayHelper::BlurayHelper() : m_dt(), m_isoWriter(nullptr) {}
 
-BlurayHelper::~BlurayHelper() { close(); }
+BlurayHelper::~BlurayHelper() { delete m_isoWriter; }
 
 void BlurayHelper::close()
 {
     if (m_isoWriter)
     {
         LTRACE(LT_INFO, 2, "Finalize ISO disk");
-        delete m_isoWriter;
+        const std::unique_ptr<IsoWriter> isoWriter(m_isoWriter);
         m_isoWriter = nullptr;
+        isoWriter->close();
     }
 }
 
 bool BlurayHelper::open(const string& dst, const DiskType dt, const int64_t diskSize, const int extraISOBlocks,
-                        const bool useReproducibleIsoHeader)
+                        const bool useReproducibleIsoHeader, const bool sequentialIso)
 {
     m_dstPath = toNativeSeparators(dst);
 
     m_dt = dt;
     string fileExt = extractFileExt(m_dstPath);
     fileExt = unquoteStr(strToUpperCase(fileExt));
-    if (fileExt == "ISO")
+    // a sequential image usually goes to a pipe or a device, whatever its name is
+    if (fileExt == "ISO" || sequentialIso)
     {
         m_isoWriter = new IsoWriter(useReproducibleIsoHeader ? IsoHeaderData::reproducible() : IsoHeaderData::normal());
         m_isoWriter->setLayerBreakPoint(0xBA7200);  // around 25Gb
-        return m_isoWriter->open(m_dstPath, diskSize, extraISOBlocks);
+        return m_isoWriter->open(m_dstPath, diskSize, extraISOBlocks, sequentialIso);
     }
     m_dstPath = closeDirPath(m_dstPath, getDirSeparator());
     return true;
@@ -342,8 +350,8 @@ void BlurayHelper::createBluRayDirs() const
     }
 }
 
-bool BlurayHelper::writeBluRayFiles(const MuxerManager& muxer, const bool usedBlankPL, const int mplsNum,
-                                    const int blankNum, const bool stereoMode) const
+bool BlurayHelper::writeBluRayFiles(const std::vector<BluRayTitle>& titles, const int blankNum,
+                                    const bool stereoMode, const V3State& discState) const
 {
     int fileSize = sizeof(bdIndexData);
     const string prefix = m_isoWriter ? "" : m_dstPath;
@@ -355,7 +363,7 @@ bool BlurayHelper::writeBluRayFiles(const MuxerManager& muxer, const bool usedBl
 
     if (m_dt == DiskType::BLURAY)
     {
-        if (isV3())
+        if (discState.isV3())
         {
             bdIndexData[5] = '3';
             fileSize = 0x9C;         // add 36 bytes for UHD data extension
@@ -370,10 +378,10 @@ bool BlurayHelper::writeBluRayFiles(const MuxerManager& muxer, const bool usedBl
             for (int i = 0; i < 36; i++) V3metaData[i] = metaData[i];
 
             // 4K => 66/100 GB Disk, 109 MB/s Recording_Rate
-            if (is4K())
+            if (discState.is4K())
                 bdIndexData[0x94] = 0x51;
             // include HDR flags
-            bdIndexData[0x96] = (V3_flags & 0x1e);
+            bdIndexData[0x96] = (discState.flags & 0x1e);
             // no HDR10 detected => SDR flag
             if (bdIndexData[0x96] == 0)
                 bdIndexData[0x96] = 1;
@@ -391,12 +399,34 @@ bool BlurayHelper::writeBluRayFiles(const MuxerManager& muxer, const bool usedBl
     }
     bdIndexData[0x2c] = stereoMode ? 0x60 : 0;  // set initial_output_mode_preference and SS_content_exist_flag
 
+    // the template holds a single title entry at 0x6c, every further title moves the extension data by 12 bytes
+    constexpr int titlesPos = 0x6a;
+    constexpr int titleEntrySize = 12;
+    const auto numTitles = static_cast<uint16_t>(titles.size());
+    const uint32_t extraSize = (numTitles - 1) * titleEntrySize;
+    std::vector<uint8_t> indexData(bdIndexData, bdIndexData + titlesPos);
+    const uint32_t extensionAddr = AV_RB32(&indexData[12]);
+    if (extensionAddr)
+        AV_WB32(&indexData[12], extensionAddr + extraSize);
+    AV_WB32(&indexData[0x4e], AV_RB32(&indexData[0x4e]) + extraSize);  // length of Indexes()
+    push_back_raw(indexData, my_htons(numTitles));
+    for (uint16_t i = 0; i < numTitles; ++i)
+    {
+        // HDMV title, movie playback of the title's movie object
+        const uint16_t objectId = i == 0 ? 0 : i + 2;
+        const std::array<uint8_t, titleEntrySize> entry = {
+            0x40, 0x00, 0x00, 0x00, 0x00, 0x00, static_cast<uint8_t>(objectId >> 8), static_cast<uint8_t>(objectId),
+            0x00, 0x00, 0x00, 0x00};
+        push_back_raw(indexData, entry);
+    }
+    indexData.insert(indexData.end(), bdIndexData + titlesPos + 2 + titleEntrySize, bdIndexData + fileSize);
+
     if (!file->open((prefix + "BDMV/index.bdmv").c_str(), AbstractOutputStream::ofWrite))
     {
         delete file;
         return false;
     }
-    file->write(bdIndexData, fileSize);
+    file->write(indexData);
     file->close();
 
     if (!file->open((prefix + "BDMV/BACKUP/index.bdmv").c_str(), File::ofWrite))
@@ -404,10 +434,10 @@ bool BlurayHelper::writeBluRayFiles(const MuxerManager& muxer, const bool usedBl
         delete file;
         return false;
     }
-    file->write(bdIndexData, fileSize);
+    file->write(indexData);
     file->close();
 
-    return writeBdMovieObjectData(muxer, file, prefix, m_dt, usedBlankPL, mplsNum, blankNum);
+    return writeBdMovieObjectData(titles, file, prefix, m_dt, blankNum, discState.isV3());
 }
 
 bool BlurayHelper::createCLPIFile(TSMuxer* muxer, int clpiNum, bool doLog) const
@@ -415,9 +445,10 @@ bool BlurayHelper::createCLPIFile(TSMuxer* muxer, int clpiNum, bool doLog) const
     static constexpr int CLPI_BUFFER_SIZE = 1024 * 1024;
     auto clpiBuffer = new uint8_t[CLPI_BUFFER_SIZE];
     CLPIParser clpiParser;
+    clpiParser.m_v3State = muxer->v3State();
     string version_number;
     clpiParser.version_number[0] = '0';
-    clpiParser.version_number[1] = m_dt == DiskType::BLURAY ? (isV3() ? '3' : '2') : '1';
+    clpiParser.version_number[1] = m_dt == DiskType::BLURAY ? (clpiParser.m_v3State.isV3() ? '3' : '2') : '1';
     clpiParser.version_number[2] = '0';
     clpiParser.version_number[3] = '0';
     clpiParser.version_number[4] = 0;
@@ -460,7 +491,7 @@ bool BlurayHelper::createCLPIFile(TSMuxer* muxer, int clpiNum, bool doLog) const
             clpiParser.TS_recording_rate = MAX_SUBMUXER_RATE / 8;
         else
         {
-            if (is4K())
+            if (clpiParser.m_v3State.is4K())
                 clpiParser.TS_recording_rate = MAX_4K_MUXER_RATE / 8;
             else
                 clpiParser.TS_recording_rate = MAX_MAIN_MUXER_RATE / 8;
@@ -540,6 +571,7 @@ bool BlurayHelper::createMPLSFile(TSMuxer* mainMuxer, TSMuxer* subMuxer, int aut
     int bufSize = 1024 * 100;
     auto mplsBuffer = new uint8_t[bufSize];
     MPLSParser mplsParser;
+    mplsParser.m_v3State = mainMuxer->v3State();
     mplsParser.m_m2tsOffset = mainMuxer->getFirstFileNum();
     mplsParser.PlayList_playback_type = 1;
     mplsParser.ref_to_STC_id = 0;
@@ -5,13 +5,23 @@
 #include <vector>
 
 #include "fs/file.h"
+#include "muxerManager.h"
 #include "vod_common.h"
 
 class IsoWriter;
 struct FileEntryInfo;
 class TSMuxer;
 class AbstractOutputStream;
-class MuxerManager;
+
+// A title of the disc: the playlist it starts and the default tracks its movie object selects.
+struct BluRayTitle
+{
+    int mplsNum;
+    bool usedBlankPL;
+    int defaultAudioIdx;  // -1 without a default audio track
+    int defaultSubIdx;    // -1 without a default subtitle track
+    MuxerManager::SubTrackMode subTrackMode;
+};
 
 class BlurayHelper final : public FileFactory
 {
@@ -20,10 +30,11 @@ class BlurayHelper final : public FileFactory
     ~BlurayHelper() override;
 
     bool open(const std::string& dst, DiskType dt, int64_t diskSize = 0, int extraISOBlocks = 0,
-              bool useReproducibleIsoHeader = false);
+              bool useReproducibleIsoHeader = false, bool sequentialIso = false);
     void createBluRayDirs() const;
-    bool writeBluRayFiles(const MuxerManager& muxer, bool usedBlankPL, int mplsNum, int blankNum,
-                          bool stereoMode) const;
+    // discState holds the V3/HDR flags of all titles
+    bool writeBluRayFiles(const std::vector<BluRayTitle>& titles, int blankNum, bool stereoMode,
+                          const V3State& discState) const;
     bool createCLPIFile(TSMuxer* muxer, int clpiNum, bool doLog) const;
     bool createMPLSFile(TSMuxer* mainMuxer, TSMuxer* subMuxer, int autoChapterLen,
                         const std::vector<double>& customChapters, DiskType dt, int mplsOffset,
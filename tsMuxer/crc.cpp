@@ -0,0 +1,140 @@
+#include "crc.h"
+
+#include "simd.h"
+#if defined(TSMUXER_SSE2)
+#include <wmmintrin.h>
+#endif
+
+namespace
+{
+// Slice-by-8 tables of an MSB-first CRC. CRCs narrower than 32 bits keep the polynomial and the running value in the
+// top bits, so the same 32-bit kernel serves every width.
+struct CrcTables
+{
+    uint32_t t[8][256];
+};
+
+constexpr CrcTables makeTables(const uint32_t poly)
+{
+    CrcTables tables{};
+    for (uint32_t i = 0; i < 256; ++i)
+    {
+        uint32_t r = i << 24;
+        for (int j = 0; j < 8; ++j) r = (r << 1) ^ ((r & 0x80000000U) ? poly : 0);
+        tables.t[0][i] = r;
+    }
+    for (int k = 1; k < 8; ++k)
+        for (int i = 0; i < 256; ++i)
+            tables.t[k][i] = (tables.t[k - 1][i] << 8) ^ tables.t[0][tables.t[k - 1][i] >> 24];
+    return tables;
+}
+
+constexpr uint32_t CRC32_POLY = 0x04C11DB7;
+
+constexpr CrcTables crc32Tables = makeTables(CRC32_POLY);
+constexpr CrcTables crc16Tables = makeTables(0x8005U << 16);
+constexpr CrcTables crc16CcittTables = makeTables(0x1021U << 16);
+constexpr CrcTables crc8Tables = makeTables(0x07U << 24);
+
+uint32_t updateSlice8(const CrcTables& tables, uint32_t crc, const uint8_t* data, size_t len)
+{
+    const auto& t = tables.t;
+    for (; len >= 8; len -= 8, data += 8)
+    {
+        const uint32_t a = crc ^ (static_cast<uint32_t>(data[0]) << 24 | static_cast<uint32_t>(data[1]) << 16 |
+                                  static_cast<uint32_t>(data[2]) << 8 | data[3]);
+        crc = t[7][a >> 24] ^ t[6][(a >> 16) & 0xff] ^ t[5][(a >> 8) & 0xff] ^ t[4][a & 0xff] ^ t[3][data[4]] ^
+              t[2][data[5]] ^ t[1][data[6]] ^ t[0][data[7]];
+    }
+    for (; len > 0; --len) crc = (crc << 8) ^ t[0][(crc >> 24) ^ *data++];
+    return crc;
+}
+
+#if defined(TSMUXER_SSE2)
+// Below this size the setup of the folding loop costs more than it saves
+constexpr size_t CLMUL_MIN_SIZE = 128;
+
+// x^n mod P
+constexpr int64_t xPowMod(const int n)
+{
+    uint32_t r = 1;
+    for (int i = 0; i < n; ++i) r = (r << 1) ^ ((r & 0x80000000U) ? CRC32_POLY : 0);
+    return r;
+}
+
+TSMUXER_TARGET("pclmul,ssse3")
+inline __m128i loadReversed(const uint8_t* data, const __m128i byteSwap)
+{
+    return _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data)), byteSwap);
+}
+
+// Folding a 128-bit value X = hi * x^64 + lo forward by D bits: X * x^D = hi * (x^(D+64) mod P) + lo * (x^D mod P).
+// The low qword of k holds the multiplier of hi, the high qword the multiplier of lo.
+TSMUXER_TARGET("pclmul,ssse3")
+inline __m128i fold(const __m128i x, const __m128i k)
+{
+    return _mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x01), _mm_clmulepi64_si128(x, k, 0x10));
+}
+
+// CRC-32 by folding 16-byte blocks with carry-less multiplication. The blocks are byte-reversed so that bit n of a
+// register is the coefficient of x^n; four independent lanes hide the multiplier latency. The folded remainder and
+// the tail shorter than a block go through the table kernel, which also does the final reduction modulo P.
+TSMUXER_TARGET("pclmul,ssse3")
+uint32_t crc32Clmul(const uint8_t* data, size_t len, const uint32_t crc)
+{
+    const __m128i byteSwap = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    const __m128i k512 = _mm_set_epi64x(xPowMod(512), xPowMod(576));
+    const __m128i k128 = _mm_set_epi64x(xPowMod(128), xPowMod(192));
+
+    // the initial value is added to the first 32 bits of the message
+    __m128i x0 = _mm_xor_si128(loadReversed(data, byteSwap), _mm_set_epi32(static_cast<int>(crc), 0, 0, 0));
+    __m128i x1 = loadReversed(data + 16, byteSwap);
+    __m128i x2 = loadReversed(data + 32, byteSwap);
+    __m128i x3 = loadReversed(data + 48, byteSwap);
+    data += 64;
+    len -= 64;
+    for (; len >= 64; len -= 64, data += 64)
+    {
+        x0 = _mm_xor_si128(fold(x0, k512), loadReversed(data, byteSwap));
+        x1 = _mm_xor_si128(fold(x1, k512), loadReversed(data + 16, byteSwap));
+        x2 = _mm_xor_si128(fold(x2, k512), loadReversed(data + 32, byteSwap));
+        x3 = _mm_xor_si128(fold(x3, k512), loadReversed(data + 48, byteSwap));
+    }
+    __m128i x = _mm_xor_si128(fold(x0, k128), x1);
+    x = _mm_xor_si128(fold(x, k128), x2);
+    x = _mm_xor_si128(fold(x, k128), x3);
+    for (; len >= 16; len -= 16, data += 16) x = _mm_xor_si128(fold(x, k128), loadReversed(data, byteSwap));
+
+    alignas(16) uint8_t rest[16];
+    _mm_store_si128(reinterpret_cast<__m128i*>(rest), _mm_shuffle_epi8(x, byteSwap));
+    return updateSlice8(crc32Tables, updateSlice8(crc32Tables, 0, rest, sizeof(rest)), data, len);
+}
+#endif
+}  // namespace
+
+namespace crc
+{
+uint32_t crc32(const uint8_t* data, const size_t len, const uint32_t crc)
+{
+#if defined(TSMUXER_SSE2)
+    if (len >= CLMUL_MIN_SIZE && cpuSupportsPclmul() && cpuSupportsSsse3())
+        return crc32Clmul(data, len, crc);
+#endif
+    return updateSlice8(crc32Tables, crc, data, len);
+}
+
+uint16_t crc16(const uint8_t* data, const size_t len, const uint16_t crc)
+{
+    return static_cast<uint16_t>(updateSlice8(crc16Tables, static_cast<uint32_t>(crc) << 16, data, len) >> 16);
+}
+
+uint16_t crc16Ccitt(const uint8_t* data, const size_t len, const uint16_t crc)
+{
+    return static_cast<uint16_t>(updateSlice8(crc16CcittTables, static_cast<uint32_t>(crc) << 16, data, len) >> 16);
+}
+
+uint8_t crc8(const uint8_t* data, const size_t len, const uint8_t crc)
+{
+    return static_cast<uint8_t>(updateSlice8(crc8Tables, static_cast<uint32_t>(crc) << 24, data, len) >> 24);
+}
+}  // namespace crc
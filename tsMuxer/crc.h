@@ -0,0 +1,25 @@
+#ifndef CRC_H_
+#define CRC_H_
+
+#include <cstddef>
+#include <cstdint>
+
+// CRCs used by the stream readers and writers. All of them are MSB-first (non-reflected) with no final xor, and the
+// last argument is the running value, so a CRC can be continued over several buffers.
+// The implementation is picked at runtime: carry-less multiplication where the CPU has it, slice-by-8 tables otherwise.
+namespace crc
+{
+// CRC-32/MPEG-2, polynomial 0x04C11DB7 (PSI sections). Ogg pages use the same CRC starting from 0.
+uint32_t crc32(const uint8_t* data, size_t len, uint32_t crc = 0xffffffff);
+
+// CRC-16, polynomial 0x8005 (AC-3 and E-AC-3 frames)
+uint16_t crc16(const uint8_t* data, size_t len, uint16_t crc = 0);
+
+// CRC-16/CCITT, polynomial 0x1021 (UDF descriptor tags)
+uint16_t crc16Ccitt(const uint8_t* data, size_t len, uint16_t crc = 0);
+
+// CRC-8, polynomial 0x07 (FLAC frame headers)
+uint8_t crc8(const uint8_t* data, size_t len, uint8_t crc = 0);
+}  // namespace crc
+
+#endif
@@ -177,15 +177,15 @@ void DTSStreamReader::checkIfOnlyHDDataExists(uint8_t* buff, const uint8_t* end)
         BitStreamReader reader{};
         reader.setBuffer(buff + 5, end);  // skip 4 byte magic and 1 unknown byte
         int hdFrameSize;
-        reader.skipBits(2);  // nuSubStreamIndex
+        reader.skipBits<2>();  // nuSubStreamIndex
         if (reader.getBit())
         {
-            reader.skipBits(12);  // headerSize
+            reader.skipBits<12>();  // headerSize
             hdFrameSize = reader.getBits<int32_t>(20) + 1;
         }
         else
         {
-            reader.skipBits(8);  // headerSize
+            reader.skipBits<8>();  // headerSize
             hdFrameSize = reader.getBits<uint16_t>(16) + 1;
         }
         buff += hdFrameSize;
@@ -336,15 +336,15 @@ int DTSStreamReader::decodeHdInfo(uint8_t* buff, const uint8_t* end)
         const bool bStaticFieldsPresent = reader.getBit();
         if (bStaticFieldsPresent)
         {
-            reader.skipBits(2);  // nuRefClockCode
+            reader.skipBits<2>();  // nuRefClockCode
             const auto nuExSSFrameDurationCode = reader.getBits<uint8_t>(3) + 1;
             if (pi_frame_length == 0)
                 pi_frame_length = nuExSSFrameDurationCode << 9;
 
             if (reader.getBit())
             {
-                reader.skipBits(18);  // nuTimeStamp, 18 high bits
-                reader.skipBits(18);  // nuTimeStamp, 18 low bits
+                reader.skipBits<18>();  // nuTimeStamp, 18 high bits
+                reader.skipBits<18>();  // nuTimeStamp, 18 low bits
             }
             const auto nuNumAudioPresent = reader.getBits<uint8_t>(3) + 1;
             nuNumAssets = reader.getBits<uint8_t>(3) + 1;
@@ -354,12 +354,12 @@ int DTSStreamReader::decodeHdInfo(uint8_t* buff, const uint8_t* end)
                 for (int j = 0; j < nuSubStreamIndex + 1; j++)
                 {
                     if ((j + 1) % 2)
-                        reader.skipBits(8);
+                        reader.skipBits<8>();
                 }
             }
             if (reader.getBit())
             {
-                reader.skipBits(2);  // nuMixMetadataAdjLevel
+                reader.skipBits<2>();  // nuMixMetadataAdjLevel
                 const auto nuBits4MixOutMask = reader.getBits<uint8_t>(2) * 4 + 4;
                 const auto nuNumMixOutConfigs = reader.getBits<uint8_t>(2) + 1;
                 for (int i = 0; i < nuNumMixOutConfigs; i++) reader.skipBits(nuBits4MixOutMask);
@@ -371,19 +371,19 @@ int DTSStreamReader::decodeHdInfo(uint8_t* buff, const uint8_t* end)
         // would simply be overwritten by subsequent assets, so only the first is meaningful.
         if (nuNumAssets > 0)
         {
-            reader.skipBits(12);  // nuAssetDescriptorFSIZE - 1, DescriptorDataForAssetIndex
+            reader.skipBits<12>();  // nuAssetDescriptorFSIZE - 1, DescriptorDataForAssetIndex
             if (bStaticFieldsPresent)
             {
-                if (reader.getBit())     // AssetTypeDescrPresent
-                    reader.skipBits(4);  // AssetTypeDescriptor
+                if (reader.getBit())       // AssetTypeDescrPresent
+                    reader.skipBits<4>();  // AssetTypeDescriptor
 
-                if (reader.getBit())      // LanguageDescrPresent
-                    reader.skipBits(24);  // LanguageDescriptor
+                if (reader.getBit())        // LanguageDescrPresent
+                    reader.skipBits<24>();  // LanguageDescriptor
 
                 if (reader.getBit())  // bInfoTextPresent
                 {
                     const auto nuInfoTextByteSize = reader.getBits<uint16_t>(10) + 1;
-                    for (int j = 0; j < nuInfoTextByteSize; j++) reader.skipBits(8);
+                    for (int j = 0; j < nuInfoTextByteSize; j++) reader.skipBits<8>();
                 }
                 const auto nuBitResolution = reader.getBits<uint8_t>(5) + 1;
                 const auto nuMaxSampleRate = reader.getBits<uint8_t>(4);
@@ -55,6 +55,7 @@ H264StreamReader::H264StreamReader()
     m_bdRomMetaDataMsgPtsPos = 0;
     m_priorityNalAddr = nullptr;
     m_OffsetMetadataPtsAddr = nullptr;
+    m_nalIndexEnabled = true;
     m_startPts = 0;
     m_decodedSliceHeader.resize(8 + 8);  // 8 for slice data, 8 - extra size for increase decoded data
     m_removalDelay = 0;
@@ -67,6 +68,18 @@ H264StreamReader::~H264StreamReader()
     for (const auto& [index, pps] : m_ppsMap) delete pps;
 }
 
+namespace
+{
+template <typename T>
+T* takeUnit(std::unique_ptr<T>& spare)
+{
+    if (!spare)
+        return new T();
+    NALUnit::resetToDefaults(*spare);
+    return spare.release();
+}
+}  // namespace
+
 void H264StreamReader::applyDiscoveryData(const StreamDiscoveryData& data)
 {
     if (data.fps > 0.0 && m_fps == 0.0)
@@ -101,16 +114,16 @@ CheckStreamRez H264StreamReader::checkStream(uint8_t* buffer, int len)
         {
             if (nalType == NALUnit::NALType::nuSPS)
                 m_mvcPrimaryStream = true;
-            auto sps = new SPSUnit();
+            auto sps = takeUnit(m_spareSps);
             sps->decodeBuffer(nal, nextNal);
             if (sps->deserialize() != 0)
             {
-                delete sps;
+                m_spareSps.reset(sps);
                 return rez;
             }
             if (m_spsMap.find(sps->seq_parameter_set_id) != m_spsMap.end())
             {
-                delete sps;
+                m_spareSps.reset(sps);
                 break;
             }
             m_spsMap.insert(make_pair(sps->seq_parameter_set_id, sps));
@@ -120,17 +133,17 @@ CheckStreamRez H264StreamReader::checkStream(uint8_t* buffer, int len)
         }
         case NALUnit::NALType::nuPPS:
         {
-            auto pps = new PPSUnit();
+            auto pps = takeUnit(m_sparePps);
             pps->decodeBuffer(nal, nextNal);
             if (pps->deserialize() != 0)
             {
-                delete pps;
+                m_sparePps.reset(pps);
                 return rez;
             }
             if (m_spsMap.find(pps->seq_parameter_set_id) == m_spsMap.end() ||
                 m_ppsMap.find(pps->pic_parameter_set_id) != m_ppsMap.end())
             {
-                delete pps;
+                m_sparePps.reset(pps);
                 break;
             }
             m_ppsMap.insert(make_pair(pps->pic_parameter_set_id, pps));
@@ -452,7 +465,8 @@ int H264StreamReader::getTSDescriptor(uint8_t* dstBuff, bool blurayMode, const b
 
         uint8_t video_format, frame_rate_index, aspect_ratio_index;
         M2TSStreamInfo::blurayStreamParams(getFPS(), getInterlaced(), getStreamWidth(), getStreamHeight(),
-                                           getStreamAR(), &video_format, &frame_rate_index, &aspect_ratio_index);
+                                           getStreamAR(), m_v3State->isV3(), &video_format, &frame_rate_index,
+                                           &aspect_ratio_index);
         *dstBuff++ = !m_mvcSubStream ? static_cast<uint8_t>(StreamType::VIDEO_H264)
                                      : static_cast<uint8_t>(StreamType::VIDEO_MVC);  // stream_coding_type
         *dstBuff++ = static_cast<uint8_t>(video_format << 4 | frame_rate_index);     // video_format + frame_rate
@@ -493,16 +507,7 @@ void H264StreamReader::updateStreamFps(void* nalUnit, uint8_t* buff, uint8_t* ne
     const long newSpsLen = sps->serializeBuffer(tmpBuffer.get(), tmpBuffer.get() + oldSpsLen + 16, false);
     if (newSpsLen == -1)
         THROW(ERR_COMMON, "Not enough buffer")
-    if (newSpsLen != oldSpsLen)
-    {
-        const int sizeDiff = newSpsLen - oldSpsLen;
-        if (m_bufEnd + sizeDiff > m_tmpBuffer + TMP_BUFFER_SIZE)
-            THROW(ERR_COMMON, "Not enough buffer")
-        memmove(nextNal + sizeDiff, nextNal, m_bufEnd - nextNal);
-        m_bufEnd += sizeDiff;
-        // m_dataLen += sizeDiff;
-    }
-    memcpy(buff, tmpBuffer.get(), newSpsLen);
+    replaceNal(buff, nextNal, tmpBuffer.get(), static_cast<int>(newSpsLen));
 }
 
 void H264StreamReader::updateHRDParam(SPSUnit* sps) const
@@ -565,7 +570,7 @@ void H264StreamReader::additionalStreamCheck(uint8_t* buff, uint8_t* end)
             m_mvcSubStream = true;
             [[fallthrough]];
         case NALUnit::NALType::nuSPS:
-            nalEnd = NALUnit::findNALWithStartCode(nal, m_bufEnd, true);
+            nalEnd = findNALWithStartCode(nal, m_bufEnd, true);
             tmpsps.decodeBuffer(nal, nalEnd);
             tmpsps.deserialize();
             orig_hrd_parameters_present_flag = tmpsps.nalHrdParams.isPresent;
@@ -575,7 +580,7 @@ void H264StreamReader::additionalStreamCheck(uint8_t* buff, uint8_t* end)
         case NALUnit::NALType::nuPPS:
         {
             PPSUnit pps2;
-            nalEnd = NALUnit::findNALWithStartCode(nal, m_bufEnd, true);
+            nalEnd = findNALWithStartCode(nal, m_bufEnd, true);
             if (pps1.m_nalBufferLen == 0)
             {
                 pps1.decodeBuffer(nal, nalEnd);
@@ -736,8 +741,8 @@ int H264StreamReader::getIdrPrevFrames(uint8_t* buff, const uint8_t* bufEnd)
 {
     int prevPicCnt = 0;
     int deserializeRez;
-    for (uint8_t* nal = NALUnit::findNextNAL(buff + 4, m_bufEnd); nal < m_bufEnd;
-         nal = NALUnit::findNextNAL(nal, m_bufEnd))
+    for (uint8_t* nal = findNextNAL(buff + 4, m_bufEnd); nal < m_bufEnd;
+         nal = findNextNAL(nal, m_bufEnd))
     {
         SliceUnit slice;
 
@@ -825,7 +830,7 @@ int H264StreamReader::intDecodeNAL(uint8_t* buff)
         return 0;
     }
 
-    uint8_t* nextNal = NALUnit::findNextNAL(buff, m_bufEnd);
+    uint8_t* nextNal = findNextNAL(buff, m_bufEnd);
     while (true)
     {
         if (nextNal == m_bufEnd)
@@ -877,7 +882,7 @@ int H264StreamReader::intDecodeNAL(uint8_t* buff)
         default:
             break;
         }
-        nextNal = NALUnit::findNextNAL(nextNal, m_bufEnd);
+        nextNal = findNextNAL(nextNal, m_bufEnd);
     }
 }
 
@@ -908,13 +913,12 @@ bool H264StreamReader::skipNal(uint8_t* nal)
     }
     if (nalType == NALUnit::NALType::nuSEI)
     {
-        SEIUnit sei;
-        const uint8_t* nextNal = NALUnit::findNALWithStartCode(nal, m_bufEnd, true);
-        sei.decodeBuffer(nal, nextNal);
-        sei.deserialize(*(m_spsMap.begin()->second),
-                        orig_hrd_parameters_present_flag || orig_vcl_parameters_present_flag);
+        const uint8_t* nextNal = findNALWithStartCode(nal, m_bufEnd, true);
+        m_sei.decodeBuffer(nal, nextNal);
+        m_sei.deserialize(*(m_spsMap.begin()->second),
+                          orig_hrd_parameters_present_flag || orig_vcl_parameters_present_flag);
 
-        if (sei.hasProcessedMessage(SEI_MSG_BUFFERING_PERIOD) || sei.hasProcessedMessage(SEI_MSG_PIC_TIMING))
+        if (m_sei.hasProcessedMessage(SEI_MSG_BUFFERING_PERIOD) || m_sei.hasProcessedMessage(SEI_MSG_PIC_TIMING))
         {
             return true;
         }
@@ -926,8 +930,8 @@ int H264StreamReader::processSEI(uint8_t* buff)
 {
     if (!m_spsMap.empty())
     {
-        SEIUnit lastSEI;
-        uint8_t* nextNal = NALUnit::findNALWithStartCode(buff, m_bufEnd, true);
+        SEIUnit& lastSEI = m_sei;
+        uint8_t* nextNal = findNALWithStartCode(buff, m_bufEnd, true);
         if (nextNal == m_bufEnd)
             return NOT_ENOUGH_BUFFER;
         if (nextNal + 4 > m_bufEnd)
@@ -992,7 +996,6 @@ int H264StreamReader::processSEI(uint8_t* buff)
         if (timingSEI && nonTimingSEI && m_needSeiCorrection)
         {
             // remove timing part from muxed SEI
-            int oldSize = static_cast<int>(nextNal - buff);
             lastSEI.removePicTimingSEI(*(m_spsMap.begin()->second));
 
             uint8_t tmpBuff[1024 * 3];
@@ -1002,15 +1005,7 @@ int H264StreamReader::processSEI(uint8_t* buff)
 
             assert(newSize > 2);
 
-            int sizeDiff = newSize - oldSize;
-            if (sizeDiff != 0)
-            {
-                if (m_bufEnd + sizeDiff > m_tmpBuffer + TMP_BUFFER_SIZE)
-                    THROW(ERR_COMMON, "Not enough buffer")
-                memmove(nextNal + sizeDiff, nextNal, m_bufEnd - nextNal);
-                m_bufEnd += sizeDiff;
-            }
-            memcpy(buff, tmpBuff, newSize);
+            replaceNal(buff, nextNal, tmpBuff, newSize);
         }
     }
     return 0;
@@ -1035,8 +1030,8 @@ bool H264StreamReader::findPPSForward(uint8_t* buff)
 {
     bool spsFound = false;
     bool ppsFound = false;
-    for (uint8_t* nal = NALUnit::findNextNAL(buff, m_bufEnd); nal != m_bufEnd;
-         nal = NALUnit::findNextNAL(nal, m_bufEnd))
+    for (uint8_t* nal = findNextNAL(buff, m_bufEnd); nal != m_bufEnd;
+         nal = findNextNAL(nal, m_bufEnd))
         switch (static_cast<NALUnit::NALType>(*nal & 0x1f))
         {
         case NALUnit::NALType::nuSPS:
@@ -1187,6 +1182,7 @@ int H264StreamReader::processSliceNal(uint8_t* buff)
     {
         const auto pts90k = m_curDts / INT_FREQ_TO_TS_FREQ + m_startPts;
         SEIUnit::updateMetadataPts(m_OffsetMetadataPtsAddr, pts90k);
+        updateNalIndex(m_OffsetMetadataPtsAddr, m_OffsetMetadataPtsAddr + 5, 0);
         m_OffsetMetadataPtsAddr = nullptr;
     }
     // LTRACE(LT_INFO, 2, "delta=" << fullPicOrder - m_frameNum << " m_lastDtsInc=" << m_lastDtsInc);
@@ -1226,7 +1222,7 @@ int H264StreamReader::detectPrimaryPicType(const SliceUnit& firstSlice, uint8_t*
     m_pict_type = -1;
     m_pict_type = (std::max)(m_pict_type, sliceTypeToPictType(firstSlice.slice_type));
 
-    uint8_t* nextSlice = NALUnit::findNextNAL(buff, m_bufEnd);
+    uint8_t* nextSlice = findNextNAL(buff, m_bufEnd);
     if (nextSlice == m_bufEnd)
     {
         return m_eof ? 0 : NOT_ENOUGH_BUFFER;
@@ -1259,7 +1255,7 @@ int H264StreamReader::detectPrimaryPicType(const SliceUnit& firstSlice, uint8_t*
         default:
             break;
         }
-        nextSlice = NALUnit::findNextNAL(nextSlice, m_bufEnd);
+        nextSlice = findNextNAL(nextSlice, m_bufEnd);
         if (nextSlice == m_bufEnd)
         {
             return m_eof ? 0 : NOT_ENOUGH_BUFFER;
@@ -1316,8 +1312,8 @@ int H264StreamReader::processSPS(uint8_t* buff)
             return 0;  // already processed
     }
 
-    auto* sps = new SPSUnit();
-    uint8_t* nextNal = NALUnit::findNALWithStartCode(buff, m_bufEnd, true);
+    auto* sps = takeUnit(m_spareSps);
+    uint8_t* nextNal = findNALWithStartCode(buff, m_bufEnd, true);
     const int oldSpsLen = static_cast<int>(nextNal - buff);
     sps->decodeBuffer(buff, nextNal);
     const int nalRez = sps->deserialize();
@@ -1337,7 +1333,7 @@ int H264StreamReader::processSPS(uint8_t* buff)
     // long sps fields can cause 00 00 0x code and it is required decode slice header
     if (nalRez != 0)
     {
-        delete sps;
+        m_spareSps.reset(sps);
         return nalRez;  // not enough buffer
     }
 
@@ -1351,6 +1347,7 @@ int H264StreamReader::processSPS(uint8_t* buff)
     if (m_forcedLevel != 0 && m_bufEnd - buff >= 4)
     {
         buff[3] = m_forcedLevel;
+        updateNalIndex(buff + 3, buff + 4, 0);
         sps->m_nalBuffer[3] = m_forcedLevel;
         sps->level_idc = m_forcedLevel;
     }
@@ -1360,8 +1357,9 @@ int H264StreamReader::processSPS(uint8_t* buff)
     if (sps->nalHrdParams.isPresent)
         updatedSPSList.insert(sps->seq_parameter_set_id);
 
-    delete m_spsMap[sps->seq_parameter_set_id];
-    m_spsMap[sps->seq_parameter_set_id] = sps;
+    SPSUnit*& mapped = m_spsMap[sps->seq_parameter_set_id];
+    m_spareSps.reset(mapped);
+    mapped = sps;
 
     double sarAR = 1.0;
     if (sps->aspect_ratio_info_present_flag)
@@ -1378,18 +1376,19 @@ int H264StreamReader::processSPS(uint8_t* buff)
 
 int H264StreamReader::processPPS(uint8_t* buff)
 {
-    auto* pps = new PPSUnit();
-    const uint8_t* nextNal = NALUnit::findNALWithStartCode(buff, m_bufEnd, true);
+    auto* pps = takeUnit(m_sparePps);
+    const uint8_t* nextNal = findNALWithStartCode(buff, m_bufEnd, true);
 
     pps->decodeBuffer(buff, nextNal);
     const int nalRez = pps->deserialize();
     if (nalRez != 0)
     {
-        delete pps;
+        m_sparePps.reset(pps);
         return nalRez;  // not enough buffer
     }
-    delete m_ppsMap[pps->pic_parameter_set_id];
-    m_ppsMap[pps->pic_parameter_set_id] = pps;
+    PPSUnit*& mapped = m_ppsMap[pps->pic_parameter_set_id];
+    m_sparePps.reset(mapped);
+    mapped = pps;
     return 0;
 }
 
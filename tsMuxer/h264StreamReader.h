@@ -2,6 +2,7 @@
 #define H264_STREAM_READER_H_
 
 #include <map>
+#include <memory>
 #include <set>
 
 #include "avPacket.h"
@@ -139,6 +140,10 @@ class H264StreamReader final : public MPEGStreamReader
     uint8_t* m_priorityNalAddr;  // just correct pts, keep other data unchanged
     uint8_t* m_OffsetMetadataPtsAddr;
     std::vector<uint8_t> m_decodedSliceHeader;
+    SEIUnit m_sei;  // reused for every SEI NAL to keep its decode buffer allocated
+    // a parameter set unit dropped or replaced in the maps, reused for the next SPS/PPS NAL
+    std::unique_ptr<SPSUnit> m_spareSps;
+    std::unique_ptr<PPSUnit> m_sparePps;
     int m_removalDelay;
     bool m_spsChangeWarned;
 };
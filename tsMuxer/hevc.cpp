@@ -17,14 +17,7 @@ unsigned ceilDiv(const unsigned a, const unsigned b) { return (a / b) + ((a % b)
 
 // ------------------------- HevcUnit -------------------
 
-unsigned HevcUnit::extractUEGolombCode()
-{
-    unsigned cnt = 0;
-    for (; !m_reader.getBit(); cnt++);
-    if (cnt > INT_BIT)
-        THROW_BITSTREAM_ERR;
-    return (1 << cnt) - 1 + m_reader.getBits(cnt);
-}
+unsigned HevcUnit::extractUEGolombCode() { return m_reader.getUEGolombCode(); }
 
 int HevcUnit::extractSEGolombCode()
 {
@@ -36,9 +29,14 @@ int HevcUnit::extractSEGolombCode()
 
 void HevcUnit::decodeBuffer(const uint8_t* buffer, const uint8_t* end)
 {
-    delete[] m_nalBuffer;
-    m_nalBuffer = new uint8_t[end - buffer];
-    m_nalBufferLen = NALUnit::decodeNAL(buffer, end, m_nalBuffer, end - buffer);
+    const auto size = static_cast<int>(end - buffer);
+    if (size > m_nalBufferCapacity)
+    {
+        delete[] m_nalBuffer;
+        m_nalBuffer = new uint8_t[size];
+        m_nalBufferCapacity = size;
+    }
+    m_nalBufferLen = NALUnit::decodeNAL(buffer, end, m_nalBuffer, m_nalBufferCapacity);
 }
 
 int HevcUnit::deserialize()
@@ -47,7 +45,7 @@ int HevcUnit::deserialize()
     try
     {
         m_reader.skipBit();
-        nal_unit_type = static_cast<NalType>(m_reader.getBits(6));
+        nal_unit_type = static_cast<NalType>(m_reader.getBits<6>());
         nuh_layer_id = m_reader.getBits<uint8_t>(6);
         nuh_temporal_id_plus1 = m_reader.getBits<uint8_t>(3);
         if (nuh_temporal_id_plus1 == 0 ||
@@ -130,13 +128,13 @@ int HevcUnitWithProfile::profile_tier_level(const int subLayers)
         bool sub_layer_profile_present_flag[7]{false};
         bool sub_layer_level_present_flag[7]{false};
 
-        m_reader.skipBits(3);  // profile_space, tier_flag
+        m_reader.skipBits<3>();  // profile_space, tier_flag
         profile_idc = m_reader.getBits<uint8_t>(5);
-        m_reader.skipBits(32);  // general_profile_compatibility_flag
-        m_reader.skipBit();     // progressive_source_flag
+        m_reader.skipBits<32>();  // general_profile_compatibility_flag
+        m_reader.skipBit();       // progressive_source_flag
         interlaced_source_flag = m_reader.getBit();
-        m_reader.skipBits(32);  // unused flags
-        m_reader.skipBits(14);  // unused flags
+        m_reader.skipBits<32>();  // unused flags
+        m_reader.skipBits<14>();  // unused flags
         level_idc = m_reader.getBits<uint8_t>(8);
 
         for (int i = 0; i < subLayers - 1; i++)
@@ -146,19 +144,19 @@ int HevcUnitWithProfile::profile_tier_level(const int subLayers)
         }
         if (subLayers > 1)
         {
-            for (int i = subLayers - 1; i < 8; i++) m_reader.skipBits(2);  // reserved_zero_2bits
+            for (int i = subLayers - 1; i < 8; i++) m_reader.skipBits<2>();  // reserved_zero_2bits
         }
 
         for (int i = 0; i < subLayers - 1; i++)
         {
             if (sub_layer_profile_present_flag[i])
             {
-                m_reader.skipBits(32);  // unused flags
-                m_reader.skipBits(32);  // unused flags
-                m_reader.skipBits(24);  // unused flags
+                m_reader.skipBits<32>();  // unused flags
+                m_reader.skipBits<32>();  // unused flags
+                m_reader.skipBits<24>();  // unused flags
             }
             if (sub_layer_level_present_flag[i])
-                m_reader.skipBits(8);  // sub_layer_level_idc[ i ]
+                m_reader.skipBits<8>();  // sub_layer_level_idc[ i ]
         }
         return 0;
     }
@@ -203,11 +201,11 @@ int HevcVpsUnit::deserialize()
 
     try
     {
-        m_reader.skipBits(12);  // vps_id, reserved, vps_max_layers
+        m_reader.skipBits<12>();  // vps_id, reserved, vps_max_layers
         const uint8_t vps_max_sub_layers = m_reader.getBits<uint8_t>(3) + 1;
         if (vps_max_sub_layers > 7)
             return 1;
-        m_reader.skipBits(17);  // vps_temporal_id_nesting_flag, vps_reserved_0xffff_16bits
+        m_reader.skipBits<17>();  // vps_temporal_id_nesting_flag, vps_reserved_0xffff_16bits
         if (profile_tier_level(vps_max_sub_layers) != 0)
             return 1;
 
@@ -232,8 +230,8 @@ int HevcVpsUnit::deserialize()
         if (m_reader.getBit())  // vps_timing_info_present_flag
         {
             num_units_in_tick_bit_pos = m_reader.getBitsCount();
-            num_units_in_tick = m_reader.getBits(32);
-            time_scale = m_reader.getBits(32);
+            num_units_in_tick = m_reader.getBits<32>();
+            time_scale = m_reader.getBits<32>();
         }
 
         return rez;
@@ -323,12 +321,12 @@ int HevcSpsUnit::hrd_parameters(const bool commonInfPresentFlag, const int maxNu
             sub_pic_hrd_params_present_flag = m_reader.getBit();
             if (sub_pic_hrd_params_present_flag)
             {
-                m_reader.skipBits(19);
+                m_reader.skipBits<19>();
             }
-            m_reader.skipBits(8);  // bit_rate_scale, cpb_size_scale
+            m_reader.skipBits<8>();  // bit_rate_scale, cpb_size_scale
             if (sub_pic_hrd_params_present_flag)
-                m_reader.skipBits(4);  // cpb_size_du_scale u(4)
-            m_reader.skipBits(15);
+                m_reader.skipBits<4>();  // cpb_size_du_scale u(4)
+            m_reader.skipBits<15>();
         }
     }
 
@@ -386,16 +384,16 @@ int HevcSpsUnit::vui_parameters()
     const bool aspect_ratio_info_present_flag = m_reader.getBit();
     if (aspect_ratio_info_present_flag)
     {
-        if (m_reader.getBits(8) == EXTENDED_SAR)  // aspect_ratio_idc
-            m_reader.skipBits(32);                // sar_width, sar_height
+        if (m_reader.getBits<8>() == EXTENDED_SAR)  // aspect_ratio_idc
+            m_reader.skipBits<32>();                // sar_width, sar_height
     }
 
     if (m_reader.getBit())   // overscan_info_present_flag
         m_reader.skipBit();  // overscan_appropriate_flag u(1)
     if (m_reader.getBit())   // video_signal_type_present_flag
     {
-        m_reader.skipBits(4);   // video_format, video_full_range_flag
-        if (m_reader.getBit())  // colour_description_present_flag
+        m_reader.skipBits<4>();  // video_format, video_full_range_flag
+        if (m_reader.getBit())   // colour_description_present_flag
         {
             colour_primaries = m_reader.getBits<uint8_t>(8);
             transfer_characteristics = m_reader.getBits<uint8_t>(8);
@@ -413,7 +411,7 @@ int HevcSpsUnit::vui_parameters()
             return 1;
     }
 
-    m_reader.skipBits(3);  // unused flags
+    m_reader.skipBits<3>();  // unused flags
 
     if (m_reader.getBit())  // default_display_window_flag
     {
@@ -425,8 +423,8 @@ int HevcSpsUnit::vui_parameters()
 
     if (m_reader.getBit())  // vui_timing_info_present_flag
     {
-        num_units_in_tick = m_reader.getBits(32);
-        time_scale = m_reader.getBits(32);
+        num_units_in_tick = m_reader.getBits<32>();
+        time_scale = m_reader.getBits<32>();
 
         if (m_reader.getBit())  // vui_poc_proportional_to_timing_flag
         {
@@ -441,7 +439,7 @@ int HevcSpsUnit::vui_parameters()
     }
     if (m_reader.getBit())  // bitstream_restriction_flag
     {
-        m_reader.skipBits(3);  //  unused flags
+        m_reader.skipBits<3>();  //  unused flags
 
         if (extractUEGolombCode() > 4095)  // min_spatial_segmentation_idc
             return 1;
@@ -536,7 +534,7 @@ int HevcSpsUnit::scaling_list_data()
     return 0;
 }
 
-int HevcSpsUnit::deserialize()
+int HevcSpsUnit::deserialize(V3State& v3State)
 {
     const int rez = HevcUnit::deserialize();
     if (rez)
@@ -565,7 +563,7 @@ int HevcSpsUnit::deserialize()
         if (pic_height_in_luma_samples == 0)
             return 1;
         if (pic_width_in_luma_samples >= 3840)
-            V3_flags |= FOUR_K;
+            v3State.flags |= FOUR_K;
 
         if (m_reader.getBit())  // conformance_window_flag
         {
@@ -631,10 +629,10 @@ int HevcSpsUnit::deserialize()
             }
         }
 
-        m_reader.skipBits(2);   // amp_enabled_flag, sample_adaptive_offset_enabled_flag
-        if (m_reader.getBit())  // pcm_enabled_flag
+        m_reader.skipBits<2>();  // amp_enabled_flag, sample_adaptive_offset_enabled_flag
+        if (m_reader.getBit())   // pcm_enabled_flag
         {
-            m_reader.skipBits(8);           // pcm_sample_bit_depth_luma_minus1, pcm_sample_bit_depth_chroma_minus1
+            m_reader.skipBits<8>();         // pcm_sample_bit_depth_luma_minus1, pcm_sample_bit_depth_chroma_minus1
             if (extractUEGolombCode() > 2)  // log2_min_pcm_luma_coding_block_size_minus3
                 return 1;
             if (extractUEGolombCode() > 2)  // log2_diff_max_min_pcm_luma_coding_block_size
@@ -662,8 +660,8 @@ int HevcSpsUnit::deserialize()
                 m_reader.skipBits(log2_max_pic_order_cnt_lsb + 1);  // lt_ref_pic_poc_lsb_sps[i]
             }
         }
-        m_reader.skipBits(2);   // sps_temporal_mvp_enabled_flag, strong_intra_smoothing_enabled_flag
-        if (m_reader.getBit())  // vui_parameters_present_flag
+        m_reader.skipBits<2>();  // sps_temporal_mvp_enabled_flag, strong_intra_smoothing_enabled_flag
+        if (m_reader.getBit())   // vui_parameters_present_flag
         {
             if (vui_parameters())
                 return 1;
@@ -734,7 +732,7 @@ int HevcPpsUnit::deserialize()
 // ----------------------- HevcHdrUnit ------------------------
 HevcHdrUnit::HevcHdrUnit() : isHDR10(false), isHDR10plus(false), isDVRPU(false), isDVEL(false) {}
 
-int HevcHdrUnit::deserialize()
+int HevcHdrUnit::deserialize(V3State& v3State)
 {
     const int rez = HevcUnit::deserialize();
     if (rez)
@@ -765,43 +763,43 @@ int HevcHdrUnit::deserialize()
             if (payloadType == 137 && !isHDR10)  // mastering_display_colour_volume
             {
                 isHDR10 = true;
-                V3_flags |= HDR10;
-                HDR10_metadata[0] = m_reader.getBits(32);  // display_primaries Green
-                HDR10_metadata[1] = m_reader.getBits(32);  // display_primaries Red
-                HDR10_metadata[2] = m_reader.getBits(32);  // display_primaries Blue
-                HDR10_metadata[3] = m_reader.getBits(32);  // White Point
-                HDR10_metadata[4] = ((m_reader.getBits(32) / 10000) << 16) +
-                                    m_reader.getBits(32);  // max & min display_mastering_luminance
+                v3State.flags |= HDR10;
+                v3State.hdr10Metadata[0] = m_reader.getBits<32>();  // display_primaries Green
+                v3State.hdr10Metadata[1] = m_reader.getBits<32>();  // display_primaries Red
+                v3State.hdr10Metadata[2] = m_reader.getBits<32>();  // display_primaries Blue
+                v3State.hdr10Metadata[3] = m_reader.getBits<32>();  // White Point
+                v3State.hdr10Metadata[4] = ((m_reader.getBits<32>() / 10000) << 16) +
+                                           m_reader.getBits<32>();  // max & min display_mastering_luminance
             }
             else if (payloadType == 144)  // content_light_level_info
             {
                 auto maxCLL = m_reader.getBits<uint32_t>(16);
                 auto maxFALL = m_reader.getBits<uint32_t>(16);
-                if (maxCLL > (HDR10_metadata[5] >> 16) || maxFALL > (HDR10_metadata[5] & 0x0000ffff))
+                if (maxCLL > (v3State.hdr10Metadata[5] >> 16) || maxFALL > (v3State.hdr10Metadata[5] & 0x0000ffff))
                 {
-                    maxCLL = (std::max)(maxCLL, HDR10_metadata[5] >> 16);
-                    maxFALL = (std::max)(maxFALL, HDR10_metadata[5] & 0xffff);
-                    HDR10_metadata[5] = (maxCLL << 16) + maxFALL;
+                    maxCLL = (std::max)(maxCLL, v3State.hdr10Metadata[5] >> 16);
+                    maxFALL = (std::max)(maxFALL, v3State.hdr10Metadata[5] & 0xffff);
+                    v3State.hdr10Metadata[5] = (maxCLL << 16) + maxFALL;
                 }
             }
             else if (payloadType == 4 && payloadSize >= 8 && !isHDR10plus)
-            {                           // HDR10Plus Metadata
-                m_reader.skipBits(8);   // country_code
-                m_reader.skipBits(32);  // terminal_provider
+            {                             // HDR10Plus Metadata
+                m_reader.skipBits<8>();   // country_code
+                m_reader.skipBits<32>();  // terminal_provider
                 const auto application_identifier = m_reader.getBits<uint8_t>(8);
                 const auto application_version = m_reader.getBits<uint8_t>(8);
                 const auto num_windows = m_reader.getBits<uint8_t>(2);
-                m_reader.skipBits(6);
+                m_reader.skipBits<6>();
                 if (application_identifier == 4 && application_version == 1 && num_windows == 1)
                 {
                     isHDR10plus = true;
-                    V3_flags |= HDR10PLUS;
+                    v3State.flags |= HDR10PLUS;
                 }
                 payloadSize -= 8;
-                for (unsigned i = 0; i < payloadSize; i++) m_reader.skipBits(8);
+                for (unsigned i = 0; i < payloadSize; i++) m_reader.skipBits<8>();
             }
             else
-                for (unsigned i = 0; i < payloadSize; i++) m_reader.skipBits(8);
+                for (unsigned i = 0; i < payloadSize; i++) m_reader.skipBits<8>();
         } while (m_reader.getBitsLeft() > 16);
 
         return 0;
@@ -849,7 +847,7 @@ int HevcSliceHeader::deserialize(const HevcSpsUnit* sps, const HevcPpsUnit* pps)
                 m_reader.skipBit();  // pic_output_flag u(1)
             if (sps->separate_colour_plane_flag == 1)
             {
-                if (m_reader.getBits(2) > 2)  // colour_plane_id
+                if (m_reader.getBits<2>() > 2)  // colour_plane_id
                     return 1;
             }
             if (!isIDR())
@@ -2,10 +2,22 @@
 #define HEVC_H_
 
 #include "nalUnits.h"
+#include "v3State.h"
 
 struct HevcUnit
 {
-    HevcUnit() : nal_unit_type(), nuh_layer_id(0), nuh_temporal_id_plus1(0), m_nalBuffer(nullptr), m_nalBufferLen(0) {}
+    HevcUnit()
+        : nal_unit_type(),
+          nuh_layer_id(0),
+          nuh_temporal_id_plus1(0),
+          m_nalBuffer(nullptr),
+          m_nalBufferLen(0),
+          m_nalBufferCapacity(0)
+    {
+    }
+    ~HevcUnit() { delete[] m_nalBuffer; }
+    HevcUnit(const HevcUnit&) = delete;
+    HevcUnit& operator=(const HevcUnit&) = delete;
 
     enum class NalType
     {
@@ -61,6 +73,7 @@ struct HevcUnit
 
     uint8_t* m_nalBuffer;
     int m_nalBufferLen;
+    int m_nalBufferCapacity;  // m_nalBuffer only grows, it is reused by the next decodeBuffer call
     BitStreamReader m_reader;
 };
 
@@ -94,7 +107,7 @@ struct HevcVpsUnit : HevcUnitWithProfile
 struct HevcSpsUnit : HevcUnitWithProfile
 {
     HevcSpsUnit();
-    int deserialize();
+    int deserialize(V3State& v3State);  // adds the 4K flag of the stream to v3State
     [[nodiscard]] double getFPS() const;
     [[nodiscard]] std::string getDescription() const;
 
@@ -148,7 +161,7 @@ struct HevcPpsUnit : HevcUnit
 struct HevcHdrUnit : HevcUnit
 {
     HevcHdrUnit();
-    int deserialize();
+    int deserialize(V3State& v3State);  // adds the HDR10/HDR10+ flags and metadata of the stream to v3State
 
     bool isHDR10;
     bool isHDR10plus;
@@ -32,6 +32,7 @@ HEVCStreamReader::HEVCStreamReader()
       m_vpsCounter(0),
       m_vpsSizeDiff(0)
 {
+    m_nalIndexEnabled = true;
 }
 
 HEVCStreamReader::~HEVCStreamReader()
@@ -86,7 +87,7 @@ CheckStreamRez HEVCStreamReader::checkStream(uint8_t* buffer, const int len)
             if (!m_sps)
                 m_sps = new HevcSpsUnit();
             m_sps->decodeBuffer(nal, nextNal);
-            if (m_sps->deserialize() != 0)
+            if (m_sps->deserialize(*m_v3State) != 0)
                 return rez;
             m_spsPpsFound = true;
             {
@@ -104,7 +105,7 @@ CheckStreamRez HEVCStreamReader::checkStream(uint8_t* buffer, const int len)
             break;
         case HevcUnit::NalType::SEI_PREFIX:
             m_hdr->decodeBuffer(nal, nextNal);
-            if (m_hdr->deserialize() != 0)
+            if (m_hdr->deserialize(*m_v3State) != 0)
                 return rez;
             break;
         case HevcUnit::NalType::DVRPU:
@@ -115,7 +116,7 @@ CheckStreamRez HEVCStreamReader::checkStream(uint8_t* buffer, const int len)
                     m_hdr->isDVEL = true;
                 else
                     m_hdr->isDVRPU = true;
-                V3_flags |= DV;
+                m_v3State->flags |= DV;
             }
             break;
         default:
@@ -142,7 +143,7 @@ CheckStreamRez HEVCStreamReader::checkStream(uint8_t* buffer, const int len)
             m_sps->matrix_coeffs == 9)  // SMPTE.ST.2084 (PQ)
         {
             m_hdr->isHDR10 = true;
-            V3_flags |= HDR10;
+            m_v3State->flags |= HDR10;
         }
 
         rez.codecInfo = hevcCodecInfo;
@@ -187,7 +188,8 @@ int HEVCStreamReader::getTSDescriptor(uint8_t* dstBuff, const bool blurayMode, c
         *dstBuff++ = static_cast<uint8_t>(StreamType::VIDEO_H265);  // stream_conding_type
         uint8_t video_format, frame_rate_index, aspect_ratio_index;
         M2TSStreamInfo::blurayStreamParams(getFPS(), getInterlaced(), getStreamWidth(), getStreamHeight(),
-                                           getStreamAR(), &video_format, &frame_rate_index, &aspect_ratio_index);
+                                           getStreamAR(), m_v3State->isV3(), &video_format, &frame_rate_index,
+                                           &aspect_ratio_index);
 
         *dstBuff++ = static_cast<uint8_t>(video_format << 4 | frame_rate_index);
         *dstBuff++ = static_cast<uint8_t>(aspect_ratio_index << 4 | 0xf);
@@ -251,14 +253,14 @@ int HEVCStreamReader::getTSDescriptor(uint8_t* dstBuff, const bool blurayMode, c
 
 int HEVCStreamReader::setDoViDescriptor(uint8_t* dstBuff) const
 {
-    const bool isDVBL = (V3_flags & BL_TRACK) == 0;
+    const bool isDVBL = (m_v3State->flags & BL_TRACK) == 0;
     if (!isDVBL)
         m_hdr->isDVEL = true;
 
     unsigned width = getStreamWidth();
     auto pixelRate = static_cast<uint32_t>(width * getStreamHeight() * getFPS());
 
-    if (!isDVBL && V3_flags & FOUR_K)
+    if (!isDVBL && m_v3State->flags & FOUR_K)
     {
         width *= 2;
         pixelRate *= 4;
@@ -313,7 +315,7 @@ int HEVCStreamReader::setDoViDescriptor(uint8_t* dstBuff) const
             default:  // unspecified, assumed DV IPT
                 profile = 5;
                 compatibility = 0;
-                V3_flags |= BL_NOTCOMPAT;
+                m_v3State->flags |= BL_NOTCOMPAT;
             }
         }
     }
@@ -399,15 +401,16 @@ void HEVCStreamReader::updateStreamFps(void* nalUnit, uint8_t* buff, uint8_t* ne
     if (newSpsLen == -1)
         THROW(ERR_COMMON, "Not enough buffer")
 
-    if (m_bufEnd && newSpsLen != oldNalSize)
+    if (m_bufEnd)
     {
         m_vpsSizeDiff = newSpsLen - oldNalSize;
-        if (m_bufEnd + m_vpsSizeDiff > m_tmpBuffer + TMP_BUFFER_SIZE)
-            THROW(ERR_COMMON, "Not enough buffer")
-        memmove(nextNal + m_vpsSizeDiff, nextNal, m_bufEnd - nextNal);
-        m_bufEnd += m_vpsSizeDiff;
+        replaceNal(buff, nextNal, tmpBuffer.get(), newSpsLen);
+    }
+    else
+    {
+        memcpy(buff, tmpBuffer.get(), newSpsLen);
+        updateNalIndex(buff, buff + newSpsLen, 0);
     }
-    memcpy(buff, tmpBuffer.get(), newSpsLen);
 }
 
 unsigned HEVCStreamReader::getStreamWidth() const { return m_sps ? m_sps->pic_width_in_luma_samples : 0; }
@@ -525,7 +528,7 @@ int HEVCStreamReader::intDecodeNAL(uint8_t* buff)
 
     const uint8_t* prevPos = nullptr;
     uint8_t* curPos = buff;
-    uint8_t* nextNal = NALUnit::findNextNAL(curPos, m_bufEnd);
+    uint8_t* nextNal = findNextNAL(curPos, m_bufEnd);
 
     if (!m_eof && nextNal == m_bufEnd)
         return NOT_ENOUGH_BUFFER;
@@ -586,7 +589,7 @@ int HEVCStreamReader::intDecodeNAL(uint8_t* buff)
                 if (!m_sps)
                     m_sps = new HevcSpsUnit();
                 m_sps->decodeBuffer(curPos, nextNalWithStartCode);
-                rez = m_sps->deserialize();
+                rez = m_sps->deserialize(*m_v3State);
                 if (rez)
                     return rez;
                 m_spsPpsFound = true;
@@ -605,7 +608,7 @@ int HEVCStreamReader::intDecodeNAL(uint8_t* buff)
                 break;
             case HevcUnit::NalType::SEI_PREFIX:
                 m_hdr->decodeBuffer(curPos, nextNal);
-                if (m_hdr->deserialize() != 0)
+                if (m_hdr->deserialize(*m_v3State) != 0)
                     return rez;
                 break;
             default:
@@ -614,7 +617,7 @@ int HEVCStreamReader::intDecodeNAL(uint8_t* buff)
         }
         prevPos = curPos;
         curPos = nextNal;
-        nextNal = NALUnit::findNextNAL(curPos, m_bufEnd);
+        nextNal = findNextNAL(curPos, m_bufEnd);
 
         if (!m_eof && nextNal == m_bufEnd)
             return NOT_ENOUGH_BUFFER;
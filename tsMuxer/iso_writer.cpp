@@ -2,6 +2,8 @@
 
 #include "iso_writer.h"
 
+#include <fs/directory.h>
+
 #include <algorithm>
 #include <cassert>
 #include <climits>
@@ -9,6 +11,7 @@
 #include <ctime>
 
 #include "convertUTF.h"
+#include "crc.h"
 #include "utf8Converter.h"
 #include "vod_common.h"
 
@@ -16,41 +19,6 @@
 
 namespace
 {
-/*
-  Name  : CRC-16 CCITT
-  Poly  : 0x1021    x^16 + x^12 + x^5 + 1
-*/
-
-const uint16_t Crc16Table[256] = {
-    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7, 0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD,
-    0xE1CE, 0xF1EF, 0x1231, 0x0210, 0x3273, 0x2252, 0x52B5, 0x4294, 0x72F7, 0x62D6, 0x9339, 0x8318, 0xB37B, 0xA35A,
-    0xD3BD, 0xC39C, 0xF3FF, 0xE3DE, 0x2462, 0x3443, 0x0420, 0x1401, 0x64E6, 0x74C7, 0x44A4, 0x5485, 0xA56A, 0xB54B,
-    0x8528, 0x9509, 0xE5EE, 0xF5CF, 0xC5AC, 0xD58D, 0x3653, 0x2672, 0x1611, 0x0630, 0x76D7, 0x66F6, 0x5695, 0x46B4,
-    0xB75B, 0xA77A, 0x9719, 0x8738, 0xF7DF, 0xE7FE, 0xD79D, 0xC7BC, 0x48C4, 0x58E5, 0x6886, 0x78A7, 0x0840, 0x1861,
-    0x2802, 0x3823, 0xC9CC, 0xD9ED, 0xE98E, 0xF9AF, 0x8948, 0x9969, 0xA90A, 0xB92B, 0x5AF5, 0x4AD4, 0x7AB7, 0x6A96,
-    0x1A71, 0x0A50, 0x3A33, 0x2A12, 0xDBFD, 0xCBDC, 0xFBBF, 0xEB9E, 0x9B79, 0x8B58, 0xBB3B, 0xAB1A, 0x6CA6, 0x7C87,
-    0x4CE4, 0x5CC5, 0x2C22, 0x3C03, 0x0C60, 0x1C41, 0xEDAE, 0xFD8F, 0xCDEC, 0xDDCD, 0xAD2A, 0xBD0B, 0x8D68, 0x9D49,
-    0x7E97, 0x6EB6, 0x5ED5, 0x4EF4, 0x3E13, 0x2E32, 0x1E51, 0x0E70, 0xFF9F, 0xEFBE, 0xDFDD, 0xCFFC, 0xBF1B, 0xAF3A,
-    0x9F59, 0x8F78, 0x9188, 0x81A9, 0xB1CA, 0xA1EB, 0xD10C, 0xC12D, 0xF14E, 0xE16F, 0x1080, 0x00A1, 0x30C2, 0x20E3,
-    0x5004, 0x4025, 0x7046, 0x6067, 0x83B9, 0x9398, 0xA3FB, 0xB3DA, 0xC33D, 0xD31C, 0xE37F, 0xF35E, 0x02B1, 0x1290,
-    0x22F3, 0x32D2, 0x4235, 0x5214, 0x6277, 0x7256, 0xB5EA, 0xA5CB, 0x95A8, 0x8589, 0xF56E, 0xE54F, 0xD52C, 0xC50D,
-    0x34E2, 0x24C3, 0x14A0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405, 0xA7DB, 0xB7FA, 0x8799, 0x97B8, 0xE75F, 0xF77E,
-    0xC71D, 0xD73C, 0x26D3, 0x36F2, 0x0691, 0x16B0, 0x6657, 0x7676, 0x4615, 0x5634, 0xD94C, 0xC96D, 0xF90E, 0xE92F,
-    0x99C8, 0x89E9, 0xB98A, 0xA9AB, 0x5844, 0x4865, 0x7806, 0x6827, 0x18C0, 0x08E1, 0x3882, 0x28A3, 0xCB7D, 0xDB5C,
-    0xEB3F, 0xFB1E, 0x8BF9, 0x9BD8, 0xABBB, 0xBB9A, 0x4A75, 0x5A54, 0x6A37, 0x7A16, 0x0AF1, 0x1AD0, 0x2AB3, 0x3A92,
-    0xFD2E, 0xED0F, 0xDD6C, 0xCD4D, 0xBDAA, 0xAD8B, 0x9DE8, 0x8DC9, 0x7C26, 0x6C07, 0x5C64, 0x4C45, 0x3CA2, 0x2C83,
-    0x1CE0, 0x0CC1, 0xEF1F, 0xFF3E, 0xCF5D, 0xDF7C, 0xAF9B, 0xBFBA, 0x8FD9, 0x9FF8, 0x6E17, 0x7E36, 0x4E55, 0x5E74,
-    0x2E93, 0x3EB2, 0x0ED1, 0x1EF0};
-
-unsigned short crc16(const unsigned char* pcBlock, unsigned short len)
-{
-    unsigned short crc = 0;
-
-    while (len--) crc = static_cast<uint16_t>(crc << 8) ^ Crc16Table[(crc >> 8) ^ *pcBlock++];
-
-    return crc;
-}
-
 void writeDescriptorTag(uint8_t* buffer, DescriptorTag tag, const uint32_t tagLocation)
 {
     const auto buff16 = reinterpret_cast<uint16_t*>(buffer);
@@ -81,7 +49,7 @@ void calcDescriptorCRC(uint8_t* buffer, const uint16_t len)
     const auto buff16 = reinterpret_cast<uint16_t*>(buffer);
 
     // calc crc
-    buff16[4] = crc16(buffer + 16, len - 16);
+    buff16[4] = crc::crc16Ccitt(buffer + 16, len - 16);
     buff16[5] = len - 16;
 
     // calc tag checksum
@@ -317,6 +285,138 @@ void ByteFileWriter::writeTimestamp(const time_t time)
 
 int64_t ByteFileWriter::size() const { return m_curPos - m_buffer; }
 
+// ------------------------------ ImageFile ------------------------------------
+
+namespace
+{
+constexpr uint32_t IMAGE_WRITE_BLOCK = 1024 * 1024 * 4;
+}
+
+ImageFile::~ImageFile() { close(); }
+
+bool ImageFile::open(const std::string& fileName, const bool sequential)
+{
+    m_cache.clear();
+    m_cachePos = m_filePos = m_pos = m_size = 0;
+    if (!sequential)
+        return m_file.open(fileName.c_str(), File::ofWrite, 0);
+
+    if (!m_dstFile.open(fileName.c_str(), File::ofWrite, 0))
+        return false;
+    if (createTempFile(m_file, "tsmuxer_iso_", File::ofWrite, m_layoutFileName))
+        return true;
+    m_dstFile.close();
+    return false;
+}
+
+bool ImageFile::close()
+{
+    if (!m_file.isOpen())
+        return true;
+    bool rez = flush();
+    // a reserved tail which was never written to still belongs to the image
+    if (m_file.size() < m_size)
+        rez &= m_file.truncate(m_size);
+    rez &= m_file.close();
+    if (m_dstFile.isOpen())
+    {
+        rez = rez && streamLayout();
+        rez &= m_dstFile.close();
+        deleteFile(m_layoutFileName);
+        m_layoutFileName.clear();
+    }
+    return rez;
+}
+
+bool ImageFile::streamLayout()
+{
+    File layout;
+    if (!layout.open(m_layoutFileName.c_str(), File::ofRead))
+        return false;
+    m_cache.resize(IMAGE_WRITE_BLOCK);
+    for (int64_t rest = m_size; rest > 0;)
+    {
+        const int len = layout.read(m_cache.data(), static_cast<uint32_t>(FFMIN(rest, IMAGE_WRITE_BLOCK)));
+        if (len <= 0)
+            return false;
+        for (int done = 0; done < len;)
+        {
+            const int written = m_dstFile.write(m_cache.data() + done, len - done);
+            if (written <= 0)
+                return false;
+            done += written;
+        }
+        rest -= len;
+    }
+    m_cache.clear();
+    return true;
+}
+
+int ImageFile::writeAt(const int64_t offset, const uint8_t* data, const uint32_t len)
+{
+    if (m_filePos != offset)
+        m_file.seek(offset);
+    const int rez = m_file.write(data, len);
+    m_filePos = offset + FFMAX(rez, 0);
+    return rez;
+}
+
+bool ImageFile::flush()
+{
+    if (m_cache.empty())
+        return true;
+    const auto len = static_cast<uint32_t>(m_cache.size());
+    const bool rez = writeAt(m_cachePos, m_cache.data(), len) == static_cast<int>(len);
+    m_cache.clear();
+    return rez;
+}
+
+int ImageFile::write(const void* data, const uint32_t len)
+{
+    const auto src = static_cast<const uint8_t*>(data);
+    if (!m_cache.empty() &&
+        (m_cachePos + static_cast<int64_t>(m_cache.size()) != m_pos || m_cache.size() + len > IMAGE_WRITE_BLOCK))
+    {
+        if (!flush())
+            return -1;
+    }
+
+    int rez = static_cast<int>(len);
+    if (len >= IMAGE_WRITE_BLOCK)
+    {
+        rez = writeAt(m_pos, src, len);
+    }
+    else
+    {
+        if (m_cache.empty())
+        {
+            m_cache.reserve(IMAGE_WRITE_BLOCK);
+            m_cachePos = m_pos;
+        }
+        m_cache.insert(m_cache.end(), src, src + len);
+    }
+    if (rez > 0)
+    {
+        m_pos += rez;
+        m_size = FFMAX(m_size, m_pos);
+    }
+    return rez;
+}
+
+void ImageFile::seek(const int64_t offset) { m_pos = offset; }
+
+void ImageFile::reserve(const int64_t size)
+{
+    m_size = FFMAX(m_size, size);
+    m_pos = size;
+}
+
+void ImageFile::sync()
+{
+    flush();
+    m_file.sync();
+}
+
 // ------------------------------ FileEntryInfo ------------------------------------
 
 FileEntryInfo::FileEntryInfo(IsoWriter* owner, FileEntryInfo* parent, const uint8_t objectId, const FileTypes fileType)
@@ -604,7 +704,14 @@ IsoWriter::IsoWriter(const IsoHeaderData& hdrData)
 
 IsoWriter::~IsoWriter()
 {
-    close();
+    try
+    {
+        close();
+    }
+    catch (const std::runtime_error&)
+    {
+        // only reached when muxing has already failed, the image is incomplete anyway
+    }
     delete m_rootDirInfo;
     delete m_systemStreamDir;
 }
@@ -618,10 +725,10 @@ void IsoWriter::setVolumeLabel(const std::string& value)
         m_volumeLabel = "Blu-Ray";
 }
 
-bool IsoWriter::open(const std::string& fileName, const int64_t diskSize, const int extraISOBlocks)
+bool IsoWriter::open(const std::string& fileName, const int64_t diskSize, const int extraISOBlocks,
+                     const bool sequential)
 {
-    constexpr int systemFlags = 0;
-    if (!m_file.open(fileName.c_str(), File::ofWrite, systemFlags))
+    if (!m_file.open(fileName, sequential))
         return false;
 
     if (diskSize > 0)
@@ -631,9 +738,9 @@ bool IsoWriter::open(const std::string& fileName, const int64_t diskSize, const
         setMetaPartitionSize(ALLOC_BLOCK_SIZE * blocks);
     }
 
-    // 1. write 32K empty space
+    // 1. reserve 32K empty space
+    m_file.reserve(32768);
     memset(m_buffer, 0, sizeof(m_buffer));
-    for (int i = 0; i < 32768 / SECTOR_SIZE; ++i) m_file.write(m_buffer, SECTOR_SIZE);
 
     // 2. write Beginning Extended Area Descriptor
     m_buffer[0] = 0;  // Structure Type
@@ -667,16 +774,14 @@ bool IsoWriter::open(const std::string& fileName, const int64_t diskSize, const
 
     // 576K align
 
-    memset(m_buffer, 0, SECTOR_SIZE);
-    while (m_file.size() < 1024LL * 576) m_file.write(m_buffer, SECTOR_SIZE);
+    m_file.reserve(1024LL * 576);
 
     m_partitionStartAddress = static_cast<int>(m_file.size() / SECTOR_SIZE);
     m_tagLocationBaseAddr = m_partitionStartAddress;
     m_partitionEndAddress = 0;
 
     // Align to 64K (640K total)
-    memset(m_buffer, 0, sizeof(m_buffer));
-    for (int i = 0; i < 64 / 2; ++i) m_file.write(m_buffer, SECTOR_SIZE);
+    m_file.reserve(1024LL * 640);
 
     // -------------- start main volume --------------------------
     m_metadataLBN = static_cast<int>(m_file.size() / SECTOR_SIZE);
@@ -692,14 +797,12 @@ bool IsoWriter::open(const std::string& fileName, const int64_t diskSize, const
 
     // reserve space for metadata area
 
-    memset(m_buffer, 0, sizeof(m_buffer));
-    const int64_t requiredFileSizeLBN = METADATA_START_ADDR + m_metadataFileLen / SECTOR_SIZE;
-    const int64_t currentFileSizeLBN = m_file.size() / SECTOR_SIZE;
-    for (int64_t i = currentFileSizeLBN; i < requiredFileSizeLBN; ++i) m_file.write(m_buffer, SECTOR_SIZE);
+    const int64_t metadataEnd = (METADATA_START_ADDR + m_metadataFileLen / SECTOR_SIZE) * SECTOR_SIZE;
+    m_file.reserve(FFMAX(m_file.size(), metadataEnd));
 
     // reserve space for metadata mapping file
 
-    for (int i = 0; i < ALLOC_BLOCK_SIZE / SECTOR_SIZE; ++i) m_file.write(m_buffer, SECTOR_SIZE);
+    m_file.reserve(m_file.size() + ALLOC_BLOCK_SIZE);
 
     m_opened = true;
     return true;
@@ -832,10 +935,9 @@ void IsoWriter::allocateMetadata()
     // write udf unique id mapping file
     m_file.seek(static_cast<int64_t>(METADATA_START_ADDR) * SECTOR_SIZE + m_metadataFileLen);
 
-    const auto buffer = new uint8_t[ALLOC_BLOCK_SIZE];
-    memset(buffer, 0, ALLOC_BLOCK_SIZE);
+    std::vector<uint8_t> buffer(ALLOC_BLOCK_SIZE);
     ByteFileWriter writer;
-    writer.setBuffer(buffer, ALLOC_BLOCK_SIZE);
+    writer.setBuffer(buffer.data(), ALLOC_BLOCK_SIZE);
 
     writer.writeCharSpecString(m_impId.c_str(), 32);
     writer.writeLE32(0);  // flags
@@ -852,9 +954,8 @@ void IsoWriter::allocateMetadata()
         writer.writeLE16(1);  // object partition
     }
 
-    m_metadataMappingFile->write(buffer, static_cast<int32_t>(writer.size()));
+    m_metadataMappingFile->write(buffer.data(), static_cast<int32_t>(writer.size()));
     m_metadataMappingFile->close();
-    delete[] buffer;
 }
 
 void IsoWriter::close()
@@ -862,8 +963,8 @@ void IsoWriter::close()
     if (!m_opened)
         return;
 
-    memset(m_buffer, 0, sizeof(m_buffer));
-    while (m_file.size() % ALLOC_BLOCK_SIZE != 1024LL * 62) m_file.write(m_buffer, SECTOR_SIZE);
+    const int64_t alignedSize = roundUp64(m_file.size() - 1024LL * 62, ALLOC_BLOCK_SIZE) + 1024LL * 62;
+    m_file.reserve(alignedSize);
 
     // mirror metadata file location and length
     m_metadataMirrorLBN = static_cast<int>(m_file.size() / SECTOR_SIZE + 1);
@@ -872,14 +973,12 @@ void IsoWriter::close()
                                      m_metadataMirrorLBN - m_partitionStartAddress, 0);
 
     // allocate space for metadata mirror file
-    memset(m_buffer, 0, sizeof(m_buffer));
-    for (int i = 0; i < m_metadataFileLen / SECTOR_SIZE; ++i) m_file.write(m_buffer, SECTOR_SIZE);
+    m_file.reserve(m_file.size() + m_metadataFileLen);
 
     m_partitionEndAddress = static_cast<int>(m_file.size() / SECTOR_SIZE);
 
     // reserve 64K for EOF anchor volume
-    memset(m_buffer, 0, sizeof(m_buffer));
-    for (int i = 0; i < 32; ++i) m_file.write(m_buffer, SECTOR_SIZE);
+    m_file.reserve(m_file.size() + ALLOC_BLOCK_SIZE);
 
     allocateMetadata();
 
@@ -896,6 +995,8 @@ void IsoWriter::close()
 
     writeDescriptors();
     m_opened = false;
+    if (!m_file.close())
+        throw std::runtime_error("ISO error: Can't write the disc image");
 }
 
 void IsoWriter::writeDescriptors()
@@ -937,9 +1038,8 @@ void IsoWriter::writeDescriptors()
     writeUnallocatedSpaceDescriptor();
     writeTerminationDescriptor();
 
-    memset(m_buffer, 0, sizeof(m_buffer));
     const int64_t fullFileSize = eofPos + static_cast<int64_t>(1024 * 512) + ALLOC_BLOCK_SIZE;
-    while (m_file.size() < fullFileSize - SECTOR_SIZE) m_file.write(m_buffer, SECTOR_SIZE);
+    m_file.reserve(FFMAX(m_file.size(), fullFileSize - SECTOR_SIZE));
     writeAnchorVolumeDescriptor(m_partitionEndAddress + ALLOC_BLOCK_SIZE / SECTOR_SIZE);
 }
 
@@ -948,10 +1048,10 @@ int32_t IsoWriter::absoluteSectorNum() const
     return static_cast<int32_t>(m_file.pos() / SECTOR_SIZE - m_tagLocationBaseAddr);
 }
 
-void IsoWriter::sectorSeek(const Partition partition, const int pos) const
+void IsoWriter::sectorSeek(const Partition partition, const int pos)
 {
     const int64_t offset = (partition == Partition::MetadataPartition) ? m_curMetadataPos : m_partitionStartAddress;
-    m_file.seek((offset + pos) * SECTOR_SIZE, File::SeekMethod::smBegin);
+    m_file.seek((offset + pos) * SECTOR_SIZE);
 }
 
 void IsoWriter::writeEntity(const FileEntryInfo* dir)
@@ -1418,11 +1518,7 @@ void IsoWriter::checkLayerBreakPoint(const int maxExtentSize)
     if (lbn < m_layerBreakPoint && lbn + maxExtentSize > m_layerBreakPoint)
     {
         const int rest = m_layerBreakPoint - lbn;
-        const int size = rest * SECTOR_SIZE;
-        const auto tmpBuffer = new uint8_t[size];
-        memset(tmpBuffer, 0, size);
-        m_file.write(tmpBuffer, size);
-        delete[] tmpBuffer;
+        m_file.reserve(m_file.pos() + static_cast<int64_t>(rest) * SECTOR_SIZE);
         m_lastWritedObjectID = -1;
     }
 }
@@ -5,6 +5,7 @@
 
 #include <map>
 #include <string>
+#include <vector>
 
 static constexpr int SECTOR_SIZE = 2048;
 static constexpr int ALLOC_BLOCK_SIZE = 1024 * 64;
@@ -121,6 +122,42 @@ struct MappingEntry
     int LBN;
 };
 
+// Output file of the image. Consecutive writes are collected into large blocks before they reach the disk, and
+// zero-filled regions are reserved by moving past them, so they are never written and may stay sparse.
+// In sequential mode the image is laid out in a temporary file first, and on close it is sent to the destination
+// from front to back without any seeks, so the destination may be a pipe or a raw device.
+class ImageFile
+{
+   public:
+    ImageFile() : m_cachePos(0), m_filePos(0), m_pos(0), m_size(0) {}
+    ~ImageFile();
+
+    bool open(const std::string& fileName, bool sequential);
+    bool close();
+
+    int write(const void* data, uint32_t len);
+    void seek(int64_t offset);
+    void reserve(int64_t size);  // grow the image to the given size without writing the zeros
+    void sync();
+
+    [[nodiscard]] int64_t pos() const { return m_pos; }
+    [[nodiscard]] int64_t size() const { return m_size; }
+
+   private:
+    bool flush();
+    int writeAt(int64_t offset, const uint8_t* data, uint32_t len);
+    bool streamLayout();
+
+    File m_file;
+    File m_dstFile;  // final destination in sequential mode, m_file holds the layout then
+    std::string m_layoutFileName;
+    std::vector<uint8_t> m_cache;
+    int64_t m_cachePos;  // image offset of the first cached byte
+    int64_t m_filePos;   // current position of the underlying file
+    int64_t m_pos;
+    int64_t m_size;
+};
+
 struct FileEntryInfo
 {
     FileEntryInfo(IsoWriter* owner, FileEntryInfo* parent, uint8_t objectId, FileTypes fileType);
@@ -183,7 +220,7 @@ class IsoWriter
     ~IsoWriter();
 
     void setVolumeLabel(const std::string& value);
-    bool open(const std::string& fileName, int64_t diskSize, int extraISOBlocks);
+    bool open(const std::string& fileName, int64_t diskSize, int extraISOBlocks, bool sequential = false);
 
     bool createDir(const std::string& dir);
     ISOFile* createFile();
@@ -220,7 +257,7 @@ class IsoWriter
     static void writeEntity(const FileEntryInfo* dir);
     int allocateEntity(FileEntryInfo* entity, int sectorNum);
 
-    void sectorSeek(Partition partition, int pos) const;
+    void sectorSeek(Partition partition, int pos);
     void writeSector(const uint8_t* sectorData);
     int32_t absoluteSectorNum() const;
 
@@ -241,7 +278,7 @@ class IsoWriter
     std::string m_impId;
     std::string m_appId;
     uint32_t m_volumeId;
-    File m_file;
+    ImageFile m_file;
     uint8_t m_buffer[SECTOR_SIZE];
     time_t m_currentTime;
 
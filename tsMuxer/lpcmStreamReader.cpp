@@ -1,11 +1,14 @@
 #include "lpcmStreamReader.h"
 
+#include <climits>
 #include <cmath>
+#include <numeric>
 #include <sstream>
 
 #include <fs/systemlog.h>
 
 #include "ioContextDemuxer.h"
+#include "simd.h"
 #include "tsPacket.h"
 #include "vodCoreException.h"
 #include "vod_common.h"
@@ -113,62 +116,152 @@ int LPCMStreamReader::decodeLPCMHeader(const uint8_t* buff)
     return audio_data_payload_size;
 }
 
-void LPCMStreamReader::storeChannelData(const uint8_t* start, const uint8_t* end, const int chNum, uint8_t* tmpData,
-                                        const int mch) const
+// Channel order of Blu-ray LPCM frames as source WAVE channel indexes, -1 is a padding channel
+static constexpr int8_t wavToPcmChannels[9][8] = {
+    {},
+    {0, -1},
+    {0, 1},
+    {0, 1, 2, -1},
+    {0, 1, 2, 3},
+    {0, 1, 2, 3, 4, -1},
+    {0, 1, 2, 4, 5, 3},           // LFE moves after the surround channels
+    {0, 1, 2, 5, 3, 4, 6, -1},
+    {0, 1, 2, 6, 4, 5, 7, 3},
+};
+
+// Channel order of WAVE frames as source LPCM channel indexes, the padding channel is dropped
+static constexpr int8_t pcmToWavChannels[9][8] = {
+    {},
+    {0},
+    {0, 1},
+    {0, 1, 2},
+    {0, 1, 2, 3},
+    {0, 1, 2, 3, 4},
+    {0, 1, 2, 5, 3, 4},
+    {0, 1, 2, 4, 5, 3, 6},
+    {0, 1, 2, 7, 4, 5, 3, 6},
+};
+
+#if defined(TSMUXER_SSE2)
+TSMUXER_TARGET("ssse3")
+static void shuffleGroups(const LPCMShufflePlan& plan, const uint8_t* src, size_t groups, uint8_t* dst)
 {
-    const int ch1SampleSize = (m_bitsPerSample == 20 ? 3 : m_bitsPerSample / 8);
-    const int fullSampleSize = mch * ch1SampleSize;
-    const int offset = ch1SampleSize * (chNum - 1);
-    const uint8_t* curPos = start + offset;
-    uint8_t* dst = tmpData;
-    for (; curPos < end; curPos += fullSampleSize)
+    const int groupSize = plan.groupFrames * plan.inFrameSize;
+    for (; groups > 0; --groups, src += groupSize)
     {
-        for (int j = 0; j < ch1SampleSize; j++) *dst++ = curPos[j];
+        for (const auto& chunk : plan.chunks)
+        {
+            __m128i data = _mm_setzero_si128();
+            for (int w = 0; w < chunk.windows; ++w)
+            {
+                const __m128i window =
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + chunk.srcOffset + 16 * w));
+                const __m128i mask = _mm_loadu_si128(reinterpret_cast<const __m128i*>(chunk.mask[w]));
+                data = _mm_or_si128(data, _mm_shuffle_epi8(window, mask));
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), data);
+            dst += 16;
+        }
     }
 }
-
-void LPCMStreamReader::restoreChannelData(uint8_t* start, const uint8_t* end, const int chNum, const uint8_t* tmpData,
-                                          const int mch) const
+#elif defined(TSMUXER_NEON)
+static void shuffleGroups(const LPCMShufflePlan& plan, const uint8_t* src, size_t groups, uint8_t* dst)
 {
-    const int ch1SampleSize = (m_bitsPerSample == 20 ? 3 : m_bitsPerSample / 8);
-    const int fullSampleSize = mch * ch1SampleSize;
-    const int offset = ch1SampleSize * (chNum - 1);
-    uint8_t* curPos = start + offset;
-    const uint8_t* src = tmpData;
-    for (; curPos < end; curPos += fullSampleSize)
+    const int groupSize = plan.groupFrames * plan.inFrameSize;
+    for (; groups > 0; --groups, src += groupSize)
     {
-        for (int j = 0; j < ch1SampleSize; j++) curPos[j] = *src++;
+        for (const auto& chunk : plan.chunks)
+        {
+            uint8x16_t data = vdupq_n_u8(0);
+            for (int w = 0; w < chunk.windows; ++w)
+                data = vorrq_u8(data, vqtbl1q_u8(vld1q_u8(src + chunk.srcOffset + 16 * w), vld1q_u8(chunk.mask[w])));
+            vst1q_u8(dst, data);
+            dst += 16;
+        }
     }
 }
+#endif
 
-void LPCMStreamReader::copyChannelData(uint8_t* start, const uint8_t* end, const int chFrom, const int chTo,
-                                       const int mch) const
+uint8_t* LPCMShufflePlan::shuffle(const uint8_t* src, const uint8_t* srcEnd, uint8_t* dst) const
 {
-    // int mch = m_channels + (m_channels%2==1 ? 1 : 0);
-    const int ch1SampleSize = (m_bitsPerSample == 20 ? 3 : m_bitsPerSample / 8);
-    const int fullSampleSize = mch * ch1SampleSize;
-    int offset = ch1SampleSize * (chFrom - 1);
-    const uint8_t* src = start + offset;
-    offset = ch1SampleSize * (chTo - 1);
-    uint8_t* dst = start + offset;
-    for (; src < end; src += fullSampleSize)
-    {
-        for (int j = 0; j < ch1SampleSize; j++) dst[j] = src[j];
-        dst += fullSampleSize;
-    }
+#if defined(TSMUXER_SSE2) || defined(TSMUXER_NEON)
+#if defined(TSMUXER_SSE2)
+    const bool useVectors = !chunks.empty() && cpuSupportsSsse3();
+#else
+    const bool useVectors = !chunks.empty();
+#endif
+    const int64_t srcLen = srcEnd - src;
+    if (useVectors && srcLen >= groupReadSize)
+    {
+        const int groupSize = groupFrames * inFrameSize;
+        const int64_t groups = (std::min)((srcLen - groupReadSize) / groupSize + 1, srcLen / groupSize);
+        shuffleGroups(*this, src, static_cast<size_t>(groups), dst);
+        src += groups * groupSize;
+        dst += groups * groupFrames * outFrameSize;
+    }
+#endif
+    for (; srcEnd - src >= inFrameSize; src += inFrameSize)
+    {
+        for (const int8_t srcByte : byteMap) *dst++ = srcByte < 0 ? 0 : src[srcByte];
+    }
+    return dst;
 }
 
-void LPCMStreamReader::removeChannel(uint8_t* start, const uint8_t* end, const int cnNum, const int mch) const
+void LPCMStreamReader::initShufflePlan(LPCMShufflePlan& plan, const int8_t* channelMap, const int inChannels,
+                                       const int outChannels) const
 {
-    // int mch = m_channels + (m_channels%2==1 ? 1 : 0);
-    assert(mch == cnNum);
+    if (plan.channels == m_channels && plan.bitsPerSample == m_bitsPerSample)
+        return;
+    plan.channels = m_channels;
+    plan.bitsPerSample = m_bitsPerSample;
+
+    // LPCM samples are big endian, WAVE samples are little endian
     const int ch1SampleSize = (m_bitsPerSample == 20 ? 3 : m_bitsPerSample / 8);
-    const int fullSampleSize = mch * ch1SampleSize;
-    uint8_t* dst = start;
-    for (const uint8_t* curPos = start; curPos < end; curPos += fullSampleSize)
-    {
-        memmove(dst, curPos, fullSampleSize);
-        dst += fullSampleSize - ch1SampleSize;
+    plan.inFrameSize = inChannels * ch1SampleSize;
+    plan.outFrameSize = outChannels * ch1SampleSize;
+    plan.byteMap.resize(plan.outFrameSize);
+    for (int ch = 0; ch < outChannels; ++ch)
+        for (int i = 0; i < ch1SampleSize; ++i)
+            plan.byteMap[ch * ch1SampleSize + i] =
+                channelMap[ch] < 0 ? -1 : static_cast<int8_t>((channelMap[ch] + 1) * ch1SampleSize - 1 - i);
+
+    // Vector kernel: each 16 byte output vector of a group of frames is gathered from up to three consecutive
+    // source vectors. Mask bytes with the high bit set give zero.
+    plan.chunks.clear();
+    plan.groupFrames = 16 / std::gcd(plan.outFrameSize, 16);
+    plan.groupReadSize = 0;
+    for (int out = 0; out < plan.groupFrames * plan.outFrameSize; out += 16)
+    {
+        int srcPos[16];
+        int lo = INT_MAX;
+        int hi = -1;
+        for (int i = 0; i < 16; ++i)
+        {
+            const int srcByte = plan.byteMap[(out + i) % plan.outFrameSize];
+            srcPos[i] = srcByte < 0 ? -1 : (out + i) / plan.outFrameSize * plan.inFrameSize + srcByte;
+            if (srcPos[i] >= 0)
+            {
+                lo = (std::min)(lo, srcPos[i]);
+                hi = (std::max)(hi, srcPos[i]);
+            }
+        }
+        LPCMShufflePlan::Chunk chunk{};
+        memset(chunk.mask, 0x80, sizeof(chunk.mask));
+        if (hi >= 0)
+        {
+            chunk.srcOffset = lo;
+            chunk.windows = (hi - lo) / 16 + 1;
+            if (chunk.windows > 3)
+            {
+                plan.chunks.clear();
+                return;
+            }
+            for (int i = 0; i < 16; ++i)
+                if (srcPos[i] >= 0)
+                    chunk.mask[(srcPos[i] - lo) / 16][i] = static_cast<uint8_t>((srcPos[i] - lo) % 16);
+            plan.groupReadSize = (std::max)(plan.groupReadSize, lo + 16 * chunk.windows);
+        }
+        plan.chunks.push_back(chunk);
     }
 }
 
@@ -183,69 +276,12 @@ int LPCMStreamReader::convertWavToPCM(uint8_t* start, uint8_t* end)
     cLen -= cLen % fullSampleSize;
     end = start + cLen;
 
-    const int64_t ch1FullSize = (end - start) / m_channels;
-    // 1. convert byte order to little endian
-    if (m_bitsPerSample == 16)
-    {
-        for (auto curPos = reinterpret_cast<uint16_t*>(start); curPos < reinterpret_cast<uint16_t*>(end); ++curPos)
-            *curPos = my_htons(*curPos);
-    }
-    else if (m_bitsPerSample > 16)
-    {
-        for (uint8_t* curPos = start; curPos < end - 2; curPos += 3)
-        {
-            const uint8_t tmp = curPos[0];
-            curPos[0] = curPos[2];
-            curPos[2] = tmp;
-        }
-    }
-    // 2. Remap channels to Blu-ray standard
-    if (m_channels == 6)
-    {
-        const auto tmpData = new uint8_t[ch1FullSize];
-        storeChannelData(start, end, 4, tmpData, m_channels);    // copy channel 6(LFE) to tmpData
-        copyChannelData(start, end, 5, 4, m_channels);           // Shift RS
-        copyChannelData(start, end, 6, 5, m_channels);           // Shift LS
-        restoreChannelData(start, end, 6, tmpData, m_channels);  // copy LFE to channel #4
-        delete[] tmpData;
-    }
-    else if (m_channels == 7)
-    {
-        const auto tmpData = new uint8_t[ch1FullSize];
-
-        storeChannelData(start, end, 4, tmpData, m_channels);  // copy channel 8(LFE) to tmpData
-        copyChannelData(start, end, 6, 4, m_channels);
-        copyChannelData(start, end, 5, 6, m_channels);
-        restoreChannelData(start, end, 5, tmpData, m_channels);
-
-        delete[] tmpData;
-    }
-    else if (m_channels == 8)
-    {
-        const auto lfeData = new uint8_t[ch1FullSize];
-
-        storeChannelData(start, end, 4, lfeData, m_channels);  // copy channel 8(LFE) to tmpData
-        copyChannelData(start, end, 7, 4, m_channels);
-        copyChannelData(start, end, 8, 7, m_channels);
-        restoreChannelData(start, end, 8, lfeData, m_channels);
-
-        delete[] lfeData;
-    }
-    // 3. transfer to frame buffer and Add X channel (zero channel for padding if needed)
-    uint8_t* dst = m_tmpFrameBuffer + (m_needPCMHdr ? 4 : 0);
-    const uint8_t* src = start;
-    for (; src < end; src += fullSampleSize)
-    {
-        memcpy(dst, src, fullSampleSize);
-        dst += fullSampleSize;
-        if (m_channels % 2 == 1)
-        {
-            memset(dst, 0, ch1SampleSize);
-            dst += ch1SampleSize;
-        }
-    }
+    // 1. convert byte order, remap channels to Blu-ray standard and add X channel (zero channel for padding if
+    // needed) while transferring to frame buffer
+    initShufflePlan(m_wavToPcm, wavToPcmChannels[m_channels], m_channels, (m_channels + 1) & 0xfe);
+    const uint8_t* dst = m_wavToPcm.shuffle(start, end, m_tmpFrameBuffer + (m_needPCMHdr ? 4 : 0));
     assert(dst < m_tmpFrameBuffer + sizeof(m_tmpFrameBuffer));
-    // 4. add LPCM frame header
+    // 2. add LPCM frame header
     if (m_needPCMHdr)
     {
         const int audio_data_payload_size = (m_bitsPerSample == 20 ? 24 : m_bitsPerSample) * m_freq *
@@ -300,67 +336,12 @@ int LPCMStreamReader::convertLPCMToWAV(uint8_t* start, uint8_t* end)
     {
         m_lastChannelRemapPos = start;
 
-        // 1. convert byte order to little endian
-        if (m_bitsPerSample == 16)
-        {
-            for (auto curPos = reinterpret_cast<uint16_t*>(start); curPos < reinterpret_cast<uint16_t*>(end); ++curPos)
-                *curPos = my_ntohs(*curPos);
-        }
-        else if (m_bitsPerSample > 16)
-        {
-            for (uint8_t* curPos = start; curPos < end; curPos += 3)
-            {
-                const uint8_t tmp = curPos[0];
-                curPos[0] = curPos[2];
-                curPos[2] = tmp;
-            }
-        }
-        // 2. Remap channels to WAV standard
-        if (m_channels == 1)
-        {
-            removeChannel(start, end, 2, mch);
-        }
-        else if (m_channels == 3)
-        {
-            removeChannel(start, end, 4, mch);
-        }
-        else if (m_channels == 5)
-        {
-            removeChannel(start, end, 6, mch);
-        }
-        else if (m_channels == 6)
-        {
-            const auto tmpData = new uint8_t[ch1FullSize];
-            storeChannelData(start, end, 6, tmpData, mch);    // copy channel 6(LFE) to tmpData
-            copyChannelData(start, end, 5, 6, mch);           // Shift RS
-            copyChannelData(start, end, 4, 5, mch);           // Shift LS
-            restoreChannelData(start, end, 4, tmpData, mch);  // copy LFE to channel #4
-            delete[] tmpData;
-        }
-        else if (m_channels == 7)
-        {
-            const auto tmpData = new uint8_t[ch1FullSize];
-
-            storeChannelData(start, end, 4, tmpData, mch);  // copy channel 8(LFE) to tmpData
-            copyChannelData(start, end, 5, 4, mch);
-            copyChannelData(start, end, 6, 5, mch);
-            restoreChannelData(start, end, 6, tmpData, mch);
-
-            delete[] tmpData;
-        }
-        else if (m_channels == 8)
-        {
-            const auto lfeData = new uint8_t[ch1FullSize];
-
-            storeChannelData(start, end, 8, lfeData, mch);
-            copyChannelData(start, end, 7, 8, mch);
-            copyChannelData(start, end, 4, 7, mch);
-            restoreChannelData(start, end, 4, lfeData, mch);
-
-            delete[] lfeData;
-        }
-        if (m_channels == 7)
-            removeChannel(start, end, 8, mch);
+        // convert byte order, remap channels to WAV standard and remove the padding channel
+        initShufflePlan(m_pcmToWav, pcmToWavChannels[m_channels], mch, m_channels);
+        if (m_shuffleBuffer.size() < static_cast<size_t>(end - start))
+            m_shuffleBuffer.resize(end - start);
+        const uint8_t* dataEnd = m_pcmToWav.shuffle(start, end, m_shuffleBuffer.data());
+        memcpy(start, m_shuffleBuffer.data(), dataEnd - m_shuffleBuffer.data());
     }
 
     return static_cast<int>(end - start - (m_channels % 2 == 1 ? ch1FullSize : 0));
@@ -433,6 +414,9 @@ int LPCMStreamReader::decodeWaveHeader(uint8_t* buff, uint8_t* end)
         {
             if (waveFormatPCMEx->Samples.wValidBitsPerSample)
                 m_bitsPerSample = waveFormatPCMEx->Samples.wValidBitsPerSample;
+            if (m_bitsPerSample != 16 && m_bitsPerSample != 20 && m_bitsPerSample != 24)
+                THROW(ERR_COMMON, "Bit depth " << m_bitsPerSample
+                                               << " is not supported for LPCM format. Allowed values: 16bit, 20bit, 24bit")
             m_lfeExists = waveFormatPCMEx->dwChannelMask & SPEAKER_LOW_FREQUENCY;
             if (!(waveFormatPCMEx->SubFormat == KSDATAFORMAT_SUBTYPE_PCM))
                 THROW(ERR_COMMON, "Unsupported WAVE format. Only PCM audio is supported.")
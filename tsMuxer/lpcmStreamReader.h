@@ -1,9 +1,33 @@
 #ifndef LPCM_STREAM_READER_H_
 #define LPCM_STREAM_READER_H_
 
+#include <vector>
+
 #include "avPacket.h"
 #include "simplePacketizerReader.h"
 
+// Byte order conversion, channel reordering and zero padding of whole sample frames, done in one pass.
+struct LPCMShufflePlan
+{
+    struct Chunk  // one 16 byte output vector of a frame group
+    {
+        int srcOffset;
+        int windows;  // number of 16 byte source loads starting at srcOffset
+        uint8_t mask[3][16];
+    };
+
+    int channels = 0;
+    int bitsPerSample = 0;
+    int inFrameSize = 0;
+    int outFrameSize = 0;
+    std::vector<int8_t> byteMap;  // source byte of every output byte of a frame, -1 for padding
+    int groupFrames = 0;          // frames whose output is a whole number of vectors
+    int groupReadSize = 0;        // source bytes read by the vector kernel for one group
+    std::vector<Chunk> chunks;    // empty if the vector kernel can't be used
+
+    uint8_t* shuffle(const uint8_t* src, const uint8_t* srcEnd, uint8_t* dst) const;
+};
+
 class LPCMStreamReader final : public SimplePacketizerReader
 {
     friend class MatroskaMuxer;
@@ -79,15 +103,17 @@ class LPCMStreamReader final : public SimplePacketizerReader
     bool m_openSizeWaveFormat;
     uint8_t* m_lastChannelRemapPos;
 
+    LPCMShufflePlan m_wavToPcm;
+    LPCMShufflePlan m_pcmToWav;
+    std::vector<uint8_t> m_shuffleBuffer;  // LPCM -> WAVE conversion is done in place through this buffer
+
+    void initShufflePlan(LPCMShufflePlan& plan, const int8_t* channelMap, int inChannels, int outChannels) const;
+
     bool detectLPCMType(uint8_t* buffer, int64_t len);
     int decodeLPCMHeader(const uint8_t* buff);
     int convertLPCMToWAV(uint8_t* start, uint8_t* end);
     int convertWavToPCM(uint8_t* start, uint8_t* end);
 
-    void storeChannelData(const uint8_t* start, const uint8_t* end, int chNum, uint8_t* tmpData, int mch) const;
-    void copyChannelData(uint8_t* start, const uint8_t* end, int chFrom, int chTo, int mch) const;
-    void restoreChannelData(uint8_t* start, const uint8_t* end, int chNum, const uint8_t* tmpData, int mch) const;
-    void removeChannel(uint8_t* start, const uint8_t* end, int cnNum, int mch) const;
     int decodeWaveHeader(uint8_t* buff, uint8_t* end);
     static uint8_t* findSubstr(const char* pattern, uint8_t* buff, const uint8_t* end);
 };
@@ -2,7 +2,12 @@
 #include <fs/systemlog.h>
 #include <fs/textfile.h>
 
+#include <algorithm>
+#include <atomic>
+#include <exception>
 #include <iostream>
+#include <memory>
+#include <thread>
 #include <vector>
 
 #include <cmath>
@@ -38,10 +43,11 @@ static constexpr char EXCEPTION_ERR_MSG[] =
     }
 DiskType checkBluRayMux(const char* metaFileName, int& autoChapterLen, vector<double>& customChaptersList,
                         int& firstMplsOffset, int& firstM2tsOffset, bool& insertBlankPL, int& blankNum,
-                        bool& stereoMode, std::string& isoDiskLabel)
+                        bool& stereoMode, std::string& isoDiskLabel, bool& blurayV3)
 {
     autoChapterLen = 0;
     stereoMode = false;
+    blurayV3 = false;
     TextFile file(metaFileName, File::ofRead);
     string str;
     file.readLine(str);
@@ -90,7 +96,7 @@ DiskType checkBluRayMux(const char* metaFileName, int& autoChapterLen, vector<do
             }
 
             if (str.find("--blu-ray-v3") != string::npos)
-                V3_flags |= HDMV_V3;
+                blurayV3 = true;
 
             if (str.find("--blu-ray") != string::npos)
                 result = DiskType::BLURAY;
@@ -228,7 +234,8 @@ string getBlurayStreamDir(const string& mplsName)
     return "";
 }
 
-void muxBlankPL(const string& appDir, BlurayHelper& blurayHelper, const PIDListMap& pidList, DiskType dt, int blankNum)
+void muxBlankPL(const string& appDir, BlurayHelper& blurayHelper, const PIDListMap& pidList, DiskType dt, int blankNum,
+                const V3State& v3State)
 {
     unsigned videoWidth = 1920;
     unsigned videoHeight = 1080;
@@ -290,6 +297,7 @@ void muxBlankPL(const string& appDir, BlurayHelper& blurayHelper, const PIDListM
     videoParams["fps"] = "23.976";
     {
         MuxerManager muxerManager(readManager, tsMuxerFactory);
+        muxerManager.v3State() = v3State;  // the blank playlist is written for the title that plays it
         muxerManager.parseMuxOpt("MUXOPT --no-pcr-on-video-pid --vbr --avchd --vbv-len=500");
         muxerManager.addStream("V_MPEG4/ISO/AVC", tmpFileName, videoParams);
         string dstFile = blurayHelper.m2tsFileName(blankNum);
@@ -303,6 +311,267 @@ void muxBlankPL(const string& appDir, BlurayHelper& blurayHelper, const PIDListM
     deleteFile(tmpFileName);
 }
 
+// Muxer of one output of a multi-output run: TS, M2TS, MKV or a demux directory. Disc outputs need the Blu-ray
+// post-processing of a dedicated run.
+AbstractMuxerFactory& fanOutMuxerFactory(const string& fileName)
+{
+    const string fileExt = strToUpperCase(unquoteStr(extractFileExt(fileName)));
+    if (fileExt == "TS" || fileExt == "M2TS" || fileExt == "M2T" || fileExt == "MTS")
+        return tsMuxerFactory;
+    if (fileExt == "MKV" || fileExt == "MKA")
+        return matroskaMuxerFactory;
+    if (fileExt == "SSIF" || fileExt == "ISO")
+        THROW(ERR_COMMON, "SSIF and ISO outputs can't be combined with other outputs: " << fileName)
+    return singleFileMuxerFactory;
+}
+
+// Writes the clip info, SSIF and playlist files of a title once its clips are muxed.
+void createTitleFiles(const BlurayHelper& blurayHelper, const MuxerManager& muxerManager, const int autoChapterLen,
+                      vector<double> customChapterList, const DiskType dt, const int mplsOffset)
+{
+    auto mainMuxer = dynamic_cast<TSMuxer*>(muxerManager.getMainMuxer());
+    auto subMuxer = dynamic_cast<TSMuxer*>(muxerManager.getSubMuxer());
+
+    if (mainMuxer)
+        blurayHelper.createCLPIFile(mainMuxer, mainMuxer->getFirstFileNum(), true);
+    if (subMuxer)
+    {
+        blurayHelper.createCLPIFile(subMuxer, subMuxer->getFirstFileNum(), false);
+
+        IsoWriter* IsoWriter = blurayHelper.isoWriter();
+        if (IsoWriter)
+        {
+            for (size_t i = 0; i < mainMuxer->splitFileCnt(); ++i)
+            {
+                string file1 = mainMuxer->getFileNameByIdx(i);
+                string file2 = subMuxer->getFileNameByIdx(i);
+                int ssifNum = strToInt32(extractFileName(file1));
+                if (!file1.empty() && !file2.empty())
+                    IsoWriter->createInterleavedFile(file1, file2, blurayHelper.ssifFileName(ssifNum));
+            }
+        }
+    }
+
+    for (auto& i : customChapterList) i -= static_cast<double>(muxerManager.getCutStart()) / INTERNAL_PTS_FREQ;
+
+    if (subMuxer)
+        mainMuxer->alignPTS(subMuxer);
+
+    blurayHelper.createMPLSFile(mainMuxer, subMuxer, autoChapterLen, customChapterList, dt, mplsOffset,
+                                muxerManager.isMvcBaseViewR());
+}
+
+// Entry of a title in the disc navigation files, with the default tracks set in its meta file.
+BluRayTitle bluRayTitle(const MuxerManager& muxerManager, const int mplsNum, const bool usedBlankPL)
+{
+    BluRayTitle title{mplsNum, usedBlankPL, muxerManager.getDefaultAudioTrackIdx(), -1,
+                      MuxerManager::SubTrackMode::Forced};
+    title.defaultSubIdx = muxerManager.getDefaultSubTrackIdx(title.subTrackMode);
+    return title;
+}
+
+// A title of a Blu-ray project: the clips of one meta file and the playlist that plays them.
+struct ProjectTitle
+{
+    string metaFile;
+    DiskType dt = DiskType::NONE;
+    int autoChapterLen = 0;
+    vector<double> customChapterList;
+    int mplsOffset = -1;
+    int m2tsOffset = -1;
+    bool insertBlankPL = false;
+    int blankNum = 1900;
+    bool stereoMode = false;
+    bool blurayV3 = false;
+    string isoDiskLabel;
+
+    // filled in when the title is muxed
+    V3State v3State;
+    BluRayTitle bluRayTitle{};
+    vector<string> clipFiles;
+    std::unique_ptr<MuxerManager> muxerManager;  // kept only for the title that the blank playlist is made for
+};
+
+// Collects the meta files listed on the TITLE lines of a project file. Returns false for a regular meta file.
+bool readProjectFile(const char* fileName, vector<string>& metaFiles)
+{
+    TextFile file(fileName, File::ofRead);
+    string str;
+    while (file.readLine(str))
+    {
+        str = trimStr(str);
+        if (strStartWith(str, "TITLE ") || strStartWith(str, "TITLE\t"))
+            metaFiles.push_back(unquoteStr(trimStr(str.substr(5))));
+    }
+    return !metaFiles.empty();
+}
+
+// Muxes the titles of a project into one disc. The meta files are opened once up front to lay out the disc, then
+// again by the muxing run of each title, so that only the titles being muxed hold their readers and muxers. The
+// titles are muxed concurrently, up to one per hardware thread, and share the reader threads and one writer thread.
+// Each title writes its clip info and playlist files when it is done; the disc navigation files are written once
+// all of them are. An ISO image is written sequentially, so its titles are muxed one after another.
+void muxProject(const string& appDir, const vector<string>& metaFiles, const string& dstPath)
+{
+    vector<ProjectTitle> titles(metaFiles.size());
+    int64_t totalSize = 0;
+    int extraIsoBlocks = 0;
+    bool reproducibleIsoHeader = false;
+    bool sequentialIso = false;
+    bool stereoMode = false;
+    string isoDiskLabel;
+    int nextMplsOffset = 0;
+    int nextM2tsOffset = 0;
+    bool discV3 = false;
+    for (size_t i = 0; i < titles.size(); ++i)
+    {
+        ProjectTitle& title = titles[i];
+        title.metaFile = metaFiles[i];
+        title.dt = checkBluRayMux(title.metaFile.c_str(), title.autoChapterLen, title.customChapterList,
+                                  title.mplsOffset, title.m2tsOffset, title.insertBlankPL, title.blankNum,
+                                  title.stereoMode, title.isoDiskLabel, title.blurayV3);
+        if (title.dt == DiskType::NONE)
+            THROW(ERR_COMMON, "Title " << title.metaFile << " is not muxed to a Blu-ray or AVCHD disc")
+        if (title.dt != titles.front().dt)
+            THROW(ERR_COMMON, "All titles of a project must be muxed to the same disc type")
+
+        MuxerManager muxerManager(readManager, tsMuxerFactory);
+        muxerManager.setAllowStereoMux(true);
+        muxerManager.openMetaFile(title.metaFile);
+        if (muxerManager.getTrackCnt() == 0)
+            THROW(ERR_COMMON, "No tracks selected in " << title.metaFile)
+        if (!title.blurayV3 && title.dt == DiskType::BLURAY && muxerManager.getHevcFound())
+        {
+            LTRACE(LT_INFO, 2, "HEVC stream detected: changing Blu-Ray version to V3.");
+            title.blurayV3 = true;
+        }
+
+        // clips and playlists are numbered on from the previous title unless the title sets its own offsets
+        if (title.mplsOffset == -1)
+            title.mplsOffset = nextMplsOffset;
+        nextMplsOffset = title.mplsOffset + 1;
+        if (title.m2tsOffset == -1)
+        {
+            if (muxerManager.isSplitMode())
+                THROW(ERR_COMMON, "Title " << title.metaFile << " is split into several clips and needs --m2tsOffset")
+            title.m2tsOffset = nextM2tsOffset;
+        }
+        nextM2tsOffset = title.m2tsOffset + (title.stereoMode ? 2 : 1);
+
+        totalSize += muxerManager.totalSize();
+        extraIsoBlocks = (std::max)(extraIsoBlocks, muxerManager.getExtraISOBlocks());
+        reproducibleIsoHeader |= muxerManager.useReproducibleIsoHeader();
+        sequentialIso |= muxerManager.useSequentialIso();
+        stereoMode |= title.stereoMode;
+        if (isoDiskLabel.empty())
+            isoDiskLabel = title.isoDiskLabel;
+        discV3 |= title.blurayV3;  // the BDMV version is the same for the whole disc
+    }
+    for (size_t i = 0; i < titles.size(); ++i)
+        for (size_t j = 0; j < i; ++j)
+        {
+            if (titles[i].mplsOffset == titles[j].mplsOffset)
+                THROW(ERR_COMMON, "Titles " << titles[j].metaFile << " and " << titles[i].metaFile
+                                            << " use the same playlist number " << titles[i].mplsOffset)
+            if (titles[i].m2tsOffset == titles[j].m2tsOffset)
+                THROW(ERR_COMMON, "Titles " << titles[j].metaFile << " and " << titles[i].metaFile
+                                            << " use the same clip number " << titles[i].m2tsOffset)
+        }
+    const ProjectTitle* blankTitle = nullptr;
+    for (const ProjectTitle& title : titles)
+        if (title.insertBlankPL && !blankTitle)
+            blankTitle = &title;
+
+    const DiskType dt = titles.front().dt;
+    BlurayHelper blurayHelper;
+    if (!blurayHelper.open(dstPath, dt, totalSize, extraIsoBlocks, reproducibleIsoHeader, sequentialIso))
+        throw runtime_error(string("Can't create output file ") + dstPath);
+    blurayHelper.setVolumeLabel(isoDiskLabel);
+    blurayHelper.createBluRayDirs();
+
+    size_t threadCnt = 1;
+    if (!blurayHelper.isoWriter())
+        threadCnt = std::clamp<size_t>(std::thread::hardware_concurrency(), 1, titles.size());
+    {
+        // shared by the concurrent titles, destroyed at the end of this block while the files it writes are still open
+        std::unique_ptr<BufferedFileWriter> fileWriter;
+        if (threadCnt > 1)
+            fileWriter = std::make_unique<BufferedFileWriter>();
+        std::atomic<size_t> nextTitle = 0;
+        vector<std::exception_ptr> errors(titles.size());
+        const auto muxTitles = [&]() {
+            for (size_t i = nextTitle++; i < titles.size(); i = nextTitle++)
+            {
+                ProjectTitle& title = titles[i];
+                try
+                {
+                    auto muxerManager = std::make_unique<MuxerManager>(readManager, tsMuxerFactory);
+                    if (discV3)
+                        muxerManager->v3State().flags |= HDMV_V3;
+                    muxerManager->setAllowStereoMux(true);
+                    if (fileWriter)
+                    {
+                        muxerManager->setFileWriter(fileWriter.get());
+                        muxerManager->setReportProgress(false);
+                    }
+                    LTRACE(LT_INFO, 2, "Muxing title " << title.metaFile);
+                    muxerManager->openMetaFile(title.metaFile);
+                    muxerManager->doMux(blurayHelper.m2tsFileName(title.m2tsOffset), &blurayHelper);
+                    createTitleFiles(blurayHelper, *muxerManager, title.autoChapterLen, title.customChapterList, dt,
+                                     title.mplsOffset);
+                    if (fileWriter)
+                        LTRACE(LT_INFO, 2, "Title " << title.metaFile << " complete");
+
+                    for (AbstractMuxer* muxer : {muxerManager->getMainMuxer(), muxerManager->getSubMuxer()})
+                    {
+                        const auto tsMuxer = dynamic_cast<TSMuxer*>(muxer);
+                        for (size_t j = 0; tsMuxer && j < tsMuxer->splitFileCnt(); ++j)
+                            title.clipFiles.push_back(tsMuxer->getFileNameByIdx(j));
+                    }
+                    title.bluRayTitle = bluRayTitle(*muxerManager, title.mplsOffset, title.insertBlankPL);
+                    title.v3State = muxerManager->v3State();
+                    if (&title == blankTitle)
+                        title.muxerManager = std::move(muxerManager);
+                }
+                catch (...)
+                {
+                    errors[i] = std::current_exception();
+                }
+            }
+        };
+        vector<std::thread> threads;
+        for (size_t i = 1; i < threadCnt; ++i) threads.emplace_back(muxTitles);
+        muxTitles();
+        for (auto& thread : threads) thread.join();
+        for (const auto& error : errors)
+            if (error)
+                std::rethrow_exception(error);
+    }
+
+    // split titles are numbered on the fly, check that their clips did not overwrite each other
+    std::set<string> clipFiles;
+    for (const ProjectTitle& title : titles)
+        for (const string& clipFile : title.clipFiles)
+            if (!clipFiles.insert(clipFile).second)
+                THROW(ERR_COMMON, "Title " << title.metaFile << " reuses the clip " << clipFile)
+
+    vector<BluRayTitle> bluRayTitles;
+    for (const ProjectTitle& title : titles) bluRayTitles.push_back(title.bluRayTitle);
+    const int blankNum = blankTitle ? blankTitle->blankNum : 1900;
+    // index.bdmv lists the HDR formats and the 4K flag of all titles
+    V3State discState;
+    for (const ProjectTitle& title : titles) discState.flags |= title.v3State.flags;
+    blurayHelper.writeBluRayFiles(bluRayTitles, blankNum, stereoMode, discState);
+
+    if (blankTitle)
+    {
+        auto mainMuxer = dynamic_cast<TSMuxer*>(blankTitle->muxerManager->getMainMuxer());
+        LTRACE(LT_INFO, 2, "Adding blank play list");
+        muxBlankPL(appDir, blurayHelper, mainMuxer->getPidList(), dt, blankNum, blankTitle->v3State);
+    }
+    blurayHelper.close();
+}
+
 void doTruncatedFile(const char* fileName, const int64_t offset)
 {
     File f;
@@ -332,11 +601,23 @@ tsMuxeR does not use external filters (codecs).
 Examples:
     tsMuxeR <media file name>
     tsMuxeR <meta file name> <out file/dir name>
+    tsMuxeR <meta file name> <out file> <out file> ...
+    tsMuxeR <project file name> <out dir/iso name>
 
 tsMuxeR can be run in track detection mode or muxing mode. If tsMuxeR is run
 with only one argument, then the program displays track information required to
 construct a meta file. When running with two arguments, tsMuxeR starts the
-muxing or demuxing process.
+muxing or demuxing process. Several TS/M2TS/MKV output files or demux
+directories can be given to produce all of them from a single pass over the
+source files; the n-th MUXOPT line of the meta file then applies to the n-th
+output, and outputs without a line of their own use the default options. Such
+outputs cannot be split.
+
+A project file authors one Blu-ray or AVCHD disc from several meta files. Each
+line of the form TITLE <meta file name> adds a title; the titles are muxed
+concurrently (one after another for an ISO image) and get consecutive playlist
+and clip numbers unless their meta file sets --mplsOffset or --m2tsOffset. Titles split with --split-duration or
+--split-size must set --m2tsOffset.
 
 Meta file format:
 File MUST have the .meta extension and be encoded in UTF-8 (but see README.md).
@@ -570,6 +851,16 @@ All parameters in this group start with two dashes:
                       of small files, it may be required to define extra space.
 --constant-iso-hdr    Generates an ISO header that does not depend on the program
                       version or the current time. Not meant for normal usage.
+--iso-sequential      Write the ISO image strictly sequentially, so the output
+                      can be a pipe or a raw device. The image is laid out in
+                      the temporary directory first, which needs enough free
+                      space for the whole image, and then copied to the output,
+                      so every byte is written twice.
+--font-dir            Look up the fonts of text subtitle tracks by name only in
+                      this directory (may be repeated) instead of the system
+                      font directories. The font list is cached in
+                      $XDG_CACHE_HOME/tsMuxeR/fonts.idx and rebuilt when one
+                      of the font directories changes.
 )help";
     LTRACE(LT_INFO, 2, help);
 }
@@ -719,7 +1010,7 @@ int main(int argc, char** argv)
             cout << endl;
             return 0;
         }
-        if (argc != 3)
+        if (argc < 3)
         {
             /*
                         LTRACE(LT_INFO, 2, "Usage: ");
@@ -738,15 +1029,58 @@ int main(int argc, char** argv)
         int autoChapterLen = 0;
         vector<double> customChapterList;
         bool stereoMode = false;
+        bool blurayV3 = false;
         string isoDiskLabel;
-        DiskType dt = checkBluRayMux(argv[1], autoChapterLen, customChapterList, firstMplsOffset, firstM2tsOffset,
-                                     insertBlankPL, blankNum, stereoMode, isoDiskLabel);
+        vector<string> projectTitles;
+        const bool projectMode = readProjectFile(argv[1], projectTitles);
+        DiskType dt = projectMode ? DiskType::NONE
+                                  : checkBluRayMux(argv[1], autoChapterLen, customChapterList, firstMplsOffset,
+                                                   firstM2tsOffset, insertBlankPL, blankNum, stereoMode, isoDiskLabel,
+                                                   blurayV3);
         std::string fileExt2 = unquoteStr(fileExt);
         bool mkvMode = fileExt2 == "MKV" || fileExt2 == "MKA";
-        bool muxMode =
-            fileExt2 == "M2TS" || fileExt2 == "TS" || fileExt2 == "SSIF" || fileExt2 == "ISO" || dt != DiskType::NONE;
+        bool muxMode = fileExt2 == "M2TS" || fileExt2 == "TS" || fileExt2 == "SSIF" || fileExt2 == "ISO" ||
+                       dt != DiskType::NONE || projectMode;
 
-        if (mkvMode)
+        if (projectMode)
+        {
+            if (argc > 3)
+                THROW(ERR_COMMON, "A project is muxed into a single disc output")
+            string dstPath = unquoteStr(argv[2]);
+            if (!isValidFileName(dstPath))
+                throw runtime_error(string("Output filename is invalid: ") + dstPath);
+            muxProject(extractFileDir(argv[0]), projectTitles, dstPath);
+
+            LTRACE(LT_INFO, 2, "Mux successful complete");
+        }
+        else if (argc > 3)
+        {
+            if (dt != DiskType::NONE)
+                THROW(ERR_COMMON, "Blu-ray and AVCHD muxing support a single output only")
+            MuxerManager muxerManager(readManager, fanOutMuxerFactory(argv[2]));
+            if (blurayV3)
+                muxerManager.v3State().flags |= HDMV_V3;
+            muxerManager.openMetaFile(argv[1]);
+            vector<string> dstFiles;
+            for (int i = 2; i < argc; ++i)
+            {
+                dstFiles.push_back(unquoteStr(argv[i]));
+                if (!isValidFileName(dstFiles.back()))
+                    throw runtime_error(string("Output filename is invalid: ") + dstFiles.back());
+                AbstractMuxerFactory& factory = fanOutMuxerFactory(argv[i]);
+                if (&factory == &singleFileMuxerFactory)
+                    createDir(dstFiles.back(), true);
+                if (i > 2)
+                    muxerManager.addOutput(factory, dstFiles.back());
+            }
+
+            if (muxerManager.getTrackCnt() == 0)
+                THROW(ERR_COMMON, "No tracks selected")
+            muxerManager.doMux(dstFiles.front(), nullptr);
+
+            LTRACE(LT_INFO, 2, "Mux successful complete");
+        }
+        else if (mkvMode)
         {
             MuxerManager muxerManager(readManager, matroskaMuxerFactory);
             muxerManager.openMetaFile(argv[1]);
@@ -767,11 +1101,13 @@ int main(int argc, char** argv)
 
             MuxerManager muxerManager(readManager, tsMuxerFactory);
             muxerManager.setAllowStereoMux(fileExt2 == "SSIF" || dt != DiskType::NONE);
+            if (blurayV3)
+                muxerManager.v3State().flags |= HDMV_V3;
             muxerManager.openMetaFile(argv[1]);
-            if (!isV3() && dt == DiskType::BLURAY && muxerManager.getHevcFound())
+            if (!muxerManager.v3State().isV3() && dt == DiskType::BLURAY && muxerManager.getHevcFound())
             {
                 LTRACE(LT_INFO, 2, "HEVC stream detected: changing Blu-Ray version to V3.");
-                V3_flags |= HDMV_V3;
+                muxerManager.v3State().flags |= HDMV_V3;
             }
 
             // output path - is checked for invalid characters on our platform
@@ -783,7 +1119,7 @@ int main(int argc, char** argv)
             if (dt != DiskType::NONE)
             {
                 if (!blurayHelper.open(dstFile, dt, muxerManager.totalSize(), muxerManager.getExtraISOBlocks(),
-                                       muxerManager.useReproducibleIsoHeader()))
+                                       muxerManager.useReproducibleIsoHeader(), muxerManager.useSequentialIso()))
                     throw runtime_error(string("Can't create output file ") + dstFile);
                 blurayHelper.setVolumeLabel(isoDiskLabel);
                 blurayHelper.createBluRayDirs();
@@ -794,44 +1130,19 @@ int main(int argc, char** argv)
             muxerManager.doMux(dstFile, dt != DiskType::NONE ? &blurayHelper : nullptr);
             if (dt != DiskType::NONE)
             {
-                blurayHelper.writeBluRayFiles(muxerManager, insertBlankPL, firstMplsOffset, blankNum, stereoMode);
+                blurayHelper.writeBluRayFiles({bluRayTitle(muxerManager, firstMplsOffset, insertBlankPL)}, blankNum,
+                                              stereoMode, muxerManager.v3State());
+                createTitleFiles(blurayHelper, muxerManager, autoChapterLen, customChapterList, dt, firstMplsOffset);
+
                 auto mainMuxer = dynamic_cast<TSMuxer*>(muxerManager.getMainMuxer());
                 auto subMuxer = dynamic_cast<TSMuxer*>(muxerManager.getSubMuxer());
-
-                if (mainMuxer)
-                    blurayHelper.createCLPIFile(mainMuxer, mainMuxer->getFirstFileNum(), true);
-                if (subMuxer)
-                {
-                    blurayHelper.createCLPIFile(subMuxer, subMuxer->getFirstFileNum(), false);
-
-                    IsoWriter* IsoWriter = blurayHelper.isoWriter();
-                    if (IsoWriter)
-                    {
-                        for (size_t i = 0; i < mainMuxer->splitFileCnt(); ++i)
-                        {
-                            string file1 = mainMuxer->getFileNameByIdx(i);
-                            string file2 = subMuxer->getFileNameByIdx(i);
-                            int ssifNum = strToInt32(extractFileName(file1));
-                            if (!file1.empty() && !file2.empty())
-                                IsoWriter->createInterleavedFile(file1, file2, blurayHelper.ssifFileName(ssifNum));
-                        }
-                    }
-                }
-
-                for (auto& i : customChapterList)
-                    i -= static_cast<double>(muxerManager.getCutStart()) / INTERNAL_PTS_FREQ;
-
-                if (subMuxer)
-                    mainMuxer->alignPTS(subMuxer);
-
-                blurayHelper.createMPLSFile(mainMuxer, subMuxer, autoChapterLen, customChapterList, dt, firstMplsOffset,
-                                            muxerManager.isMvcBaseViewR());
-
                 if (insertBlankPL && mainMuxer && !subMuxer)
                 {
                     LTRACE(LT_INFO, 2, "Adding blank play list");
-                    muxBlankPL(extractFileDir(argv[0]), blurayHelper, mainMuxer->getPidList(), dt, blankNum);
+                    muxBlankPL(extractFileDir(argv[0]), blurayHelper, mainMuxer->getPidList(), dt, blankNum,
+                               muxerManager.v3State());
                 }
+                blurayHelper.close();
             }
 
             LTRACE(LT_INFO, 2, "Mux successful complete");
@@ -5,6 +5,7 @@
 
 #include <fs/textfile.h>
 #include <types/types.h>
+#include <algorithm>
 #include <climits>
 #include <memory>
 
@@ -43,12 +44,13 @@ using namespace std;
 static constexpr int MAX_DEMUX_BUFFER_SIZE = 1024 * 1024 * 192;
 static constexpr int MIN_READED_BLOCK = 16384;
 
-METADemuxer::METADemuxer(const BufferedReaderManager& readManager)
-    : m_containerReader(*this, readManager), m_readManager(readManager)
+METADemuxer::METADemuxer(const BufferedReaderManager& readManager, V3State& v3State)
+    : m_containerReader(*this, readManager), m_readManager(readManager), m_v3State(&v3State)
 {
     m_flushDataMode = false;
     m_HevcFound = false;
     m_totalSize = 0;
+    m_reportProgress = true;
     m_lastProgressY = 0;
     m_lastReadRez = 0;
 }
@@ -313,6 +315,12 @@ std::vector<MPLSPlayItem> METADemuxer::mergePlayItems(const std::vector<MPLSPars
     return result;
 }
 
+void METADemuxer::addFontDir(const string& dir)
+{
+    if (std::find(m_fontDirs.begin(), m_fontDirs.end(), dir) == m_fontDirs.end())
+        m_fontDirs.push_back(dir);
+}
+
 int METADemuxer::addStream(const string& codec, const string& codecStreamName, const map<string, string>& addParams)
 {
     int32_t pid = 0;
@@ -414,7 +422,7 @@ int METADemuxer::addStream(const string& codec, const string& codecStreamName, c
 
     int64_t fileSize = 0;
 
-    if (m_containerReader.m_demuxers.find(fileList[0]) == m_containerReader.m_demuxers.end())
+    if (!m_source && m_containerReader.m_demuxers.find(fileList[0]) == m_containerReader.m_demuxers.end())
     {
         File tmpFile;
         for (const string& fileName : fileList)
@@ -510,6 +518,10 @@ int METADemuxer::addStream(const string& codec, const string& codecStreamName, c
         delete codecReader;
         THROW(ERR_INVALID_CODEC_FORMAT, "This version do not support multicast or other network steams for muxing")
     }
+    // a mirror gets the blocks the source demuxer reads instead of reading the file
+    const bool fromContainer = dataReader == &m_containerReader;
+    if (m_source)
+        dataReader = &m_mirrorReader;
 
     m_codecInfo.emplace_back(dataReader, codecReader, fileList[0], codecStreamName, pid, isSubStream);
     if (listIterator)
@@ -529,10 +541,11 @@ int METADemuxer::addStream(const string& codec, const string& codecStreamName, c
     if (addParams.find("fps") == addParams.end())
     {
         auto mpegReader = dynamic_cast<MPEGStreamReader*>(codecReader);
-        if (mpegReader && mpegReader->getFPS() == 0.0 && dataReader == &m_containerReader)
+        if (mpegReader && mpegReader->getFPS() == 0.0 && fromContainer)
         {
-            auto demuxerIt = m_containerReader.m_demuxers.find(fileList[0]);
-            if (demuxerIt != m_containerReader.m_demuxers.end() && demuxerIt->second.m_demuxer)
+            const auto& demuxers = (m_source ? m_source->m_containerReader : m_containerReader).m_demuxers;
+            auto demuxerIt = demuxers.find(fileList[0]);
+            if (demuxerIt != demuxers.end() && demuxerIt->second.m_demuxer)
             {
                 const double containerFps = correctFps(demuxerIt->second.m_demuxer->getTrackFps(pid));
                 if (containerFps > 0.0)
@@ -601,19 +614,20 @@ int METADemuxer::addStream(const string& codec, const string& codecStreamName, c
 
         if (haveTrack)
         {
-            if (dataReader != &m_containerReader)
+            if (!fromContainer)
                 THROW(ERR_INVALID_CODEC_FORMAT,
                       "merge-ac3-track is only supported when the TrueHD stream is inside a container (e.g. MKV).")
-            const int r2 = m_containerReader.createReader(mergeReader->getTmpBufferSize());
-            if (!m_containerReader.openStream(r2, fileList[0].c_str(), mergeReader->mergeAc3TrackPid(), &ac3CodecInfo))
+            AbstractReader* ac3Reader = m_source ? static_cast<AbstractReader*>(&m_mirrorReader) : &m_containerReader;
+            const int r2 = ac3Reader->createReader(mergeReader->getTmpBufferSize());
+            if (!ac3Reader->openStream(r2, fileList[0].c_str(), mergeReader->mergeAc3TrackPid(), &ac3CodecInfo))
                 THROW(ERR_CANT_OPEN_STREAM, "Can't open merge-ac3-track stream: " << fileList[0])
             streamInfo.m_mergeAc3ReaderId = r2;
-            streamInfo.m_mergeAc3DataReader = &m_containerReader;
+            streamInfo.m_mergeAc3DataReader = ac3Reader;
         }
         else if (haveFile)
         {
             const std::string ac3File = unquoteStr(trimStr(itFile->second));
-            AbstractReader* ac3Reader = m_readManager.getReader(ac3File.c_str());
+            AbstractReader* ac3Reader = m_source ? &m_mirrorReader : m_readManager.getReader(ac3File.c_str());
             if (ac3Reader == nullptr)
                 THROW(ERR_INVALID_CODEC_FORMAT, "merge-ac3-file: can't open reader for " << ac3File)
             const int r2 = ac3Reader->createReader(mergeReader->getTmpBufferSize());
@@ -644,6 +658,25 @@ void METADemuxer::readClose()
     m_codecInfo.clear();
 }
 
+std::unique_ptr<METADemuxer> METADemuxer::createMirror()
+{
+    auto mirror = std::make_unique<METADemuxer>(m_readManager, *m_v3State);
+    mirror->m_source = this;
+    mirror->m_fontDirs = m_fontDirs;
+    mirror->setTimeOffset(m_timeOffset);
+    // the mirror adds the tracks of the meta file in the same order, with the same parameters
+    mirror->openFile(m_streamName);
+    if (mirror->m_codecInfo.size() != m_codecInfo.size())
+        THROW(ERR_COMMON, "Can't mirror the tracks of " << m_streamName)
+    for (size_t i = 0; i < m_codecInfo.size(); ++i)
+    {
+        const StreamInfo& mirrorInfo = mirror->m_codecInfo[i];
+        m_codecInfo[i].m_mirrors.push_back({&mirror->m_mirrorReader, mirrorInfo.m_readerID,
+                                            mirrorInfo.m_mergeAc3ReaderId});
+    }
+    return mirror;
+}
+
 // ---------------------------------------------------------------------------
 // Discovery phase — self-contained probe of all tracks
 // ---------------------------------------------------------------------------
@@ -912,6 +945,7 @@ DetectStreamRez METADemuxer::DetectStreamReader(const BufferedReaderManager& rea
     AbstractStreamReader::ContainerType containerType = AbstractStreamReader::ContainerType::ctNone;
     CLPIParser clpi;
     bool clpiParsed = false;
+    V3State v3State;  // the PGS track numbers of an M2TS file depend on the HDR formats of its video
     if (fileExt == "m2ts" || fileExt == "mts" || fileExt == "ssif")
     {
         demuxer = std::make_unique<TSDemuxer>(readManager, "");
@@ -970,7 +1004,7 @@ DetectStreamRez METADemuxer::DetectStreamReader(const BufferedReaderManager& rea
         {
             StreamData& vect = itr.second;
             CheckStreamRez trackRez = detectTrackReader(vect.data(), static_cast<int>(vect.size()), containerType,
-                                                        acceptedPidMap[itr.first].m_trackType, itr.first);
+                                                        acceptedPidMap[itr.first].m_trackType, itr.first, v3State);
             if (!trackRez.codecInfo.programName.empty())
             {
                 if (trackRez.codecInfo.programName[0] != 'S')
@@ -1045,7 +1079,7 @@ DetectStreamRez METADemuxer::DetectStreamReader(const BufferedReaderManager& rea
             containerType = AbstractStreamReader::ContainerType::ctLPCM;
         else if (fileExt == "srt")
             containerType = AbstractStreamReader::ContainerType::ctSRT;
-        CheckStreamRez trackRez = detectTrackReader(tmpBuffer.get(), len, containerType, 0, 0);
+        CheckStreamRez trackRez = detectTrackReader(tmpBuffer.get(), len, containerType, 0, 0, v3State);
 
         if (strStartWith(trackRez.codecInfo.programName, "V_"))
             addTrack(Vstreams, trackRez);
@@ -1081,11 +1115,12 @@ void METADemuxer::addTrack(vector<CheckStreamRez>& rez, CheckStreamRez trackRez)
 
 CheckStreamRez METADemuxer::detectTrackReader(uint8_t* tmpBuffer, int len,
                                               AbstractStreamReader::ContainerType containerType, int containerDataType,
-                                              int containerStreamIndex)
+                                              int containerStreamIndex, V3State& v3State)
 {
     CheckStreamRez rez;
 
     auto pgsReader = std::make_unique<PGSStreamReader>();
+    pgsReader->setV3State(&v3State);
     rez = pgsReader->checkStream(tmpBuffer, len, containerType, containerDataType, containerStreamIndex);
     if (rez.codecInfo.codecID)
         return rez;
@@ -1144,6 +1179,7 @@ CheckStreamRez METADemuxer::detectTrackReader(uint8_t* tmpBuffer, int len,
         return rez;
 
     auto hevcCodec = std::make_unique<HEVCStreamReader>();
+    hevcCodec->setV3State(&v3State);
     rez = hevcCodec->checkStream(tmpBuffer, len);
     if (rez.codecInfo.codecID)
         return rez;
@@ -1221,7 +1257,8 @@ int pipScaleFromStr(const std::string& value)
 }
 
 AbstractStreamReader* METADemuxer::createCodec(const string& codecName, const map<string, string>& addParams,
-                                               const std::string& codecStreamName, const vector<MPLSPlayItem>& mplsInfo)
+                                               const std::string& codecStreamName,
+                                               const vector<MPLSPlayItem>& mplsInfo) const
 {
     AbstractStreamReader* rez = nullptr;
     if (codecName == "V_MPEG4/ISO/AVC" || codecName == "V_MPEG4/ISO/MVC")
@@ -1394,7 +1431,7 @@ AbstractStreamReader* METADemuxer::createCodec(const string& codecName, const ma
         dynamic_cast<PGSStreamReader*>(rez)->setVideoInfo(width, height, fps);
         itr = addParams.find("font-border");
         if (itr != addParams.end())
-            dynamic_cast<PGSStreamReader*>(rez)->setFontBorder(strToInt32(itr->second.c_str()));
+            dynamic_cast<PGSStreamReader*>(rez)->setFontBorder(strToFloat(itr->second.c_str()));
     }
     else if (codecName == "S_TEXT/UTF8")
     {
@@ -1456,6 +1493,7 @@ AbstractStreamReader* METADemuxer::createCodec(const string& codecName, const ma
         if (srtWidth == 0 || srtHeight == 0 || fps == 0.0)
             THROW(ERR_COMMON, "video-width, video-height and fps parameters MUST be provided for SRT tracks")
         srtReader->setVideoInfo(srtWidth, srtHeight, fps);
+        srtReader->setFontDirs(m_fontDirs);
         srtReader->setFont(font);
         srtReader->setAnimation(animation);
     }
@@ -1507,6 +1545,7 @@ AbstractStreamReader* METADemuxer::createCodec(const string& codecName, const ma
     if (itr != addParams.end())
         pipParams.scaleIndex = pipScaleFromStr(itr->second);
     rez->setPipParams(pipParams);
+    rez->setV3State(m_v3State);
 
     if (!mplsInfo.empty() && dynamic_cast<SimplePacketizerReader*>(rez))
         dynamic_cast<SimplePacketizerReader*>(rez)->setMPLSInfo(mplsInfo);
@@ -1568,6 +1607,8 @@ string METADemuxer::findBluRayFile(const string& streamDir, const string& reques
 
 void METADemuxer::updateReport(const bool checkTime)
 {
+    if (m_source || !m_reportProgress)
+        return;  // a mirror leaves the progress to its source demuxer
     const auto currentTime = std::chrono::steady_clock::now();
     if (!checkTime || currentTime - m_lastReportTime > std::chrono::microseconds(250000))
     {
@@ -1638,6 +1679,8 @@ int StreamInfo::read()
                 m_lastAVRez = ac3Rez;
                 return ac3Rez;
             }
+            for (const MirrorLink& mirror : m_mirrors)
+                mirror.reader->addBlock(mirror.mergeAc3ReaderId, ac3Data, ac3Cnt, ac3Rez);
             if (ac3Rez == BufferedFileReader::DATA_EOF || ac3Rez == BufferedFileReader::DATA_EOF2)
             {
                 if (ac3Data != nullptr && ac3Cnt > 0)
@@ -1661,6 +1704,13 @@ int StreamInfo::read()
         else
         {
             m_data = m_dataReader->readBlock(m_readerID, m_blockSize, readRez);
+            if (readRez != BufferedFileReader::DATA_NOT_READY)
+            {
+                // a delayed block is kept by the source reader, the mirrors only skip the stream once as well
+                const uint32_t size = readRez == BufferedFileReader::DATA_DELAYED ? 0 : m_blockSize;
+                for (const MirrorLink& mirror : m_mirrors)
+                    mirror.reader->addBlock(mirror.readerID, m_data, size, readRez);
+            }
             if (readRez == BufferedFileReader::DATA_NOT_READY || readRez == BufferedFileReader::DATA_DELAYED)
             {
                 m_lastAVRez = readRez;
@@ -1676,6 +1726,45 @@ int StreamInfo::read()
     return readRez;
 }
 
+// ------------------------------ MirrorReader --------------------------------
+
+uint8_t* MirrorReader::readBlock(const int readerID, uint32_t& readCnt, int& rez, bool* firstBlockVar)
+{
+    const auto itr = m_readers.find(readerID);
+    if (itr == m_readers.end() || itr->second.blocks.empty())
+    {
+        readCnt = 0;
+        rez = DATA_NOT_READY;
+        return nullptr;
+    }
+    ReaderData& data = itr->second;
+    data.current = std::move(data.blocks.front());
+    data.blocks.pop_front();
+    readCnt = data.current.size;
+    rez = data.current.rez;
+    return data.current.data.data();
+}
+
+void MirrorReader::addBlock(const int readerID, const uint8_t* data, const uint32_t size, const int rez)
+{
+    ReaderData& reader = m_readers[readerID];
+    Block& block = reader.blocks.emplace_back();
+    // the headroom is copied too, the TrueHD/AC-3 merge reads the AC-3 blocks from the start of the buffer
+    block.data.resize(reader.readOffset + size);
+    if (data)
+        memcpy(block.data.data(), data, block.data.size());
+    block.size = size;
+    block.rez = rez;
+}
+
+int MirrorReader::createReader(const int readBuffOffset)
+{
+    m_readers[++m_readerCnt].readOffset = readBuffOffset;
+    return m_readerCnt;
+}
+
+void MirrorReader::deleteReader(const int readerID) { m_readers.erase(readerID); }
+
 // ------------------------------ ContainerToReaderWrapper --------------------------------
 
 uint8_t* ContainerToReaderWrapper::readBlock(const int readerID, uint32_t& readCnt, int& rez, bool* firstBlockVar)
@@ -2,7 +2,9 @@
 #define META_DEMUXER_H_
 
 #include <chrono>
+#include <deque>
 #include <map>
+#include <memory>
 #include <set>
 #include <string>
 #include <vector>
@@ -16,6 +18,8 @@
 
 // META file demuxer
 
+class MirrorReader;
+
 struct StreamInfo
 {
     AbstractReader* m_dataReader;
@@ -49,6 +53,15 @@ struct StreamInfo
 
     int read();
 
+    // Stream of a mirror demuxer that gets a copy of every block read for this one
+    struct MirrorLink
+    {
+        MirrorReader* reader;
+        int readerID;
+        int mergeAc3ReaderId;
+    };
+    std::vector<MirrorLink> m_mirrors;
+
     int m_mergeAc3ReaderId;
     AbstractReader* m_mergeAc3DataReader;
 
@@ -158,6 +171,44 @@ class ContainerToReaderWrapper final : public AbstractReader
     bool m_terminated;
 };
 
+// Data reader of a mirror demuxer. It reads no files, it hands out copies of the blocks the source demuxer read for
+// the same stream, in the same order. A stream whose next block the source has not read yet is DATA_NOT_READY.
+class MirrorReader final : public AbstractReader
+{
+   public:
+    uint8_t* readBlock(int readerID, uint32_t& readCnt, int& rez, bool* firstBlockVar = nullptr) override;
+    bool seek(int readerID, int64_t offset) override { return false; }
+    bool incSeek(int readerID, int64_t offset) override { return false; }
+    void notify(int readerID, uint32_t dataReaded) override {}
+    int createReader(int readBuffOffset = 0) override;
+    void deleteReader(int readerID) override;
+    bool openStream(int readerID, const char* streamName, int pid = 0, const CodecInfo* codecInfo = nullptr) override
+    {
+        return true;
+    }
+    bool gotoByte(int readerID, int64_t seekDist) override { return false; }
+
+    // Queues a block returned by the source reader. data points to the start of the buffer, the block follows the
+    // reader offset.
+    void addBlock(int readerID, const uint8_t* data, uint32_t size, int rez);
+
+   private:
+    struct Block
+    {
+        std::vector<uint8_t> data;  // readOffset bytes reserved for the stream reader, then the block
+        uint32_t size;
+        int rez;
+    };
+    struct ReaderData
+    {
+        int readOffset = 0;
+        std::deque<Block> blocks;
+        Block current;  // block returned by the last readBlock(), valid until the next one
+    };
+    std::map<int, ReaderData> m_readers;
+    int m_readerCnt = 0;
+};
+
 typedef std::map<std::string, MPLSParser> MPLSCache;
 
 struct DetectStreamRez
@@ -172,19 +223,27 @@ struct DetectStreamRez
 class METADemuxer final : public AbstractDemuxer
 {
    public:
-    METADemuxer(const BufferedReaderManager& readManager);
+    // The stream readers of the demuxer add the V3/HDR flags of their streams to v3State
+    METADemuxer(const BufferedReaderManager& readManager, V3State& v3State);
     ~METADemuxer() override;
     int readPacket(AVPacket& avPacket);
     void readClose() override;
     int64_t getDemuxedSize() override;
     int addStream(const std::string& codec, const std::string& codecStreamName,
                   const std::map<std::string, std::string>& addParams);
+    // Directory to look up the fonts of text subtitle tracks in (--font-dir), must be set before the tracks are added
+    void addFontDir(const std::string& dir);
     void openFile(const std::string& streamName) override;
     [[nodiscard]] const std::vector<StreamInfo>& getStreamInfo() const { return m_codecInfo; }
     static DetectStreamRez DetectStreamReader(const BufferedReaderManager& readManager, const std::string& fileName,
                                               bool calcDuration);
     std::vector<StreamInfo>& getCodecInfo() { return m_codecInfo; }
 
+    // Creates a demuxer with stream readers of its own for the tracks of this one. It reads no files: every block
+    // this demuxer reads for a track is copied to the track of the mirror, so a muxer that needs the streams prepared
+    // in another way (demuxing, MKV) can run from the same pass over the sources. The tracks must be added already.
+    std::unique_ptr<METADemuxer> createMirror();
+
     /// Run a self-contained discovery pass: for every track in m_codecInfo,
     /// open a temporary demuxer, probe the first few frames, and return a
     /// vector of StreamDiscoveryData (indexed the same as m_codecInfo).
@@ -193,6 +252,7 @@ class METADemuxer final : public AbstractDemuxer
 
     int getLastReadRez() override { return m_lastReadRez; }
     [[nodiscard]] int64_t totalSize() const { return m_totalSize; }
+    void setReportProgress(const bool value) { m_reportProgress = value; }
     static std::string mplsTrackToFullName(const std::string& mplsFileName, const std::string& mplsNum);
     static std::string mplsTrackToSSIFName(const std::string& mplsFileName, const std::string& mplsNum);
     bool m_HevcFound;
@@ -204,6 +264,7 @@ class METADemuxer final : public AbstractDemuxer
     int m_lastProgressY;
     std::chrono::steady_clock::time_point m_lastReportTime;
     int64_t m_totalSize;
+    bool m_reportProgress;
     bool m_flushDataMode;
     const BufferedReaderManager& m_readManager;
     std::string m_streamName;
@@ -213,18 +274,21 @@ class METADemuxer final : public AbstractDemuxer
     // MPLSPlayItemsMap m_mplsStreamMap;
     MPLSCache m_mplsStreamMap;
     std::set<std::string> m_processedTracks;
+    std::vector<std::string> m_fontDirs;
+    V3State* m_v3State;
+    const METADemuxer* m_source = nullptr;  // demuxer this one mirrors, see createMirror()
+    MirrorReader m_mirrorReader;            // data reader of all tracks of a mirror
 
     friend class ContainerToReaderWrapper;
 
-    static AbstractStreamReader* createCodec(const std::string& codecName,
-                                             const std::map<std::string, std::string>& addParams,
-                                             const std::string& codecStreamName,
-                                             const std::vector<MPLSPlayItem>& mplsInfo);
+    AbstractStreamReader* createCodec(const std::string& codecName, const std::map<std::string, std::string>& addParams,
+                                      const std::string& codecStreamName,
+                                      const std::vector<MPLSPlayItem>& mplsInfo) const;
     inline void updateReport(bool checkTime);
     void lineBack();
     static CheckStreamRez detectTrackReader(uint8_t* tmpBuffer, int len,
                                             AbstractStreamReader::ContainerType containerType, int containerDataType,
-                                            int containerStreamIndex);
+                                            int containerStreamIndex, V3State& v3State);
     static std::string findBluRayFile(const std::string& streamDir, const std::string& requestDir,
                                       const std::string& requestFile);
     std::vector<MPLSParser> getMplsInfo(const std::string& mplsFileName);
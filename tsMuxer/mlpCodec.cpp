@@ -98,7 +98,7 @@ bool MLPCodec::decodeFrame(uint8_t* buffer, uint8_t* end)
         return false;
     BitStreamReader reader{};
     reader.setBuffer(buffer + 4, end);
-    if (reader.getBits(24) != HD_SYNC_WORD) /* Sync words */
+    if (reader.getBits<24>() != HD_SYNC_WORD) /* Sync words */
         return isMinorSync(buffer, end);
 
     uint8_t ratebits;
@@ -107,14 +107,14 @@ bool MLPCodec::decodeFrame(uint8_t* buffer, uint8_t* end)
     if (stream_type == 0xbb)  // MLP
     {
         m_subType = MlpSubType::stMLP;
-        reader.skipBits(8);  // group1_bits, group2_bits
+        reader.skipBits<8>();  // group1_bits, group2_bits
         ratebits = reader.getBits<uint8_t>(4);
         m_samplerate = mlp_samplerate(ratebits);
         if (m_samplerate == 0)
             return false;
-        reader.skipBits(4);  // group2_samplerate
-        reader.skipBits(11);
-        m_channels = mlp_channels[reader.getBits(5)];
+        reader.skipBits<4>();  // group2_samplerate
+        reader.skipBits<11>();
+        m_channels = mlp_channels[reader.getBits<5>()];
     }
     else if (stream_type == 0xba)  // True-HD
     {
@@ -123,11 +123,11 @@ bool MLPCodec::decodeFrame(uint8_t* buffer, uint8_t* end)
         m_samplerate = mlp_samplerate(ratebits);
         if (m_samplerate == 0)
             return false;
-        if (reader.getBits(2) > 0)  // 6/8ch_multichannel_type: 0 = standard loudspeaker layout
+        if (reader.getBits<2>() > 0)  // 6/8ch_multichannel_type: 0 = standard loudspeaker layout
             return false;
-        reader.skipBits(6);  // reserved, 2ch_presentation_channel_modifier, 6ch_presentation_channel_modifier
+        reader.skipBits<6>();  // reserved, 2ch_presentation_channel_modifier, 6ch_presentation_channel_modifier
         const auto channel_assign_6 = reader.getBits<uint8_t>(5);    // 6ch_presentation_channel_assignment
-        reader.skipBits(2);                                          // 8ch_presentation_channel_modifier
+        reader.skipBits<2>();                                        // 8ch_presentation_channel_modifier
         const auto channel_assign_8 = reader.getBits<uint16_t>(13);  // 8ch_presentation_channel_assignment
 
         if (channel_assign_8 > 0)
@@ -147,10 +147,10 @@ bool MLPCodec::decodeFrame(uint8_t* buffer, uint8_t* end)
         return false;
 
     m_samples = 40 << (ratebits & 7);
-    if (reader.getBits(16) != 0xB752)  // signature
+    if (reader.getBits<16>() != 0xB752)  // signature
         return false;
-    reader.skipBits(32);  // flags, reserved
-    reader.skipBit();     // is_vbr
+    reader.skipBits<32>();  // flags, reserved
+    reader.skipBit();       // is_vbr
     m_bitrate =
         (reader.getBits<uint16_t>(15) /* peak_data_rate */ * m_samplerate + 8) >> 4;  // + 8 is for rounding to nearest
     m_substreams = reader.getBits<uint8_t>(4);
@@ -2,7 +2,9 @@
 #include "mpegStreamReader.h"
 
 #include <fs/systemlog.h>
+#include <system/workerpool.h>
 
+#include <algorithm>
 #include <cmath>
 #include <cstring>
 #include <iostream>
@@ -14,6 +16,10 @@
 static constexpr double EPSILON = 5e-5;
 static constexpr int64_t MAX_PULLDOWN_ASYNC = 100000000ll;
 static constexpr int UNIT_SKIPPED = 5;
+// minimal amount of new data per start code scan task
+static constexpr uint32_t NAL_INDEX_CHUNK_SIZE = 512 * 1024;
+// bytes around an index update that are scanned again to check the index
+static constexpr uint32_t NAL_INDEX_CHECK_MARGIN = 4096;
 
 using namespace std;
 
@@ -26,6 +32,8 @@ void MPEGStreamReader::setBuffer(uint8_t* data, const uint32_t dataLen, const bo
         THROW(ERR_COMMON_SMALL_BUFFER,
               "Not enough buffer for parse video stream. Current frame num " << m_totalFrameNum)
     memcpy(m_tmpBuffer + m_tmpBufferLen, data + MAX_AV_PACKET_SIZE, dataLen);
+    if (m_nalIndexEnabled)
+        indexBuffer(static_cast<uint32_t>(m_tmpBufferLen), static_cast<uint32_t>(m_tmpBufferLen + dataLen));
     m_tmpBufferLen += dataLen;
 
     m_curPos = m_buffer = m_tmpBuffer;
@@ -81,11 +89,132 @@ int MPEGStreamReader::flushPacket(AVPacket& avPacket)
 
 void MPEGStreamReader::onShiftBuffer(int offset) {}
 
+void MPEGStreamReader::indexBuffer(const uint32_t from, const uint32_t to)
+{
+    m_nalIndex.erase(std::lower_bound(m_nalIndex.begin(), m_nalIndex.end(), from), m_nalIndex.end());
+    // the zero bytes of a start code may belong to the previous data
+    uint8_t* scanStart = m_tmpBuffer + (from > 2 ? from - 2 : 0);
+    uint8_t* scanEnd = m_tmpBuffer + to;
+
+    WorkerPool& pool = WorkerPool::instance();
+    const size_t chunks = (std::min)(static_cast<size_t>(pool.concurrency()),
+                                     static_cast<size_t>(scanEnd - scanStart) / NAL_INDEX_CHUNK_SIZE);
+    if (chunks < 2)
+    {
+        NALUnit::findStartCodes(scanStart, scanEnd, m_tmpBuffer, m_nalIndex);
+    }
+    else
+    {
+        const size_t chunkSize = (scanEnd - scanStart) / chunks;
+        m_nalIndexParts.resize(chunks);
+        pool.parallelFor(chunks, [&](const size_t i) {
+            // a chunk owns the start codes beginning in it, they may end in the next one
+            const uint8_t* chunkStart = scanStart + i * chunkSize;
+            const uint8_t* chunkEnd = i + 1 == chunks ? scanEnd : chunkStart + chunkSize + 2;
+            m_nalIndexParts[i].clear();
+            NALUnit::findStartCodes(chunkStart, chunkEnd, m_tmpBuffer, m_nalIndexParts[i]);
+        });
+        for (const auto& part : m_nalIndexParts) m_nalIndex.insert(m_nalIndex.end(), part.begin(), part.end());
+    }
+    m_nalIndexEnd = to;
+}
+
+void MPEGStreamReader::updateNalIndex(const uint8_t* begin, const uint8_t* end, const int sizeDiff)
+{
+    if (!m_nalIndexEnabled || begin < m_tmpBuffer || end > m_tmpBuffer + m_nalIndexEnd)
+        return;
+    const auto from = static_cast<uint32_t>(begin - m_tmpBuffer);
+    const auto to = static_cast<uint32_t>(end - m_tmpBuffer);
+    // start codes that end inside the changed bytes or in the two bytes after them are rescanned
+    const auto first = std::lower_bound(m_nalIndex.begin(), m_nalIndex.end(), from);
+    const auto last = std::lower_bound(first, m_nalIndex.end(), to + 2);
+    for (auto it = last; it != m_nalIndex.end(); ++it) *it += sizeDiff;
+    m_nalIndexEnd += sizeDiff;
+
+    std::vector<uint32_t> rescanned;
+    NALUnit::findStartCodes(m_tmpBuffer + (from > 2 ? from - 2 : 0),
+                            m_tmpBuffer + (std::min)(static_cast<uint32_t>(to + sizeDiff + 2), m_nalIndexEnd),
+                            m_tmpBuffer, rescanned);
+    m_nalIndex.insert(m_nalIndex.erase(first, last), rescanned.begin(), rescanned.end());
+    if (!nalIndexMatches(from > NAL_INDEX_CHECK_MARGIN ? from - NAL_INDEX_CHECK_MARGIN : 0,
+                         (std::min)(static_cast<uint32_t>(to + sizeDiff + NAL_INDEX_CHECK_MARGIN), m_nalIndexEnd)))
+    {
+        LTRACE(LT_DEBUG, 0, "NAL index does not match the buffer after an in-place change, rebuilding it");
+        indexBuffer(0, m_nalIndexEnd);
+    }
+}
+
+bool MPEGStreamReader::nalIndexMatches(const uint32_t from, const uint32_t to) const
+{
+    if (!std::is_sorted(m_nalIndex.begin(), m_nalIndex.end()) ||
+        (!m_nalIndex.empty() && m_nalIndex.back() >= m_nalIndexEnd))
+        return false;
+    std::vector<uint32_t> scanned;
+    NALUnit::findStartCodes(m_tmpBuffer + from, m_tmpBuffer + to, m_tmpBuffer, scanned);
+    // a scan of [from, to) finds the start codes whose 0x01 byte is in [from + 2, to)
+    const auto first = std::lower_bound(m_nalIndex.begin(), m_nalIndex.end(), from + 2);
+    const auto last = std::lower_bound(first, m_nalIndex.end(), to);
+    return std::equal(first, last, scanned.begin(), scanned.end());
+}
+
+void MPEGStreamReader::replaceNal(uint8_t* nal, uint8_t* nalEnd, const uint8_t* data, const int dataLen)
+{
+    const int sizeDiff = dataLen - static_cast<int>(nalEnd - nal);
+    if (sizeDiff != 0)
+    {
+        if (m_bufEnd + sizeDiff > m_tmpBuffer + TMP_BUFFER_SIZE)
+            THROW(ERR_COMMON, "Not enough buffer")
+        memmove(nalEnd + sizeDiff, nalEnd, m_bufEnd - nalEnd);
+        m_bufEnd += sizeDiff;
+    }
+    memcpy(nal, data, dataLen);
+    updateNalIndex(nal, nalEnd, sizeDiff);
+}
+
+uint8_t* MPEGStreamReader::findIndexedStartCode(uint8_t* buffer, uint8_t* end) const
+{
+    const auto it =
+        std::lower_bound(m_nalIndex.begin(), m_nalIndex.end(), static_cast<uint32_t>(buffer - m_tmpBuffer));
+    return it != m_nalIndex.end() && m_tmpBuffer + *it < end ? m_tmpBuffer + *it : end;
+}
+
+uint8_t* MPEGStreamReader::findNextNAL(uint8_t* buffer, uint8_t* end) const
+{
+    if (buffer < m_tmpBuffer || end > m_tmpBuffer + m_nalIndexEnd)
+        return NALUnit::findNextNAL(buffer, end);
+    if (end - buffer < 3)
+        return end;
+    uint8_t* code = findIndexedStartCode(buffer + 2, end);
+    return code != end ? code + 1 : end;
+}
+
+uint8_t* MPEGStreamReader::findNALWithStartCode(uint8_t* buffer, uint8_t* end, const bool longCodesAllowed) const
+{
+    if (buffer < m_tmpBuffer || end > m_tmpBuffer + m_nalIndexEnd)
+        return NALUnit::findNALWithStartCode(buffer, end, longCodesAllowed);
+    if (end - buffer < 3)
+        return end;
+    uint8_t* code = findIndexedStartCode(buffer + 2, end);
+    if (code == end)
+        return end;
+    if (longCodesAllowed && code - 3 >= buffer && code[-3] == 0)
+        return code - 3;
+    return code - 2;
+}
+
 void MPEGStreamReader::storeBufferRest()
 {
     onShiftBuffer(static_cast<int>(m_curPos - m_tmpBuffer));
     memmove(m_tmpBuffer, m_curPos, m_bufEnd - m_curPos);
     m_tmpBufferLen = static_cast<int>(m_bufEnd - m_curPos);
+    if (m_nalIndexEnabled)
+    {
+        // a start code stays valid only if its leading zero bytes are kept as well
+        const auto offset = static_cast<uint32_t>(m_curPos - m_tmpBuffer);
+        m_nalIndex.erase(m_nalIndex.begin(), std::lower_bound(m_nalIndex.begin(), m_nalIndex.end(), offset + 2));
+        for (auto& pos : m_nalIndex) pos -= offset;
+        m_nalIndexEnd = static_cast<uint32_t>(m_tmpBufferLen);
+    }
     if (m_lastDecodedPos > m_curPos)
         m_lastDecodedPos = m_tmpBuffer + (m_lastDecodedPos - m_curPos);
     else
@@ -109,7 +238,7 @@ int MPEGStreamReader::readPacket(AVPacket& avPacket)
     const uint8_t* prevPos = m_curPos;
     if (!m_syncToStream)
     {
-        uint8_t* nal = NALUnit::findNALWithStartCode(m_curPos, m_bufEnd, m_longCodesAllowed);
+        uint8_t* nal = findNALWithStartCode(m_curPos, m_bufEnd, m_longCodesAllowed);
         if (nal != m_bufEnd)
         {
             m_syncToStream = true;
@@ -125,7 +254,7 @@ int MPEGStreamReader::readPacket(AVPacket& avPacket)
     }
 
     const uint8_t* nextNal =
-        NALUnit::findNALWithStartCode((std::min)(m_curPos + 3, m_bufEnd), m_bufEnd, m_longCodesAllowed);
+        findNALWithStartCode((std::min)(m_curPos + 3, m_bufEnd), m_bufEnd, m_longCodesAllowed);
     if (nextNal == m_bufEnd)
     {
         storeBufferRest();
@@ -143,7 +272,7 @@ int MPEGStreamReader::readPacket(AVPacket& avPacket)
             rez = decodeNal(m_curPos + isNal);
             if (rez != UNIT_SKIPPED)
                 break;
-            uint8_t* nal = NALUnit::findNALWithStartCode(m_curPos + isNal, m_bufEnd, m_longCodesAllowed);
+            uint8_t* nal = findNALWithStartCode(m_curPos + isNal, m_bufEnd, m_longCodesAllowed);
             // assert(nal < findEnd); // if unit is skipped, next unit MUST be in buffer
 
             m_processedBytes += nal - m_curPos;
@@ -180,7 +309,7 @@ int MPEGStreamReader::readPacket(AVPacket& avPacket)
         }
     }
     uint8_t* findEnd = (std::min)(m_bufEnd, m_curPos + MAX_AV_PACKET_SIZE);
-    uint8_t* nal = NALUnit::findNALWithStartCode(m_curPos + isNal, findEnd, m_longCodesAllowed);
+    uint8_t* nal = findNALWithStartCode(m_curPos + isNal, findEnd, m_longCodesAllowed);
 
     if (nal == findEnd)
     {
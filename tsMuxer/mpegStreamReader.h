@@ -1,6 +1,8 @@
 #ifndef MPEG_STREAM_READER_H_
 #define MPEG_STREAM_READER_H_
 
+#include <vector>
+
 #include "abstractStreamReader.h"
 #include "limits.h"
 #include "streamDiscoveryData.h"
@@ -32,6 +34,8 @@ class MPEGStreamReader : public AbstractStreamReader
         m_testPulldownDts = 0;
         m_streamAR = m_ar = VideoAspectRatio::AR_KEEP_DEFAULT;
         m_spsPpsFound = false;
+        m_nalIndexEnabled = false;
+        m_nalIndexEnd = 0;
     }
     ~MPEGStreamReader() override { delete[] m_tmpBuffer; }
     void setFPS(const double fps)
@@ -98,6 +102,19 @@ class MPEGStreamReader : public AbstractStreamReader
     uint8_t* m_tmpBuffer;
     bool m_spsPpsFound;
 
+    // Same results as the NALUnit functions. Inside m_tmpBuffer the start codes are taken from m_nalIndex instead
+    // of scanning the data again for every NAL unit and every retry of a partially buffered access unit.
+    uint8_t* findNextNAL(uint8_t* buffer, uint8_t* end) const;
+    uint8_t* findNALWithStartCode(uint8_t* buffer, uint8_t* end, bool longCodesAllowed) const;
+    // replaces NAL unit [nal, nalEnd) in m_tmpBuffer by dataLen bytes, moving the rest of the buffer if the size changes
+    void replaceNal(uint8_t* nal, uint8_t* nalEnd, const uint8_t* data, int dataLen);
+    // must be called after bytes [begin, end) of m_tmpBuffer are rewritten in place and the data after them is moved
+    // by sizeDiff. The index is rescanned around the change and rebuilt if it still differs from the data there.
+    void updateNalIndex(const uint8_t* begin, const uint8_t* end, int sizeDiff);
+    // Set by codecs whose start codes may be indexed: every in-place change of the buffered data goes through
+    // replaceNal() or updateNalIndex().
+    bool m_nalIndexEnabled;
+
    private:
     int64_t m_pulldownWarnCnt;
     long m_lastDecodeOffset;
@@ -106,6 +123,16 @@ class MPEGStreamReader : public AbstractStreamReader
     [[nodiscard]] int bufFromNAL() const;
     virtual int decodeNal(uint8_t* buff);
     void storeBufferRest();
+
+    // Offsets in m_tmpBuffer of the 0x01 byte of every start code, in ascending order, valid up to m_nalIndexEnd.
+    // New data is scanned by setBuffer() on the worker pool.
+    std::vector<uint32_t> m_nalIndex;
+    std::vector<std::vector<uint32_t>> m_nalIndexParts;
+    uint32_t m_nalIndexEnd;
+    void indexBuffer(uint32_t from, uint32_t to);
+    // true if the index is ordered and equal to a fresh scan of bytes [from, to) of m_tmpBuffer
+    [[nodiscard]] bool nalIndexMatches(uint32_t from, uint32_t to) const;
+    [[nodiscard]] uint8_t* findIndexedStartCode(uint8_t* buffer, uint8_t* end) const;
 };
 
 #endif
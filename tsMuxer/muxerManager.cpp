@@ -1,7 +1,9 @@
 #include "muxerManager.h"
 
+#include <algorithm>
 #include <cmath>
 
+#include <fs/directory.h>
 #include <fs/systemlog.h>
 #include "fs/textfile.h"
 
@@ -9,11 +11,14 @@
 #include "iso_writer.h"
 #include "tsMuxer.h"
 #include "vodCoreException.h"
+#include "vod_common.h"
 
 using namespace std;
 
 // static const int SSIF_INTERLEAVE_BLOCKSIZE = 1024 * 1024 * 7;
 static constexpr int MAX_FRAME_SIZE = 1200000;  // 1.2m
+// memory for the ssif interleave blocks waiting for the sub muxer. A few main blocks in normal streams.
+static constexpr int64_t MAX_DELAYED_MEM_SIZE = 4ll * MAIN_INTERLEAVE_BLOCKSIZE;
 
 namespace
 {
@@ -37,10 +42,50 @@ int seekDefaultTrack(const std::vector<StreamInfo>& tracks, std::string& param,
     }
     return -1;
 }
+
+// Whether an output can mux the packets of the stream readers set up by an output of the same muxer type
+bool canShareReaders(AbstractMuxer* muxer, AbstractMuxer* other)
+{
+    const auto tsMuxer = dynamic_cast<TSMuxer*>(muxer);
+    const auto otherTsMuxer = dynamic_cast<TSMuxer*>(other);
+    return !tsMuxer || !otherTsMuxer || tsMuxer->canShareReaders(*otherTsMuxer);
+}
+
+// The first muxer of a group sets up the stream readers, the others take its stream descriptors and the results of
+// the reader hooks
+std::unique_ptr<PESHeaderCache> shareReaders(const std::vector<AbstractMuxer*>& muxers)
+{
+    if (muxers.size() < 2)
+        return nullptr;
+    auto cache = std::make_unique<PESHeaderCache>();
+    const auto primary = dynamic_cast<TSMuxer*>(muxers.front());
+    for (AbstractMuxer* muxer : muxers)
+    {
+        const auto tsMuxer = dynamic_cast<TSMuxer*>(muxer);
+        if (!tsMuxer)
+            continue;
+        tsMuxer->setPESHeaderCache(cache.get());
+        if (tsMuxer != primary)
+            tsMuxer->setPrimaryMuxer(primary);
+    }
+    return cache;
+}
+
+// The reader hooks called while muxing may alter the packet, so every output gets its own copy
+void muxGroupPacket(const std::vector<AbstractMuxer*>& muxers, PESHeaderCache* cache, const AVPacket& avPacket)
+{
+    if (cache)
+        cache->packetNum++;
+    for (AbstractMuxer* muxer : muxers)
+    {
+        AVPacket outPacket = avPacket;
+        muxer->muxPacket(outPacket);
+    }
+}
 }  // namespace
 
 MuxerManager::MuxerManager(const BufferedReaderManager& readManager, AbstractMuxerFactory& factory)
-    : m_metaDemuxer(readManager), m_factory(factory)
+    : m_metaDemuxer(readManager, m_v3State), m_factory(factory)
 {
     m_asyncMode = true;
     m_cutStart = 0;
@@ -56,11 +101,17 @@ MuxerManager::MuxerManager(const BufferedReaderManager& readManager, AbstractMux
     m_demuxMode = false;
 }
 
-MuxerManager::~MuxerManager() = default;
+MuxerManager::~MuxerManager() { closeSpillFile(); }
+
+void MuxerManager::addOutput(AbstractMuxerFactory& factory, const std::string& fileName)
+{
+    m_extraOutputs.push_back({&factory, fileName, nullptr});
+}
 
 void MuxerManager::preinitMux(const std::string& outFileName, FileFactory* fileFactory)
 {
     vector<StreamInfo>& ci = m_metaDemuxer.getCodecInfo();
+    const string& mainMuxOpts = m_extraOutputs.empty() || m_muxOptLines.empty() ? m_muxOpts : m_muxOptLines.front();
     bool mvcTrackFirst = false;
     bool firstH264Track = true;
     for (const StreamInfo& si : ci)
@@ -95,7 +146,7 @@ void MuxerManager::preinitMux(const std::string& outFileName, FileFactory* fileF
                 const auto tsMuxer = dynamic_cast<TSMuxer*>(m_mainMuxer.get());
                 if (tsMuxer)
                     tsMuxer->setPtsOffset(m_ptsOffset);
-                m_mainMuxer->parseMuxOpt(m_muxOpts);
+                m_mainMuxer->parseMuxOpt(mainMuxOpts);
             }
         }
     }
@@ -130,6 +181,46 @@ void MuxerManager::preinitMux(const std::string& outFileName, FileFactory* fileF
         m_mainMuxer->setMasterMode(m_subMuxer.get(), !mvcTrackFirst);
     }
 
+    for (size_t i = 0; i < m_extraOutputs.size(); ++i)
+    {
+        ExtraOutput& output = m_extraOutputs[i];
+        output.muxer = output.factory->newInstance(this);
+        const auto tsMuxer = dynamic_cast<TSMuxer*>(output.muxer.get());
+        if (tsMuxer)
+            tsMuxer->setPtsOffset(m_ptsOffset);
+        output.muxer->parseMuxOpt(i + 1 < m_muxOptLines.size() ? m_muxOptLines[i + 1] : "");
+        // a split notifies the shared readers, which the outputs would do at different packets
+        if (tsMuxer && tsMuxer->isSplitMode())
+            THROW(ERR_COMMON, "--split-duration and --split-size are not supported with several outputs")
+        output.muxer->setFileName(output.fileName, nullptr);
+
+        if (output.factory == &m_factory && canShareReaders(output.muxer.get(), m_mainMuxer.get()))
+        {
+            m_sharedOutputs.push_back(output.muxer.get());
+            continue;
+        }
+        auto group = std::find_if(m_mirrorGroups.begin(), m_mirrorGroups.end(), [&](const MirrorGroup& g) {
+            return g.factory == output.factory && canShareReaders(output.muxer.get(), g.muxers.front());
+        });
+        if (group == m_mirrorGroups.end())
+        {
+            // the mirror has to be linked before the main readers return their first blocks
+            m_mirrorGroups.push_back({output.factory, m_metaDemuxer.createMirror(), {}, nullptr});
+            group = std::prev(m_mirrorGroups.end());
+        }
+        group->muxers.push_back(output.muxer.get());
+    }
+    if (!m_extraOutputs.empty())
+    {
+        const auto tsMuxer = dynamic_cast<TSMuxer*>(m_mainMuxer.get());
+        if (tsMuxer && tsMuxer->isSplitMode())
+            THROW(ERR_COMMON, "--split-duration and --split-size are not supported with several outputs")
+        vector<AbstractMuxer*> muxers{m_mainMuxer.get()};
+        muxers.insert(muxers.end(), m_sharedOutputs.begin(), m_sharedOutputs.end());
+        m_pesHeaderCache = shareReaders(muxers);
+        for (MirrorGroup& group : m_mirrorGroups) group.pesHeaderCache = shareReaders(group.muxers);
+    }
+
     for (size_t i = 0; i < ci.size(); ++i)
     {
         StreamInfo& si = ci[i];
@@ -155,12 +246,34 @@ void MuxerManager::preinitMux(const std::string& outFileName, FileFactory* fileF
             m_mainMuxer->intAddStream(si.m_fullStreamName, si.m_codec, si.m_streamReader->getStreamIndex(),
                                       si.m_addParams, si.m_streamReader);
         }
+        for (AbstractMuxer* muxer : m_sharedOutputs)
+            muxer->intAddStream(si.m_fullStreamName, si.m_codec, si.m_streamReader->getStreamIndex(), si.m_addParams,
+                                si.m_streamReader);
+    }
+
+    for (MirrorGroup& group : m_mirrorGroups)
+    {
+        vector<StreamInfo>& mirrorInfo = group.demuxer->getCodecInfo();
+        for (size_t i = 0; i < mirrorInfo.size(); ++i)
+        {
+            StreamInfo& si = mirrorInfo[i];
+            const auto h264Reader = dynamic_cast<H264StreamReader*>(si.m_streamReader);
+            if (h264Reader)
+                h264Reader->setStartPTS(m_ptsOffset);
+            si.read();
+            if (i < m_discoveryData.size() && m_discoveryData[i].discovered)
+                si.m_streamReader->applyDiscoveryData(m_discoveryData[i]);
+            for (AbstractMuxer* muxer : group.muxers)
+                muxer->intAddStream(si.m_fullStreamName, si.m_codec, si.m_streamReader->getStreamIndex(),
+                                    si.m_addParams, si.m_streamReader);
+        }
     }
 
     checkTrackList(ci);
 
     if (m_mainMuxer)
         m_mainMuxer->openDstFile();
+    for (const ExtraOutput& output : m_extraOutputs) output.muxer->openDstFile();
     if (m_subMuxer)
     {
         if (!m_interleave || (fileFactory && fileFactory->isVirtualFS()))
@@ -170,6 +283,28 @@ void MuxerManager::preinitMux(const std::string& outFileName, FileFactory* fileF
     }
 }
 
+// Muxes the packets the mirror demuxers can parse from the blocks read so far. Returns true once all of them are done.
+bool MuxerManager::muxMirrorPackets()
+{
+    bool finished = true;
+    for (MirrorGroup& group : m_mirrorGroups)
+    {
+        AVPacket avPacket;
+        while (!group.finished)
+        {
+            const int avRez = group.demuxer->readPacket(avPacket);
+            if (avRez == BufferedReader::DATA_NOT_READY)
+                break;
+            if (avRez == BufferedReader::DATA_EOF || (m_cutEnd > 0 && avPacket.pts >= m_cutEnd))
+                group.finished = true;
+            else if (m_cutStart == 0 || avPacket.pts >= m_cutStart)
+                muxGroupPacket(group.muxers, group.pesHeaderCache.get(), avPacket);
+        }
+        finished = finished && group.finished;
+    }
+    return finished;
+}
+
 void MuxerManager::checkTrackList(const vector<StreamInfo>& ci) const
 {
     if (m_demuxMode)
@@ -206,7 +341,7 @@ void MuxerManager::checkTrackList(const vector<StreamInfo>& ci) const
         else if (m_bluRayMode && mlpFound && !mlpMergedWithAc3)
             LTRACE(LT_ERROR, 2,
                    "Warning! MLP codec is not standard for BD disks, the disk will not play in a Blu-ray player.");
-        else if (m_bluRayMode && (V3_flags & DV) && !(V3_flags & BL_TRACK))
+        else if (m_bluRayMode && (m_v3State.flags & DV) && !(m_v3State.flags & BL_TRACK))
             LTRACE(LT_ERROR, 2,
                    "Warning! Dolby Vision Double Layer Single Tracks are not standard for BD disks, the disk will "
                    "not play in a Blu-ray player.");
@@ -226,44 +361,75 @@ void MuxerManager::doMux(const string& outFileName, FileFactory* fileFactory)
 
     preinitMux(outFileName, fileFactory);
 
-    m_fileWriter = std::make_unique<BufferedFileWriter>();
+    if (!m_fileWriter)
+    {
+        m_ownFileWriter = std::make_unique<BufferedFileWriter>();
+        m_fileWriter = m_ownFileWriter.get();
+    }
     AVPacket avPacket;
+    bool mainFinished = false;
 
     while (true)
     {
         const int avRez = m_metaDemuxer.readPacket(avPacket);
+        // the mirrors parse the blocks the main demuxer has just read
+        const bool mirrorsFinished = muxMirrorPackets();
 
         if (avRez == BufferedReader::DATA_EOF)
             break;
+        if (mainFinished)
+        {
+            if (mirrorsFinished)
+                break;
+            continue;
+        }
         if (m_cutStart > 0)
         {
             if (avPacket.pts < m_cutStart)
                 continue;
         }
         if (m_cutEnd > 0 && avPacket.pts >= m_cutEnd)
-            break;
+        {
+            // the mirrors may lag behind, keep reading for them
+            mainFinished = true;
+            if (mirrorsFinished)
+                break;
+            continue;
+        }
+
+        muxGroupPacket(m_sharedOutputs, m_pesHeaderCache.get(), avPacket);
 
         if (m_subStreamIndex.find(avPacket.stream_index) != m_subStreamIndex.end())
             m_subMuxer->muxPacket(avPacket);
         else
             m_mainMuxer->muxPacket(avPacket);
     }
+    // every block of the source files is queued for the mirrors once the main demuxer is at the end
+    if (!muxMirrorPackets())
+        THROW(ERR_COMMON, "The mirrored outputs didn't get all the data of the source files")
 
     LTRACE(LT_INFO, 2, "Flushing write buffer");
 
     if (m_subMuxer)
         m_subMuxer->doFlush();
     m_mainMuxer->doFlush();
+    for (const ExtraOutput& output : m_extraOutputs) output.muxer->doFlush();
 
-    for (auto& i : m_delayedData) asyncWriteBlock(i);
+    writeDelayedData();
 
     waitForWriting();
+    closeSpillFile();
 
     m_mainMuxer->close();
     if (m_subMuxer)
         m_subMuxer->close();
+    for (const ExtraOutput& output : m_extraOutputs) output.muxer->close();
 
-    m_fileWriter.reset();
+    if (m_ownFileWriter)
+    {
+        m_fileWriter = nullptr;
+        m_ownFileWriter.reset();
+    }
 }
 
 int MuxerManager::addStream(const string& codecName, const string& fileName, const map<string, string>& addParams)
@@ -282,6 +448,7 @@ bool MuxerManager::openMetaFile(const string& fileName)
         if (strStartWith(str, "MUXOPT"))
         {
             m_muxOpts = str;
+            m_muxOptLines.push_back(str);
             parseMuxOpt(m_muxOpts);
             m_mvcBaseViewR = m_muxOpts.find("right-eye") != string::npos;
         }
@@ -302,9 +469,7 @@ void MuxerManager::muxBlockFinished(const AbstractMuxer* muxer)
 
     if (m_subBlockFinished && m_mainBlockFinished)
     {
-        for (auto& i : m_delayedData) asyncWriteBlock(i);
-
-        m_delayedData.clear();
+        writeDelayedData();
         m_subBlockFinished = false;
         m_mainBlockFinished = false;
     }
@@ -322,13 +487,69 @@ void MuxerManager::asyncWriteBuffer(const AbstractMuxer* muxer, uint8_t* buff, c
     if (m_interleave && muxer == m_mainMuxer.get())
     {
         // do interleave of SSIF blocks. Place sub channel blocks first, delay main muxer blocks
-        m_delayedData.push_back(data);
+        delayBlock(data);
         return;
     }
 
     asyncWriteBlock(data);
 }
 
+void MuxerManager::delayBlock(const WriterData& data)
+{
+    if (m_delayedMemSize + data.m_bufferLen <= MAX_DELAYED_MEM_SIZE)
+    {
+        m_delayedMemSize += data.m_bufferLen;
+        m_delayedData.push_back({data, -1});
+        return;
+    }
+
+    if (!m_spillFile.isOpen())
+    {
+        if (!createTempFile(m_spillFile, "tsmuxer_ssif_", File::ofRead | File::ofWrite, m_spillFileName))
+            THROW(ERR_COMMON, "Can't create a temporary file for the SSIF interleave buffer")
+    }
+    m_spillFile.seek(m_spillSize);
+    const bool written = m_spillFile.write(data.m_buffer, data.m_bufferLen) == data.m_bufferLen;
+    delete[] data.m_buffer;
+    if (!written)
+        THROW(ERR_COMMON, "Can't write to temporary file " << m_spillFileName)
+
+    WriterData spilled = data;
+    spilled.m_buffer = nullptr;
+    m_delayedData.push_back({spilled, m_spillSize});
+    m_spillSize += data.m_bufferLen;
+}
+
+void MuxerManager::writeDelayedData()
+{
+    for (DelayedBlock& block : m_delayedData)
+    {
+        if (block.spillPos >= 0)
+        {
+            block.data.m_buffer = new uint8_t[block.data.m_bufferLen];
+            m_spillFile.seek(block.spillPos);
+            if (m_spillFile.read(block.data.m_buffer, block.data.m_bufferLen) != block.data.m_bufferLen)
+            {
+                delete[] block.data.m_buffer;
+                THROW(ERR_COMMON, "Can't read from temporary file " << m_spillFileName)
+            }
+        }
+        asyncWriteBlock(block.data);
+    }
+    m_delayedData.clear();
+    m_delayedMemSize = 0;
+    m_spillSize = 0;
+}
+
+void MuxerManager::closeSpillFile()
+{
+    if (m_spillFileName.empty())
+        return;
+    m_spillFile.close();
+    deleteFile(m_spillFileName);
+    m_spillFileName.clear();
+}
+
 void MuxerManager::asyncWriteBlock(const WriterData& data) const
 {
     static constexpr int nMaxWriteQueueSize = 256 * 1024 * 1024 / DEFAULT_FILE_BLOCK_SIZE;
@@ -392,6 +613,7 @@ void MuxerManager::parseMuxOpt(const string& opts)
         }
         else if (paramPair[0] == "--split-duration" || paramPair[0] == "--split-size")
         {
+            m_splitMode = true;
             if (m_extraIsoBlocks == 0)
                 m_extraIsoBlocks = 4;
         }
@@ -411,6 +633,15 @@ void MuxerManager::parseMuxOpt(const string& opts)
         {
             m_reproducibleIsoHeader = true;
         }
+        else if (paramPair[0] == "--iso-sequential")
+        {
+            m_sequentialIso = true;
+        }
+        else if (paramPair[0] == "--font-dir" && paramPair.size() > 1)
+        {
+            const string param = trimStr(i);  // the path may contain '='
+            m_metaDemuxer.addFontDir(unquoteStr(param.substr(param.find('=') + 1)));
+        }
     }
 }
 
@@ -9,6 +9,7 @@
 #include "metaDemuxer.h"
 
 class FileFactory;
+struct PESHeaderCache;
 
 class MuxerManager final
 {
@@ -25,10 +26,23 @@ class MuxerManager final
 
     [[nodiscard]] bool isAsyncMode() const { return m_asyncMode; }
 
+    // Queues the output blocks to the given writer thread instead of starting one of its own. The writer must
+    // outlive the muxed files.
+    void setFileWriter(BufferedFileWriter* writer) { m_fileWriter = writer; }
+    void setReportProgress(const bool value) { m_metaDemuxer.setReportProgress(value); }
+
+    // V3/HDR state of the muxed title, shared by its stream readers and muxers
+    [[nodiscard]] V3State& v3State() { return m_v3State; }
+    [[nodiscard]] const V3State& v3State() const { return m_v3State; }
+
     bool openMetaFile(const std::string& fileName);
     int addStream(const std::string& codecName, const std::string& fileName,
                   const std::map<std::string, std::string>& addParams);
 
+    // Adds an output that is muxed from the same read of the source files as the main one. The n-th MUXOPT line of
+    // the meta file applies to the n-th output; outputs without a line of their own use the default options.
+    void addOutput(AbstractMuxerFactory& factory, const std::string& fileName);
+
     void doMux(const std::string& outFileName, FileFactory* fileFactory);
 
     void setCutStart(const int64_t value) { m_cutStart = value; }
@@ -55,8 +69,10 @@ class MuxerManager final
     [[nodiscard]] bool isMvcBaseViewR() const { return m_mvcBaseViewR; }
     [[nodiscard]] int64_t totalSize() const { return m_metaDemuxer.totalSize(); }
     [[nodiscard]] int getExtraISOBlocks() const { return m_extraIsoBlocks; }
+    [[nodiscard]] bool isSplitMode() const { return m_splitMode; }
 
     [[nodiscard]] bool useReproducibleIsoHeader() const { return m_reproducibleIsoHeader; }
+    [[nodiscard]] bool useSequentialIso() const { return m_sequentialIso; }
 
     enum class SubTrackMode
     {
@@ -71,26 +87,66 @@ class MuxerManager final
     void preinitMux(const std::string& outFileName, FileFactory* fileFactory);
     std::unique_ptr<AbstractMuxer> createMuxer();
     void asyncWriteBlock(const WriterData& data) const;
+    void delayBlock(const WriterData& data);
+    void writeDelayedData();
+    void closeSpillFile();
     void checkTrackList(const std::vector<StreamInfo>& ci) const;
+    bool muxMirrorPackets();
+
+    struct ExtraOutput
+    {
+        AbstractMuxerFactory* factory;
+        std::string fileName;
+        std::unique_ptr<AbstractMuxer> muxer;
+    };
+
+    // Outputs that can't share the stream readers of the main output: another muxer type, or TS options that change
+    // the reader setup. A mirror demuxer parses the blocks read for m_metaDemuxer again for them.
+    struct MirrorGroup
+    {
+        AbstractMuxerFactory* factory;
+        std::unique_ptr<METADemuxer> demuxer;
+        std::vector<AbstractMuxer*> muxers;
+        std::unique_ptr<PESHeaderCache> pesHeaderCache;
+        bool finished = false;
+    };
 
     std::unique_ptr<AbstractMuxer> m_mainMuxer;
     std::unique_ptr<AbstractMuxer> m_subMuxer;
+    std::vector<ExtraOutput> m_extraOutputs;
+    std::vector<AbstractMuxer*> m_sharedOutputs;  // extra outputs that mux the packets of m_metaDemuxer
+    std::unique_ptr<PESHeaderCache> m_pesHeaderCache;
+    std::vector<MirrorGroup> m_mirrorGroups;
 
     bool m_asyncMode;
     // int32_t m_fileBlockSize;
     std::string m_outFileName;
     std::condition_variable reinitCond;
+    V3State m_v3State;
     METADemuxer m_metaDemuxer;
     int64_t m_cutStart;
     int64_t m_cutEnd;
-    std::unique_ptr<BufferedFileWriter> m_fileWriter;
+    BufferedFileWriter* m_fileWriter = nullptr;
+    std::unique_ptr<BufferedFileWriter> m_ownFileWriter;
     AbstractMuxerFactory& m_factory;
     bool m_allowStereoMux;
     std::set<int> m_subStreamIndex;
     std::string m_muxOpts;
+    std::vector<std::string> m_muxOptLines;
     bool m_interleave;
 
-    std::vector<WriterData> m_delayedData;  // ssif interlieave
+    // ssif interleave: main muxer blocks held back until the sub muxer block is written. Blocks over the memory
+    // budget are moved to a temporary file and read back when their turn comes.
+    struct DelayedBlock
+    {
+        WriterData data;
+        int64_t spillPos;  // position in m_spillFile, -1 if the block is held in memory
+    };
+    std::vector<DelayedBlock> m_delayedData;
+    int64_t m_delayedMemSize = 0;
+    File m_spillFile;
+    std::string m_spillFileName;
+    int64_t m_spillSize = 0;
     bool m_subBlockFinished;
     bool m_mainBlockFinished;
     bool m_mvcBaseViewR;
@@ -98,7 +154,9 @@ class MuxerManager final
     int m_extraIsoBlocks;
     bool m_bluRayMode;
     bool m_demuxMode;
+    bool m_splitMode = false;
     bool m_reproducibleIsoHeader = false;
+    bool m_sequentialIso = false;
 
     /// Results of the discovery (probe) phase, indexed by stream index.
     std::vector<StreamDiscoveryData> m_discoveryData;
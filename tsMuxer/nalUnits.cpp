@@ -7,6 +7,7 @@
 
 #include "bitStream.h"
 #include "nalUnits.h"
+#include "simd.h"
 #include "vod_common.h"
 
 static constexpr uint8_t BDROM_METADATA_GUID[] = "\x17\xee\x8c\x60\xf8\x4d\x11\xd9\x8c\xd6\x08\x00\x20\x0c\x9a\x66";
@@ -99,35 +100,85 @@ uint8_t* NALUnit::findNALWithStartCode(uint8_t* buffer, uint8_t* end, const bool
     return end;
 }
 
+// Returns the first position k in [buffer, end - 2) where buffer[k] == 0, buffer[k + 1] == 0 and
+// buffer[k + 2] <= 3, i.e. the start of every sequence that either is an emulation prevention byte or requires one.
+// Such runs are rare in real payloads, so the bulk of the data is skipped 16 bytes at a time.
+static const uint8_t* findEmulationCandidate(const uint8_t* buffer, const uint8_t* end)
+{
+    if (end - buffer < 3)
+        return end;
+#if defined(TSMUXER_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i three = _mm_set1_epi8(3);
+    for (; end - buffer >= 18; buffer += 16)
+    {
+        const __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buffer));
+        const __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buffer + 1));
+        const __m128i b2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buffer + 2));
+        const __m128i match = _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(b0, zero), _mm_cmpeq_epi8(b1, zero)),
+                                            _mm_cmpeq_epi8(_mm_min_epu8(b2, three), b2));
+        if (const int mask = _mm_movemask_epi8(match))
+            return buffer + std::countr_zero(static_cast<unsigned>(mask));
+    }
+#elif defined(TSMUXER_NEON)
+    const uint8x16_t three = vdupq_n_u8(3);
+    for (; end - buffer >= 18; buffer += 16)
+    {
+        const uint8x16_t match = vandq_u8(vandq_u8(vceqzq_u8(vld1q_u8(buffer)), vceqzq_u8(vld1q_u8(buffer + 1))),
+                                          vcleq_u8(vld1q_u8(buffer + 2), three));
+        if (vmaxvq_u8(match))
+            break;
+    }
+#endif
+    for (buffer += 2; buffer < end;)
+    {
+        if (*buffer > 3)
+            buffer += 3;
+        else if (buffer[-2] == 0 && buffer[-1] == 0)
+            return buffer - 2;
+        else
+            buffer++;
+    }
+    return end;
+}
+
+void NALUnit::findStartCodes(const uint8_t* buffer, const uint8_t* end, const uint8_t* base,
+                             std::vector<uint32_t>& offsets)
+{
+    // every start code is also an emulation prevention candidate, so the SIMD scan does the bulk of the work
+    while ((buffer = findEmulationCandidate(buffer, end)) != end)
+    {
+        if (buffer[2] == 1)
+            offsets.push_back(static_cast<uint32_t>(buffer + 2 - base));
+        buffer++;
+    }
+}
+
 int NALUnit::encodeNAL(const uint8_t* srcBuffer, const uint8_t* srcEnd, uint8_t* dstBuffer, size_t dstBufferSize)
 {
     const uint8_t* srcStart = srcBuffer;
     const uint8_t* initDstBuffer = dstBuffer;
-    for (srcBuffer += 2; srcBuffer < srcEnd;)
+    while ((srcBuffer = findEmulationCandidate(srcBuffer, srcEnd)) != srcEnd)
     {
-        if (*srcBuffer > 3)
-            srcBuffer += 3;
-        else if (srcBuffer[-2] == 0 && srcBuffer[-1] == 0)
+        srcBuffer += 2;
+        if (dstBufferSize < static_cast<size_t>(srcBuffer - srcStart + 2))
+            return -1;
+        memcpy(dstBuffer, srcStart, srcBuffer - srcStart);
+        dstBuffer += srcBuffer - srcStart;
+        dstBufferSize -= srcBuffer - srcStart + 2;
+        *dstBuffer++ = 3;
+        *dstBuffer++ = *srcBuffer++;
+
+        if (srcBuffer < srcEnd)
         {
-            if (dstBufferSize < static_cast<size_t>(srcBuffer - srcStart + 2))
+            if (dstBufferSize < 1)
                 return -1;
-            memcpy(dstBuffer, srcStart, srcBuffer - srcStart);
-            dstBuffer += srcBuffer - srcStart;
-            dstBufferSize -= srcBuffer - srcStart + 2;
-            *dstBuffer++ = 3;
             *dstBuffer++ = *srcBuffer++;
-
-            if (srcBuffer < srcEnd)
-            {
-                if (dstBufferSize < 1)
-                    return -1;
-                *dstBuffer++ = *srcBuffer++;
-                dstBufferSize--;
-            }
-            srcStart = srcBuffer;
+            dstBufferSize--;
         }
-        else
-            srcBuffer++;
+        srcStart = srcBuffer;
+        // the two bytes just copied may start a new zero run
+        srcBuffer -= 2;
     }
     if (dstBufferSize < static_cast<size_t>(srcEnd - srcStart))
         return -1;
@@ -138,28 +189,11 @@ int NALUnit::encodeNAL(const uint8_t* srcBuffer, const uint8_t* srcEnd, uint8_t*
 
 int NALUnit::decodeNAL(const uint8_t* srcBuffer, const uint8_t* srcEnd, uint8_t* dstBuffer, size_t dstBufferSize)
 {
-    const uint8_t* initDstBuffer = dstBuffer;
-    const uint8_t* srcStart = srcBuffer;
-    for (srcBuffer += 3; srcBuffer < srcEnd;)
-    {
-        if (*srcBuffer > 3)
-            srcBuffer += 4;
-        else if (srcBuffer[-3] == 0 && srcBuffer[-2] == 0 && srcBuffer[-1] == 3)
-        {
-            if (dstBufferSize < static_cast<size_t>(srcBuffer - srcStart))
-                return -1;
-            memcpy(dstBuffer, srcStart, srcBuffer - srcStart - 1);
-            dstBuffer += srcBuffer - srcStart - 1;
-            dstBufferSize -= srcBuffer - srcStart;
-            *dstBuffer++ = *srcBuffer++;
-            srcStart = srcBuffer;
-        }
-        else
-            srcBuffer++;
-    }
-    memcpy(dstBuffer, srcStart, srcEnd - srcStart);
-    dstBuffer += srcEnd - srcStart;
-    return static_cast<int>(dstBuffer - initDstBuffer);
+    bool keepSrcBuffer;
+    const int rez = decodeNAL2(srcBuffer, srcEnd, dstBuffer, dstBufferSize, &keepSrcBuffer);
+    if (rez > 0 && keepSrcBuffer)
+        memcpy(dstBuffer, srcBuffer, rez);
+    return rez;
 }
 
 int NALUnit::decodeNAL2(const uint8_t* srcBuffer, const uint8_t* srcEnd, uint8_t* dstBuffer, size_t dstBufferSize,
@@ -168,23 +202,22 @@ int NALUnit::decodeNAL2(const uint8_t* srcBuffer, const uint8_t* srcEnd, uint8_t
     const uint8_t* initDstBuffer = dstBuffer;
     const uint8_t* srcStart = srcBuffer;
     *keepSrcBuffer = true;
-    for (srcBuffer += 3; srcBuffer < srcEnd;)
+    while ((srcBuffer = findEmulationCandidate(srcBuffer, srcEnd)) != srcEnd)
     {
-        if (*srcBuffer > 3)
-            srcBuffer += 4;
-        else if (srcBuffer[-3] == 0 && srcBuffer[-2] == 0 && srcBuffer[-1] == 3)
+        // 0x000003 is an escape only when followed by 0x00..0x03
+        if (srcBuffer[2] != 3 || srcEnd - srcBuffer < 4 || srcBuffer[3] > 3)
         {
-            if (dstBufferSize < static_cast<size_t>(srcBuffer - srcStart))
-                return -1;
-            memcpy(dstBuffer, srcStart, srcBuffer - srcStart - 1);
-            dstBuffer += srcBuffer - srcStart - 1;
-            dstBufferSize -= srcBuffer - srcStart;
-            *dstBuffer++ = *srcBuffer++;
-            srcStart = srcBuffer;
-            *keepSrcBuffer = false;
-        }
-        else
             srcBuffer++;
+            continue;
+        }
+        srcBuffer += 2;
+        if (dstBufferSize < static_cast<size_t>(srcBuffer - srcStart + 1))
+            return -1;
+        memcpy(dstBuffer, srcStart, srcBuffer - srcStart);
+        dstBuffer += srcBuffer - srcStart;
+        dstBufferSize -= srcBuffer - srcStart;
+        srcStart = ++srcBuffer;
+        *keepSrcBuffer = false;
     }
     if (!*keepSrcBuffer)
         memcpy(dstBuffer, srcStart, srcEnd - srcStart);
@@ -199,14 +232,7 @@ unsigned NALUnit::extractUEGolombCode(uint8_t* buffer, const uint8_t* bufEnd)
     return extractUEGolombCode(reader);
 }
 
-unsigned NALUnit::extractUEGolombCode()
-{
-    unsigned cnt = 0;
-    for (; bitReader.getBit() == 0; cnt++);
-    if (cnt > INT_BIT)
-        THROW_BITSTREAM_ERR;
-    return (1 << cnt) - 1 + bitReader.getBits(cnt);
-}
+unsigned NALUnit::extractUEGolombCode() { return bitReader.getUEGolombCode(); }
 
 void NALUnit::writeSEGolombCode(BitStreamWriter& bitWriter, const int32_t value)
 {
@@ -231,12 +257,7 @@ void NALUnit::writeUEGolombCode(BitStreamWriter& bitWriter, const uint32_t value
     bitWriter.putBits(nBit, value - (x - 1));
 }
 
-unsigned NALUnit::extractUEGolombCode(BitStreamReader& bitReader)
-{
-    int cnt = 0;
-    for (; bitReader.getBit() == 0; cnt++);
-    return (1 << cnt) - 1 + bitReader.getBits(cnt);
-}
+unsigned NALUnit::extractUEGolombCode(BitStreamReader& bitReader) { return bitReader.getUEGolombCode(); }
 
 int NALUnit::extractSEGolombCode()
 {
@@ -264,9 +285,14 @@ int NALUnit::deserialize(uint8_t* buffer, uint8_t* end)
 
 void NALUnit::decodeBuffer(const uint8_t* buffer, const uint8_t* end)
 {
-    delete[] m_nalBuffer;
-    m_nalBuffer = new uint8_t[end - buffer];
-    m_nalBufferLen = decodeNAL(buffer, end, m_nalBuffer, end - buffer);
+    const auto size = static_cast<unsigned>(end - buffer);
+    if (size > m_nalBufferCapacity)
+    {
+        delete[] m_nalBuffer;
+        m_nalBuffer = new uint8_t[size];
+        m_nalBufferCapacity = size;
+    }
+    m_nalBufferLen = decodeNAL(buffer, end, m_nalBuffer, m_nalBufferCapacity);
 }
 
 int NALUnit::serializeBuffer(uint8_t* dstBuffer, uint8_t* dstEnd, const bool writeStartCode) const
@@ -601,9 +627,9 @@ int SPSUnit::deserializeVuiParameters()
         bitReader.skipBit();  // overscan_appropriate_flag
     if (bitReader.getBit())   // video_signal_type_present_flag
     {
-        bitReader.skipBits(4);       // video_format, video_full_range_flag
-        if (bitReader.getBit())      // colour_description_present_flag
-            bitReader.skipBits(24);  // colour_primaries, transfer_characteristics, matrix_coefficients
+        bitReader.skipBits<4>();       // video_format, video_full_range_flag
+        if (bitReader.getBit())        // colour_description_present_flag
+            bitReader.skipBits<24>();  // colour_primaries, transfer_characteristics, matrix_coefficients
     }
     if (bitReader.getBit())  // chroma_loc_info_present_flag
     {
@@ -616,8 +642,8 @@ int SPSUnit::deserializeVuiParameters()
     if (timing_info_present_flag)
     {
         num_units_in_tick_bit_pos = bitReader.getBitsCount();
-        num_units_in_tick = bitReader.getBits(32);
-        time_scale = bitReader.getBits(32);
+        num_units_in_tick = bitReader.getBits<32>();
+        time_scale = bitReader.getBits<32>();
         fixed_frame_rate_flag = bitReader.getBit();
     }
     hrdParamsBitPos = bitReader.getBitsCount() + 32;
@@ -740,7 +766,8 @@ void SPSUnit::updateTimingInfo()
 
     static constexpr int EXTRA_SPACE = 64;
 
-    const auto newNalBuffer = new uint8_t[m_nalBufferLen + EXTRA_SPACE];
+    const unsigned newNalBufferSize = m_nalBufferLen + EXTRA_SPACE;
+    const auto newNalBuffer = new uint8_t[newNalBufferSize];
 
     const int beforeBytes = bitPos >> 3;
     memcpy(newNalBuffer, m_nalBuffer, m_nalBufferLen);
@@ -774,7 +801,7 @@ void SPSUnit::updateTimingInfo()
     unsigned bitRest = full_sps_bit_len - reader.getBitsCount() - beforeBytes * 8;
     for (; bitRest >= 8; bitRest -= 8)
     {
-        tmpVal = reader.getBits(8);
+        tmpVal = reader.getBits<8>();
         writer.putBits(8, tmpVal);
     }
     if (bitRest > 0)
@@ -791,6 +818,7 @@ void SPSUnit::updateTimingInfo()
 
     delete[] m_nalBuffer;
     m_nalBuffer = newNalBuffer;
+    m_nalBufferCapacity = newNalBufferSize;
 }
 
 void SPSUnit::insertHrdData(const int bitPos, const int nal_hrd_len, const int vcl_hrd_len, const bool addVuiHeader,
@@ -799,7 +827,8 @@ void SPSUnit::insertHrdData(const int bitPos, const int nal_hrd_len, const int v
     // replace hrd parameters not implemented. only insert
     static constexpr int EXTRA_SPACE = 64;
 
-    const auto newNalBuffer = new uint8_t[m_nalBufferLen + EXTRA_SPACE];
+    const unsigned newNalBufferSize = m_nalBufferLen + EXTRA_SPACE;
+    const auto newNalBuffer = new uint8_t[newNalBufferSize];
 
     const int beforeBytes = bitPos >> 3;
     memcpy(newNalBuffer, m_nalBuffer, m_nalBufferLen);
@@ -843,7 +872,7 @@ void SPSUnit::insertHrdData(const int bitPos, const int nal_hrd_len, const int v
         if (reader.getBit())
         {  // source nal_hrd_parameters_present_flag
             // nal hrd already exists, copy from a source stream
-            for (int i = 0; i < nal_hrd_len / 32; ++i) writer.putBits(32, reader.getBits(32));
+            for (int i = 0; i < nal_hrd_len / 32; ++i) writer.putBits(32, reader.getBits<32>());
             writer.putBits(nal_hrd_len % 32, reader.getBits(nal_hrd_len % 32));
         }
         else
@@ -855,7 +884,7 @@ void SPSUnit::insertHrdData(const int bitPos, const int nal_hrd_len, const int v
         if (reader.getBit())
         {  // source vcl_hrd_parameters_present_flag
             // vcl hrd already exists, copy from a source stream
-            for (int i = 0; i < vcl_hrd_len / 32; ++i) writer.putBits(32, reader.getBits(32));
+            for (int i = 0; i < vcl_hrd_len / 32; ++i) writer.putBits(32, reader.getBits<32>());
             writer.putBits(vcl_hrd_len % 32, reader.getBits(vcl_hrd_len % 32));
         }
         else
@@ -871,7 +900,7 @@ void SPSUnit::insertHrdData(const int bitPos, const int nal_hrd_len, const int v
     unsigned bitRest = full_sps_bit_len - reader.getBitsCount() - beforeBytes * 8;
     for (; bitRest >= 8; bitRest -= 8)
     {
-        tmpVal = reader.getBits(8);
+        tmpVal = reader.getBits<8>();
         writer.putBits(8, tmpVal);
     }
     if (bitRest > 0)
@@ -888,6 +917,7 @@ void SPSUnit::insertHrdData(const int bitPos, const int nal_hrd_len, const int v
 
     delete[] m_nalBuffer;
     m_nalBuffer = newNalBuffer;
+    m_nalBufferCapacity = newNalBufferSize;
 }
 
 unsigned SPSUnit::getMaxBitrate() const
@@ -1064,7 +1094,7 @@ int SPSUnit::seq_parameter_set_mvc_extension()
             return 1;
         for (size_t j = 0; j <= num_applicable_ops_minus1[i]; j++)
         {
-            bitReader.skipBits(3);                         // applicable_op_temporal_id[ i ][ j ]
+            bitReader.skipBits<3>();                       // applicable_op_temporal_id[ i ][ j ]
             const unsigned dummy = extractUEGolombCode();  // applicable_op_num_target_views_minus1[ i ][ j ]
             if (dummy >= 1 << 10)
                 return 1;
@@ -1105,9 +1135,9 @@ int SPSUnit::mvc_vui_parameters_extension()
 
         if (bitReader.getBit())  // vui_mvc_timing_info_present_flag[ i ]
         {
-            bitReader.skipBits(32);  // vui_mvc_num_units_in_tick[i]
-            bitReader.skipBits(32);  // vui_mvc_time_scale[ i ]
-            bitReader.skipBit();     // vui_mvc_fixed_frame_rate_flag[ i ]
+            bitReader.skipBits<32>();  // vui_mvc_num_units_in_tick[i]
+            bitReader.skipBits<32>();  // vui_mvc_time_scale[ i ]
+            bitReader.skipBit();       // vui_mvc_fixed_frame_rate_flag[ i ]
         }
 
         mvcHrdParamsBitPos[i] = bitReader.getBitsCount() + 32;
@@ -1156,15 +1186,15 @@ SliceUnit::SliceUnit()
 void SliceUnit::nal_unit_header_svc_extension()
 {
     non_idr_flag = !bitReader.getBit();  // idr_flag here, use same variable
-    bitReader.skipBits(22);
+    bitReader.skipBits<22>();
 }
 
 void SliceUnit::nal_unit_header_mvc_extension()
 {
     non_idr_flag = bitReader.getBit();
-    bitReader.skipBits(19);  // priority_id, view_id, temporal_id
+    bitReader.skipBits<19>();  // priority_id, view_id, temporal_id
     anchor_pic_flag = bitReader.getBit();
-    bitReader.skipBits(2);  // inter_view_flag, reserved_one_bit
+    bitReader.skipBits<2>();  // inter_view_flag, reserved_one_bit
 }
 
 bool SliceUnit::isIDR() const
@@ -1301,7 +1331,7 @@ int SliceUnit::deserializeSliceHeader(const std::map<uint32_t, SPSUnit*>& spsMap
     sps = itr2->second;
 
     if (sps->separate_colour_plane_flag)
-        bitReader.skipBits(2);  // colour_plane_id
+        bitReader.skipBits<2>();  // colour_plane_id
 
     frame_num = bitReader.getBits<uint16_t>(sps->log2_max_frame_num);
     bottom_field_flag = 0;
@@ -1330,6 +1360,11 @@ int SliceUnit::deserializeSliceHeader(const std::map<uint32_t, SPSUnit*>& spsMap
 void SEIUnit::deserialize(const SPSUnit& sps, const int orig_hrd_parameters_present_flag)
 {
     pic_struct = -1;
+    m_processedMessages.clear();
+    number_of_offset_sequences = -1;
+    metadataPtsOffset = 0;
+    m_mvcHeaderLen = 0;
+    m_mvcHeaderStart = nullptr;
 
     uint8_t* nalEnd = m_nalBuffer + m_nalBufferLen;
     try
@@ -1455,11 +1490,11 @@ unsigned SEIUnit::removePicTimingSEI(SPSUnit& sps)
         }
         curBuff += payloadSize;
     }
-    if (m_nalBufferLen < tmpBufferLen)
+    if (m_nalBufferCapacity < tmpBufferLen)
     {
-        // assert(m_nalBufferLen < tmpBufferLen);
         delete[] m_nalBuffer;
         m_nalBuffer = new uint8_t[tmpBufferLen];
+        m_nalBufferCapacity = tmpBufferLen;
     }
     memcpy(m_nalBuffer, tmpBuffer, tmpBufferLen);
     m_nalBufferLen = tmpBufferLen;
@@ -1714,7 +1749,7 @@ int SEIUnit::mvc_scalable_nesting(const SPSUnit& sps, uint8_t* curBuf, const int
                 const unsigned num_view_components_minus1 = extractUEGolombCode();
                 if (num_view_components_minus1 >= 1 << 10)
                     return 1;
-                for (size_t i = 0; i <= num_view_components_minus1; i++) bitReader.skipBits(10);  // sei_view_id[ i ]
+                for (size_t i = 0; i <= num_view_components_minus1; i++) bitReader.skipBits<10>();  // sei_view_id[ i ]
             }
         }
         else
@@ -1724,7 +1759,7 @@ int SEIUnit::mvc_scalable_nesting(const SPSUnit& sps, uint8_t* curBuf, const int
                 return 1;
             for (size_t i = 0; i <= num_view_components_op_minus1; i++)
             {
-                bitReader.skipBits(13);  // sei_op_view_id[ i ], sei_op_temporal_id
+                bitReader.skipBits<13>();  // sei_op_view_id[ i ], sei_op_temporal_id
             }
         }
         const int byteBits = bitReader.getBitsCount() % 8;
@@ -1751,8 +1786,8 @@ int SEIUnit::mvc_scalable_nesting(const SPSUnit& sps, uint8_t* curBuf, const int
                 if (memcmp(bdData, BDROM_METADATA_GUID, 128 / 8) == 0)
                 {
                     // process bd rom meta data
-                    for (int i = 0; i < 4; ++i) bitReader.skipBits(32);
-                    const auto type_indicator = bitReader.getBits(32);
+                    for (int i = 0; i < 4; ++i) bitReader.skipBits<32>();
+                    const auto type_indicator = bitReader.getBits<32>();
                     switch (type_indicator)
                     {
                     case 0x4F464D44:
@@ -1787,11 +1822,11 @@ void SEIUnit::processBlurayGopStructure() {}
 
 void SEIUnit::processBlurayOffsetMetadata()
 {
-    bitReader.skipBits(8);
+    bitReader.skipBits<8>();
     const uint8_t* ptr = bitReader.getBuffer() + bitReader.getBitsCount() / 8;
     metadataPtsOffset = static_cast<int>(ptr - m_nalBuffer);
-    bitReader.skipBits(24);  // PTS[32..30], marker_bit, PTS[29..15]
-    bitReader.skipBits(18);  // marker_bit, PTS[14..0], marker_bit, reserved_for_future_use bit
+    bitReader.skipBits<24>();  // PTS[32..30], marker_bit, PTS[29..15]
+    bitReader.skipBits<18>();  // marker_bit, PTS[14..0], marker_bit, reserved_for_future_use bit
     number_of_offset_sequences = bitReader.getBits<uint8_t>(6);
 }
 
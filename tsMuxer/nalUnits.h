@@ -68,12 +68,19 @@ class NALUnit
     uint8_t* m_nalBuffer;
     unsigned m_nalBufferLen;
 
-    NALUnit(uint8_t nalUnitType) : nal_unit_type(), nal_ref_idc(0), m_nalBuffer(nullptr), m_nalBufferLen(0) {}
-    NALUnit() : nal_unit_type(), nal_ref_idc(0), m_nalBuffer(nullptr), m_nalBufferLen(0) {}
+    NALUnit(uint8_t nalUnitType)
+        : nal_unit_type(), nal_ref_idc(0), m_nalBuffer(nullptr), m_nalBufferLen(0), m_nalBufferCapacity(0)
+    {
+    }
+    NALUnit() : nal_unit_type(), nal_ref_idc(0), m_nalBuffer(nullptr), m_nalBufferLen(0), m_nalBufferCapacity(0) {}
     // NALUnit(const NALUnit& other);
     virtual ~NALUnit() { delete[] m_nalBuffer; }
     static uint8_t* findNextNAL(uint8_t* buffer, uint8_t* end);
     static uint8_t* findNALWithStartCode(uint8_t* buffer, uint8_t* end, bool longCodesAllowed);
+    // appends to offsets the position (relative to base) of the 0x01 byte of every 00 00 01 start code in
+    // [buffer, end)
+    static void findStartCodes(const uint8_t* buffer, const uint8_t* end, const uint8_t* base,
+                               std::vector<uint32_t>& offsets);
     static int encodeNAL(const uint8_t* srcBuffer, const uint8_t* srcEnd, uint8_t* dstBuffer, size_t dstBufferSize);
     static int decodeNAL(const uint8_t* srcBuffer, const uint8_t* srcEnd, uint8_t* dstBuffer, size_t dstBufferSize);
     static int decodeNAL2(const uint8_t* srcBuffer, const uint8_t* srcEnd, uint8_t* dstBuffer, size_t dstBufferSize,
@@ -82,7 +89,21 @@ class NALUnit
     virtual int serializeBuffer(uint8_t* dstBuffer, uint8_t* dstEnd, bool writeStartCode) const;
     virtual int serialize(uint8_t* dstBuffer);
     // void setBuffer(uint8_t* buffer, uint8_t* end);
+    // Unescapes [buffer, end) into m_nalBuffer. The buffer is grow-only, so a unit object reused for every NAL of
+    // its type allocates only when a larger NAL than seen before arrives.
     void decodeBuffer(const uint8_t* buffer, const uint8_t* end);
+    // Resets a unit to its default constructed state but keeps its decode buffer, so a spare unit can take the next
+    // NAL of its type without allocating.
+    template <typename T>
+    static void resetToDefaults(T& unit)
+    {
+        static const T defaults;
+        uint8_t* buffer = unit.m_nalBuffer;
+        const unsigned capacity = unit.m_nalBufferCapacity;
+        unit = defaults;
+        unit.m_nalBuffer = buffer;
+        unit.m_nalBufferCapacity = capacity;
+    }
     static uint8_t* addStartCode(uint8_t* buffer, const uint8_t* boundStart);
 
     static unsigned extractUEGolombCode(uint8_t* buffer, const uint8_t* bufEnd);
@@ -98,6 +119,7 @@ class NALUnit
    protected:
     // GetBitContext getBitContext;
     BitStreamReader bitReader;
+    unsigned m_nalBufferCapacity;
     inline unsigned extractUEGolombCode();
     inline int extractSEGolombCode();
     void updateBits(int bitOffset, int bitLen, unsigned value) const;
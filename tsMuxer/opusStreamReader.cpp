@@ -6,6 +6,7 @@
 #include <sstream>
 
 #include "avCodecs.h"
+#include "crc.h"
 #include "tsPacket.h"
 #include "vodCoreException.h"
 #include "vod_common.h"
@@ -58,39 +59,13 @@ static constexpr int kOpusFrameSamples[32] = {
 // OGG CRC-32 (polynomial 0x04C11DB7, used by the Ogg framing spec)
 // ---------------------------------------------------------------------------
 
-static uint32_t oggCrcTable[256];
-static bool oggCrcTableBuilt = false;
-
-static void buildOggCrcTable()
-{
-    if (oggCrcTableBuilt)
-        return;
-    for (int i = 0; i < 256; i++)
-    {
-        uint32_t r = static_cast<uint32_t>(i) << 24;
-        for (int j = 0; j < 8; j++) r = (r << 1) ^ ((r & 0x80000000U) ? 0x04C11DB7U : 0);
-        oggCrcTable[i] = r;
-    }
-    oggCrcTableBuilt = true;
-}
-
-static uint32_t oggCrc32(const uint8_t* data, int len)
-{
-    buildOggCrcTable();
-    uint32_t crc = 0;
-    for (int i = 0; i < len; i++) crc = (crc << 8) ^ oggCrcTable[((crc >> 24) ^ data[i]) & 0xFF];
-    return crc;
-}
+static uint32_t oggCrc32(const uint8_t* data, const int len) { return crc::crc32(data, len, 0); }
 
 /// Compute OGG CRC over two disjoint buffers (for pages where header and
 /// payload are stored separately).
-static uint32_t oggCrc32_two(const uint8_t* a, int aLen, const uint8_t* b, int bLen)
+static uint32_t oggCrc32_two(const uint8_t* a, const int aLen, const uint8_t* b, const int bLen)
 {
-    buildOggCrcTable();
-    uint32_t crc = 0;
-    for (int i = 0; i < aLen; i++) crc = (crc << 8) ^ oggCrcTable[((crc >> 24) ^ a[i]) & 0xFF];
-    for (int i = 0; i < bLen; i++) crc = (crc << 8) ^ oggCrcTable[((crc >> 24) ^ b[i]) & 0xFF];
-    return crc;
+    return crc::crc32(b, bLen, crc::crc32(a, aLen, 0));
 }
 
 // ---------------------------------------------------------------------------
@@ -10,10 +10,14 @@
 #include "../vod_common.h"
 // #include "../math.h"
 #include <fs/directory.h>
+#include <fs/file.h>
 #include <cmath>
 
 #include <algorithm>
+#include <filesystem>
+#include <list>
 #include <map>
+#include <unordered_map>
 
 #if defined(_WIN32)
 static constexpr char FONT_ROOT[] = "c:/WINDOWS/Fonts";  // for debug only
@@ -27,6 +31,11 @@ const static char FONT_ROOT[] = "/usr/X11R7/lib/X11/fonts/";
 
 #include <freetype/ftstroke.h>
 #include <fs/systemlog.h>
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
 
 using namespace std;
 
@@ -42,7 +51,9 @@ std::string realpath(const std::string& path)
 namespace text_subtitles
 {
 FT_Library TextSubtitlesRenderFT::library;
-std::map<std::string, std::string> TextSubtitlesRenderFT::m_fontNameToFile;
+std::mutex TextSubtitlesRenderFT::m_libraryMtx;
+std::map<std::vector<std::string>, std::map<std::string, std::string>> TextSubtitlesRenderFT::m_fontMaps;
+std::mutex TextSubtitlesRenderFT::m_fontMapsMtx;
 
 constexpr double PI = 3.1415926f;
 constexpr double angle = -PI / 10.0f;
@@ -58,15 +69,13 @@ uint32_t convertColor(uint32_t color)
 
 TextSubtitlesRenderFT::TextSubtitlesRenderFT() : TextSubtitlesRender()
 {
-    static bool initialized = false;
-    if (!initialized)
-    {
+    static const bool initialized = []() {
         int error = FT_Init_FreeType(&library);
         if (error)
             THROW(ERR_COMMON, "Can't initialize freeType font library");
-        loadFontMap();
-        initialized = true;
-    }
+        return true;
+    }();
+    (void)initialized;
     m_pData = nullptr;
     italic_matrix.xx = static_cast<FT_Fixed>(cos(angle) * 0x10000L);
     italic_matrix.xy = static_cast<FT_Fixed>(-sin(angle) * 0x10000L);
@@ -84,19 +93,176 @@ TextSubtitlesRenderFT::TextSubtitlesRenderFT() : TextSubtitlesRender()
     italic_bold_matrix.yy = 1 * 0x10000L;
 }
 
-void TextSubtitlesRenderFT::loadFontMap()
+namespace
 {
-    vector<string> fileList;
-    // sort(fileList.begin(), fileList.end());
-    findFilesRecursive(FONT_ROOT, "*.ttf", &fileList);
+// The font index keeps the family name to file map between runs, so that the fonts are not opened one by one at every
+// start. It is valid as long as the scanned directories are the same and none of the directories in their trees has
+// been modified since.
+constexpr char FONT_INDEX_SIGNATURE[] = "tsMuxeR font index 1";
+constexpr int64_t MAX_FONT_INDEX_SIZE = 64 * 1024 * 1024;
+
+typedef std::map<std::string, int64_t> DirTimes;
+
+std::string fontIndexFileName()
+{
+    const char* cacheHome = getenv("XDG_CACHE_HOME");
+    if (cacheHome && *cacheHome)
+        return std::string(cacheHome) + "/tsMuxeR/fonts.idx";
+    const char* home = getenv("HOME");
+    if (home && *home)
+        return std::string(home) + "/.cache/tsMuxeR/fonts.idx";
+    return {};
+}
+
+// Returns -1 if the directory does not exist
+int64_t dirTime(const std::string& dir)
+{
+    std::error_code ec;
+    const auto time = std::filesystem::last_write_time(dir, ec);
+    return ec ? -1 : static_cast<int64_t>(time.time_since_epoch().count());
+}
+
+void addDirTimes(const std::string& root, DirTimes& dirTimes)
+{
+    dirTimes[root] = dirTime(root);
+    std::error_code ec;
+    for (std::filesystem::recursive_directory_iterator itr(root, ec), end; !ec && itr != end; itr.increment(ec))
+    {
+        if (itr->is_directory(ec) && !itr->is_symlink(ec))
+            dirTimes[itr->path().string()] = dirTime(itr->path().string());
+    }
+}
+
+bool loadFontIndex(const std::string& fileName, const std::vector<std::string>& roots,
+                   std::map<std::string, std::string>& fontNameToFile)
+{
+    File file;
+    if (!file.open(fileName.c_str(), File::ofRead))
+        return false;
+    const int64_t size = file.size();
+    if (size <= 0 || size > MAX_FONT_INDEX_SIZE)
+        return false;
+    std::string data(static_cast<size_t>(size), '\0');
+    if (file.read(data.data(), static_cast<uint32_t>(size)) != size)
+        return false;
+
+    const std::vector<std::string> lines = splitStr(data.c_str(), '\n');
+    if (lines.empty() || lines[0] != FONT_INDEX_SIGNATURE)
+        return false;
+    std::vector<std::string> indexRoots;
+    std::map<std::string, std::string> fonts;
+    for (size_t i = 1; i < lines.size(); ++i)
+    {
+        const std::vector<std::string> fields = splitStr(lines[i].c_str(), '\t');
+        if (fields.size() == 2 && fields[0] == "R")
+            indexRoots.push_back(fields[1]);
+        else if (fields.size() == 3 && fields[0] == "D")
+        {
+            if (dirTime(fields[2]) != strToInt64(fields[1].c_str()))
+                return false;
+        }
+        else if (fields.size() == 3 && fields[0] == "F")
+            fonts[fields[1]] = fields[2];
+        else if (fields.size() == 2 && fields[0] == "E")
+        {
+            // the end marker holds the number of fonts, a truncated index is rebuilt
+            if (indexRoots != roots || strToInt64(fields[1].c_str()) != static_cast<int64_t>(fonts.size()))
+                return false;
+            fontNameToFile = std::move(fonts);
+            return true;
+        }
+        else
+            return false;
+    }
+    return false;
+}
+
+void saveFontIndex(const std::string& fileName, const std::vector<std::string>& roots, const DirTimes& dirTimes,
+                   const std::map<std::string, std::string>& fontNameToFile)
+{
+    // a name with a separator in it can't be stored, the index would be read back wrong
+    const auto storable = [](const std::string& str) { return str.find_first_of("\t\n") == std::string::npos; };
+    if (!std::all_of(roots.begin(), roots.end(), storable))
+        return;
+    for (const auto& [dir, time] : dirTimes)
+        if (!storable(dir))
+            return;
+    for (const auto& [family, file] : fontNameToFile)
+        if (!storable(family) || !storable(file))
+            return;
+
+    std::string data = std::string(FONT_INDEX_SIGNATURE) + '\n';
+    for (const auto& root : roots) data += "R\t" + root + '\n';
+    for (const auto& [dir, time] : dirTimes) data += "D\t" + int64ToStr(time) + '\t' + dir + '\n';
+    for (const auto& [family, file] : fontNameToFile) data += "F\t" + family + '\t' + file + '\n';
+    data += "E\t" + int64ToStr(static_cast<int64_t>(fontNameToFile.size())) + '\n';
+
+    // written aside and renamed, so that concurrent runs never see a partial index
+    createDir(extractFileDir(fileName), true);
+#ifdef _WIN32
+    const int pid = _getpid();
+#else
+    const int pid = getpid();
+#endif
+    const std::string tmpName = fileName + "." + int32ToStr(pid);
+    File file;
+    if (!file.open(tmpName.c_str(), File::ofWrite))
+        return;
+    const bool written = file.write(data.data(), static_cast<uint32_t>(data.size())) ==
+                         static_cast<int>(data.size());
+    file.close();
+    std::error_code ec;
+    if (written)
+        std::filesystem::rename(tmpName, fileName, ec);
+    if (!written || ec)
+        deleteFile(tmpName);
+}
+}  // namespace
+
+string TextSubtitlesRenderFT::findFontFile(const vector<string>& fontDirs, const string& fontName)
+{
+    std::lock_guard lock(m_fontMapsMtx);
+    auto fontMap = m_fontMaps.find(fontDirs);
+    if (fontMap == m_fontMaps.end())
+        fontMap = m_fontMaps.emplace(fontDirs, loadFontMap(fontDirs)).first;
+    const auto itr = fontMap->second.find(strToLowerCase(fontName));
+    if (itr == fontMap->second.end())
+        THROW(ERR_COMMON, "Can't find ttf file for font " << fontName)
+    return itr->second;
+}
+
+map<string, string> TextSubtitlesRenderFT::loadFontMap(const vector<string>& fontDirs)
+{
+    vector<string> roots;
+    for (string dir : fontDirs)
+    {
+        if (!dir.empty() && dir.back() != getDirSeparator())
+            dir += getDirSeparator();
+        if (std::find(roots.begin(), roots.end(), dir) == roots.end())
+            roots.push_back(dir);
+    }
+    if (roots.empty())
+    {
+        roots.emplace_back(FONT_ROOT);
 #if defined(__APPLE__) && defined(__MACH__)
-    vector<string> fileList1;
-    findFilesRecursive("/Library/Fonts/", "*.ttf", &fileList1);
-    fileList.insert(fileList.end(), fileList1.begin(), fileList1.end());
-    findFilesRecursive("~/Library/Fonts/", "*.ttf", &fileList1);
-    fileList.insert(fileList.end(), fileList1.begin(), fileList1.end());
+        roots.emplace_back("/Library/Fonts/");
+        roots.emplace_back("~/Library/Fonts/");
 #endif
+    }
+    map<string, string> fontNameToFile;
+    const string indexFile = fontIndexFileName();
+    if (!indexFile.empty() && loadFontIndex(indexFile, roots, fontNameToFile))
+        return fontNameToFile;
 
+    DirTimes dirTimes;
+    vector<string> fileList;
+    for (const auto& root : roots)
+    {
+        addDirTimes(root, dirTimes);
+        findFilesRecursive(root, "*.ttf", &fileList);
+    }
+
+    std::lock_guard lock(m_libraryMtx);
     for (auto& fontFile : fileList)
     {
         // LTRACE(LT_INFO, 2, "before loading font " << fileList[i].c_str());
@@ -109,20 +275,21 @@ void TextSubtitlesRenderFT::loadFontMap()
         {
             string fontFamily = strToLowerCase(font->family_name);
 
-            auto itr = m_fontNameToFile.find(fontFamily);
+            auto itr = fontNameToFile.find(fontFamily);
 
-            if (itr == m_fontNameToFile.end() || fontFile.length() < itr->second.length())
+            if (itr == fontNameToFile.end() || fontFile.length() < itr->second.length())
             {
-                m_fontNameToFile[fontFamily] = tsmuxer::realpath(fontFile);
+                fontNameToFile[fontFamily] = tsmuxer::realpath(fontFile);
             }
             FT_Done_Face(font);
         }
         // LTRACE(LT_INFO, 2, "after loading font " << fileList[i].c_str());
     }
+    if (!indexFile.empty())
+        saveFontIndex(indexFile, roots, dirTimes, fontNameToFile);
+    return fontNameToFile;
 }
 
-TextSubtitlesRenderFT::~TextSubtitlesRenderFT() { delete m_pData; }
-
 void TextSubtitlesRenderFT::setRenderSize(int width, int height)
 {
     m_width = width;
@@ -130,6 +297,7 @@ void TextSubtitlesRenderFT::setRenderSize(int width, int height)
     delete m_pData;
     const int size = width * height * 4;
     m_pData = new uint8_t[size];  // 32bpp ARGB buffer
+    m_dirtyRect = {0, 0, width, height};
 }
 
 string TextSubtitlesRenderFT::findAdditionFontFile(const string& fontName, const string& fontExt, bool isBold,
@@ -202,6 +370,7 @@ int TextSubtitlesRenderFT::loadFont(const string& fontName, FT_Face& face)
     const auto itr = m_fontMap.find(fontName);
     if (itr == m_fontMap.end())
     {
+        std::lock_guard lock(m_libraryMtx);
         const int error = FT_New_Face(library, fontName.c_str(), 0, &face);
         if (error)
             return error;
@@ -220,14 +389,7 @@ void TextSubtitlesRenderFT::setFont(const Font& font)
         m_font = font;
         string fontName = font.m_name;
         if (!strEndWith(fontName, string(".ttf")))
-        {
-            std::string fontLower = strToLowerCase(fontName);
-            auto itr = m_fontNameToFile.find(fontLower);
-            if (itr != m_fontNameToFile.end())
-                fontName = itr->second;
-            else
-                THROW(ERR_COMMON, "Can't find ttf file for font " << fontName)
-        }
+            fontName = findFontFile(m_fontDirs, fontName);
         string fileExt = extractFileExt(fontName);
         if (fileExt.length() > 0)
             fileExt = string(".") + fileExt;
@@ -289,7 +451,7 @@ uint32_t clrMax(uint32_t first, uint32_t second)
     return first_yuv > second_yuv ? first : second;
 }
 
-void TextSubtitlesRenderFT::drawHorLine(int left, int right, int top, const RECT* rect) const
+void TextSubtitlesRenderFT::drawHorLine(int left, int right, int top, const RECT* rect)
 {
     if (top < rect->top || top >= rect->bottom)
         return;
@@ -297,6 +459,7 @@ void TextSubtitlesRenderFT::drawHorLine(int left, int right, int top, const RECT
         left = rect->left;
     if (right > rect->right)
         right = rect->right;
+    markDirty(left, top, right + 1, top + 1);
     const int offset = m_width * top + left;
     auto dst = reinterpret_cast<uint32_t*>(m_pData) + offset;
     for (int x = left; x <= right; ++x) *dst++ = convertColor(m_font.m_color);
@@ -381,145 +544,250 @@ void RenderSpans(const FT_Library& library, FT_Outline* const outline, Spans* sp
     FT_Outline_Render(library, outline, &params);
 }
 
-void RenderGlyph(const FT_Library& library, const uint32_t ch, const FT_Face& face, const Pixel32& fontCol,
-                 const Pixel32 outlineColOut, const Pixel32 outlineColIner, const float outlineWidth, int left, int top,
-                 const int width, const int height, uint32_t* dstData)
+// A glyph of one face, size and style. The part used for drawing and the part used for measuring are filled on first
+// use, each from the glyph loaded the way drawText() and getTextSize() load it.
+struct CachedGlyph
+{
+    bool drawn = false;
+    bool hasImage = false;  // false if the glyph has no outline or nothing to draw
+    int advance = 0;
+    int bitmapLeft = 0;
+    int bearingX = 0;
+    int bearingY = 0;
+    Rect rect;  // bounding rect of all span lists
+    Spans spans;
+    Spans outlineSpansOut;
+    Spans outlineSpansIner;
+
+    bool measured = false;
+    int measureAdvance = 0;
+    int measureBitmapLeft = 0;
+};
+
+struct GlyphKey
+{
+    FT_Face face;
+    int size;
+    uint32_t charset;
+    float borderWidth;
+    bool emulateItalic;
+    bool emulateBold;
+    // drawText() translates the outlines of a text by its position in pixels taken as 26.6 units. The glyphs are
+    // rendered with the fractional part of that translation, DrawGlyph() adds the whole pixels.
+    int deltaX = 0;
+    int deltaY = 0;
+    uint32_t ch = 0;
+
+    bool operator==(const GlyphKey& other) const = default;
+};
+
+struct GlyphKeyHash
+{
+    size_t operator()(const GlyphKey& key) const
+    {
+        size_t h = std::hash<const void*>()(key.face);
+        h = h * 31 + static_cast<size_t>(key.size);
+        h = h * 31 + key.charset;
+        h = h * 31 + std::hash<float>()(key.borderWidth);
+        h = h * 31 + (key.emulateItalic ? 2 : 0) + (key.emulateBold ? 1 : 0);
+        h = h * 31 + static_cast<size_t>(key.deltaX * 64 + key.deltaY);
+        return h * 31 + key.ch;
+    }
+};
+
+// Least recently used glyphs of a renderer
+struct TextSubtitlesRenderFT::GlyphCache
+{
+    static constexpr size_t MAX_GLYPHS = 1024;
+
+    // Returns the entry of the key, an empty one if the glyph is not cached yet
+    CachedGlyph& get(const GlyphKey& key)
+    {
+        const auto itr = index.find(key);
+        if (itr != index.end())
+        {
+            lru.splice(lru.begin(), lru, itr->second);
+            return itr->second->second;
+        }
+        if (lru.size() == MAX_GLYPHS)
+        {
+            index.erase(lru.back().first);
+            lru.pop_back();
+        }
+        lru.emplace_front(key, CachedGlyph());
+        index.emplace(key, lru.begin());
+        return lru.front().second;
+    }
+
+    std::list<std::pair<GlyphKey, CachedGlyph>> lru;
+    std::unordered_map<GlyphKey, std::list<std::pair<GlyphKey, CachedGlyph>>::iterator, GlyphKeyHash> index;
+    uint64_t drawn = 0;       // glyphs drawn by drawText()
+    uint64_t rasterized = 0;  // glyphs of them that were not cached and had to be rasterized
+};
+
+bool StrokeGlyph(const FT_Library& library, const FT_GlyphSlot slot, const int strokeWidth, Spans* spans)
+{
+    FT_Glyph glyph;
+    if (FT_Get_Glyph(slot, &glyph) != 0)
+        return false;
+    FT_Stroker stroker;
+    FT_Stroker_New(library, &stroker);
+    FT_Stroker_Set(stroker, strokeWidth, FT_STROKER_LINECAP_ROUND, FT_STROKER_LINEJOIN_ROUND, 0);
+    FT_Glyph_StrokeBorder(&glyph, stroker, 0, 1);
+    // Again, this needs to be an outline to work.
+    if (glyph->format == FT_GLYPH_FORMAT_OUTLINE)
+    {
+        // Render the outline spans to the span list
+        FT_Outline* o = &reinterpret_cast<FT_OutlineGlyph>(glyph)->outline;
+        RenderSpans(library, o, spans);
+    }
+    FT_Stroker_Done(stroker);  // Clean up afterwards.
+    FT_Done_Glyph(glyph);
+    return true;
+}
+
+// Renders the glyph and its outline to span lists with the transform set on the face, DrawGlyph() places it
+void RasterizeGlyph(const FT_Library& library, const uint32_t ch, const FT_Face& face, const float outlineWidth,
+                    CachedGlyph& glyph)
 {
+    glyph.drawn = true;
     // Load the glyph we are looking for.
     const FT_UInt gindex = FT_Get_Char_Index(face, ch);
+    const int error = FT_Load_Glyph(face, gindex, FT_LOAD_NO_BITMAP);
+    glyph.advance = face->glyph->advance.x >> 6;
+    glyph.bitmapLeft = face->glyph->bitmap_left;
     // Need an outline for this to work.
-    if (FT_Load_Glyph(face, gindex, FT_LOAD_NO_BITMAP) != 0 || face->glyph->format != FT_GLYPH_FORMAT_OUTLINE)
+    if (error != 0 || face->glyph->format != FT_GLYPH_FORMAT_OUTLINE)
         return;
 
     // Render the basic glyph to a span list.
-    Spans spans;
-    RenderSpans(library, &face->glyph->outline, &spans);
+    RenderSpans(library, &face->glyph->outline, &glyph.spans);
 
     // Next we need the spans for the outline.
-    Spans outlineSpansOut;
-    Spans outlineSpansIner;
+    if (!StrokeGlyph(library, face->glyph, static_cast<int>(outlineWidth * 64), &glyph.outlineSpansOut))
+        return;
+    StrokeGlyph(library, face->glyph, static_cast<int>(outlineWidth * 32), &glyph.outlineSpansIner);
+    if (glyph.spans.empty())
+        return;
 
-    FT_Glyph glyph;
-    if (FT_Get_Glyph(face->glyph, &glyph) == 0)
+    // Figure out what the bounding rect is for all the span lists.
+    Rect& rect = glyph.rect;
+    rect = Rect(glyph.spans[0].x, glyph.spans[0].y, glyph.spans[0].x, glyph.spans[0].y);
+    for (const Spans* list : {&glyph.spans, &glyph.outlineSpansOut, &glyph.outlineSpansIner})
     {
-        FT_Stroker strokerOut;
-        FT_Stroker_New(library, &strokerOut);
-        FT_Stroker_Set(strokerOut, static_cast<int>(outlineWidth * 64), FT_STROKER_LINECAP_ROUND,
-                       FT_STROKER_LINEJOIN_ROUND, 0);
-        FT_Glyph_StrokeBorder(&glyph, strokerOut, 0, 1);
-        // Again, this needs to be an outline to work.
-        if (glyph->format == FT_GLYPH_FORMAT_OUTLINE)
-        {
-            // Render the outline spans to the span list
-            FT_Outline* o = &reinterpret_cast<FT_OutlineGlyph>(glyph)->outline;
-            RenderSpans(library, o, &outlineSpansOut);
-        }
-        FT_Stroker_Done(strokerOut);  // Clean up afterwards.
-        FT_Done_Glyph(glyph);
-
-        FT_Get_Glyph(face->glyph, &glyph);
-        FT_Stroker strokerIn;
-        FT_Stroker_New(library, &strokerIn);
-        FT_Stroker_Set(strokerIn, static_cast<int>(outlineWidth * 32), FT_STROKER_LINECAP_ROUND,
-                       FT_STROKER_LINEJOIN_ROUND, 0);
-        FT_Glyph_StrokeBorder(&glyph, strokerIn, 0, 1);
-        if (glyph->format == FT_GLYPH_FORMAT_OUTLINE)
+        for (const auto& span : *list)
         {
-            FT_Outline* o = &reinterpret_cast<FT_OutlineGlyph>(glyph)->outline;
-            RenderSpans(library, o, &outlineSpansIner);
+            rect.Include(Vec2(span.x, span.y));
+            rect.Include(Vec2(span.x + span.width - 1, span.y));
         }
-        FT_Stroker_Done(strokerIn);
-
-        // Now we need to put it all together.
-        if (!spans.empty())
-        {
-            // Figure out what the bounding rect is for both the span lists.
-            Rect rect(spans[0].x, spans[0].y, spans[0].x, spans[0].y);
-            for (const auto& span : spans)
-            {
-                rect.Include(Vec2(span.x, span.y));
-                rect.Include(Vec2(span.x + span.width - 1, span.y));
-            }
-            for (const auto& span : outlineSpansOut)
-            {
-                rect.Include(Vec2(span.x, span.y));
-                rect.Include(Vec2(span.x + span.width - 1, span.y));
-            }
-            for (const auto& span : outlineSpansIner)
-            {
-                rect.Include(Vec2(span.x, span.y));
-                rect.Include(Vec2(span.x + span.width - 1, span.y));
-            }
+    }
+    glyph.bearingX = face->glyph->metrics.horiBearingX >> 6;
+    glyph.bearingY = face->glyph->metrics.horiBearingY >> 6;
+    glyph.hasImage = true;
+}
 
-            // This is unused in this test but you would need this to draw
-            // more than one glyph.
-            const int bearingX = face->glyph->metrics.horiBearingX >> 6;
-            const int bearingY = face->glyph->metrics.horiBearingY >> 6;
+// Returns false if nothing was drawn, the area covered by the glyph otherwise (unclipped, in image coordinates)
+bool DrawGlyph(const CachedGlyph& glyph, const FT_Face& face, const Pixel32& fontCol, const Pixel32 outlineColOut,
+               const Pixel32 outlineColIner, int left, int top, const int width, const int height, uint32_t* dstData,
+               Rect* area)
+{
+    if (!glyph.hasImage)
+        return false;
 
-            // Get some metrics of our image.
-            const int imgHeight = rect.Height();
+    // Get some metrics of our image.
+    const int imgHeight = glyph.rect.Height();
 
-            top += (face->size->metrics.ascender >> 6) - bearingY;
-            left += bearingX;
+    top += (face->size->metrics.ascender >> 6) - glyph.bearingY;
+    left += glyph.bearingX;
+    *area = Rect(glyph.rect.xmin + left, top, glyph.rect.xmax + left, top + imgHeight - 1);
 
-            // Loop over the outline spans and just draw them into the image.
-            for (const auto& span : outlineSpansOut)
+    // Loop over the outline spans and just draw them into the image.
+    for (const auto& span : glyph.outlineSpansOut)
+    {
+        for (int w = 0; w < span.width; ++w)
+        {
+            const int y = imgHeight - 1 - (span.y - glyph.rect.ymin) + top;
+            const int x = span.x + w + left;
+            if (y >= 0 && y < height && x >= 0 && x < width)
             {
-                for (int w = 0; w < span.width; ++w)
-                {
-                    const int y = imgHeight - 1 - (span.y - rect.ymin) + top;
-                    const int x = span.x + w + left;
-                    if (y >= 0 && y < height && x >= 0 && x < width)
-                    {
-                        const int offset = y * width + x;
-                        const auto dst = reinterpret_cast<Pixel32*>(dstData) + offset;
-                        if (*reinterpret_cast<uint32_t*>(dst) == 0)
-                            *dst = Pixel32(
-                                outlineColOut.r, outlineColOut.g, outlineColOut.b,
-                                static_cast<uint8_t>(static_cast<float>(span.coverage * outlineColOut.a) / 255.0F));
-                    }
-                }
+                const int offset = y * width + x;
+                const auto dst = reinterpret_cast<Pixel32*>(dstData) + offset;
+                if (*reinterpret_cast<uint32_t*>(dst) == 0)
+                    *dst = Pixel32(
+                        outlineColOut.r, outlineColOut.g, outlineColOut.b,
+                        static_cast<uint8_t>(static_cast<float>(span.coverage * outlineColOut.a) / 255.0F));
             }
+        }
+    }
 
-            // Loop over the outline spans and just draw them into the image.
-            for (const auto& span : outlineSpansIner)
+    // Loop over the outline spans and just draw them into the image.
+    for (const auto& span : glyph.outlineSpansIner)
+    {
+        for (int w = 0; w < span.width; ++w)
+        {
+            const int y = imgHeight - 1 - (span.y - glyph.rect.ymin) + top;
+            const int x = span.x + w + left;
+            if (y >= 0 && y < height && x >= 0 && x < width)
             {
-                for (int w = 0; w < span.width; ++w)
-                {
-                    const int y = imgHeight - 1 - (span.y - rect.ymin) + top;
-                    const int x = span.x + w + left;
-                    if (y >= 0 && y < height && x >= 0 && x < width)
-                    {
-                        const int offset = y * width + x;
-                        Pixel32* dst = reinterpret_cast<Pixel32*>(dstData) + offset;
-                        *dst = Pixel32(outlineColIner.r, outlineColIner.g, outlineColIner.b, span.coverage);
-                    }
-                }
+                const int offset = y * width + x;
+                Pixel32* dst = reinterpret_cast<Pixel32*>(dstData) + offset;
+                *dst = Pixel32(outlineColIner.r, outlineColIner.g, outlineColIner.b, span.coverage);
             }
+        }
+    }
 
-            // Then loop over the regular glyph spans and blend them into the image.
-            for (const auto& span : spans)
+    // Then loop over the regular glyph spans and blend them into the image.
+    for (const auto& span : glyph.spans)
+    {
+        for (int w = 0; w < span.width; ++w)
+        {
+            const int y = imgHeight - 1 - (span.y - glyph.rect.ymin) + top;
+            const int x = span.x + w + left;
+
+            if (y >= 0 && y < height && x >= 0 && x < width)
             {
-                for (int w = 0; w < span.width; ++w)
-                {
-                    const int y = imgHeight - 1 - (span.y - rect.ymin) + top;
-                    const int x = span.x + w + left;
-
-                    if (y >= 0 && y < height && x >= 0 && x < width)
-                    {
-                        const int offset = y * width + x;
-                        const auto dst = reinterpret_cast<Pixel32*>(dstData) + offset;
-
-                        const auto src = Pixel32(fontCol.r, fontCol.g, fontCol.b, span.coverage);
-                        dst->r = static_cast<uint8_t>(static_cast<float>(dst->r + (src.r - dst->r) * src.a) / 255.0f);
-                        dst->g = static_cast<uint8_t>(static_cast<float>(dst->g + (src.g - dst->g) * src.a) / 255.0f);
-                        dst->b = static_cast<uint8_t>(static_cast<float>(dst->b + (src.b - dst->b) * src.a) / 255.0f);
-                        dst->a = FFMIN(255, dst->a + src.a);
-                    }
-                }
+                const int offset = y * width + x;
+                const auto dst = reinterpret_cast<Pixel32*>(dstData) + offset;
+
+                const auto src = Pixel32(fontCol.r, fontCol.g, fontCol.b, span.coverage);
+                dst->r = static_cast<uint8_t>(static_cast<float>(dst->r + (src.r - dst->r) * src.a) / 255.0f);
+                dst->g = static_cast<uint8_t>(static_cast<float>(dst->g + (src.g - dst->g) * src.a) / 255.0f);
+                dst->b = static_cast<uint8_t>(static_cast<float>(dst->b + (src.b - dst->b) * src.a) / 255.0f);
+                dst->a = FFMIN(255, dst->a + src.a);
             }
         }
     }
+    return true;
+}
+
+TextSubtitlesRenderFT::~TextSubtitlesRenderFT()
+{
+    if (m_glyphCache && m_glyphCache->drawn > 0)
+    {
+        const uint64_t hits = m_glyphCache->drawn - m_glyphCache->rasterized;
+        LTRACE(LT_DEBUG, 0,
+               "Glyph cache: " << hits << " of " << m_glyphCache->drawn << " drawn glyphs hit ("
+                               << hits * 100 / m_glyphCache->drawn << "%)");
+    }
+    {
+        std::lock_guard lock(m_libraryMtx);
+        for (const auto& [name, face] : m_fontMap) FT_Done_Face(face);
+    }
+    delete m_pData;
+}
+
+void TextSubtitlesRenderFT::setTransform(FT_Vector* delta)
+{
+    if (m_emulateItalic && m_emulateBold)
+        FT_Set_Transform(m_face, &italic_bold_matrix, delta);
+    else if (m_emulateItalic)
+        FT_Set_Transform(m_face, &italic_matrix, delta);
+    else if (m_emulateBold)
+        FT_Set_Transform(m_face, &bold_matrix, delta);
+    else
+        FT_Set_Transform(m_face, nullptr, delta);
+    if (!m_glyphCache)
+        m_glyphCache = std::make_unique<GlyphCache>();
 }
 
 void TextSubtitlesRenderFT::drawText(const string& text, RECT* rect)
@@ -534,28 +802,37 @@ void TextSubtitlesRenderFT::drawText(const string& text, RECT* rect)
 
     int maxX = 0;
 
-    if (m_emulateItalic && m_emulateBold)
-        FT_Set_Transform(m_face, &italic_bold_matrix, &pen);
-    else if (m_emulateItalic)
-        FT_Set_Transform(m_face, &italic_matrix, &pen);
-    else if (m_emulateBold)
-        FT_Set_Transform(m_face, &bold_matrix, &pen);
-    else
-        FT_Set_Transform(m_face, nullptr, &pen);
+    // the outlines are rendered with the subpixel part of the pen position and shifted by the whole pixels
+    FT_Vector delta{pen.x & 63, pen.y & 63};
+    const int shiftX = static_cast<int>(pen.x >> 6);
+    setTransform(&delta);
+    GlyphKey key{m_face, m_font.m_size, m_font.m_charset, m_font.m_borderWidth, m_emulateItalic, m_emulateBold};
+    key.deltaX = static_cast<int>(delta.x);
+    key.deltaY = static_cast<int>(delta.y);
 
     const uint8_t alpha = m_font.m_color >> 24;
     const auto outColor = static_cast<uint8_t>(lround(static_cast<float>(alpha) / 255.0 * 48.0));
     convertUTF::IterateUTF8Chars(text,
                                  [&](auto c)
                                  {
-                                     RenderGlyph(library, c, m_face, m_font.m_color, Pixel32(0, 0, 0, outColor),
-                                                 Pixel32(0, 0, 0, alpha), m_font.m_borderWidth, pen.x, pen.y,
-                                                 rect->right, rect->bottom, reinterpret_cast<uint32_t*>(m_pData));
-                                     pen.x += m_face->glyph->advance.x >> 6;
+                                     key.ch = c;
+                                     CachedGlyph& glyph = m_glyphCache->get(key);
+                                     ++m_glyphCache->drawn;
+                                     if (!glyph.drawn)
+                                     {
+                                         ++m_glyphCache->rasterized;
+                                         RasterizeGlyph(library, c, m_face, m_font.m_borderWidth, glyph);
+                                     }
+                                     Rect area;
+                                     if (DrawGlyph(glyph, m_face, m_font.m_color, Pixel32(0, 0, 0, outColor),
+                                                   Pixel32(0, 0, 0, alpha), pen.x + shiftX, pen.y, rect->right,
+                                                   rect->bottom, reinterpret_cast<uint32_t*>(m_pData), &area))
+                                         markDirty(area.xmin, area.ymin, area.xmax + 1, area.ymax + 1);
+                                     pen.x += glyph.advance;
                                      pen.x += lround(m_font.m_borderWidth / 2.0F);
                                      if (m_emulateBold || m_emulateItalic)
                                          pen.x += m_line_thickness - 1;
-                                     maxX = pen.x + m_face->glyph->bitmap_left;
+                                     maxX = pen.x + glyph.bitmapLeft;
                                      return true;
                                  });
     if (m_font.m_opts & Font::UNDERLINE || m_font.m_opts & Font::STRIKE_OUT)
@@ -583,32 +860,34 @@ void TextSubtitlesRenderFT::getTextSize(const string& text, SIZE* mSize)
     pen.y = 0;
     mSize->cy = mSize->cx = 0;
 
-    if (m_emulateItalic && m_emulateBold)
-        FT_Set_Transform(m_face, &italic_bold_matrix, &pen);
-    else if (m_emulateItalic)
-        FT_Set_Transform(m_face, &italic_matrix, &pen);
-    else if (m_emulateBold)
-        FT_Set_Transform(m_face, &bold_matrix, &pen);
-    else
-        FT_Set_Transform(m_face, nullptr, &pen);
+    setTransform(&pen);
+    GlyphKey key{m_face, m_font.m_size, m_font.m_charset, m_font.m_borderWidth, m_emulateItalic, m_emulateBold};
 
     convertUTF::IterateUTF8Chars(text,
                                  [&](auto c)
                                  {
-                                     const int glyph_index = FT_Get_Char_Index(m_face, c);
-                                     int error = FT_Load_Glyph(m_face, glyph_index, 0);
-                                     if (error)
-                                         THROW(ERR_COMMON, "Can't load symbol code '" << c << "' from font")
-
-                                     error = FT_Render_Glyph(m_face->glyph, FT_RENDER_MODE_NORMAL);
-                                     if (error)
-                                         THROW(ERR_COMMON, "Can't render symbol code '" << c << "' from font")
-                                     pen.x += m_face->glyph->advance.x >> 6;
+                                     key.ch = c;
+                                     CachedGlyph& glyph = m_glyphCache->get(key);
+                                     if (!glyph.measured)
+                                     {
+                                         const int glyph_index = FT_Get_Char_Index(m_face, c);
+                                         int error = FT_Load_Glyph(m_face, glyph_index, 0);
+                                         if (error)
+                                             THROW(ERR_COMMON, "Can't load symbol code '" << c << "' from font")
+
+                                         error = FT_Render_Glyph(m_face->glyph, FT_RENDER_MODE_NORMAL);
+                                         if (error)
+                                             THROW(ERR_COMMON, "Can't render symbol code '" << c << "' from font")
+                                         glyph.measureAdvance = m_face->glyph->advance.x >> 6;
+                                         glyph.measureBitmapLeft = m_face->glyph->bitmap_left;
+                                         glyph.measured = true;
+                                     }
+                                     pen.x += glyph.measureAdvance;
                                      if (m_emulateBold || m_emulateItalic)
                                          pen.x += m_line_thickness - 1;
                                      pen.x += lround(m_font.m_borderWidth / 2.0F);
                                      mSize->cy = m_face->size->metrics.height >> 6;
-                                     mSize->cx = pen.x + m_face->glyph->bitmap_left;
+                                     mSize->cx = pen.x + glyph.measureBitmapLeft;
                                      return true;
                                  });
 }
@@ -4,6 +4,9 @@
 #include <ft2build.h>
 
 #include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 #include "../textSubtitlesRender.h"
 
@@ -26,8 +29,13 @@ class TextSubtitlesRenderFT final : public TextSubtitlesRender
     void flushRasterBuffer() override;
 
    private:
+    struct GlyphCache;
+
     static FT_Library library;
-    static std::map<std::string, std::string> m_fontNameToFile;
+    static std::mutex m_libraryMtx;  // guards face creation, the renderers on the worker pool share the library
+    // family to file maps by the font directories they are built from, loaded on the first lookup by font name
+    static std::map<std::vector<std::string>, std::map<std::string, std::string>> m_fontMaps;
+    static std::mutex m_fontMapsMtx;
     FT_Face m_face;
     bool m_emulateItalic;
     bool m_emulateBold;
@@ -36,13 +44,16 @@ class TextSubtitlesRenderFT final : public TextSubtitlesRender
     FT_Matrix italic_matrix;
     FT_Matrix bold_matrix;
     FT_Matrix italic_bold_matrix;
-    void drawHorLine(int left, int right, int top, const RECT* rect) const;
+    void drawHorLine(int left, int right, int top, const RECT* rect);
     std::string findAdditionFontFile(const std::string& fontName, const std::string& fontExt, bool isBold,
                                      bool isItalic);
     int loadFont(const std::string& fontName, FT_Face& face);
-    static void loadFontMap();
+    static std::string findFontFile(const std::vector<std::string>& fontDirs, const std::string& fontName);
+    static std::map<std::string, std::string> loadFontMap(const std::vector<std::string>& fontDirs);
+    void setTransform(FT_Vector* delta);
 
     std::map<std::string, FT_Face> m_fontMap;
+    std::unique_ptr<GlyphCache> m_glyphCache;
 };
 
 }  // namespace text_subtitles
@@ -66,6 +66,7 @@ void TextSubtitlesRenderWin32::setRenderSize(const int width, const int height)
     m_hbmp = CreateDIBSection(m_dc, m_pbmpInfo, DIB_RGB_COLORS, reinterpret_cast<void**>(&m_pData), nullptr, 0);
     if (m_hbmp == nullptr)
         THROW(ERR_COMMON, "Can't initialize graphic subsystem for render text subtitles")
+    m_dirtyRect = {0, 0, width, height};
     SelectObject(m_dc, m_hbmp);
     SetBkColor(m_dc, RGB(0, 0, 0));
     SetBkMode(m_dc, TRANSPARENT);
@@ -103,6 +104,7 @@ void TextSubtitlesRenderWin32::drawText(const std::string& text, RECT* rect)
 {
 #ifdef OLD_WIN32_RENDERER
     ::DrawText(m_dc, text.c_str(), text.length(), rect, DT_NOPREFIX);
+    markDirty(rect->left, rect->top, rect->right, rect->bottom);
 #else
     Graphics graphics(m_dc);
     graphics.SetSmoothingMode(SmoothingModeHighQuality);
@@ -128,6 +130,12 @@ void TextSubtitlesRenderWin32::drawText(const std::string& text, RECT* rect)
 
     const SolidBrush brush(Color(m_font.m_color));
     graphics.FillPath(&brush, &path);
+
+    // one extra pixel around the outline for antialiasing
+    RectF bounds;
+    path.GetBounds(&bounds, nullptr, &pen);
+    markDirty(static_cast<int>(floor(bounds.X)) - 1, static_cast<int>(floor(bounds.Y)) - 1,
+              static_cast<int>(ceil(bounds.GetRight())) + 1, static_cast<int>(ceil(bounds.GetBottom())) + 1);
 #endif
 }
 
@@ -2,11 +2,13 @@
 
 #include <fs/systemlog.h>
 #include <cmath>
+#include <cstring>
 #include <sstream>
 #include <string>
 
 #include "avCodecs.h"
 #include "ioContextDemuxer.h"
+#include "simd.h"
 #include "tsMuxer.h"
 #include "vodCoreException.h"
 #include "vod_common.h"
@@ -45,6 +47,7 @@ PGSStreamReader::PGSStreamReader()
     m_scale = 1.0;
     m_isNewFrame = false;
     m_needRescale = false;
+    m_rgbArea = {0, 0, 0, 0};
     m_imgBuffer = nullptr;
     m_rgbBuffer = nullptr;
     m_scaledRgbBuffer = nullptr;
@@ -52,7 +55,7 @@ PGSStreamReader::PGSStreamReader()
     m_scaled_height = 0;
     m_render = new TextToPGSConverter(false);
     m_renderedData = nullptr;
-    m_fontBorder = 0;
+    m_fontBorder = 0.0F;
     m_offsetId = 0xff;
     m_forced_on_flag = false;
 
@@ -128,31 +131,74 @@ void PGSStreamReader::readPalette(const uint8_t* pos, const uint8_t* end)
     }
 }
 
-void PGSStreamReader::yuvToRgb(const int minY) const
+void PGSStreamReader::yuvToRgb(const int minY, BitmapArea& area)
 {
-    const uint8_t* src = m_imgBuffer;
-    const int size = m_video_width * m_video_height;
-    const uint8_t* end = src + size;
     auto dst = reinterpret_cast<RGBQUAD*>(m_rgbBuffer);
 
     RGBQUAD rgbPal[256]{};
-    YUVQuad yuvPal[256];
-    memset(&rgbPal[0], 0, sizeof(rgbPal));
-    memset(&rgbPal[0], 0, sizeof(yuvPal));
-
     for (auto itr : m_palette)
     {
-        rgbPal[itr.first] = TextToPGSConverter::YUVAToRGBA(itr.second);
-        yuvPal[itr.first] = itr.second;
+        if (itr.second.Y >= minY)
+            rgbPal[itr.first] = TextToPGSConverter::YUVAToRGBA(itr.second);
     }
     constexpr RGBQUAD zeroRgb = {};
-    for (; src < end; ++src)
+    bool transparent[256];
+    for (int i = 0; i < 256; ++i) transparent[i] = memcmp(&rgbPal[i], &zeroRgb, sizeof(RGBQUAD)) == 0;
+
+    // Most of the image is filled with one transparent index, which is skipped a vector at a time. The buffer only
+    // needs to be cleared there where the previous image had something.
+    const BitmapArea prevArea = m_rgbArea;
+    area = {m_video_width, m_video_height, 0, 0};
+    for (int y = 0; y < m_video_height; ++y)
     {
-        if (yuvPal[*src].Y >= minY)
-            *dst++ = rgbPal[*src];
-        else
-            *dst++ = zeroRgb;
+        const uint8_t* src = m_imgBuffer + y * m_video_width;
+        RGBQUAD* dstLine = dst + y * m_video_width;
+        const bool prevRow = y >= prevArea.top && y < prevArea.bottom;
+        int left = m_video_width;
+        int right = 0;
+        int x = 0;
+        while (x < m_video_width)
+        {
+#if defined(TSMUXER_SSE2)
+            if (transparent[src[x]] && x + 16 <= m_video_width &&
+                _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x)),
+                                                 _mm_set1_epi8(static_cast<char>(src[x])))) == 0xffff)
+            {
+                if (prevRow && x + 16 > prevArea.left && x < prevArea.right)
+                    memset(dstLine + x, 0, 16 * sizeof(RGBQUAD));
+                x += 16;
+                continue;
+            }
+#elif defined(TSMUXER_NEON)
+            if (transparent[src[x]] && x + 16 <= m_video_width &&
+                vminvq_u8(vceqq_u8(vld1q_u8(src + x), vdupq_n_u8(src[x]))) == 0xff)
+            {
+                if (prevRow && x + 16 > prevArea.left && x < prevArea.right)
+                    memset(dstLine + x, 0, 16 * sizeof(RGBQUAD));
+                x += 16;
+                continue;
+            }
+#endif
+            const int end = FFMIN(x + 16, static_cast<int>(m_video_width));
+            for (; x < end; ++x)
+            {
+                dstLine[x] = rgbPal[src[x]];
+                if (!transparent[src[x]])
+                {
+                    left = FFMIN(left, x);
+                    right = x + 1;
+                }
+            }
+        }
+        if (left < right)
+        {
+            area.left = FFMIN(area.left, left);
+            area.right = FFMAX(area.right, right);
+            area.top = FFMIN(area.top, y);
+            area.bottom = y + 1;
+        }
     }
+    m_rgbArea = area;
 }
 
 void PGSStreamReader::decodeRleData(const int xOffset, const int yOffset) const
@@ -164,12 +210,18 @@ void PGSStreamReader::decodeRleData(const int xOffset, const int yOffset) const
 
     uint8_t* dst = m_imgBuffer + (yOffset * m_video_width + xOffset);
     const int dstLineStep = m_video_width - object_width;
-    uint8_t color;
     int run_length;
     while (src < srcEnd)
     {
         if (*src != 0)
-            *dst++ = *src++;
+        {
+            // a sequence of single pixels, up to the next escape byte
+            const auto escape = static_cast<const uint8_t*>(memchr(src, 0, srcEnd - src));
+            const size_t count = (escape ? escape : srcEnd) - src;
+            memcpy(dst, src, count);
+            dst += count;
+            src += count;
+        }
         else
         {
             src++;
@@ -191,11 +243,9 @@ void PGSStreamReader::decodeRleData(const int xOffset, const int yOffset) const
                     run_length = *src & 0x3f;
                     src++;
                 }
-                if (b1)
-                    color = *src++;
-                else
-                    color = 0;
-                for (int i = 0; i < run_length; ++i) *dst++ = color;
+                const uint8_t color = b1 ? *src++ : 0;
+                memset(dst, color, run_length);
+                dst += run_length;
             }
         }
     }
@@ -242,7 +292,8 @@ int PGSStreamReader::readObjectDef(const uint8_t* pos, const uint8_t* end)
     {
         decodeRleData(composition_object_horizontal_position[object_id],
                       composition_object_vertical_position[object_id]);
-        yuvToRgb(m_fontBorder ? Y_THRESHOLD : 0);
+        BitmapArea area;
+        yuvToRgb(m_fontBorder > 0 ? Y_THRESHOLD : 0, area);
         BitmapInfo bmpDest;
         BitmapInfo bmpRef;
 
@@ -253,56 +304,153 @@ int PGSStreamReader::readObjectDef(const uint8_t* pos, const uint8_t* end)
         bmpDest.Width = m_scaled_width;
         bmpDest.Height = m_scaled_height;
 
-        rescaleRGB(&bmpDest, &bmpRef);
-        if (m_fontBorder)
-            TextSubtitlesRender::addBorder(m_fontBorder, m_scaledRgbBuffer, m_scaled_width, m_scaled_height);
+        BitmapArea scaledArea;
+        rescaleRGB(&bmpDest, &bmpRef, area, scaledArea);
+        if (m_fontBorder > 0)
+            TextSubtitlesRender::addBorder(m_fontBorder, m_scaledRgbBuffer, m_scaled_width, m_scaled_height,
+                                           {scaledArea.left, scaledArea.top, scaledArea.right, scaledArea.bottom});
         // memcpy(bmpDest.buffer, bmpRef.buffer, bmpDest.Width * bmpDest.Height * 4);
     }
     return 0;
 }
 
-void PGSStreamReader::rescaleRGB(const BitmapInfo* bmpDest, const BitmapInfo* bmpRef)
+namespace
+{
+// Bilinear scaling in fixed point: the weights are in 1/SCALE_ONE units, the horizontal sums keep 7 fractional bits so
+// that they fit in 16 bits for the vertical pass. The result is within 1 of the floating-point interpolation.
+constexpr int SCALE_BITS = 14;
+constexpr int SCALE_ONE = 1 << SCALE_BITS;
+constexpr int H_SHIFT = 7;
+constexpr int V_SHIFT = 2 * SCALE_BITS - H_SHIFT;
+
+// Source position of a destination pixel: a pair of neighbours starting at pos and the weight of the second one
+struct ScaleTap
+{
+    int pos;
+    int weight;
+};
+
+void scaleTaps(const int dstSize, const int srcSize, std::vector<ScaleTap>& taps)
+{
+    const double factor = static_cast<double>(srcSize) / static_cast<double>(dstSize);
+    taps.resize(dstSize);
+    for (int i = 0; i < dstSize; ++i)
+    {
+        const int pos = static_cast<int>(floor(i * factor));
+        taps[i].pos = pos;
+        taps[i].weight = static_cast<int>(lround((i * factor - pos) * SCALE_ONE));
+        if (pos >= srcSize - 1)
+        {
+            // the last pixel has no neighbour after it, it is taken in full as the second pixel of the pair before it
+            taps[i].pos = srcSize - 2;
+            taps[i].weight = SCALE_ONE;
+        }
+    }
+}
+
+#if defined(TSMUXER_SSE2)
+void scaleRow(const RGBQUAD* top, const RGBQUAD* bottom, const int yWeight, const ScaleTap* taps, const int count,
+              RGBQUAD* dst)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i yWeights = _mm_set1_epi32(yWeight << 16 | (SCALE_ONE - yWeight));
+    for (int i = 0; i < count; ++i)
+    {
+        const __m128i xWeights = _mm_set1_epi32(taps[i].weight << 16 | (SCALE_ONE - taps[i].weight));
+        __m128i t = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(top + taps[i].pos)), zero);
+        __m128i b = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(bottom + taps[i].pos)), zero);
+        // pair each channel of the first pixel with the same channel of the second one
+        t = _mm_unpacklo_epi16(t, _mm_unpackhi_epi64(t, t));
+        b = _mm_unpacklo_epi16(b, _mm_unpackhi_epi64(b, b));
+        const __m128i hTop = _mm_srli_epi32(_mm_madd_epi16(t, xWeights), H_SHIFT);
+        const __m128i hBottom = _mm_srli_epi32(_mm_madd_epi16(b, xWeights), H_SHIFT);
+        __m128i v = _mm_madd_epi16(_mm_or_si128(hTop, _mm_slli_epi32(hBottom, 16)), yWeights);
+        v = _mm_srli_epi32(v, V_SHIFT);
+        const int pixel = _mm_cvtsi128_si32(_mm_packus_epi16(_mm_packs_epi32(v, v), zero));
+        memcpy(dst + i, &pixel, sizeof(RGBQUAD));
+    }
+}
+#elif defined(TSMUXER_NEON)
+void scaleRow(const RGBQUAD* top, const RGBQUAD* bottom, const int yWeight, const ScaleTap* taps, const int count,
+              RGBQUAD* dst)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        const auto xWeight = static_cast<uint16_t>(taps[i].weight);
+        const auto xRest = static_cast<uint16_t>(SCALE_ONE - taps[i].weight);
+        const uint16x8_t t = vmovl_u8(vld1_u8(reinterpret_cast<const uint8_t*>(top + taps[i].pos)));
+        const uint16x8_t b = vmovl_u8(vld1_u8(reinterpret_cast<const uint8_t*>(bottom + taps[i].pos)));
+        uint32x4_t hTop = vmlal_n_u16(vmull_n_u16(vget_low_u16(t), xRest), vget_high_u16(t), xWeight);
+        uint32x4_t hBottom = vmlal_n_u16(vmull_n_u16(vget_low_u16(b), xRest), vget_high_u16(b), xWeight);
+        hTop = vshrq_n_u32(hTop, H_SHIFT);
+        hBottom = vshrq_n_u32(hBottom, H_SHIFT);
+        uint32x4_t v = vmlaq_n_u32(vmulq_n_u32(hTop, static_cast<uint32_t>(SCALE_ONE - yWeight)), hBottom,
+                                   static_cast<uint32_t>(yWeight));
+        v = vshrq_n_u32(v, V_SHIFT);
+        const uint8x8_t pixel = vmovn_u16(vcombine_u16(vmovn_u32(v), vmovn_u32(v)));
+        vst1_lane_u32(reinterpret_cast<uint32_t*>(dst + i), vreinterpret_u32_u8(pixel), 0);
+    }
+}
+#else
+void scaleRow(const RGBQUAD* top, const RGBQUAD* bottom, const int yWeight, const ScaleTap* taps, const int count,
+              RGBQUAD* dst)
 {
-    const double xFactor = static_cast<double>(bmpRef->Width) / static_cast<double>(bmpDest->Width);
-    const double yFactor = static_cast<double>(bmpRef->Height) / static_cast<double>(bmpDest->Height);
-    RGBQUAD* ImagePixels = bmpDest->buffer;
+    for (int i = 0; i < count; ++i)
+    {
+        const auto t = reinterpret_cast<const uint8_t*>(top + taps[i].pos);
+        const auto b = reinterpret_cast<const uint8_t*>(bottom + taps[i].pos);
+        const int xWeight = taps[i].weight;
+        const auto d = reinterpret_cast<uint8_t*>(dst + i);
+        for (int c = 0; c < 4; ++c)
+        {
+            const int hTop = (t[c] * (SCALE_ONE - xWeight) + t[c + 4] * xWeight) >> H_SHIFT;
+            const int hBottom = (b[c] * (SCALE_ONE - xWeight) + b[c + 4] * xWeight) >> H_SHIFT;
+            d[c] = static_cast<uint8_t>((hTop * (SCALE_ONE - yWeight) + hBottom * yWeight) >> V_SHIFT);
+        }
+    }
+}
+#endif
+}  // namespace
 
-    for (int yDest = 0; yDest < bmpDest->Height; yDest++)
+void PGSStreamReader::rescaleRGB(const BitmapInfo* bmpDest, const BitmapInfo* bmpRef, const BitmapArea& refArea,
+                                 BitmapArea& destArea)
+{
+    destArea = {0, 0, 0, 0};
+    if (bmpRef->Width < 2 || bmpRef->Height < 2)  // no pixel pairs to interpolate between
     {
-        for (int xDest = 0; xDest < bmpDest->Width; xDest++)
+        memset(bmpDest->buffer, 0, static_cast<size_t>(bmpDest->Width) * bmpDest->Height * sizeof(RGBQUAD));
+        return;
+    }
+    std::vector<ScaleTap> xTaps;
+    std::vector<ScaleTap> yTaps;
+    scaleTaps(bmpDest->Width, bmpRef->Width, xTaps);
+    scaleTaps(bmpDest->Height, bmpRef->Height, yTaps);
+
+    // Only the destination pixels that take something from the non-transparent area of the source are interpolated
+    const auto touches = [](const ScaleTap& tap, const int first, const int end)
+    { return tap.pos + 1 >= first && tap.pos < end; };
+    int left = 0;
+    int right = bmpDest->Width;
+    while (left < right && !touches(xTaps[left], refArea.left, refArea.right)) ++left;
+    while (right > left && !touches(xTaps[right - 1], refArea.left, refArea.right)) --right;
+
+    RGBQUAD* dst = bmpDest->buffer;
+    for (int y = 0; y < bmpDest->Height; ++y, dst += bmpDest->Width)
+    {
+        const ScaleTap& yTap = yTaps[y];
+        if (left == right || !touches(yTap, refArea.top, refArea.bottom))
         {
-            const int floor_x = static_cast<int>(floor(xDest * xFactor));
-            const int floor_y = static_cast<int>(floor(yDest * yFactor));
-            const int ceil_x = FFMIN(bmpRef->Width - 1, floor_x + 1);
-            const int ceil_y = FFMIN(bmpRef->Height - 1, floor_y + 1);
-            const double fraction_x = xDest * xFactor - floor_x;
-            const double fraction_y = yDest * yFactor - floor_y;
-            const double one_minus_x = 1.0 - fraction_x;
-            const double one_minus_y = 1.0 - fraction_y;
-            int offset = floor_y * bmpRef->Width;
-            const RGBQUAD* c1 = bmpRef->buffer + offset;
-            const RGBQUAD* c2 = c1;
-            c1 += floor_x;
-            c2 += ceil_x;
-            offset = ceil_y * bmpRef->Width;
-            const RGBQUAD* c3 = bmpRef->buffer + offset;
-            const RGBQUAD* c4 = c3;
-            c3 += floor_x;
-            c4 += ceil_x;
-            double b1 = one_minus_x * c1->rgbRed + fraction_x * c2->rgbRed;
-            double b2 = one_minus_x * c3->rgbRed + fraction_x * c4->rgbRed;
-            ImagePixels->rgbRed = static_cast<uint8_t>(one_minus_y * b1 + fraction_y * b2);
-            b1 = one_minus_x * c1->rgbGreen + fraction_x * c2->rgbGreen;
-            b2 = one_minus_x * c3->rgbGreen + fraction_x * c4->rgbGreen;
-            ImagePixels->rgbGreen = static_cast<uint8_t>(one_minus_y * b1 + fraction_y * b2);
-            b1 = one_minus_x * c1->rgbBlue + fraction_x * c2->rgbBlue;
-            b2 = one_minus_x * c3->rgbBlue + fraction_x * c4->rgbBlue;
-            ImagePixels->rgbBlue = static_cast<uint8_t>(one_minus_y * b1 + fraction_y * b2);
-            b1 = one_minus_x * c1->rgbReserved + fraction_x * c2->rgbReserved;
-            b2 = one_minus_x * c3->rgbReserved + fraction_x * c4->rgbReserved;
-            ImagePixels->rgbReserved = static_cast<uint8_t>(one_minus_y * b1 + fraction_y * b2);
-            ImagePixels++;
+            memset(dst, 0, bmpDest->Width * sizeof(RGBQUAD));
+            continue;
         }
+        memset(dst, 0, left * sizeof(RGBQUAD));
+        memset(dst + right, 0, (bmpDest->Width - right) * sizeof(RGBQUAD));
+        const RGBQUAD* top = bmpRef->buffer + yTap.pos * bmpRef->Width;
+        const RGBQUAD* bottom = top + bmpRef->Width;
+        scaleRow(top, bottom, yTap.weight, &xTaps[left], right - left, dst + left);
+        if (destArea.right == 0)
+            destArea = {left, y, right, y};
+        destArea.bottom = y + 1;
     }
 }
 
@@ -311,16 +459,7 @@ void PGSStreamReader::renderTextShow(int64_t inTime)
     m_renderedBlocks.clear();
     m_firstRenderedPacket = true;
 
-    uint32_t mask = 0;
-    int step = 0;
-    while (!m_render->rlePack(mask))
-    {
-        // reduce colors
-        const auto tmp = reinterpret_cast<uint8_t*>(&mask);
-        const int idx = step++ % 4;
-        tmp[idx] <<= 1;
-        tmp[idx]++;
-    }
+    m_render->encodeImage();
     inTime = inTime / INT_FREQ_TO_TS_FREQ;
 
     const double decodedObjectSize = m_render->renderedHeight() * m_scaled_width;
@@ -614,9 +753,8 @@ int PGSStreamReader::readPacket(AVPacket& avPacket)
             //	  << " objectID=" << (int)m_curPos[0] << " version=" << (int) m_curPos[2]);
             if (m_needRescale)
             {
+                // the RGB buffers are fully rewritten by yuvToRgb() and rescaleRGB()
                 memset(m_imgBuffer, 0xff, static_cast<size_t>(m_video_width) * m_video_height);
-                memset(m_rgbBuffer, 0x00, static_cast<size_t>(m_video_width) * m_video_height * 4);
-                memset(m_scaledRgbBuffer, 0x00, static_cast<size_t>(m_scaled_width) * m_scaled_height * 4);
                 if (readObjectDef(m_curPos, m_curPos + segment_len) == NEED_MORE_DATA)
                 {
                     m_tmpBufferLen = m_bufEnd - m_curPos;
@@ -739,7 +877,7 @@ CheckStreamRez PGSStreamReader::checkStream(uint8_t* buffer, int len, ContainerT
         rez.streamDescr = "Presentation Graphic Stream";
         if (containerStreamIndex >= 0x1200)
             rez.streamDescr +=
-                std::string(" #") + int32ToStr(containerStreamIndex - (V3_flags & 0x1e ? 0x12A0 : 0x1200));
+                std::string(" #") + int32ToStr(containerStreamIndex - (m_v3State->flags & 0x1e ? 0x12A0 : 0x1200));
     }
     else if (containerType == ContainerType::ctMKV && containerDataType == TRACKTYPE_PGS)
     {
@@ -24,6 +24,15 @@ class PGSStreamReader final : public AbstractStreamReader
 #endif
     };
 
+    // Part of a bitmap that holds non-transparent pixels, right and bottom are exclusive
+    struct BitmapArea
+    {
+        int left;
+        int top;
+        int right;
+        int bottom;
+    };
+
     PGSStreamReader();
     ~PGSStreamReader() override
     {
@@ -47,7 +56,7 @@ class PGSStreamReader final : public AbstractStreamReader
     // void setVideoHeight(int value);
     // void setFPS(double value);
     void setVideoInfo(uint16_t width, uint16_t height, double fps);
-    void setFontBorder(const int value) { m_fontBorder = value; }
+    void setFontBorder(const float value) { m_fontBorder = value; }
     void setBottomOffset(const int value) const { m_render->setBottomOffset(value); }
     void setOffsetId(const uint8_t value) { m_offsetId = value; }
     [[nodiscard]] uint8_t getOffsetId() const { return m_offsetId; }
@@ -101,7 +110,7 @@ class PGSStreamReader final : public AbstractStreamReader
     int64_t m_processedSize;
     uint8_t* m_avFragmentEnd;
     int m_afterPesByte;
-    int m_fontBorder;
+    float m_fontBorder;
 
     uint16_t m_video_width;
     uint16_t m_video_height;
@@ -115,6 +124,7 @@ class PGSStreamReader final : public AbstractStreamReader
     uint16_t object_height;
     uint8_t* m_imgBuffer;
     uint8_t* m_rgbBuffer;
+    BitmapArea m_rgbArea;  // m_rgbBuffer is transparent outside of it
     uint8_t* m_scaledRgbBuffer;
     std::map<uint8_t, text_subtitles::YUVQuad> m_palette;
     uint16_t m_scaled_width;
@@ -137,8 +147,10 @@ class PGSStreamReader final : public AbstractStreamReader
     void readPalette(const uint8_t* pos, const uint8_t* end);
     int readObjectDef(const uint8_t* pos, const uint8_t* end);
     void decodeRleData(int xOffset, int yOffset) const;
-    void yuvToRgb(int minY) const;
-    static void rescaleRGB(const BitmapInfo* bmpDest, const BitmapInfo* bmpRef);
+    void yuvToRgb(int minY, BitmapArea& area);
+    // destArea receives the part of bmpDest that takes something from refArea, the rest of bmpDest is transparent
+    static void rescaleRGB(const BitmapInfo* bmpDest, const BitmapInfo* bmpRef, const BitmapArea& refArea,
+                           BitmapArea& destArea);
     void intDecodeStream(uint8_t* buffer, size_t len);
 
     int m_palleteID;
@@ -0,0 +1,65 @@
+#ifndef SIMD_H_
+#define SIMD_H_
+
+// Compile-time selection of the vector instruction set used by the hot byte-processing loops.
+// SSE2 is part of the x86-64 baseline and NEON of AArch64, so kernels written for them need no runtime dispatch;
+// every kernel keeps a scalar path for other targets and for buffer tails.
+// Kernels that need a later x86 extension are compiled with TSMUXER_TARGET() and called only if the matching
+// cpuSupports*() check succeeds.
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TSMUXER_SSE2 1
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define TSMUXER_TARGET(isa)
+#else
+#define TSMUXER_TARGET(isa) __attribute__((target(isa)))
+#endif
+#elif (defined(__ARM_NEON) && defined(__aarch64__)) || defined(_M_ARM64)
+#define TSMUXER_NEON 1
+#include <arm_neon.h>
+#endif
+
+#include <bit>
+
+#if defined(TSMUXER_SSE2)
+// SSSE3 (pshufb)
+inline bool cpuSupportsSsse3()
+{
+#if defined(__SSSE3__)
+    return true;
+#elif defined(_MSC_VER) && !defined(__clang__)
+    static const bool supported = []() {
+        int info[4];
+        __cpuid(info, 1);
+        return (info[2] & (1 << 9)) != 0;
+    }();
+    return supported;
+#else
+    static const bool supported = __builtin_cpu_supports("ssse3");
+    return supported;
+#endif
+}
+
+// PCLMULQDQ (carry-less multiplication)
+inline bool cpuSupportsPclmul()
+{
+#if defined(__PCLMUL__)
+    return true;
+#elif defined(_MSC_VER) && !defined(__clang__)
+    static const bool supported = []() {
+        int info[4];
+        __cpuid(info, 1);
+        return (info[2] & (1 << 1)) != 0;
+    }();
+    return supported;
+#else
+    static const bool supported = __builtin_cpu_supports("pclmul");
+    return supported;
+#endif
+}
+#endif
+
+#endif
@@ -1,10 +1,12 @@
 #include "srtStreamReader.h"
 
+#include <mutex>
 #include <string>
 
 #include "convertUTF.h"
 #include "fs/systemlog.h"
 #include "matroskaParser.h"
+#include "system/workerpool.h"
 #include "vodCoreException.h"
 #include "vod_common.h"
 
@@ -12,6 +14,94 @@ using namespace std;
 
 using namespace text_subtitles;
 
+namespace
+{
+// messages rendered ahead at most, every one of them needs a converter with its own frame buffer
+constexpr size_t MAX_RENDER_BATCH = 8;
+
+// copies a field of a timing line to buf as a C string, with ',' as the decimal separator replaced by '.'
+void copyTimeField(const std::string_view field, char (&buf)[32])
+{
+    const size_t len = FFMIN(field.size(), sizeof(buf) - 1);
+    for (size_t i = 0; i < len; ++i) buf[i] = field[i] == ',' ? '.' : field[i];
+    buf[len] = 0;
+}
+
+// Same as timeToFloat(trimStr(str)) with ',' as the decimal separator, but parses the fields in place
+double srtTimeToFloat(std::string_view str)
+{
+    const auto isSpace = [](const char c) { return c == ' ' || c == '\r' || c == '\n'; };
+    while (!str.empty() && isSpace(str.front())) str.remove_prefix(1);
+    while (!str.empty() && isSpace(str.back())) str.remove_suffix(1);
+    if (str.empty())
+        return 0;
+    if (str.back() == ':')
+        str.remove_suffix(1);  // splitStr() does not return an empty last field
+
+    char buf[32];
+    double value[3] = {0, 0, 0};  // seconds, minutes, hours
+    for (int i = 0; i < 3; ++i)
+    {
+        const size_t pos = str.rfind(':');
+        copyTimeField(pos == std::string_view::npos ? str : str.substr(pos + 1), buf);
+        value[i] = i == 0 ? strtod(buf, nullptr) : static_cast<int32_t>(strtol(buf, nullptr, 10));
+        if (pos == std::string_view::npos)
+            break;
+        str = str.substr(0, pos);
+    }
+    return static_cast<int>(value[2]) * 3600 + static_cast<int>(value[1]) * 60 + value[0];
+}
+}  // namespace
+
+// Converters for the render tasks of a batch beyond the first one, which runs on the converter of the reader. They are
+// shared by all SRT readers, so only one converter less than the worker pool has threads is kept. The pool is released
+// with the last reader.
+class SRTStreamReader::RenderPool
+{
+   public:
+    static std::shared_ptr<RenderPool> instance()
+    {
+        static std::mutex mtx;
+        static std::weak_ptr<RenderPool> current;
+        std::lock_guard lock(mtx);
+        std::shared_ptr<RenderPool> pool = current.lock();
+        if (!pool)
+        {
+            pool = std::make_shared<RenderPool>();
+            current = pool;
+        }
+        return pool;
+    }
+
+    std::unique_ptr<TextToPGSConverter> acquire(const TextToPGSConverter& settings)
+    {
+        std::unique_ptr<TextToPGSConverter> render;
+        {
+            std::lock_guard lock(m_mtx);
+            if (!m_free.empty())
+            {
+                render = std::move(m_free.back());
+                m_free.pop_back();
+            }
+        }
+        if (!render)
+            render = std::make_unique<TextToPGSConverter>(true);
+        render->copySettings(settings);
+        return render;
+    }
+
+    void release(std::unique_ptr<TextToPGSConverter> render)
+    {
+        std::lock_guard lock(m_mtx);
+        if (m_free.size() + 1 < static_cast<size_t>(WorkerPool::instance().concurrency()))
+            m_free.push_back(std::move(render));
+    }
+
+   private:
+    std::mutex m_mtx;
+    std::vector<std::unique_ptr<TextToPGSConverter>> m_free;
+};
+
 SRTStreamReader::SRTStreamReader() : m_lastBlock(false), m_short_R(0), m_short_N(0), m_long_R(0), m_long_N(0)
 {
     // in future version here must be case for destination subtitle format (DVB sub, DVD sub e.t.c)
@@ -116,42 +206,70 @@ int SRTStreamReader::parseText(uint8_t* dataStart, const size_t len)
         if (!detectSrcFormat(dataStart, len, prefixLen))
             return false;
     }
+    // drop the text of the lines parsed from the previous block
+    if (m_sourceLines.empty())
+        m_sourceText.clear();
+    else if (const size_t parsed = m_sourceLines.front().offset; parsed > 0)
+    {
+        m_sourceText.erase(0, parsed);
+        for (auto& line : m_sourceLines) line.offset -= parsed;
+    }
+
     uint8_t* cur = dataStart + prefixLen;
-    const size_t roundLen = len & (~(m_charSize - 1));
-    const uint8_t* end = cur + roundLen;
+    const uint8_t* end = dataStart + (len & ~(m_charSize - 1));
     const uint8_t* lastProcessedLine = cur;
-    vector<string> rez;
-    for (; cur < end; cur += m_charSize)
+    while (cur < end)
     {
-        // if (cur[m_splitterOfs] == '\n')
-        if ((m_charSize == 1 && *cur == '\n') || (m_charSize == 2 && *reinterpret_cast<uint16_t*>(cur) == m_short_N) ||
-            (m_charSize == 4 && *reinterpret_cast<uint32_t*>(cur) == m_long_N))
+        if (m_charSize == 1)
+        {
+            cur = static_cast<uint8_t*>(memchr(cur, '\n', end - cur));
+            if (!cur)
+                break;
+        }
+        else if ((m_charSize == 2 && *reinterpret_cast<uint16_t*>(cur) != m_short_N) ||
+                 (m_charSize == 4 && *reinterpret_cast<uint32_t*>(cur) != m_long_N))
         {
-            int32_t x = 0;
-            if (cur >= m_charSize + lastProcessedLine)
-                if ((m_charSize == 1 && cur[-1] == '\r') ||
-                    (m_charSize == 2 && reinterpret_cast<uint16_t*>(cur)[-1] == m_short_R) ||
-                    (m_charSize == 4 && reinterpret_cast<uint32_t*>(cur)[-1] == m_long_R))
-                    x = m_charSize;
-
-            m_sourceText.emplace(UtfConverter::toUtf8(lastProcessedLine, cur - lastProcessedLine - x, m_srcFormat));
-            std::string& tmp = m_sourceText.back();
-            if (strOnlySpace(tmp))
-                tmp.clear();
-
-            m_origSize.push(static_cast<int32_t>(cur + m_charSize - lastProcessedLine + prefixLen));
-            prefixLen = 0;
-            lastProcessedLine = cur + m_charSize;
+            cur += m_charSize;
+            continue;
         }
+
+        size_t x = 0;
+        if (cur >= m_charSize + lastProcessedLine)
+            if ((m_charSize == 1 && cur[-1] == '\r') ||
+                (m_charSize == 2 && reinterpret_cast<uint16_t*>(cur)[-1] == m_short_R) ||
+                (m_charSize == 4 && reinterpret_cast<uint32_t*>(cur)[-1] == m_long_R))
+                x = m_charSize;
+
+        const size_t offset = m_sourceText.size();
+        UtfConverter::appendUtf8(m_sourceText, lastProcessedLine, cur - lastProcessedLine - x, m_srcFormat);
+        if (strOnlySpace(std::string_view(m_sourceText).substr(offset)))
+            m_sourceText.resize(offset);
+        m_sourceLines.push_back({offset, m_sourceText.size() - offset,
+                                 static_cast<int32_t>(cur + m_charSize - lastProcessedLine + prefixLen)});
+        prefixLen = 0;
+        cur += m_charSize;
+        lastProcessedLine = cur;
     }
     return static_cast<int>(lastProcessedLine - dataStart);
 }
 
-bool SRTStreamReader::strOnlySpace(const std::string& str)
+bool SRTStreamReader::strOnlySpace(const std::string_view str)
 {
     return std::all_of(str.begin(), str.end(), [](const char c) { return c == ' '; });
 }
 
+std::string_view SRTStreamReader::frontLine() const
+{
+    const SourceLine& line = m_sourceLines.front();
+    return std::string_view(m_sourceText).substr(line.offset, line.len);
+}
+
+void SRTStreamReader::popLine()
+{
+    m_processedSize += m_sourceLines.front().origSize;
+    m_sourceLines.pop_front();
+}
+
 int SRTStreamReader::readPacket(AVPacket& avPacket)
 {
     const int rez = m_dstSubCodec->readPacket(avPacket);
@@ -162,7 +280,7 @@ int SRTStreamReader::readPacket(AVPacket& avPacket)
         if (renderedBuffer)
         {
             m_dstSubCodec->setBuffer(renderedBuffer - MAX_AV_PACKET_SIZE, renderedLen,
-                                     m_lastBlock && m_sourceText.empty());
+                                     m_lastBlock && m_sourceLines.empty() && m_messages.empty());
             return m_dstSubCodec->readPacket(avPacket);
         }
         return NEED_MORE_DATA;
@@ -172,23 +290,72 @@ int SRTStreamReader::readPacket(AVPacket& avPacket)
 
 uint8_t* SRTStreamReader::renderNextMessage(uint32_t& renderedLen)
 {
-    uint8_t* rez = nullptr;
-    if (m_sourceText.empty())
-        return nullptr;
-    if (m_state == ParseState::PARSE_FIRST_LINE)
+    if (m_messages.empty())
     {
-        while (!m_sourceText.empty() && m_sourceText.front().empty())
+        const size_t batchSize = FFMIN(static_cast<size_t>(WorkerPool::instance().concurrency()), MAX_RENDER_BATCH);
+        while (m_messages.size() < batchSize && parseNextMessage())
         {
-            m_sourceText.pop();  // delete empty lines before message
-            m_processedSize += m_origSize.front();
-            m_origSize.pop();
         }
-        if (m_sourceText.empty())
-            return nullptr;
+        if (m_messages.size() > 1)
+            renderMessages();
+    }
+    if (m_messages.empty())
+        return nullptr;
+
+    TextMessage& msg = m_messages.front();
+    if (!msg.rendered)
+        m_srtRender->renderObject(msg.text, msg.face, msg.object);
+    uint8_t* rez = m_srtRender->doConvert(msg.object, m_animation, msg.inTime, msg.outTime, renderedLen);
+    m_messages.pop_front();
+    return rez;
+}
+
+void SRTStreamReader::renderMessages()
+{
+    // repeated texts of the batch are rendered once, the rest come from the render cache of later batches
+    std::vector<size_t> unique;
+    for (size_t i = 0; i < m_messages.size(); ++i)
+    {
+        const std::string& text = m_messages[i].text;
+        if (std::none_of(unique.begin(), unique.end(), [&](const size_t j) { return m_messages[j].text == text; }))
+            unique.push_back(i);
+    }
+    // every task renders with its own converter, the first one uses the converter of the reader
+    if (!m_renderPool)
+        m_renderPool = RenderPool::instance();
+    std::vector<std::unique_ptr<TextToPGSConverter>> renders;
+    for (size_t i = 1; i < unique.size(); ++i) renders.push_back(m_renderPool->acquire(*m_srtRender));
+    WorkerPool::instance().parallelFor(unique.size(), [this, &unique, &renders](const size_t i) {
+        TextToPGSConverter* render = i == 0 ? m_srtRender : renders[i - 1].get();
+        TextMessage& msg = m_messages[unique[i]];
+        render->renderObject(msg.text, msg.face, msg.object);
+        msg.rendered = true;
+    });
+    for (auto& render : renders) m_renderPool->release(std::move(render));
+    for (TextMessage& msg : m_messages)
+    {
+        if (msg.rendered)
+            continue;
+        const auto first = std::find_if(m_messages.begin(), m_messages.end(),
+                                        [&msg](const TextMessage& other) { return other.text == msg.text; });
+        msg.object = first->object;
+        msg.rendered = true;
+    }
+}
+
+bool SRTStreamReader::parseNextMessage()
+{
+    if (m_sourceLines.empty())
+        return false;
+    if (m_state == ParseState::PARSE_FIRST_LINE)
+    {
+        while (!m_sourceLines.empty() && frontLine().empty()) popLine();  // delete empty lines before message
+        if (m_sourceLines.empty())
+            return false;
         m_state = ParseState::PARSE_TIME;
         bool isNUmber = true;
         {
-            for (const auto& c : m_sourceText.front())
+            for (const auto& c : frontLine())
                 if (!(c >= '0' && c <= '9') && c != ' ')
                 {
                     isNUmber = false;
@@ -197,79 +364,61 @@ uint8_t* SRTStreamReader::renderNextMessage(uint32_t& renderedLen)
         }
         if (isNUmber)
         {
-            m_sourceText.pop();
-            m_processedSize += m_origSize.front();
-            m_origSize.pop();
-            if (m_sourceText.empty())
-                return nullptr;
+            popLine();
+            if (m_sourceLines.empty())
+                return false;
         }
     }
     if (m_state == ParseState::PARSE_TIME)
     {
-        if (!parseTime(m_sourceText.front()))
-            THROW(ERR_COMMON, "Invalid SRT format. \"" << m_sourceText.front().c_str() << "\" is invalid timing info")
+        if (!parseTime(frontLine()))
+            THROW(ERR_COMMON, "Invalid SRT format. \"" << frontLine() << "\" is invalid timing info")
         m_state = ParseState::PARSE_TEXT;
-        m_sourceText.pop();
-        m_processedSize += m_origSize.front();
-        m_origSize.pop();
-        if (m_sourceText.empty())
-            return nullptr;
+        popLine();
+        if (m_sourceLines.empty())
+            return false;
     }
 
-    while (!m_sourceText.empty() && !m_sourceText.front().empty())
+    while (!m_sourceLines.empty() && !frontLine().empty())
     {
         if (!m_renderedText.empty())
             m_renderedText += '\n';
-        m_renderedText += m_sourceText.front();
-        m_sourceText.pop();
-        m_processedSize += m_origSize.front();
-        m_origSize.pop();
+        m_renderedText += frontLine();
+        popLine();
     }
 
-    if (m_sourceText.empty())
+    if (m_sourceLines.empty())
     {
         if (m_lastBlock && !m_renderedText.empty())
         {
             m_state = ParseState::PARSE_FIRST_LINE;
             m_renderedText.clear();
-            rez = m_srtRender->doConvert(m_renderedText, m_animation, m_inTime, m_outTime, renderedLen);
+            addMessage();
+            return true;
         }
-        return rez;
+        return false;
     }
-    m_sourceText.pop();  // delete empty line (messages separator)
-    m_processedSize += m_origSize.front();
-    m_origSize.pop();
-    rez = m_srtRender->doConvert(m_renderedText, m_animation, m_inTime, m_outTime, renderedLen);
+    popLine();  // delete empty line (messages separator)
+    addMessage();
     m_state = ParseState::PARSE_FIRST_LINE;
     m_renderedText.clear();
-    return rez;
+    return true;
 }
 
-bool SRTStreamReader::parseTime(const string& text)
+void SRTStreamReader::addMessage()
 {
-    for (size_t i = 0; i < text.length() - 2; i++)
-    {
-        if (text[i] == '-' && text[i + 1] == '-' && text[i + 2] == '>')
-        {
-            string first = trimStr(text.substr(0, i));
-            string second = trimStr(text.substr(i + 3, text.length() - i - 3));
-            for (char& c : first)
-            {
-                if (c == ',')
-                    c = '.';
-            }
-            for (char& c : second)
-            {
-                if (c == ',')
-                    c = '.';
-            }
+    m_messages.push_back({m_renderedText, m_inTime, m_outTime, false, m_face, {}});
+    m_face = m_srtRender->m_textRender->faceAfterText(m_renderedText, m_face);
+}
 
-            m_inTime = timeToFloat(first);
-            m_outTime = timeToFloat(second);
-            return true;
-        }
-    }
-    return false;
+bool SRTStreamReader::parseTime(const std::string_view text)
+{
+    const size_t arrow = text.find("-->");
+    if (arrow == std::string_view::npos)
+        return false;
+    m_inTime = srtTimeToFloat(text.substr(0, arrow));
+    m_outTime = srtTimeToFloat(text.substr(arrow + 3));
+    return true;
 }
 
 // ReSharper disable once CppMemberFunctionMayBeStatic
@@ -1,7 +1,9 @@
 #ifndef SRT_STREAM_READER_
 #define SRT_STREAM_READER_
 
-#include <queue>
+#include <deque>
+#include <memory>
+#include <string_view>
 
 #include "abstractStreamReader.h"
 #include "avCodecs.h"
@@ -41,7 +43,12 @@ class SRTStreamReader final : public AbstractStreamReader
         if (pgsReader)
             pgsReader->setVideoInfo(0, 0, fps);
     }
-    void setFont(const text_subtitles::Font& font) const { m_srtRender->m_textRender->setFont(font); }
+    void setFont(const text_subtitles::Font& font)
+    {
+        m_srtRender->m_textRender->setFont(font);
+        m_face = font;
+    }
+    void setFontDirs(const std::vector<std::string>& dirs) const { m_srtRender->m_textRender->m_fontDirs = dirs; }
     void setAnimation(const text_subtitles::TextAnimation& animation);
     void setBottomOffset(const int offset) const { m_srtRender->setBottomOffset(offset); }
 
@@ -63,8 +70,17 @@ class SRTStreamReader final : public AbstractStreamReader
     bool m_lastBlock;
     int parseText(uint8_t* dataStart, size_t len);
     std::vector<uint8_t> m_tmpBuffer;
-    std::queue<std::string> m_sourceText;
-    std::queue<int32_t> m_origSize;
+
+    // Lines of the current input block which are not parsed yet. Their UTF-8 text is kept in one buffer, which is
+    // compacted when the next block arrives, so the memory used does not depend on the size of the file.
+    struct SourceLine
+    {
+        size_t offset;
+        size_t len;
+        int32_t origSize;  // size in the source file with the line break
+    };
+    std::string m_sourceText;
+    std::deque<SourceLine> m_sourceLines;
     std::string m_renderedText;
     long m_splitterOfs;
     uint16_t m_short_R;
@@ -73,6 +89,22 @@ class SRTStreamReader final : public AbstractStreamReader
     uint32_t m_long_N;
     text_subtitles::TextAnimation m_animation;
 
+    // Parsed message. Messages are read ahead and rendered in batches on the worker pool, their display sets are
+    // composed one by one in source order.
+    struct TextMessage
+    {
+        std::string text;
+        double inTime;
+        double outTime;
+        bool rendered;
+        text_subtitles::Font face;  // face loaded when the message starts in sequential rendering
+        text_subtitles::TextToPGSConverter::RenderedObject object;
+    };
+    std::deque<TextMessage> m_messages;
+    text_subtitles::Font m_face;  // face loaded after the last parsed message
+    class RenderPool;
+    std::shared_ptr<RenderPool> m_renderPool;
+
     enum class ParseState
     {
         PARSE_FIRST_LINE,
@@ -81,10 +113,15 @@ class SRTStreamReader final : public AbstractStreamReader
     };
     ParseState m_state;
     uint8_t* renderNextMessage(uint32_t& renderedLen);
-    bool parseTime(const std::string& text);
+    bool parseNextMessage();
+    void addMessage();
+    void renderMessages();
+    std::string_view frontLine() const;
+    void popLine();
+    bool parseTime(std::string_view text);
     static std::string detectUTF8Lang(uint8_t* buffer, int len);
     bool detectSrcFormat(const uint8_t* dataStart, size_t len, int& prefixLen);
-    static bool strOnlySpace(const std::string& str);
+    static bool strOnlySpace(std::string_view str);
 };
 
 #endif
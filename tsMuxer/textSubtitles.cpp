@@ -11,8 +11,12 @@
 #include "osdep/textSubtitlesRenderFT.h"
 #endif
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <list>
+#include <mutex>
+#include <string_view>
 
 #include "pgsStreamReader.h"
 #include "vodCoreException.h"
@@ -96,8 +100,16 @@ void TextToPGSConverter::enlargeCrop(const uint16_t width, const uint16_t height
 
 void TextToPGSConverter::setVideoInfo(const uint16_t width, const uint16_t height, const double fps)
 {
-    enlargeCrop(width, height, &m_videoWidth, &m_videoHeight);
+    uint16_t renderWidth, renderHeight;
+    enlargeCrop(width, height, &renderWidth, &renderHeight);
     m_videoFps = fps;
+    resizeBuffers(renderWidth, renderHeight);
+}
+
+void TextToPGSConverter::resizeBuffers(const uint16_t width, const uint16_t height)
+{
+    m_videoWidth = width;
+    m_videoHeight = height;
     if (m_textRender)
         m_textRender->setRenderSize(m_videoWidth, m_videoHeight);
     delete[] m_renderedData;
@@ -112,27 +124,34 @@ double TextToPGSConverter::alignToGrid(const double value) const
     return frameCnt / m_videoFps;
 }
 
-uint8_t TextToPGSConverter::color32To8(const uint32_t* buff, const uint32_t colorMask)
+YUVQuad TextToPGSConverter::pixelColor(const uint32_t rgba)
+{
+    PixelColor& cached = m_pixelColors[(rgba * 0x9E3779B1U) >> (32 - PIXEL_COLOR_CACHE_BITS)];
+    if (!cached.valid || cached.rgba != rgba)
+    {
+        cached.rgba = rgba;
+        cached.yuv = RGBAToYUVA(rgba);
+        if (!m_colorMap.empty())
+            cached.yuv = m_colorMap[cached.yuv];
+        cached.valid = true;
+    }
+    return cached.yuv;
+}
+
+uint8_t TextToPGSConverter::color32To8(const uint32_t* buff)
 {
-    YUVQuad yuv = RGBAToYUVA(*buff | colorMask);
+    const YUVQuad yuv = pixelColor(*buff);
     const auto itr = m_paletteYUV.find(yuv);
     if (itr == m_paletteYUV.end())
     {
         if (m_paletteYUV.size() < 255)
-        {
-            const pair<map<YUVQuad, uint8_t>::iterator, bool> rez =
-                m_paletteYUV.insert(std::make_pair(yuv, static_cast<uint8_t>(m_paletteYUV.size())));
-            return rez.first->second;
-        }
-        // find nearest color
-        // if (m_paletteYUV.size() >= 256)
+            return m_paletteYUV.emplace(yuv, static_cast<uint8_t>(m_paletteYUV.size())).first->second;
         THROW(ERR_COMMON, "Can't transform image to YUV: too many colors are used.")
-        // return m_paletteYUV[yuv];
     }
     return itr->second;
 }
 
-int TextToPGSConverter::getRepeatCnt(const uint32_t* pos, const uint32_t* end, const uint32_t colorMask)
+int TextToPGSConverter::getRepeatCnt(const uint32_t* pos, const uint32_t* end)
 {
     int rez = 1;
     if (*pos == 0)
@@ -147,12 +166,11 @@ int TextToPGSConverter::getRepeatCnt(const uint32_t* pos, const uint32_t* end, c
     }
     else
     {
-        const uint32_t rgbColor = *pos | colorMask;
-        const YUVQuad color = RGBAToYUVA(rgbColor);
+        const uint32_t rgbColor = *pos;
+        const YUVQuad color = pixelColor(rgbColor);
         for (const uint32_t* cur = pos + 1; cur < end && *cur != 0; cur++)
         {
-            const uint32_t newRGBColor = *cur | colorMask;
-            if (newRGBColor == rgbColor || RGBAToYUVA(newRGBColor) == color)
+            if (*cur == rgbColor || pixelColor(*cur) == color)
                 rez++;
             else
                 break;
@@ -161,44 +179,238 @@ int TextToPGSConverter::getRepeatCnt(const uint32_t* pos, const uint32_t* end, c
     return rez;
 }
 
+namespace
+{
+struct ColorCount
+{
+    YUVQuad color;
+    uint32_t count;
+};
+
+uint8_t channel(const YUVQuad& color, const int idx)
+{
+    switch (idx)
+    {
+    case 0:
+        return color.Y;
+    case 1:
+        return color.Cr;
+    case 2:
+        return color.Cb;
+    default:
+        return color.alpha;
+    }
+}
+
+// Median cut: the box with the widest channel range is split at the pixel-weighted median of that channel until
+// there are maxColors boxes. Every color is mapped to the weighted mean of its box.
+void medianCut(std::vector<ColorCount>& colors, const size_t maxColors,
+               std::unordered_map<YUVQuad, YUVQuad, YUVQuadHash>& colorMap)
+{
+    struct Box
+    {
+        size_t begin;
+        size_t end;
+        int channel;  // widest channel
+        int range;
+    };
+    const auto makeBox = [&colors](const size_t begin, const size_t end) {
+        int minValue[4] = {255, 255, 255, 255};
+        int maxValue[4] = {};
+        for (size_t i = begin; i < end; ++i)
+        {
+            for (int c = 0; c < 4; ++c)
+            {
+                minValue[c] = FFMIN(minValue[c], channel(colors[i].color, c));
+                maxValue[c] = FFMAX(maxValue[c], channel(colors[i].color, c));
+            }
+        }
+        Box box{begin, end, 0, 0};
+        for (int c = 0; c < 4; ++c)
+        {
+            if (maxValue[c] - minValue[c] > box.range)
+            {
+                box.range = maxValue[c] - minValue[c];
+                box.channel = c;
+            }
+        }
+        return box;
+    };
+
+    std::vector<Box> boxes{makeBox(0, colors.size())};
+    while (boxes.size() < maxColors)
+    {
+        Box* widest = nullptr;
+        for (auto& box : boxes)
+            if (box.range > 0 && (!widest || box.range > widest->range))
+                widest = &box;
+        if (!widest)
+            break;
+        const Box box = *widest;
+        std::stable_sort(colors.begin() + box.begin, colors.begin() + box.end,
+                         [c = box.channel](const ColorCount& a, const ColorCount& b) {
+                             return channel(a.color, c) < channel(b.color, c);
+                         });
+        uint64_t total = 0;
+        for (size_t i = box.begin; i < box.end; ++i) total += colors[i].count;
+        size_t split = box.begin + 1;
+        for (uint64_t sum = colors[box.begin].count; split < box.end - 1 && sum * 2 < total; ++split)
+            sum += colors[split].count;
+        *widest = makeBox(box.begin, split);
+        boxes.push_back(makeBox(split, box.end));
+    }
+
+    for (const auto& box : boxes)
+    {
+        uint64_t sum[4] = {};
+        uint64_t total = 0;
+        for (size_t i = box.begin; i < box.end; ++i)
+        {
+            for (int c = 0; c < 4; ++c) sum[c] += static_cast<uint64_t>(channel(colors[i].color, c)) * colors[i].count;
+            total += colors[i].count;
+        }
+        YUVQuad mean;
+        mean.Y = static_cast<uint8_t>((sum[0] + total / 2) / total);
+        mean.Cr = static_cast<uint8_t>((sum[1] + total / 2) / total);
+        mean.Cb = static_cast<uint8_t>((sum[2] + total / 2) / total);
+        mean.alpha = static_cast<uint8_t>((sum[3] + total / 2) / total);
+        for (size_t i = box.begin; i < box.end; ++i) colorMap[colors[i].color] = mean;
+    }
+}
+}  // namespace
+
+void TextToPGSConverter::buildColorMap(const size_t maxColors)
+{
+    if (!m_colorMap.empty())
+    {
+        m_colorMap.clear();
+        std::fill(std::begin(m_pixelColors), std::end(m_pixelColors), PixelColor());
+    }
+
+    // histogram of the image in YUV
+    std::unordered_map<YUVQuad, uint32_t, YUVQuadHash> histogram;
+    uint16_t firstRow, endRow;
+    drawnRows(firstRow, endRow);
+    const auto srcData = reinterpret_cast<const uint32_t*>(m_textRender ? m_textRender->m_pData : m_imageBuffer);
+    const uint32_t* cur = srcData + static_cast<size_t>(firstRow) * m_videoWidth;
+    const uint32_t* end = srcData + static_cast<size_t>(endRow) * m_videoWidth;
+    while (cur < end)
+    {
+        const uint32_t* runEnd = cur + 1;
+        while (runEnd < end && *runEnd == *cur) ++runEnd;
+        histogram[pixelColor(*cur)] += static_cast<uint32_t>(runEnd - cur);
+        cur = runEnd;
+    }
+    // the rows outside of the drawn area are transparent
+    if (endRow - firstRow < m_videoHeight)
+        histogram.try_emplace(pixelColor(0), 0);
+    if (histogram.size() <= maxColors)
+        return;  // the colors are used as is
+    std::fill(std::begin(m_pixelColors), std::end(m_pixelColors), PixelColor());
+
+    // fully transparent colors are not quantized, they all become the transparent black
+    const YUVQuad transparent = RGBAToYUVA(0);
+    std::vector<ColorCount> colors;
+    bool hasTransparent = false;
+    for (const auto& [color, count] : histogram)
+    {
+        if (color.alpha == 0)
+        {
+            m_colorMap[color] = transparent;
+            hasTransparent = true;
+        }
+        else
+            colors.push_back({color, count});
+    }
+    // a defined order, so that the result doesn't depend on the hash table
+    std::sort(colors.begin(), colors.end(), [](const ColorCount& a, const ColorCount& b) { return a.color < b.color; });
+    if (!colors.empty())
+        medianCut(colors, hasTransparent && maxColors > 1 ? maxColors - 1 : maxColors, m_colorMap);
+}
+
+namespace
+{
+// The BT.601 conversions below are done in integers with the coefficients in 1/1000 units: lround(x / 1000.0) >> 8 is
+// (x + 500) / 256000 for x > 0. Only a tie that lands on a multiple of 256 can come out differently, as the double
+// expression rounds it up or down depending on how its coefficients are represented. Such ties are left to that
+// expression, so that the result stays bit-exact with it. Negative values only come from YUVAToRGBA(), which clamps
+// them to 0.
+constexpr int64_t FIXED_TIE = 255500;
+constexpr int64_t FIXED_SCALE = 256000;
+
+template <typename Expr>
+int fixedToInt(const int64_t x, const Expr floatExpr)
+{
+    if (x <= 0)
+        return 0;
+    if (x % FIXED_SCALE == FIXED_TIE)
+        return static_cast<int>(lround(floatExpr()) >> 8);
+    return static_cast<int>((x + 500) / FIXED_SCALE);
+}
+
+uint8_t clampToByte(const int x) { return static_cast<uint8_t>(FFMAX(FFMIN(x, 255), 0)); }
+}  // namespace
+
 YUVQuad TextToPGSConverter::RGBAToYUVA(uint32_t data)
 {
     const auto rgba = reinterpret_cast<RGBQUAD*>(&data);
+    const int r = rgba->rgbRed;
+    const int g = rgba->rgbGreen;
+    const int b = rgba->rgbBlue;
     YUVQuad rez;
-    rez.Y = static_cast<uint8_t>(
-        lround(65.738 * rgba->rgbRed + 129.057 * rgba->rgbGreen + 25.064 * rgba->rgbBlue + 4224.0) >> 8);
-    rez.Cr = static_cast<uint8_t>(
-        lround(112.439 * rgba->rgbRed - 94.154 * rgba->rgbGreen - 18.285 * rgba->rgbBlue + 32896.0) >> 8);
-    rez.Cb = static_cast<uint8_t>(
-        lround(-37.945 * rgba->rgbRed - 74.494 * rgba->rgbGreen + 112.439 * rgba->rgbBlue + 32896.0) >> 8);
+    rez.Y = static_cast<uint8_t>(fixedToInt(65738LL * r + 129057LL * g + 25064LL * b + 4224000,
+                                            [&] { return 65.738 * r + 129.057 * g + 25.064 * b + 4224.0; }));
+    rez.Cr = static_cast<uint8_t>(fixedToInt(112439LL * r - 94154LL * g - 18285LL * b + 32896000,
+                                             [&] { return 112.439 * r - 94.154 * g - 18.285 * b + 32896.0; }));
+    rez.Cb = static_cast<uint8_t>(fixedToInt(-37945LL * r - 74494LL * g + 112439LL * b + 32896000,
+                                             [&] { return -37.945 * r - 74.494 * g + 112.439 * b + 32896.0; }));
     rez.alpha = rgba->rgbReserved;
     return rez;
 }
 
 RGBQUAD TextToPGSConverter::YUVAToRGBA(const YUVQuad& yuv)
 {
+    const int y = yuv.Y;
+    const int cr = yuv.Cr;
+    const int cb = yuv.Cb;
     RGBQUAD rez;
-    int tmp = lround(298.082 * yuv.Y + 516.412 * yuv.Cb - 70742.016) >> 8;
-    rez.rgbBlue = static_cast<uint8_t>(FFMAX(FFMIN(tmp, 255L), 0));
-    tmp = lround(298.082 * yuv.Y - 208.120 * yuv.Cr - 100.291 * yuv.Cb + 34835.456) >> 8;
-    rez.rgbGreen = static_cast<uint8_t>(FFMAX(FFMIN(tmp, 255L), 0));
-    tmp = lround(298.082 * yuv.Y + 516.412 * yuv.Cr - 56939.776) >> 8;
-    rez.rgbRed = static_cast<uint8_t>(FFMAX(FFMIN(tmp, 255L), 0));
+    rez.rgbBlue = clampToByte(
+        fixedToInt(298082LL * y + 516412LL * cb - 70742016, [&] { return 298.082 * y + 516.412 * cb - 70742.016; }));
+    rez.rgbGreen = clampToByte(fixedToInt(298082LL * y - 208120LL * cr - 100291LL * cb + 34835456,
+                                          [&] { return 298.082 * y - 208.120 * cr - 100.291 * cb + 34835.456; }));
+    rez.rgbRed = clampToByte(
+        fixedToInt(298082LL * y + 516412LL * cr - 56939776, [&] { return 298.082 * y + 516.412 * cr - 56939.776; }));
     rez.rgbReserved = yuv.alpha;
     return rez;
 }
 
-void TextToPGSConverter::reduceColors(uint8_t mask) const
+void TextToPGSConverter::drawnRows(uint16_t& firstRow, uint16_t& endRow) const
 {
-    mask = ~mask;
-    const uint32_t val = (mask << 24) + (mask << 16) + (mask << 8) + mask;
-    auto dst = reinterpret_cast<uint32_t*>(m_textRender ? m_textRender->m_pData : m_imageBuffer);
-    const int len = m_videoWidth * m_videoHeight;
-    const uint32_t* end = dst + len;
-    for (; dst < end; ++dst) *dst &= val;
+    firstRow = 0;
+    endRow = m_videoHeight;
+    if (m_textRender)
+    {
+        // the renderer knows where it has drawn, all other rows are empty
+        const RECT& dirty = m_textRender->m_dirtyRect;
+        firstRow = static_cast<uint16_t>(FFMIN(dirty.top, m_videoHeight));
+        endRow = static_cast<uint16_t>(FFMAX(firstRow, FFMIN(dirty.bottom, m_videoHeight)));
+    }
+}
+
+void TextToPGSConverter::encodeImage()
+{
+    // The image is quantized to a palette up front. Only if an RLE line still overflows, the palette is shrunk.
+    for (size_t maxColors = 255;; maxColors /= 2)
+    {
+        buildColorMap(maxColors);
+        if (rlePack())
+            return;
+        if (maxColors == 1)
+            THROW(ERR_COMMON, "Not enough RLE buffer for encoding picture (RLE line length > width + 16)")
+    }
 }
 
-bool TextToPGSConverter::rlePack(const uint32_t colorMask)
+bool TextToPGSConverter::rlePack()
 {
     try
     {
@@ -207,19 +419,22 @@ bool TextToPGSConverter::rlePack(const uint32_t colorMask)
 
         uint8_t* curPtr = m_renderedData;
         const uint8_t* trimPos = m_renderedData;
+        uint16_t firstRow, endRow;
+        drawnRows(firstRow, endRow);
         auto srcData = reinterpret_cast<uint32_t*>(m_textRender ? m_textRender->m_pData : m_imageBuffer);
         assert(srcData);
+        srcData += static_cast<size_t>(firstRow) * m_videoWidth;
         m_rleLen = 0;
         m_minLine = UINT16_MAX;
         m_maxLine = 0;
-        for (uint16_t y = 0; y < m_videoHeight; y++)
+        for (uint16_t y = firstRow; y < endRow; y++)
         {
             const uint32_t* srcLineEnd = srcData + m_videoWidth;
             const uint8_t* dstLineEnd = curPtr + m_videoWidth + 16;
             bool isEmptyLine = false;
             while (srcData < srcLineEnd)
             {
-                const int repCnt = getRepeatCnt(srcData, srcLineEnd, colorMask);
+                const int repCnt = getRepeatCnt(srcData, srcLineEnd);
 
                 if (repCnt == m_videoWidth)
                 {
@@ -236,7 +451,7 @@ bool TextToPGSConverter::rlePack(const uint32_t colorMask)
                     m_maxLine = FFMAX(m_maxLine, y);
                 }
 
-                const uint8_t srcColor = color32To8(srcData, colorMask);
+                const uint8_t srcColor = color32To8(srcData);
                 assert(repCnt < 16384);
                 if (srcColor)  // color exists
                 {
@@ -289,12 +504,18 @@ bool TextToPGSConverter::rlePack(const uint32_t colorMask)
             if (!isEmptyLine)
                 trimPos = curPtr;
         }
+        if (endRow < m_videoHeight && curPtr != m_renderedData)
+        {
+            // the empty rows below are trimmed from the output, they only add the transparent color to the palette
+            constexpr uint32_t transparent = 0;
+            color32To8(&transparent);
+        }
         if (m_minLine == UINT16_MAX)
             m_minLine = m_maxLine = 0;
         m_rleLen = static_cast<int>(trimPos - m_renderedData);
         // sort by colors indexes
         m_paletteByColor.clear();
-        for (auto [fst, snd] : m_paletteYUV) m_paletteByColor.insert(std::make_pair(snd, fst));
+        for (const auto& [fst, snd] : m_paletteYUV) m_paletteByColor.insert(std::make_pair(snd, fst));
         assert(m_paletteByColor.size() == m_paletteYUV.size());
         return true;
     }
@@ -326,30 +547,155 @@ float toCurve(const float value)
     return result;
 }
 
-uint8_t* TextToPGSConverter::doConvert(const std::string& text, const TextAnimation& animation, double inTimeSec,
-                                       double outTimeSec, uint32_t& dstBufSize)
+void TextToPGSConverter::copySettings(const TextToPGSConverter& other)
 {
-    const bool forced = m_textRender->rasterText(text);
-    inTimeSec = alignToGrid(inTimeSec);
-    outTimeSec = alignToGrid(outTimeSec);
+    m_bottomOffset = other.m_bottomOffset;
+    m_videoFps = other.m_videoFps;
+    // the size of the other converter is enlarged already, the buffers of a reused converter are kept if it matches
+    if (m_videoWidth != other.m_videoWidth || m_videoHeight != other.m_videoHeight)
+        resizeBuffers(other.m_videoWidth, other.m_videoHeight);
+    m_textRender->m_fontDirs = other.m_textRender->m_fontDirs;
+    m_textRender->setFont(other.m_textRender->getFont());
+}
 
-    const double inTimePTS = inTimeSec * 90000.0;
-    const double outTimePTS = outTimeSec * 90000.0;
+namespace
+{
+// Rendered objects of all converters by the content they are made of: the text, the font, the face the text starts
+// with, the font directories the font files are looked up in and the video size. Repeated events (karaoke, fades,
+// forced tracks) and the same file muxed into several tracks are rendered once. The bottom offset only moves the window
+// when the display set is composed, so variants which differ in it share one object.
+class RenderCache
+{
+   public:
+    static constexpr size_t MAX_BYTES = 32 * 1024 * 1024;
+
+    bool get(const std::string& key, TextToPGSConverter::RenderedObject& object)
+    {
+        std::lock_guard lock(m_mtx);
+        const auto itr = m_index.find(key);
+        if (itr == m_index.end())
+            return false;
+        m_lru.splice(m_lru.begin(), m_lru, itr->second);
+        object = itr->second->object;
+        return true;
+    }
 
-    uint32_t mask = 0;
-    int step = 0;
-    while (!rlePack(mask))
+    void put(std::string key, const TextToPGSConverter::RenderedObject& object)
     {
-        // reduce colors
-        const auto tmp = reinterpret_cast<uint8_t*>(&mask);
-        const int idx = step++ % 4;
-        tmp[idx] <<= 1;
-        tmp[idx]++;
+        const size_t size = key.size() + object.rleData.size() + object.palette.size() * sizeof(YUVQuad);
+        std::lock_guard lock(m_mtx);
+        if (size > MAX_BYTES / 16 || m_index.find(key) != m_index.end())
+            return;
+        while (!m_lru.empty() && m_bytes + size > MAX_BYTES)
+        {
+            m_index.erase(m_lru.back().key);
+            m_bytes -= m_lru.back().size;
+            m_lru.pop_back();
+        }
+        m_lru.push_front({std::move(key), object, size});
+        m_index.emplace(m_lru.front().key, m_lru.begin());
+        m_bytes += size;
     }
 
+   private:
+    struct Entry
+    {
+        std::string key;
+        TextToPGSConverter::RenderedObject object;
+        size_t size;
+    };
+    std::mutex m_mtx;
+    std::list<Entry> m_lru;
+    std::unordered_map<std::string_view, std::list<Entry>::iterator> m_index;  // views of the keys in m_lru
+    size_t m_bytes = 0;
+};
+
+RenderCache& renderCache()
+{
+    static RenderCache cache;
+    return cache;
+}
+
+template <typename T>
+void appendBytes(std::string& dst, const T& value)
+{
+    dst.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+}  // namespace
+
+std::string TextToPGSConverter::renderKey(const std::string& text, const Font& face) const
+{
+    std::string key;
+    key.reserve(64 + text.size());
+    appendBytes(key, m_videoWidth);
+    appendBytes(key, m_videoHeight);
+    for (const Font* font : {&m_textRender->getFont(), &face})
+    {
+        appendBytes(key, font->m_size);
+        appendBytes(key, font->m_opts);
+        appendBytes(key, font->m_borderWidth);
+        appendBytes(key, font->m_charset);
+        appendBytes(key, font->m_color);
+        appendBytes(key, font->m_lineSpacing);
+        key += font->m_name;
+        key += '\0';
+    }
+    // a font name can resolve to another file with other --font-dir lists, for the tags of the text as well
+    appendBytes(key, m_textRender->m_fontDirs.size());
+    for (const std::string& dir : m_textRender->m_fontDirs)
+    {
+        key += dir;
+        key += '\0';
+    }
+    key += text;
+    return key;
+}
+
+bool TextToPGSConverter::renderText(const std::string& text)
+{
+    const bool forced = m_textRender->rasterText(text);
+    encodeImage();
+    return forced;
+}
+
+void TextToPGSConverter::renderObject(const std::string& text, const Font& face, RenderedObject& object)
+{
+    std::string key = renderKey(text, face);
+    if (renderCache().get(key, object))
+        return;
+    m_textRender->loadFace(face);
+    object.forced = renderText(text);
+    object.rleData.assign(m_renderedData, m_renderedData + m_rleLen);
+    object.palette = m_paletteByColor;
+    object.minLine = m_minLine;
+    object.maxLine = m_maxLine;
+    renderCache().put(std::move(key), object);
+}
+
+uint8_t* TextToPGSConverter::doConvert(const RenderedObject& object, const TextAnimation& animation,
+                                       const double inTimeSec, const double outTimeSec, uint32_t& dstBufSize)
+{
+    m_rleLen = static_cast<int>(object.rleData.size());
+    if (m_rleLen > 0)
+        memcpy(m_renderedData, object.rleData.data(), m_rleLen);
+    m_paletteByColor = object.palette;
+    m_minLine = object.minLine;
+    m_maxLine = object.maxLine;
+    return composeDisplaySet(object.forced, animation, inTimeSec, outTimeSec, dstBufSize);
+}
+
+uint8_t* TextToPGSConverter::composeDisplaySet(const bool forced, const TextAnimation& animation, double inTimeSec,
+                                               double outTimeSec, uint32_t& dstBufSize)
+{
     if (m_rleLen == 0)
         return nullptr;  // empty text
 
+    inTimeSec = alignToGrid(inTimeSec);
+    outTimeSec = alignToGrid(outTimeSec);
+
+    const double inTimePTS = inTimeSec * 90000.0;
+    const double outTimePTS = outTimeSec * 90000.0;
+
     const auto objectWindowHeight = static_cast<uint16_t>(FFMAX(0, renderedHeight()));
     const auto objectWindowTop =
         static_cast<uint16_t>(FFMAX(0, m_textRender->m_height - objectWindowHeight - m_bottomOffset));
@@ -10,6 +10,8 @@
 
 #include <map>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "textSubtitlesRender.h"
 
@@ -47,13 +49,30 @@ class TextToPGSConverter  //: public TextSubtitlesRenderWin32
    public:
     typedef std::map<uint8_t, YUVQuad> Palette;
 
+    // Rasterized and RLE-encoded text of one message, ready to be composed into a display set
+    struct RenderedObject
+    {
+        std::vector<uint8_t> rleData;
+        Palette palette;
+        uint16_t minLine = 0;
+        uint16_t maxLine = 0;
+        bool forced = false;
+    };
+
     TextToPGSConverter(bool sourceIsText);
     ~TextToPGSConverter();
     void setVideoInfo(uint16_t width, uint16_t height, double fps);
     void enlargeCrop(uint16_t width, uint16_t height, uint16_t* newWidth, uint16_t* newHeight) const;
     void setBottomOffset(const int offset) { m_bottomOffset = offset; }
-    uint8_t* doConvert(const std::string& text, const TextAnimation& animation, double inTimeSec, double outTimeSec,
-                       uint32_t& dstBufSize);
+    // Renders a text starting with the face of `face` (see TextSubtitlesRender::faceAfterText), so that it needs no
+    // state shared between messages and may run on any thread for its own converter. The display sets must be composed
+    // in presentation order as they carry composition numbers.
+    // Objects are cached by content and shared between all converters, identical messages are rendered once.
+    void renderObject(const std::string& text, const Font& face, RenderedObject& object);
+    uint8_t* doConvert(const RenderedObject& object, const TextAnimation& animation, double inTimeSec,
+                       double outTimeSec, uint32_t& dstBufSize);
+    // Takes the video size, bottom offset, font and font directories of another converter
+    void copySettings(const TextToPGSConverter& other);
     TextSubtitlesRender* m_textRender;
     static YUVQuad RGBAToYUVA(uint32_t data);
     static RGBQUAD YUVAToRGBA(const YUVQuad& yuv);
@@ -81,16 +100,36 @@ class TextToPGSConverter  //: public TextSubtitlesRenderWin32
     long composeEnd(uint8_t* buff, int64_t pts, int64_t dts, bool needPgHeader = true);
     static long writePGHeader(uint8_t* buff, int64_t pts, int64_t dts);
     [[nodiscard]] double alignToGrid(double value) const;
-    bool rlePack(uint32_t colorMask);
-    void reduceColors(uint8_t mask) const;
-    static int getRepeatCnt(const uint32_t* pos, const uint32_t* end, uint32_t colorMask);
-    uint8_t color32To8(const uint32_t* buff, uint32_t colorMask);
+    // sets the render size, which must be enlarged already, and allocates the frame buffers for it
+    void resizeBuffers(uint16_t width, uint16_t height);
+    bool renderText(const std::string& text);
+    [[nodiscard]] std::string renderKey(const std::string& text, const Font& face) const;
+    uint8_t* composeDisplaySet(bool forced, const TextAnimation& animation, double inTimeSec, double outTimeSec,
+                               uint32_t& dstBufSize);
+    // Quantizes the image to the PGS palette and RLE-encodes it
+    void encodeImage();
+    void buildColorMap(size_t maxColors);
+    bool rlePack();
+    void drawnRows(uint16_t& firstRow, uint16_t& endRow) const;
+    YUVQuad pixelColor(uint32_t rgba);
+    int getRepeatCnt(const uint32_t* pos, const uint32_t* end);
+    uint8_t color32To8(const uint32_t* buff);
     Palette buildPalette(float opacity);
     [[nodiscard]] uint16_t renderedHeight() const;
     [[nodiscard]] uint16_t minLine() const;
     [[nodiscard]] uint16_t maxLine() const;
 
-    std::map<YUVQuad, uint8_t> m_paletteYUV;
+    std::unordered_map<YUVQuad, uint8_t, YUVQuadHash> m_paletteYUV;
+    std::unordered_map<YUVQuad, YUVQuad, YUVQuadHash> m_colorMap;  // quantized colors, empty if not needed
+    // direct mapped cache of RGBA to palette color conversions
+    static constexpr int PIXEL_COLOR_CACHE_BITS = 12;
+    struct PixelColor
+    {
+        uint32_t rgba = 0;
+        YUVQuad yuv;
+        bool valid = false;
+    };
+    PixelColor m_pixelColors[1 << PIXEL_COLOR_CACHE_BITS];
     uint8_t* m_renderedData;
 
     Palette m_paletteByColor;
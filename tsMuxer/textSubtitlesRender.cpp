@@ -5,6 +5,7 @@
 #include <cstring>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include "utf8Converter.h"
 #include "vod_common.h"
@@ -186,7 +187,7 @@ size_t findUnquotedStr(const string& str, const string& substr)
 
 namespace text_subtitles
 {
-TextSubtitlesRender::TextSubtitlesRender() : m_width(0), m_height(0)
+TextSubtitlesRender::TextSubtitlesRender() : m_width(0), m_height(0), m_dirtyRect()
 {
     m_pData = nullptr;
     m_borderWidth = 0;
@@ -363,7 +364,7 @@ vector<pair<Font, string>> TextSubtitlesRender::processTxtLine(const std::string
 bool TextSubtitlesRender::rasterText(const std::string& text)
 {
     bool forced = false;
-    memset(m_pData, 0, static_cast<size_t>(m_width) * m_height * 4);
+    clearDirtyRect();
     vector<Font> fontStack;
     const vector<string> lines = splitStr(text.c_str(), '\n');
     int curY = 0;
@@ -414,59 +415,148 @@ bool TextSubtitlesRender::rasterText(const std::string& text)
     return forced;
 }
 
+Font TextSubtitlesRender::faceAfterText(const std::string& text, const Font& face)
+{
+    // same font changes as rasterText(): every line sets the fonts of its parts once to measure and once to draw them
+    Font loaded = face;
+    Font current = m_font;
+    vector<Font> fontStack;
+    m_initFont = m_font;
+    for (auto& i : splitStr(text.c_str(), '\n'))
+    {
+        const vector<pair<Font, string>> txtParts = processTxtLine(i, fontStack);
+        for (int pass = 0; pass < 2; ++pass)
+        {
+            for (const auto& j : txtParts)
+            {
+                if (current != j.first)
+                    loaded = current = j.first;
+            }
+        }
+    }
+    return loaded;
+}
+
+void TextSubtitlesRender::loadFace(const Font& face)
+{
+    const Font font = m_font;
+    m_font.m_size = -1;  // matches no font, setFont() loads the face even if it has the current settings
+    setFont(face);
+    m_font = font;
+}
+
+void TextSubtitlesRender::markDirty(const int left, const int top, const int right, const int bottom)
+{
+    m_dirtyRect.left = FFMAX(0, FFMIN(m_dirtyRect.left, left));
+    m_dirtyRect.top = FFMAX(0, FFMIN(m_dirtyRect.top, top));
+    m_dirtyRect.right = FFMIN(m_width, FFMAX(m_dirtyRect.right, right));
+    m_dirtyRect.bottom = FFMIN(m_height, FFMAX(m_dirtyRect.bottom, bottom));
+}
+
+void TextSubtitlesRender::clearDirtyRect()
+{
+    const int width = m_dirtyRect.right - m_dirtyRect.left;
+    if (width > 0)
+    {
+        for (int y = m_dirtyRect.top; y < m_dirtyRect.bottom; ++y)
+            memset(m_pData + (static_cast<size_t>(y) * m_width + m_dirtyRect.left) * 4, 0,
+                   static_cast<size_t>(width) * 4);
+    }
+    // empty rectangle: any markDirty() call replaces it
+    m_dirtyRect = {m_width, m_height, 0, 0};
+}
+
 static constexpr uint32_t BORDER_COLOR = 0xff020202;
-static constexpr uint32_t BORDER_COLOR_TMP = RGB(0x1, 0x1, 0x1);
 
-inline void setBPoint(uint32_t* addr)
+namespace
+{
+// Vertical part of the chessboard distance transform: marks the pixels that have a pixel with a horizontal distance
+// of at most reach within reach rows above or below. hDist and the result are w * h, row by row.
+void verticalReach(const std::vector<uint16_t>& hDist, const int w, const int h, const int reach,
+                   std::vector<uint16_t>& vDist)
 {
-    if (*addr == 0)
-        *addr = BORDER_COLOR_TMP;
+    const auto cap = static_cast<uint16_t>(reach + 1);
+    vDist.resize(hDist.size());
+    for (int x = 0; x < w; ++x) vDist[x] = hDist[x] <= reach ? 0 : cap;
+    for (int y = 1; y < h; ++y)
+    {
+        const uint16_t* src = &hDist[static_cast<size_t>(y) * w];
+        const uint16_t* prev = &vDist[static_cast<size_t>(y - 1) * w];
+        uint16_t* dst = &vDist[static_cast<size_t>(y) * w];
+        for (int x = 0; x < w; ++x) dst[x] = src[x] <= reach ? 0 : FFMIN(cap, prev[x] + 1);
+    }
+    for (int y = h - 2; y >= 0; --y)
+    {
+        const uint16_t* next = &vDist[static_cast<size_t>(y + 1) * w];
+        uint16_t* dst = &vDist[static_cast<size_t>(y) * w];
+        for (int x = 0; x < w; ++x) dst[x] = FFMIN(dst[x], next[x] + 1);
+    }
 }
+}  // namespace
 
-void TextSubtitlesRender::addBorder(const int borderWidth, uint8_t* data, const int width, const int height)
+void TextSubtitlesRender::addBorder(const float borderWidth, uint8_t* data, const int width, const int height,
+                                    const RECT& dirtyRect)
 {
-    // add black border
-    for (int i = 0; i < borderWidth; ++i)
+    // Every transparent pixel within a chessboard distance of borderWidth from the image gets the border color. The
+    // fractional part of the width becomes a ring of partially transparent border around that.
+    const int radius = static_cast<int>(borderWidth);
+    const auto softAlpha = static_cast<uint32_t>(lround((borderWidth - static_cast<float>(radius)) * 255.0f));
+    const int reach = softAlpha > 0 ? radius + 1 : radius;
+    if (reach <= 0)
+        return;
+
+    // the distances only have to be known within reach of the dirty rectangle
+    const auto pixels = reinterpret_cast<uint32_t*>(data);
+    if (dirtyRect.left >= dirtyRect.right || dirtyRect.top >= dirtyRect.bottom)
+        return;
+    const int left = FFMAX(0, dirtyRect.left - reach);
+    const int top = FFMAX(0, dirtyRect.top - reach);
+    const int right = FFMIN(width - 1, dirtyRect.right - 1 + reach);
+    const int bottom = FFMIN(height - 1, dirtyRect.bottom - 1 + reach);
+    const int w = right - left + 1;
+    const int h = bottom - top + 1;
+
+    // horizontal distance to the nearest image pixel of the row, capped at reach + 1
+    const auto cap = static_cast<uint16_t>(reach + 1);
+    std::vector<uint16_t> hDist(static_cast<size_t>(w) * h);
+    for (int y = 0; y < h; ++y)
     {
-        auto dst = reinterpret_cast<uint32_t*>(data);
-        for (int y = 0; y < height; ++y)
+        const uint32_t* src = pixels + static_cast<size_t>(y + top) * width + left;
+        uint16_t* dst = &hDist[static_cast<size_t>(y) * w];
+        uint16_t d = cap;
+        for (int x = 0; x < w; ++x)
         {
-            for (int x = 0; x < width; ++x)
-            {
-                if (*dst != 0 && *dst != BORDER_COLOR_TMP)
-                {
-                    if (x > 0)
-                    {
-                        setBPoint(dst - 1);
-                        if (y > 0)
-                            setBPoint(dst - 1 - width);
-                        if (y < height - 1)
-                            setBPoint(dst - 1 + width);
-                    }
-                    if (y > 0)
-                        setBPoint(dst - width);
-                    if (y < height - 1)
-                        setBPoint(dst + width);
-                    if (x < width - 1)
-                    {
-                        setBPoint(dst + 1);
-                        if (y > 0)
-                            setBPoint(dst + 1 - width);
-                        if (y < height - 1)
-                            setBPoint(dst + 1 + width);
-                    }
-                }
-                dst++;
-            }
+            d = src[x] != 0 ? 0 : FFMIN(cap, d + 1);
+            dst[x] = d;
+        }
+        d = cap;
+        for (int x = w - 1; x >= 0; --x)
+        {
+            d = FFMIN(dst[x], FFMIN(cap, d + 1));
+            dst[x] = d;
+        }
+    }
+
+    std::vector<uint16_t> inner;
+    if (radius > 0)
+        verticalReach(hDist, w, h, radius, inner);
+    std::vector<uint16_t> outer;
+    if (reach > radius)
+        verticalReach(hDist, w, h, reach, outer);
+    const uint32_t softColor = (softAlpha << 24) | (BORDER_COLOR & 0xffffff);
+    for (int y = 0; y < h; ++y)
+    {
+        uint32_t* dst = pixels + static_cast<size_t>(y + top) * width + left;
+        const size_t row = static_cast<size_t>(y) * w;
+        for (int x = 0; x < w; ++x)
+        {
+            if (dst[x] != 0)
+                continue;
+            if (!inner.empty() && inner[row + x] <= radius)
+                dst[x] = BORDER_COLOR;
+            else if (!outer.empty() && outer[row + x] <= reach)
+                dst[x] = softColor;
         }
-        dst = reinterpret_cast<uint32_t*>(data);
-        for (int y = 0; y < height; ++y)
-            for (int x = 0; x < width; ++x)
-            {
-                if (*dst == BORDER_COLOR_TMP)
-                    *dst = BORDER_COLOR;
-                dst++;
-            }
     }
 }
 
@@ -5,6 +5,7 @@
 
 #include <map>
 #include <string>
+#include <vector>
 
 #ifdef _WIN32
 #include "windows.h"
@@ -68,6 +69,15 @@ struct YUVQuad
     }
 };
 
+struct YUVQuadHash
+{
+    size_t operator()(const YUVQuad& color) const
+    {
+        return static_cast<size_t>(color.Y) | static_cast<size_t>(color.Cr) << 8 |
+               static_cast<size_t>(color.Cb) << 16 | static_cast<size_t>(color.alpha) << 24;
+    }
+};
+
 struct Font
 {
     static constexpr int BOLD = 1;
@@ -98,8 +108,15 @@ class TextSubtitlesRender
     TextSubtitlesRender();
     virtual ~TextSubtitlesRender();
     bool rasterText(const std::string& text);  // return true if text was forced
+    // rasterText() restores the font settings after the text, but setFont() keeps the face of the last text run
+    // loaded as long as the settings don't change. The next text then starts with that face. faceAfterText() returns
+    // the font of the face loaded after rasterText(text) when `face` is loaded before it, loadFace() loads the face of
+    // a font without changing the font settings, so that any renderer can draw a text as it would be drawn in sequence.
+    Font faceAfterText(const std::string& text, const Font& face);
+    void loadFace(const Font& face);
 
     virtual void setFont(const Font& font) = 0;
+    [[nodiscard]] const Font& getFont() const { return m_font; }
     virtual void setRenderSize(int width, int height) = 0;
     virtual void getTextSize(const std::string& text, SIZE* mSize) = 0;
     virtual int getLineSpacing() = 0;
@@ -107,15 +124,23 @@ class TextSubtitlesRender
     virtual void drawText(const std::string& text, RECT* rect) = 0;
     virtual void flushRasterBuffer() = 0;
     // void rescaleRGB(BitmapInfo* bmpDest, BitmapInfo* bmpRef);
-    static void addBorder(int borderWidth, uint8_t* data, int width, int height);
+    // draws the border around the image in data, which is transparent outside of dirtyRect
+    static void addBorder(float borderWidth, uint8_t* data, int width, int height, const RECT& dirtyRect);
 
     int m_width;
     int m_height;
     uint8_t* m_pData;
+    RECT m_dirtyRect;  // bounding box of the pixels drawn by the last rasterText(), the rest of m_pData is zero
+    // Directories to look up fonts by name in instead of the system font directories (--font-dir). Ignored by the
+    // GDI renderer.
+    std::vector<std::string> m_fontDirs;
 
    protected:
     Font m_font;
 
+    // Extends the dirty rectangle by [left, right) x [top, bottom), clipped to the render size
+    void markDirty(int left, int top, int right, int bottom);
+
     float m_borderWidth;
     std::vector<std::pair<Font, std::string>> processTxtLine(const std::string& line,
                                                              std::vector<Font>& fontStack) const;
@@ -123,6 +148,8 @@ class TextSubtitlesRender
 
    private:
     Font m_initFont;
+
+    void clearDirtyRect();
 };
 }  // namespace text_subtitles
 #endif
@@ -23,11 +23,6 @@
 
 using namespace std;
 
-int V3_flags = 0;
-unsigned HDR10_metadata[6] = {0, 0, 0, 0, 0, 0};
-bool isV3() { return V3_flags & HDMV_V3; }
-bool is4K() { return V3_flags & FOUR_K; }
-
 static constexpr int64_t M_PCR_DELTA = 7000;
 static constexpr int64_t SIT_INTERVAL = 76900;
 static constexpr int64_t M_CBR_PCR_DELTA = 7000;
@@ -38,7 +33,7 @@ static constexpr int PAT_PID = 0;
 static constexpr int SIT_PID = 0x1f;
 static constexpr int NULL_PID = 8191;
 
-uint8_t DefaultSitTableOne[] = {
+static const uint8_t DefaultSitTableOne[] = {
     0x47, 0x40, 0x1f, 0x10, 0x00, 0x7f, 0xf0, 0x19, 0xff, 0xff, 0xc1, 0x00, 0x00, 0xf0, 0x0a, 0x63, 0x08, 0xc1, 0xd4,
     0xc0, 0xff, 0xff, 0xff, 0xff, 0xff, 0x00, 0x01, 0x80, 0x00, 0x03, 0x00, 0x38, 0x6d, 0xff, 0xff, 0xff, 0xff, 0xff,
     0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
@@ -51,8 +46,8 @@ uint8_t DefaultSitTableOne[] = {
     0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
 
 // for v3 Blu-ray, change "peak_rate" and CRC to 128 mbps
-uint8_t SitTableHEVC[] = {0xc4, 0xe1, 0x06, 0xff, 0xff, 0xff, 0xff, 0xff,
-                          0x00, 0x01, 0x80, 0x00, 0x24, 0xc4, 0xba, 0xf0};
+static const uint8_t SitTableHEVC[] = {0xc4, 0xe1, 0x06, 0xff, 0xff, 0xff, 0xff, 0xff,
+                                       0x00, 0x01, 0x80, 0x00, 0x24, 0xc4, 0xba, 0xf0};
 
 TSMuxer::TSMuxer(MuxerManager* owner) : AbstractMuxer(owner)
 {
@@ -75,6 +70,7 @@ TSMuxer::TSMuxer(MuxerManager* owner) : AbstractMuxer(owner)
     m_pmtCnt = 0;
     m_patCnt = 0;
     m_sitCnt = 0;
+    m_hevcSit = false;
     m_needTruncate = false;
     m_videoTrackCnt = 0;
     m_DVvideoTrackCnt = 0;
@@ -94,6 +90,9 @@ TSMuxer::TSMuxer(MuxerManager* owner) : AbstractMuxer(owner)
     m_interleaveInfo.emplace_back();
     m_pesIFrame = false;
     m_pesSpsPps = false;
+    m_pesWrittenSize = 0;
+    m_pesTsPackets = 0;
+    m_pesUpdateIdx = false;
     m_computeMuxStats = false;
     m_pmtFrames = 0;
     m_curFileStartPts = 0;  // FIXED_PTS_OFFSET;
@@ -155,7 +154,16 @@ void TSMuxer::intAddStream(const std::string& streamName, const std::string& cod
 {
     int descriptorLen = 0;
     uint8_t descrBuffer[1024];
-    if (codecReader != nullptr)
+    if (m_primaryMuxer)
+    {
+        const auto pidItr = m_primaryMuxer->m_extIndexToTSIndex.find(streamIndex);
+        if (pidItr == m_primaryMuxer->m_extIndexToTSIndex.end())
+            THROW(ERR_COMMON, "Stream " << streamName << " is not muxed to the first output")
+        const PMTStreamInfo& primaryInfo = m_primaryMuxer->m_pmt.pidList.at(pidItr->second);
+        descriptorLen = primaryInfo.m_esInfoLen;
+        memcpy(descrBuffer, primaryInfo.m_esInfoData, descriptorLen);
+    }
+    else if (codecReader != nullptr)
         descriptorLen = codecReader->getTSDescriptor(descrBuffer, m_bluRayMode, m_hdmvDescriptors);
 
     if (codecName[0] == 'V' || (codecName[0] == 'A' && m_mainStreamIndex == -1))
@@ -183,7 +191,7 @@ void TSMuxer::intAddStream(const std::string& streamName, const std::string& cod
             {
                 tsStreamIndex = 0x1011 + m_videoTrackCnt * doubleMux;
                 m_videoTrackCnt++;
-                V3_flags |= BL_TRACK;
+                m_owner->v3State().flags |= BL_TRACK;
             }
             if (m_subMode)
                 tsStreamIndex++;
@@ -209,7 +217,7 @@ void TSMuxer::intAddStream(const std::string& streamName, const std::string& cod
     }
     else if (codecName == "S_HDMV/PGS" || codecName == "S_TEXT/UTF8")
     {
-        tsStreamIndex = (V3_flags & 0x1e ? 0x12A0 : 0x1200) + m_pgsTrackCnt;
+        tsStreamIndex = (m_owner->v3State().flags & 0x1e ? 0x12A0 : 0x1200) + m_pgsTrackCnt;
         m_pgsTrackCnt++;
     }
     m_extIndexToTSIndex[streamIndex] = tsStreamIndex;
@@ -289,12 +297,12 @@ void TSMuxer::intAddStream(const std::string& streamName, const std::string& cod
     {
         StreamType stream_type = StreamType::VIDEO_H265;
         // Change "peak_rate" to 109 mbps + change descriptor CRC32
-        memcpy(&DefaultSitTableOne[17], SitTableHEVC, 16);
+        m_hevcSit = true;
         // For non-bluray, second Dolby Vision track must be stream_type 06 = private data
-        if (!m_bluRayMode && tsStreamIndex == 0x1015 && (V3_flags & BL_TRACK))
+        if (!m_bluRayMode && tsStreamIndex == 0x1015 && (m_owner->v3State().flags & BL_TRACK))
             stream_type = StreamType::PRIVATE_DATA;
         // Dolby Vision profile 5 is not compatible with SDR or HDR and must be stream_type 06 = private data
-        // else if (V3_flags & BL_NOTCOMPAT)
+        // else if (m_owner->v3State().flags & BL_NOTCOMPAT)
         //     stream_type = StreamType::PRIVATE_DATA;
 
         m_pmt.pidList[tsStreamIndex] =
@@ -633,16 +641,47 @@ void TSMuxer::buildPesHeader(const uint8_t pesStreamID, AVPacket& avPacket, int
     m_fullPesDTS = avPacket.dts;
     m_fullPesPTS = avPacket.pts;
     pesPacket->flagsHi |= PES_DATA_ALIGNMENT;
-    // int additionDataSize = avPacket.codec->writePESExtension(pesPacket);
-    const auto ast = dynamic_cast<AbstractStreamReader*>(avPacket.codec);
-    if (ast)
-        ast->writePESExtension(pesPacket, avPacket);
-    if (avPacket.flags & AVPacket::IS_COMPLETE_FRAME)
-        pesPacket->setPacketLength(avPacket.size + pesPacket->getHeaderLength());
 
     PriorityDataInfo tmpPriorityData;
-    const int additionDataSize = avPacket.codec->writeAdditionData(
-        tmpBuffer + pesPacket->getHeaderLength(), tmpBuffer + sizeof(tmpBuffer), avPacket, &tmpPriorityData);
+    int additionDataSize;
+    PESHeaderCache* cache = m_pesHeaderCache;
+    const int baseHeaderLen = pesPacket->getHeaderLength();
+    if (cache && cache->filledPacket == cache->packetNum)
+    {
+        // another output already ran the reader hooks for this packet
+        if (cache->baseHeader.size() != static_cast<size_t>(baseHeaderLen) ||
+            memcmp(cache->baseHeader.data(), tmpBuffer, baseHeaderLen) != 0)
+            THROW(ERR_COMMON, "All outputs of a multi-output mux must use the same PES settings for track " << pid)
+        memcpy(tmpBuffer, cache->data.data(), cache->data.size());
+        additionDataSize = static_cast<int>(cache->data.size()) - pesPacket->getHeaderLength();
+        tmpPriorityData = cache->priorityData;
+        avPacket.data = cache->avData;
+        avPacket.size = cache->avSize;
+        avPacket.flags = cache->avFlags;
+    }
+    else
+    {
+        if (cache)
+            cache->baseHeader.assign(tmpBuffer, tmpBuffer + baseHeaderLen);
+        // int additionDataSize = avPacket.codec->writePESExtension(pesPacket);
+        const auto ast = dynamic_cast<AbstractStreamReader*>(avPacket.codec);
+        if (ast)
+            ast->writePESExtension(pesPacket, avPacket);
+        if (avPacket.flags & AVPacket::IS_COMPLETE_FRAME)
+            pesPacket->setPacketLength(avPacket.size + pesPacket->getHeaderLength());
+
+        additionDataSize = avPacket.codec->writeAdditionData(
+            tmpBuffer + pesPacket->getHeaderLength(), tmpBuffer + sizeof(tmpBuffer), avPacket, &tmpPriorityData);
+        if (cache)
+        {
+            cache->filledPacket = cache->packetNum;
+            cache->data.assign(tmpBuffer, tmpBuffer + pesPacket->getHeaderLength() + additionDataSize);
+            cache->priorityData = tmpPriorityData;
+            cache->avData = avPacket.data;
+            cache->avSize = avPacket.size;
+            cache->avFlags = avPacket.flags;
+        }
+    }
     const int bufLen = pesPacket->getHeaderLength() + additionDataSize;
     m_pesData.resize(bufLen);
     memcpy(m_pesData.data(), tmpBuffer, bufLen);
@@ -652,7 +691,7 @@ void TSMuxer::buildPesHeader(const uint8_t pesStreamID, AVPacket& avPacket, int
 void TSMuxer::addData(const uint8_t pesStreamID, const int pid, AVPacket& avPacket)
 {
     int beforePesLen = static_cast<int>(m_pesData.size());
-    if (m_pesData.size() == 0)
+    if (m_pesData.size() == 0 && m_pesWrittenSize == 0)
     {
         buildPesHeader(pesStreamID, avPacket, pid);
         m_pesPID = pid;
@@ -661,8 +700,21 @@ void TSMuxer::addData(const uint8_t pesStreamID, const int pid, AVPacket& avPack
     }
     const int oldLen = static_cast<int>(m_pesData.size());
     const int pesHeaderLen = oldLen - beforePesLen;
-    if (oldLen > 100000000)
+    if (m_pesWrittenSize + oldLen > 100000000)
         THROW(ERR_COMMON, "Pes packet len too large ( >100Mb). Bad stream or invalid codec speciffed.")
+
+    // Once the PES is known to be longer than the PES_packet_length field can express, its header is final and
+    // the payload can be packetized as it arrives instead of being staged in m_pesData first. That must not
+    // reorder the output: the sibling muxer of an SSIF pair may write into this one between two packets, and in
+    // CBR mode the PCR placement depends on the bits written so far, so keep the whole PES pending there.
+    const bool canStream = !m_sublingMuxer && m_cbrBitrate == -1;
+    if (canStream && m_priorityData.empty() && !(avPacket.flags & AVPacket::PRIORITY_DATA) &&
+        m_pesWrittenSize + oldLen + avPacket.size - 6 > 0xffff)
+    {
+        streamPESData(avPacket.data, avPacket.size);
+        return;
+    }
+
     m_pesData.grow(avPacket.size /*+ additionDataSize*/);
     uint8_t* dst = m_pesData.data() + oldLen;
     // memcpy(dst, tmpBuffer, additionDataSize);
@@ -676,6 +728,38 @@ void TSMuxer::addData(const uint8_t pesStreamID, const int pid, AVPacket& avPack
     }
 }
 
+void TSMuxer::streamPESData(const uint8_t* data, const size_t size)
+{
+    // Writes every complete TS payload of the pending PES bytes followed by 'data'. Pending bytes are topped up to
+    // a payload boundary, the rest of 'data' goes to the output buffer directly and only the final partial
+    // payload is kept in m_pesData.
+    constexpr size_t payloadLen = TS_FRAME_SIZE - TSPacket::TS_HEADER_SIZE;
+    if (m_pesWrittenSize == 0)
+        indexPESPacket();
+
+    const size_t headLen = FFMIN((payloadLen - m_pesData.size() % payloadLen) % payloadLen, size);
+    m_pesData.append(data, headLen);
+    data += headLen;
+    const size_t dataLen = size - headLen;
+
+    const size_t pendingLen = m_pesData.size() / payloadLen * payloadLen;
+    const size_t directLen = dataLen / payloadLen * payloadLen;
+    bool payloadStart = m_pesWrittenSize == 0;
+    if (pendingLen > 0)
+    {
+        m_pesTsPackets += writeTSFrames(m_pesPID, m_pesData.data(), pendingLen, false, payloadStart);
+        payloadStart = false;
+    }
+    if (directLen > 0)
+        m_pesTsPackets += writeTSFrames(m_pesPID, data, directLen, false, payloadStart);
+    m_pesWrittenSize += static_cast<int64_t>(pendingLen + directLen);
+
+    const size_t restLen = m_pesData.size() - pendingLen;
+    memmove(m_pesData.data(), m_pesData.data() + pendingLen, restLen);
+    m_pesData.resize(static_cast<unsigned>(restLen));
+    m_pesData.append(data + directLen, dataLen - directLen);
+}
+
 void TSMuxer::flushTSFrame() { writePESPacket(); }
 
 void TSMuxer::writePATPMT(const int64_t pcr, const bool force)
@@ -739,6 +823,21 @@ std::string TSMuxer::getNextName(const std::string curName)
     return toNativeSeparators(result);
 }
 
+void TSMuxer::setPrimaryMuxer(const TSMuxer* muxer)
+{
+    if (muxer->m_hdmvDescriptors != m_hdmvDescriptors)
+        THROW(ERR_COMMON, "All outputs of a multi-output mux must use the same --no-hdmv-descriptors setting")
+    m_primaryMuxer = muxer;
+}
+
+const V3State& TSMuxer::v3State() const { return m_owner->v3State(); }
+
+bool TSMuxer::canShareReaders(const TSMuxer& other) const
+{
+    return m_bluRayMode == other.m_bluRayMode && m_hdmvDescriptors == other.m_hdmvDescriptors &&
+           m_useNewStyleAudioPES == other.m_useNewStyleAudioPES;
+}
+
 void TSMuxer::gotoNextFile(const int64_t newPts)
 {
     // 2. CloseCurrentFile
@@ -774,90 +873,97 @@ void TSMuxer::gotoNextFile(const int64_t newPts)
     m_curFileStartPts = newPts;
 }
 
-void TSMuxer::writePESPacket()
+void TSMuxer::indexPESPacket()
 {
-    if (m_pesData.size() > 0)
+    PMTStreamInfo& streamInfo = m_pmt.pidList[m_pesPID];
+    const auto pesPacket = reinterpret_cast<PESPacket*>(m_pesData.data());
+    if (m_computeMuxStats && (pesPacket->flagsLo & 0x80) == 0x80)
     {
-        uint32_t tsPackets = 0;
-
-        const size_t size = m_pesData.size() - 6;
-        if (size <= 0xffff)
+        uint64_t curPts = pesPacket->getPts();
+
+        size_t idxSize = streamInfo.m_index.size();
+        if (idxSize == 0)
+            streamInfo.m_index.emplace_back();
+        const auto vCodec = dynamic_cast<MPEGStreamReader*>(streamInfo.m_codecReader);
+        // bool isH264 = dynamic_cast <H264StreamReader*> (streamInfo.m_codecReader);
+        const bool SPSRequired = streamInfo.m_codecReader->needSPSForSplit();
+        const auto aCodec = dynamic_cast<SimplePacketizerReader*>(streamInfo.m_codecReader);
+        if (vCodec && m_pesIFrame)
         {
-            m_pesData.data()[4] = static_cast<uint8_t>(size / 256);
-            m_pesData.data()[5] = static_cast<uint8_t>(size % 256);
-        }
-
-        PMTStreamInfo& streamInfo = m_pmt.pidList[m_pesPID];
-        const auto pesPacket = reinterpret_cast<PESPacket*>(m_pesData.data());
-        bool updateIdx = false;
-        if (m_computeMuxStats && (pesPacket->flagsLo & 0x80) == 0x80)
-        {
-            uint64_t curPts = pesPacket->getPts();
-
-            size_t idxSize = streamInfo.m_index.size();
-            if (idxSize == 0)
-                streamInfo.m_index.emplace_back();
-            const auto vCodec = dynamic_cast<MPEGStreamReader*>(streamInfo.m_codecReader);
-            // bool isH264 = dynamic_cast <H264StreamReader*> (streamInfo.m_codecReader);
-            const bool SPSRequired = streamInfo.m_codecReader->needSPSForSplit();
-            const auto aCodec = dynamic_cast<SimplePacketizerReader*>(streamInfo.m_codecReader);
-            if (vCodec && m_pesIFrame)
+            // skip some I-frames for H.264 if no SPS/PPS in a gop
+            if (m_pesSpsPps || !SPSRequired)
             {
-                // skip some I-frames for H.264 if no SPS/PPS in a gop
-                if (m_pesSpsPps || !SPSRequired)
+                PMTIndex& curIndex = *streamInfo.m_index.rbegin();
+                if (curIndex.empty() || curPts > curIndex.rbegin()->first)
                 {
-                    PMTIndex& curIndex = *streamInfo.m_index.rbegin();
-                    if (curIndex.empty() || curPts > curIndex.rbegin()->first)
-                    {
-                        curIndex.insert(
-                            std::make_pair(curPts, PMTIndexData(m_muxedPacketCnt[m_muxedPacketCnt.size() - 1], 0)));
-                        updateIdx = true;
-                    }
+                    curIndex.insert(
+                        std::make_pair(curPts, PMTIndexData(m_muxedPacketCnt[m_muxedPacketCnt.size() - 1], 0)));
+                    m_pesUpdateIdx = true;
                 }
+            }
 
+            m_lastGopNullCnt = m_nullCnt;
+        }
+        else if (aCodec)
+        {
+            if (m_videoTrackCnt + m_videoSecondTrackCnt == 0)
+            {
                 m_lastGopNullCnt = m_nullCnt;
             }
-            else if (aCodec)
+            PMTIndex& curIndex = *streamInfo.m_index.rbegin();
+            idxSize = curIndex.size();
+            if (idxSize == 0 || curPts - curIndex.rbegin()->first >= 90000)
             {
-                if (m_videoTrackCnt + m_videoSecondTrackCnt == 0)
-                {
-                    m_lastGopNullCnt = m_nullCnt;
-                }
-                PMTIndex& curIndex = *streamInfo.m_index.rbegin();
-                idxSize = curIndex.size();
-                if (idxSize == 0 || curPts - curIndex.rbegin()->first >= 90000)
-                {
-                    curIndex.insert(
-                        std::make_pair(curPts, PMTIndexData(m_muxedPacketCnt[m_muxedPacketCnt.size() - 1], 0)));
-                    updateIdx = true;
-                }
+                curIndex.insert(
+                    std::make_pair(curPts, PMTIndexData(m_muxedPacketCnt[m_muxedPacketCnt.size() - 1], 0)));
+                m_pesUpdateIdx = true;
             }
         }
+    }
+}
+
+void TSMuxer::writePESPacket()
+{
+    if (m_pesData.size() > 0 || m_pesWrittenSize > 0)
+    {
+        if (m_pesWrittenSize == 0)
+        {
+            const size_t size = m_pesData.size() - 6;
+            if (size <= 0xffff)
+            {
+                m_pesData.data()[4] = static_cast<uint8_t>(size / 256);
+                m_pesData.data()[5] = static_cast<uint8_t>(size % 256);
+            }
+            indexPESPacket();
+        }
 
         const uint8_t* curPtr = m_pesData.data();
         const uint8_t* dataEnd = curPtr + m_pesData.size();
-        bool payloadStart = true;
+        bool payloadStart = m_pesWrittenSize == 0;
         for (const auto& i : m_priorityData)
         {
             const uint8_t* blockPtr = m_pesData.data() + i.first;
             if (blockPtr > curPtr)
             {
-                tsPackets += writeTSFrames(m_pesPID, curPtr, blockPtr - curPtr, false, payloadStart);
+                m_pesTsPackets += writeTSFrames(m_pesPID, curPtr, blockPtr - curPtr, false, payloadStart);
                 payloadStart = false;
             }
-            tsPackets += writeTSFrames(m_pesPID, blockPtr, i.second, true, payloadStart);
+            m_pesTsPackets += writeTSFrames(m_pesPID, blockPtr, i.second, true, payloadStart);
             curPtr = blockPtr + i.second;
         }
-        tsPackets += writeTSFrames(m_pesPID, curPtr, dataEnd - curPtr, false, payloadStart);
+        m_pesTsPackets += writeTSFrames(m_pesPID, curPtr, dataEnd - curPtr, false, payloadStart);
 
         m_pesData.resize(0);
         m_priorityData.clear();
-        if (updateIdx)
+        if (m_pesUpdateIdx)
         {
-            PMTIndex& curIndex = *streamInfo.m_index.rbegin();
+            PMTIndex& curIndex = *m_pmt.pidList[m_pesPID].m_index.rbegin();
             assert(curIndex.rbegin()->second.m_frameLen == 0);
-            curIndex.rbegin()->second.m_frameLen = (tsPackets + 1) * m_frameSize;
+            curIndex.rbegin()->second.m_frameLen = (m_pesTsPackets + 1) * m_frameSize;
         }
+        m_pesWrittenSize = 0;
+        m_pesTsPackets = 0;
+        m_pesUpdateIdx = false;
     }
 }
 
@@ -1053,9 +1159,51 @@ bool TSMuxer::muxPacket(AVPacket& avPacket)
     return true;
 }
 
+bool TSMuxer::cbrPCRDue(const int64_t extraBits) const
+{
+    const auto newPCR = llround(static_cast<double>(m_lastPCR + m_pcrBits + extraBits) * 90000.0 / m_cbrBitrate);
+    return newPCR - m_lastPCR >= m_pcr_delta;
+}
+
+int64_t TSMuxer::cbrPacketsBeforePCR(const int64_t maxPackets, const int packetBits) const
+{
+    // The PCR test runs before every packet and is monotonic in m_pcrBits, so the first packet that needs a PCR
+    // in front of it can be found by bisection. The test for the current packet has already run and a PCR was
+    // written if it was due, so that packet is always written: at low bitrates PAT/PMT/PCR alone can take longer
+    // than the PCR interval and the test is still true right after them.
+    if (maxPackets <= 1 || !cbrPCRDue((maxPackets - 1) * packetBits))
+        return maxPackets;
+    int64_t lo = 0;
+    int64_t hi = maxPackets - 1;
+    while (hi - lo > 1)
+    {
+        const int64_t mid = (lo + hi) / 2;
+        if (cbrPCRDue(mid * packetBits))
+            hi = mid;
+        else
+            lo = mid;
+    }
+    return hi;
+}
+
 int TSMuxer::writeTSFrames(const int pid, const uint8_t* buffer, const int64_t len, const bool priorityData,
-                           bool payloadStart)
+                           const bool payloadStart)
 {
+    if (m_m2tsMode)
+        return m_cbrBitrate != -1 ? writeTSFramesImpl<true, true>(pid, buffer, len, priorityData, payloadStart)
+                                  : writeTSFramesImpl<true, false>(pid, buffer, len, priorityData, payloadStart);
+    return m_cbrBitrate != -1 ? writeTSFramesImpl<false, true>(pid, buffer, len, priorityData, payloadStart)
+                              : writeTSFramesImpl<false, false>(pid, buffer, len, priorityData, payloadStart);
+}
+
+template <bool m2ts, bool cbr>
+int TSMuxer::writeTSFramesImpl(const int pid, const uint8_t* buffer, const int64_t len, const bool priorityData,
+                               bool payloadStart)
+{
+    constexpr int m2tsHeaderSize = m2ts ? 4 : 0;
+    constexpr int frameSize = TS_FRAME_SIZE + m2tsHeaderSize;
+    constexpr int64_t fullPayloadLen = TS_FRAME_SIZE - TSPacket::TS_HEADER_SIZE;
+
     int result = 0;
 
     const uint8_t* curPos = buffer;
@@ -1064,13 +1212,17 @@ int TSMuxer::writeTSFrames(const int pid, const uint8_t* buffer, const int64_t l
     const bool tsPriority = priorityData;
     StreamInfo& streamInfo = m_streamInfo[pid];
 
+    // TS header bytes 1-2 of a packet without adaptation field: PID, priority and payload_unit_start
+    const auto pidHi = static_cast<uint8_t>(((pid >> 8) & 0x1f) | (tsPriority ? 0x20 : 0));
+    const auto pidLow = static_cast<uint8_t>(pid);
+
     while (curPos < end)
     {
-        if (m_cbrBitrate != -1 && m_lastPCR != -1)
+        if constexpr (cbr)
         {
-            const auto newPCR = llround(static_cast<double>(m_lastPCR + m_pcrBits) * 90000.0 / m_cbrBitrate);
-            if (newPCR - m_lastPCR >= m_pcr_delta && m_lastPCR != -1)
+            if (m_lastPCR != -1 && cbrPCRDue(0))
             {
+                const auto newPCR = llround(static_cast<double>(m_lastPCR + m_pcrBits) * 90000.0 / m_cbrBitrate);
                 m_pcrBits = 0;
                 writePATPMT(newPCR);
                 writePCR(newPCR);
@@ -1083,7 +1235,47 @@ int TSMuxer::writeTSFrames(const int pid, const uint8_t* buffer, const int64_t l
             }
         }
 
-        if (m_m2tsMode)
+        int64_t packets = (end - curPos) / fullPayloadLen;
+        if (packets > 0)
+        {
+            // Run of full-payload packets, cut at the packet that fills the output block and, for CBR, at the
+            // packet that has to be preceded by PAT/PMT/PCR.
+            const int64_t toBlockEnd = (m_writeBlockSize - m_outBufLen + frameSize - 1) / frameSize;
+            packets = std::min(packets, std::max<int64_t>(toBlockEnd, 1));
+            if constexpr (cbr)
+            {
+                if (m_lastPCR != -1)
+                    packets = cbrPacketsBeforePCR(packets, frameSize * 8);
+            }
+
+            uint8_t* dst = m_outBuf + m_outBufLen;
+            int counter = streamInfo.m_tsCnt;
+            for (int64_t i = 0; i < packets; i++)
+            {
+                dst += m2tsHeaderSize;  // filled in by processM2TSPCR()
+                dst[0] = TSPacket::TS_FRAME_SYNC_BYTE;
+                dst[1] = pidHi | (payloadStart ? 0x40 : 0);
+                dst[2] = pidLow;
+                dst[3] = static_cast<uint8_t>(0x10 | (counter++ & 0x0f));  // payload only
+                memcpy(dst + TSPacket::TS_HEADER_SIZE, curPos, fullPayloadLen);
+                payloadStart = false;
+                curPos += fullPayloadLen;
+                dst += TS_FRAME_SIZE;
+            }
+            streamInfo.m_tsCnt = counter;
+
+            const auto runSize = static_cast<int>(packets * frameSize);
+            m_outBufLen += runSize;
+            m_processedBlockSize += runSize;
+            m_pcrBits += runSize * 8;
+            m_muxedPacketCnt.back() += static_cast<uint32_t>(packets);
+            result += static_cast<int>(packets);
+            writeOutBuffer();
+            continue;
+        }
+
+        // last packet of the buffer, padded with an adaptation field
+        if constexpr (m2ts)
         {
             m_outBufLen += 4;
             m_processedBlockSize += 4;
@@ -1099,27 +1291,20 @@ int TSMuxer::writeTSFrames(const int pid, const uint8_t* buffer, const int64_t l
         tsPacket->payloadStart = payloadStart;  // curPos == buffer;
         payloadStart = false;
         tsPacket->priority = tsPriority;
-        if (tmpBufferLen < payloadLen)
+        tsPacket->afExists = 1;
+        if (payloadLen - tmpBufferLen == 1)
         {
-            // insert padding bytes
-            if (!tsPacket->afExists)
-            {
-                tsPacket->afExists = 1;
-                if (payloadLen - tmpBufferLen == 1)
-                {
-                    tsPacket->adaptiveField.length = 0;
-                    payloadLen--;
-                }
-                else
-                {
-                    initTS[1] = 0x01;  // zero all af flags, set af len to 1.
-                    payloadLen -= 2;
-                }
-            }
-            memset(reinterpret_cast<uint8_t*>(tsPacket) + tsPacket->getHeaderSize(), 0xff, payloadLen - tmpBufferLen);
-            tsPacket->adaptiveField.length += static_cast<unsigned>(payloadLen - tmpBufferLen);
-            payloadLen = tmpBufferLen;
+            tsPacket->adaptiveField.length = 0;
+            payloadLen--;
+        }
+        else
+        {
+            initTS[1] = 0x01;  // zero all af flags, set af len to 1.
+            payloadLen -= 2;
         }
+        memset(reinterpret_cast<uint8_t*>(tsPacket) + tsPacket->getHeaderSize(), 0xff, payloadLen - tmpBufferLen);
+        tsPacket->adaptiveField.length += static_cast<unsigned>(payloadLen - tmpBufferLen);
+        payloadLen = tmpBufferLen;
         const int tsHeaderSize = tsPacket->getHeaderSize();
         memcpy(m_outBuf + m_outBufLen + tsHeaderSize, curPos, payloadLen);
 
@@ -1189,24 +1374,38 @@ void TSMuxer::buildPMT()
 
 void TSMuxer::buildSIT() {}
 
-void TSMuxer::writeNullPackets(const int cnt)
+void TSMuxer::writeNullPackets(int cnt)
 {
-    for (int i = 0; i < cnt; i++)
+    // Null packets only differ in the continuity counter, so they are copied from a run of 16 prebuilt packets
+    // (one per counter value, with room for the M2TS header filled in later by processM2TSPCR) in as few memcpy
+    // calls as the output block boundaries allow.
+    const int runSize = m_frameSize * 16;
+    if (static_cast<int>(m_nullRun.size()) != runSize)
     {
-        if (m_m2tsMode)
+        m_nullRun.assign(runSize, 0);
+        const int m2tsHeaderSize = m_frameSize - TS_FRAME_SIZE;
+        for (int i = 0; i < 16; i++)
         {
-            m_outBufLen += 4;
-            m_processedBlockSize += 4;
-            m_pcrBits += 4 * 8;
+            uint8_t* packet = m_nullRun.data() + i * m_frameSize + m2tsHeaderSize;
+            memcpy(packet, m_nullBuffer, TS_FRAME_SIZE);
+            reinterpret_cast<TSPacket*>(packet)->counter = i;
         }
-        memcpy(m_outBuf + m_outBufLen, m_nullBuffer, TS_FRAME_SIZE);
-        const auto tsPacket = reinterpret_cast<TSPacket*>(m_outBuf + m_outBufLen);
-        tsPacket->counter = m_nullCnt++;
-        m_outBufLen += TS_FRAME_SIZE;
-        m_processedBlockSize += TS_FRAME_SIZE;
-        m_pcrBits += TS_FRAME_SIZE * 8;
-        m_muxedPacketCnt[m_muxedPacketCnt.size() - 1]++;
+    }
+
+    while (cnt > 0)
+    {
+        const int first = m_nullCnt & 0x0f;
+        const int toBlockEnd = (m_writeBlockSize - m_outBufLen + m_frameSize - 1) / m_frameSize;
+        const int packets = FFMIN(FFMIN(cnt, 16 - first), FFMAX(toBlockEnd, 1));
+        const int size = packets * m_frameSize;
+        memcpy(m_outBuf + m_outBufLen, m_nullRun.data() + first * m_frameSize, size);
+        m_nullCnt += packets;
+        m_outBufLen += size;
+        m_processedBlockSize += size;
+        m_pcrBits += size * 8;
+        m_muxedPacketCnt.back() += packets;
         writeOutBuffer();
+        cnt -= packets;
     }
 }
 
@@ -1285,6 +1484,8 @@ void TSMuxer::writeSIT()
         m_pcrBits += 4 * 8;
     }
     memcpy(m_outBuf + m_outBufLen, DefaultSitTableOne, TS_FRAME_SIZE);
+    if (m_hevcSit)
+        memcpy(m_outBuf + m_outBufLen + 17, SitTableHEVC, sizeof(SitTableHEVC));
     const auto tsPacket = reinterpret_cast<TSPacket*>(m_outBuf + m_outBufLen);
     tsPacket->counter = m_sitCnt++;
     m_outBufLen += TS_FRAME_SIZE;
@@ -10,26 +10,24 @@
 #include "avPacket.h"
 #include "hevc.h"
 #include "limits.h"
+#include "v3State.h"
 
-enum V3Flags
+static constexpr int MAX_PES_HEADER_LEN = 512;
+
+// PES header and reader addition data of the current packet, shared by the TS outputs of a multi-output mux so
+// that the stateful writePESExtension()/writeAdditionData() reader hooks run only once per packet.
+struct PESHeaderCache
 {
-    HDMV_V3 = 1,
-    HDR10 = 2,
-    DV = 4,
-    SL_HDR2 = 8,
-    HDR10PLUS = 16,
-    FOUR_K = 32,
-    BL_TRACK = 64,
-    BL_NOTCOMPAT = 128
+    int64_t packetNum = 0;            // advanced by MuxerManager for every demuxed packet
+    int64_t filledPacket = -1;        // packet the fields below belong to
+    std::vector<uint8_t> baseHeader;  // PES header before the hooks ran
+    std::vector<uint8_t> data;        // PES header and addition data after the hooks ran
+    PriorityDataInfo priorityData;
+    uint8_t* avData = nullptr;  // AVPacket fields after writeAdditionData()
+    int32_t avSize = 0;
+    unsigned avFlags = 0;
 };
 
-extern int V3_flags;
-extern unsigned HDR10_metadata[6];
-extern bool isV3();
-extern bool is4K();
-
-static constexpr int MAX_PES_HEADER_LEN = 512;
-
 class TSMuxer final : public AbstractMuxer
 {
     typedef AbstractMuxer base_class;
@@ -58,6 +56,15 @@ class TSMuxer final : public AbstractMuxer
     [[nodiscard]] size_t splitFileCnt() const { return m_fileNames.size(); }
     void setSplitDuration(const int64_t value) { m_splitDuration = value; }
     void setSplitSize(const uint32_t value) { m_splitSize = value; }
+    [[nodiscard]] bool isSplitMode() const { return m_splitSize > 0 || m_splitDuration > 0; }
+    // Muxes the streams of another output of the same run: the stream descriptors are taken from that muxer, so the
+    // stream readers are only set up by it
+    void setPrimaryMuxer(const TSMuxer* muxer);
+    // Whether the PES headers and stream descriptors of this muxer are those of `other`, so that both can mux the
+    // packets of the same stream readers
+    [[nodiscard]] bool canShareReaders(const TSMuxer& other) const;
+    // Reader hook results shared with the other outputs that mux the same packets
+    void setPESHeaderCache(PESHeaderCache* cache) { m_pesHeaderCache = cache; }
     void parseMuxOpt(const std::string& opts) override;
 
     void setFileName(const std::string& fileName, FileFactory* fileFactory) override;
@@ -66,6 +73,8 @@ class TSMuxer final : public AbstractMuxer
     [[nodiscard]] bool isInterleaveMode() const;
     [[nodiscard]] std::vector<int32_t> getInterleaveInfo(size_t idx) const;
     [[nodiscard]] bool isSubStream() const { return m_subMode; }
+    // V3/HDR state of the title this muxer writes the clips of
+    [[nodiscard]] const V3State& v3State() const;
 
     void setPtsOffset(int64_t value);
 
@@ -80,6 +89,10 @@ class TSMuxer final : public AbstractMuxer
     bool doFlush(int64_t newPCR, int64_t pcrGAP);
     void flushTSFrame();
     int writeTSFrames(int pid, const uint8_t* buffer, int64_t len, bool priorityData, bool payloadStart);
+    template <bool m2ts, bool cbr>
+    int writeTSFramesImpl(int pid, const uint8_t* buffer, int64_t len, bool priorityData, bool payloadStart);
+    [[nodiscard]] bool cbrPCRDue(int64_t extraBits) const;
+    [[nodiscard]] int64_t cbrPacketsBeforePCR(int64_t maxPackets, int packetBits) const;
     void writeSIT();
     void writePMT();
     void writePAT();
@@ -93,6 +106,8 @@ class TSMuxer final : public AbstractMuxer
     void addData(uint8_t pesStreamID, int pid, AVPacket& avPacket);
     void buildPesHeader(uint8_t pesStreamID, AVPacket& avPacket, int pid);
     void writePESPacket();
+    void indexPESPacket();
+    void streamPESData(const uint8_t* data, size_t size);
     void processM2TSPCR(int64_t pcrVal, int64_t pcrGAP);
     [[nodiscard]] inline int calcM2tsFrameCnt() const;
     static void writeM2TSHeader(uint8_t* buffer, const int64_t m2tsPCR)
@@ -163,6 +178,8 @@ class TSMuxer final : public AbstractMuxer
     int64_t m_minDts;
     bool m_beforePCRDataWrited;
     std::map<int, int> m_extIndexToTSIndex;
+    const TSMuxer* m_primaryMuxer = nullptr;
+    PESHeaderCache* m_pesHeaderCache = nullptr;
     uint16_t m_videoTrackCnt;
     uint16_t m_DVvideoTrackCnt;
     uint16_t m_videoSecondTrackCnt;
@@ -178,11 +195,13 @@ class TSMuxer final : public AbstractMuxer
     int m_pmtCnt;
     int m_patCnt;
     int m_sitCnt;
+    bool m_hevcSit;  // the SIT announces the peak rate of an HEVC stream
     uint32_t m_lastGopNullCnt;
 
     uint8_t m_pmtBuffer[4096];
     uint8_t m_patBuffer[TS_FRAME_SIZE];
     uint8_t m_nullBuffer[TS_FRAME_SIZE];
+    std::vector<uint8_t> m_nullRun;  // 16 null packets with counters 0..15, m_frameSize apart
     TS_program_map_section m_pmt;
     TS_program_association_section m_pat;
     std::map<int, uint8_t> m_pesType;
@@ -193,6 +212,9 @@ class TSMuxer final : public AbstractMuxer
     std::vector<uint32_t> m_muxedPacketCnt;
     bool m_pesIFrame;
     bool m_pesSpsPps;
+    int64_t m_pesWrittenSize;  // PES bytes already packetized by streamPESData()
+    uint32_t m_pesTsPackets;
+    bool m_pesUpdateIdx;
     bool m_computeMuxStats;
     int64_t m_pmtFrames;
     int64_t m_curFileStartPts;
@@ -9,7 +9,7 @@
 #include <string>
 
 #include "bitStream.h"
-#include "crc32.h"
+#include "crc.h"
 #include "h264StreamReader.h"
 #include "mpegStreamReader.h"
 #include "simplePacketizerReader.h"
@@ -190,7 +190,7 @@ uint32_t TS_program_association_section::serialize(uint8_t* buffer, const int bu
         bitWriter.putBits(13, fst);  // pid
     }
     bitWriter.flushBits();
-    const uint32_t crc = calculateCRC32(buffer, bitWriter.getBitsCount() / 8);
+    const uint32_t crc = crc::crc32(buffer, bitWriter.getBitsCount() / 8);
     const auto crcPtr = reinterpret_cast<uint32_t*>(buffer + bitWriter.getBitsCount() / 8);
     *crcPtr = my_htonl(crc);
 
@@ -353,7 +353,7 @@ bool TS_program_map_section::deserialize(uint8_t* buffer, const int buf_size)
         if (curPos != crcPos)
             return false;
 
-        // uint32_t rez = my_htonl(calculateCRC32(buffer, curPos - buffer));
+        // uint32_t rez = my_htonl(crc::crc32(buffer, curPos - buffer));
         return true;
     }
     catch (BitStreamException&)
@@ -510,7 +510,7 @@ uint32_t TS_program_map_section::serialize(uint8_t* buffer, const int max_buf_si
     *LengthPos1 = my_htons(static_cast<uint16_t>(0xb000 + bitWriter.getBitsCount() / 8 - beforeCount1 + 4));
     bitWriter.flushBits();
 
-    const uint32_t crc = calculateCRC32(buffer, bitWriter.getBitsCount() / 8);
+    const uint32_t crc = crc::crc32(buffer, bitWriter.getBitsCount() / 8);
 
     const auto crcPtr = reinterpret_cast<uint32_t*>(buffer + bitWriter.getBitsCount() / 8);
     *crcPtr = my_htonl(crc);
@@ -874,13 +874,14 @@ void CLPIParser::composeEP_map(BitStreamWriter& writer, const bool isSSExt)
     writer.putBits(8, 0);                                       // reserved_for_word_align
     writer.putBits(8, static_cast<int>(processStream.size()));  // number_of_stream_PID_entries
     std::vector<uint32_t*> epStartAddrPos;
+    std::vector<std::vector<BluRayCoarseInfo>> coarseInfoList;
 
     for (auto& i : processStream)
     {
         writer.putBits(16, i.streamPID);  // stream_PID[k]
         writer.putBits(10, 0);            // reserved_for_word_align
         writer.putBits(4, EP_stream_type);
-        std::vector<BluRayCoarseInfo> coarseInfo = buildCoarseInfo(i);
+        const std::vector<BluRayCoarseInfo>& coarseInfo = coarseInfoList.emplace_back(buildCoarseInfo(i));
         writer.putBits(16, static_cast<int>(coarseInfo.size()));  // number_of_EP_coarse_entries[k]
         if (!i.m_index.empty())
             writer.putBits(18, static_cast<int>(i.m_index[m_clpiNum].size()));  // number_of_EP_fine_entries[k]
@@ -895,13 +896,13 @@ void CLPIParser::composeEP_map(BitStreamWriter& writer, const bool isSSExt)
     for (size_t i = 0; i < processStream.size(); ++i)
     {
         *epStartAddrPos[i] = my_htonl(writer.getBitsCount() / 8 - beforeCount);
-        composeEP_map_for_one_stream_PID(writer, processStream[i]);
+        composeEP_map_for_one_stream_PID(writer, processStream[i], coarseInfoList[i]);
         if (writer.getBitsCount() % 16 != 0)
             writer.putBits(8, 0);  // padding_word
     }
 }
 
-std::vector<BluRayCoarseInfo> CLPIParser::buildCoarseInfo(M2TSStreamInfo& streamInfo) const
+std::vector<BluRayCoarseInfo> CLPIParser::buildCoarseInfo(const M2TSStreamInfo& streamInfo) const
 {
     std::vector<BluRayCoarseInfo> rez;
     if (streamInfo.m_index.empty())
@@ -909,7 +910,7 @@ std::vector<BluRayCoarseInfo> CLPIParser::buildCoarseInfo(M2TSStreamInfo& stream
     uint32_t cnt = 0;
     int64_t lastPktCnt = 0;
     int64_t lastCoarsePts = 0;
-    PMTIndex& curIndex = streamInfo.m_index[m_clpiNum];
+    const PMTIndex& curIndex = streamInfo.m_index[m_clpiNum];
     for (const auto& [fst, snd] : curIndex)
     {
         const PMTIndexData& indexData = snd;
@@ -927,12 +928,12 @@ std::vector<BluRayCoarseInfo> CLPIParser::buildCoarseInfo(M2TSStreamInfo& stream
     return rez;
 }
 
-void CLPIParser::composeEP_map_for_one_stream_PID(BitStreamWriter& writer, M2TSStreamInfo& streamInfo) const
+void CLPIParser::composeEP_map_for_one_stream_PID(BitStreamWriter& writer, const M2TSStreamInfo& streamInfo,
+                                                  const std::vector<BluRayCoarseInfo>& coarseInfo) const
 {
     const auto epFineStartAddr = reinterpret_cast<uint32_t*>(writer.getBuffer() + writer.getBitsCount() / 8);
     const uint32_t beforePos = writer.getBitsCount() / 8;
     writer.putBits(32, 0);  // EP_fine_table_start_address
-    const std::vector<BluRayCoarseInfo> coarseInfo = buildCoarseInfo(streamInfo);
     for (const auto& i : coarseInfo)
     {
         writer.putBits(18, i.m_fineRefID);  // ref_to_EP_fine_id[i]
@@ -952,7 +953,7 @@ void CLPIParser::composeEP_map_for_one_stream_PID(BitStreamWriter& writer, M2TSS
             int endCode = 0;
             if (indexData.m_frameLen > 0)
             {
-                if (is4K())
+                if (m_v3State.is4K())
                 {
                     if (indexData.m_frameLen < 786432)
                         endCode = 1;
@@ -1413,7 +1414,7 @@ int MPLSParser::composeSTN_tableSS(uint8_t* buffer, const int bufferSize)
     }
 };
 
-int MPLSParser::composeUHD_metadata(uint8_t* buffer, const int bufferSize)
+int MPLSParser::composeUHD_metadata(uint8_t* buffer, const int bufferSize) const
 {
     BitStreamWriter writer{};
     writer.setBuffer(buffer, buffer + bufferSize);
@@ -1422,7 +1423,7 @@ int MPLSParser::composeUHD_metadata(uint8_t* buffer, const int bufferSize)
         writer.putBits(32, 0x20);
         writer.putBits(32, 1 << 24);
         writer.putBits(32, 1 << 28);
-        for (const unsigned i : HDR10_metadata) writer.putBits(32, i);
+        for (const unsigned i : m_v3State.hdr10Metadata) writer.putBits(32, i);
         writer.flushBits();
         return writer.getBitsCount() / 8;
     }
@@ -1458,7 +1459,7 @@ int MPLSParser::compose(uint8_t* buffer, int bufferSize, const DiskType dt)
     const std::string type_indicator = "MPLS";
     std::string version_number;
     if (dt == DiskType::BLURAY)
-        version_number = (isV3() ? "0300" : "0200");
+        version_number = (m_v3State.isV3() ? "0300" : "0200");
     else
         version_number = "0100";
     CLPIStreamInfo::writeString(type_indicator.c_str(), writer, 4);
@@ -1485,7 +1486,7 @@ int MPLSParser::compose(uint8_t* buffer, int bufferSize, const DiskType dt)
     if (writer.getBitsCount() % 16 != 0)
         writer.putBits(8, 0);
 
-    if (number_of_SubPaths > 0 || isDependStreamExist || isV3())
+    if (number_of_SubPaths > 0 || isDependStreamExist || m_v3State.isV3())
     {
         *extDataStartAddr = my_htonl(writer.getBitsCount() / 8);
         uint8_t buff[1024 * 4];
@@ -1510,7 +1511,7 @@ int MPLSParser::compose(uint8_t* buffer, int bufferSize, const DiskType dt)
             blockVector.push_back(extDataBlock2);
         }
 
-        if (isV3())
+        if (m_v3State.isV3())
         {
             bufferSize = composeUHD_metadata(buff, sizeof(buff));
             const ExtDataBlockInfo extDataBlock(buff, bufferSize, 3, 5);
@@ -1562,9 +1563,9 @@ void MPLSParser::composeAppInfoPlayList(BitStreamWriter& writer) const
         writer.putBits(16, 0);  // reserved_for_future_use
     }
     writer.putBits(28, 0);               // UO_mask_table;
-    writer.putBits(4, isV3() ? 15 : 0);  // UO_mask_table;
+    writer.putBits(4, m_v3State.isV3() ? 15 : 0);  // UO_mask_table;
     writer.putBit(0);                    // reserved
-    writer.putBit(isV3() ? 1 : 0);       // UO_mask_table: SecondaryPGStreamNumberChange
+    writer.putBit(m_v3State.isV3() ? 1 : 0);       // UO_mask_table: SecondaryPGStreamNumberChange
     writer.putBits(30, 0);               // UO_mask_table cont;
     writer.putBit(0);                    // PlayList_random_access_flag
     writer.putBit(1);  // audio_mix_app_flag. 0 == no secondary audio, 1- allow secondary audio if exist
@@ -2130,9 +2131,9 @@ void MPLSParser::composePlayItem(BitStreamWriter& writer, const size_t playItemN
         writer.putBits(32, OUT_time);
 
     writer.putBits(28, 0);               // UO_mask_table;
-    writer.putBits(4, isV3() ? 15 : 0);  // UO_mask_table;
+    writer.putBits(4, m_v3State.isV3() ? 15 : 0);  // UO_mask_table;
     writer.putBit(0);                    // reserved
-    writer.putBit(isV3() ? 1 : 0);       // UO_mask_table: SecondaryPGStreamNumberChange
+    writer.putBit(m_v3State.isV3() ? 1 : 0);       // UO_mask_table: SecondaryPGStreamNumberChange
     writer.putBits(30, 0);               // UO_mask_table cont;
 
     writer.putBit(PlayItem_random_access_flag);
@@ -2499,8 +2500,8 @@ void MPLSParser::STN_table(BitStreamReader& reader, int PlayItem_id)
 // ------------- M2TSStreamInfo -----------------------
 
 void M2TSStreamInfo::blurayStreamParams(const double fps, const bool interlaced, const unsigned width,
-                                        const unsigned height, const VideoAspectRatio ar, uint8_t* video_format,
-                                        uint8_t* frame_rate_index, uint8_t* aspect_ratio_index)
+                                        const unsigned height, const VideoAspectRatio ar, const bool isV3,
+                                        uint8_t* video_format, uint8_t* frame_rate_index, uint8_t* aspect_ratio_index)
 {
     *video_format = 0;
     *frame_rate_index = 0;
@@ -2519,9 +2520,9 @@ void M2TSStreamInfo::blurayStreamParams(const double fps, const bool interlaced,
     else
         *video_format = 5;  // as 1280x720
 
-    if (width < 1080 && isV3())
+    if (width < 1080 && isV3)
         LTRACE(LT_WARN, 2, "Warning: video height < 1080 is not standard for V3 Blu-ray.");
-    if (interlaced && isV3())
+    if (interlaced && isV3)
         LTRACE(LT_WARN, 2, "Warning: interlaced video is not standard for V3 Blu-ray.");
 
     if (fabs(fps - 23.976) < 1e-4)
@@ -2567,8 +2568,8 @@ M2TSStreamInfo::M2TSStreamInfo(const PMTStreamInfo& pmtStreamInfo)
             height = vStream->getStreamHeight();
             HDR = vStream->getStreamHDR();
             const VideoAspectRatio ar = vStream->getStreamAR();
-            blurayStreamParams(vStream->getFPS(), vStream->getInterlaced(), width, height, ar, &video_format,
-                               &frame_rate_index, &aspect_ratio_index);
+            blurayStreamParams(vStream->getFPS(), vStream->getInterlaced(), width, height, ar,
+                               vStream->getV3State().isV3(), &video_format, &frame_rate_index, &aspect_ratio_index);
             if (ar == VideoAspectRatio::AR_3_4)
                 width = height * 4 / 3;
             else if (ar == VideoAspectRatio::AR_16_9)
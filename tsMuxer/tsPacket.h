@@ -4,10 +4,13 @@
 #include <memory.h>
 #include <types/types.h>
 
+#include <algorithm>
 #include <map>
+#include <vector>
 
 #include "avPacket.h"
 #include "bitStream.h"
+#include "v3State.h"
 #include "vod_common.h"
 
 // H.222 Table 2-45 - Program and program element descriptor
@@ -224,7 +227,48 @@ struct PMTIndexData
     PMTIndexData(const uint32_t pktCnt, const uint32_t frameLen) : m_pktCnt(pktCnt), m_frameLen(frameLen) {}
 };
 
-typedef std::map<uint64_t, PMTIndexData> PMTIndex;
+// Seek index of one clip: key frame PTS -> TS packet position, sorted by PTS. Entries are produced in PTS order,
+// so they are appended to a flat array; an out-of-order entry falls back to a sorted insert. As with std::map,
+// inserting an existing PTS keeps the old entry.
+class PMTIndex
+{
+   public:
+    typedef std::pair<uint64_t, PMTIndexData> value_type;
+    typedef std::vector<value_type>::iterator iterator;
+    typedef std::vector<value_type>::const_iterator const_iterator;
+    typedef std::vector<value_type>::reverse_iterator reverse_iterator;
+    typedef std::vector<value_type>::const_reverse_iterator const_reverse_iterator;
+
+    bool insert(const value_type& entry)
+    {
+        if (m_entries.empty() || m_entries.back().first < entry.first)
+        {
+            m_entries.push_back(entry);
+            return true;
+        }
+        const auto pos = std::lower_bound(m_entries.begin(), m_entries.end(), entry.first,
+                                          [](const value_type& e, const uint64_t pts) { return e.first < pts; });
+        if (pos != m_entries.end() && pos->first == entry.first)
+            return false;
+        m_entries.insert(pos, entry);
+        return true;
+    }
+
+    [[nodiscard]] bool empty() const { return m_entries.empty(); }
+    [[nodiscard]] size_t size() const { return m_entries.size(); }
+
+    iterator begin() { return m_entries.begin(); }
+    iterator end() { return m_entries.end(); }
+    [[nodiscard]] const_iterator begin() const { return m_entries.begin(); }
+    [[nodiscard]] const_iterator end() const { return m_entries.end(); }
+    reverse_iterator rbegin() { return m_entries.rbegin(); }
+    reverse_iterator rend() { return m_entries.rend(); }
+    [[nodiscard]] const_reverse_iterator rbegin() const { return m_entries.rbegin(); }
+    [[nodiscard]] const_reverse_iterator rend() const { return m_entries.rend(); }
+
+   private:
+    std::vector<value_type> m_entries;
+};
 
 struct PMTStreamInfo final
 {
@@ -357,7 +401,8 @@ struct M2TSStreamInfo
     std::vector<PMTIndex> m_index;
 
     static void blurayStreamParams(double fps, bool interlaced, unsigned width, unsigned height, VideoAspectRatio ar,
-                                   uint8_t* video_format, uint8_t* frame_rate_index, uint8_t* aspect_ratio_index);
+                                   bool isV3, uint8_t* video_format, uint8_t* frame_rate_index,
+                                   uint8_t* aspect_ratio_index);
 };
 
 struct CLPIStreamInfo : M2TSStreamInfo
@@ -456,6 +501,7 @@ class CLPIParser
     std::vector<uint32_t> SPN_extent_start;
     std::vector<int32_t> interleaveInfo;
     bool isDependStream;
+    V3State m_v3State;  // of the title the composed clip belongs to
 
    private:
     static void HDMV_LPCM_down_mix_coefficient(uint8_t* buffer, unsigned dataLength);
@@ -481,8 +527,9 @@ class CLPIParser
     void composeExtentInfo(BitStreamWriter& writer);
     void composeExtentStartPoint(BitStreamWriter& writer) const;
     void composeEP_map(BitStreamWriter& writer, bool isSSExt);
-    std::vector<BluRayCoarseInfo> buildCoarseInfo(M2TSStreamInfo& streamInfo) const;
-    void composeEP_map_for_one_stream_PID(BitStreamWriter& writer, M2TSStreamInfo& streamInfo) const;
+    std::vector<BluRayCoarseInfo> buildCoarseInfo(const M2TSStreamInfo& streamInfo) const;
+    void composeEP_map_for_one_stream_PID(BitStreamWriter& writer, const M2TSStreamInfo& streamInfo,
+                                          const std::vector<BluRayCoarseInfo>& coarseInfo) const;
 };
 
 struct MPLSStreamInfo : M2TSStreamInfo
@@ -570,6 +617,7 @@ struct MPLSParser
     bool isDependStreamExist;
     bool mvc_base_view_r;
     int subPath_type;
+    V3State m_v3State;  // of the title the composed playlist belongs to
 
     uint8_t number_of_primary_video_stream_entries;
     uint8_t number_of_primary_audio_stream_entries;
@@ -608,7 +656,7 @@ struct MPLSParser
     void composeSTN_table(BitStreamWriter& writer, size_t PlayItem_id, bool isSSEx);
     int composeSTN_tableSS(uint8_t* buffer, int bufferSize);
     int composeSubPathEntryExtension(uint8_t* buffer, int bufferSize);
-    static int composeUHD_metadata(uint8_t* buffer, int bufferSize);
+    int composeUHD_metadata(uint8_t* buffer, int bufferSize) const;
     MPLSStreamInfo& getMainStream();
     MPLSStreamInfo& getMVCDependStream();
     static int calcPlayItemID(const MPLSStreamInfo& streamInfo, uint32_t pts);
@@ -3,6 +3,7 @@
 #include <types/types.h>
 
 #include "convertUTF.h"
+#include "simd.h"
 #include "vodCoreException.h"
 #include "vod_common.h"
 
@@ -15,6 +16,11 @@ uint16_t read_le16(const uint8_t* p) { return static_cast<uint16_t>(p[0] | p[1]
 uint32_t read_be32(const uint8_t* p) { return p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3]; }
 uint32_t read_le32(const uint8_t* p) { return p[0] | p[1] << 8 | p[2] << 16 | p[3] << 24; }
 
+constexpr uint32_t SUR_HIGH_START = 0xd800;
+constexpr uint32_t SUR_HIGH_END = 0xdbff;
+constexpr uint32_t SUR_LOW_START = 0xdc00;
+constexpr uint32_t SUR_LOW_END = 0xdfff;
+
 template <typename R, typename... A>
 R get_fn_ret_type(R (*)(A...));
 
@@ -38,49 +44,153 @@ auto make_vector(const uint8_t* start, size_t numBytes, F func) -> std::vector<d
 }
 
 template <typename InputType, typename F>
-std::string from_utf_nn(std::vector<InputType>&& vec, F conversionFn)
+void from_utf_nn(std::string& dst, std::vector<InputType>&& vec, F conversionFn)
 {
-    std::string rv;
-    rv.resize(vec.size() * 4);
+    const size_t dstOffset = dst.size();
+    dst.resize(dstOffset + vec.size() * 4);
     const InputType* sourceStart = vec.data();
     auto sourceEnd = sourceStart + vec.size();
-    const auto targetStart = reinterpret_cast<UTF8*>(rv.data());
+    const auto targetStart = reinterpret_cast<UTF8*>(dst.data() + dstOffset);
     auto targetStart_out = targetStart;
-    auto targetEnd = targetStart + rv.size();
+    auto targetEnd = targetStart + vec.size() * 4;
     auto result = conversionFn(&sourceStart, sourceEnd, &targetStart_out, targetEnd, ConversionFlags::strictConversion);
     if (result != ConversionResult::conversionOK)
     {
+        dst.resize(dstOffset);
         THROW(ERR_COMMON, "Cannot convert string : invalid source text")
     }
-    rv.resize(targetStart_out - targetStart);
-    return rv;
+    dst.resize(dstOffset + (targetStart_out - targetStart));
+}
+
+// Copies the leading ASCII code units of UTF-16 text to dst, 8 units at a time. Returns the number of units copied,
+// the caller converts the rest of the text starting with the first block that has a non-ASCII unit.
+template <bool bigEndian>
+size_t copyAsciiUtf16(const uint8_t* src, const size_t units, uint8_t* dst)
+{
+    size_t i = 0;
+#if defined(TSMUXER_SSE2)
+    const __m128i nonAscii = _mm_set1_epi16(bigEndian ? static_cast<short>(0x80ff) : static_cast<short>(0xff80));
+    for (; i + 8 <= units; i += 8)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 2));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(v, nonAscii), _mm_setzero_si128())) != 0xffff)
+            break;
+        if (bigEndian)
+            v = _mm_srli_epi16(v, 8);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(v, v));
+    }
+#elif defined(TSMUXER_NEON)
+    for (; i + 8 <= units; i += 8)
+    {
+        uint8x16_t bytes = vld1q_u8(src + i * 2);
+        if (bigEndian)
+            bytes = vrev16q_u8(bytes);
+        const uint16x8_t v = vreinterpretq_u16_u8(bytes);
+        if (vmaxvq_u16(v) >= 0x80)
+            break;
+        vst1_u8(dst + i, vmovn_u16(v));
+    }
+#endif
+    return i;
+}
+
+// UTF-16 to UTF-8 with the same validation as the strict ConvertUTF16toUTF8: unpaired surrogates are rejected.
+// ASCII runs, which make up most of subtitle text, take the vector path.
+template <bool bigEndian>
+void fromUtf16(std::string& dst, const uint8_t* src, const size_t numBytes)
+{
+    if (numBytes % 2)
+        THROW(ERR_COMMON, "Cannot convert string : size " << numBytes << " should be divisible by 2")
+    const size_t units = numBytes / 2;
+    const size_t dstOffset = dst.size();
+    // 3 bytes per unit at most: a surrogate pair takes 2 units and gives 4 bytes
+    dst.resize(dstOffset + units * 3);
+    const auto dstStart = reinterpret_cast<uint8_t*>(dst.data() + dstOffset);
+    uint8_t* out = dstStart;
+    const auto readUnit = [src](const size_t i) -> uint32_t {
+        return bigEndian ? read_be16(src + i * 2) : read_le16(src + i * 2);
+    };
+    size_t i = 0;
+    while (i < units)
+    {
+        const size_t ascii = copyAsciiUtf16<bigEndian>(src + i * 2, units - i, out);
+        i += ascii;
+        out += ascii;
+        // one code point at a time until the next vector block
+        for (const size_t blockEnd = FFMIN(i + 8, units); i < blockEnd; ++i)
+        {
+            uint32_t ch = readUnit(i);
+            if (ch < 0x80)
+            {
+                *out++ = static_cast<uint8_t>(ch);
+                continue;
+            }
+            if (ch < 0x800)
+            {
+                *out++ = static_cast<uint8_t>(0xc0 | ch >> 6);
+                *out++ = static_cast<uint8_t>(0x80 | (ch & 0x3f));
+                continue;
+            }
+            if (ch >= SUR_HIGH_START && ch <= SUR_LOW_END)
+            {
+                const uint32_t ch2 = i + 1 < units ? readUnit(i + 1) : 0;
+                if (ch > SUR_HIGH_END || ch2 < SUR_LOW_START || ch2 > SUR_LOW_END)
+                {
+                    dst.resize(dstOffset);
+                    THROW(ERR_COMMON, "Cannot convert string : invalid source text")
+                }
+                ch = ((ch - SUR_HIGH_START) << 10) + (ch2 - SUR_LOW_START) + 0x10000;
+                ++i;
+                *out++ = static_cast<uint8_t>(0xf0 | ch >> 18);
+                *out++ = static_cast<uint8_t>(0x80 | (ch >> 12 & 0x3f));
+            }
+            else
+            {
+                *out++ = static_cast<uint8_t>(0xe0 | ch >> 12);
+            }
+            *out++ = static_cast<uint8_t>(0x80 | (ch >> 6 & 0x3f));
+            *out++ = static_cast<uint8_t>(0x80 | (ch & 0x3f));
+        }
+    }
+    dst.resize(dstOffset + (out - dstStart));
 }
 }  // namespace
 
 namespace UtfConverter
 {
-std::string toUtf8(const uint8_t* start, const size_t numBytes, const SourceFormat srcFormat)
+void appendUtf8(std::string& dst, const uint8_t* start, const size_t numBytes, const SourceFormat srcFormat)
 {
     switch (srcFormat)
     {
     case SourceFormat::sfUTF8:
-        return {start, start + numBytes};
+        dst.append(reinterpret_cast<const char*>(start), numBytes);
+        break;
     case SourceFormat::sfUTF16be:
-        return from_utf_nn(make_vector(start, numBytes, read_be16), ConvertUTF16toUTF8);
+        fromUtf16<true>(dst, start, numBytes);
+        break;
     case SourceFormat::sfUTF16le:
-        return from_utf_nn(make_vector(start, numBytes, read_le16), ConvertUTF16toUTF8);
+        fromUtf16<false>(dst, start, numBytes);
+        break;
     case SourceFormat::sfUTF32be:
-        return from_utf_nn(make_vector(start, numBytes, read_be32), ConvertUTF32toUTF8);
+        from_utf_nn(dst, make_vector(start, numBytes, read_be32), ConvertUTF32toUTF8);
+        break;
     case SourceFormat::sfUTF32le:
-        return from_utf_nn(make_vector(start, numBytes, read_le32), ConvertUTF32toUTF8);
+        from_utf_nn(dst, make_vector(start, numBytes, read_le32), ConvertUTF32toUTF8);
+        break;
 #ifdef _WIN32
     case SourceFormat::sfANSI:
-    {
-        return ::toUtf8(fromAcp(reinterpret_cast<const char*>(start), static_cast<int>(numBytes)).data());
-    }
+        dst += ::toUtf8(fromAcp(reinterpret_cast<const char*>(start), static_cast<int>(numBytes)).data());
+        break;
 #endif
     default:
         THROW(ERR_COMMON, "Unknown parameter to UtfConverter::toUtf8")
     }
 }
+
+std::string toUtf8(const uint8_t* start, const size_t numBytes, const SourceFormat srcFormat)
+{
+    std::string rv;
+    appendUtf8(rv, start, numBytes, srcFormat);
+    return rv;
+}
 }  // namespace UtfConverter
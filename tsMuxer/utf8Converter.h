@@ -21,6 +21,8 @@ enum class SourceFormat
 };
 
 std::string toUtf8(const uint8_t* start, size_t numBytes, SourceFormat srcFormat);
+// Same as toUtf8, appends the converted text to dst instead of allocating a new string
+void appendUtf8(std::string& dst, const uint8_t* start, size_t numBytes, SourceFormat srcFormat);
 }  // namespace UtfConverter
 
 #endif
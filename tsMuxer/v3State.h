@@ -0,0 +1,27 @@
+#ifndef V3_STATE_H_
+#define V3_STATE_H_
+
+enum V3Flags
+{
+    HDMV_V3 = 1,
+    HDR10 = 2,
+    DV = 4,
+    SL_HDR2 = 8,
+    HDR10PLUS = 16,
+    FOUR_K = 32,
+    BL_TRACK = 64,
+    BL_NOTCOMPAT = 128
+};
+
+// Blu-ray V3 (UHD) and HDR properties of one title. The stream readers and the muxers of the title add the flags of
+// its streams while it is muxed; its clip info and playlist files are written from them.
+struct V3State
+{
+    int flags = 0;
+    unsigned hdr10Metadata[6] = {0, 0, 0, 0, 0, 0};
+
+    [[nodiscard]] bool isV3() const { return flags & HDMV_V3; }
+    [[nodiscard]] bool is4K() const { return flags & FOUR_K; }
+};
+
+#endif  // V3_STATE_H_
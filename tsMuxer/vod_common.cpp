@@ -10,7 +10,7 @@
 
 using namespace std;
 
-bool sLastMsg = false;
+std::atomic<bool> sLastMsg = false;
 
 std::string toNativeSeparators(const std::string& dirName)
 {
@@ -3,6 +3,7 @@
 
 #include <types/types.h>
 
+#include <atomic>
 #include <chrono>
 #include <iostream>
 #include <string>
@@ -10,7 +11,7 @@
 #include <vector>
 
 #if 1
-extern bool sLastMsg;
+extern std::atomic<bool> sLastMsg;  // set by the messages of concurrently muxed titles
 #define LTRACE(level, errIndex, msg)               \
     do                                             \
     {                                              \
@@ -14,14 +14,7 @@ static constexpr int EXTENDED_SAR = 255;
 
 // ------------------------- VvcUnit -------------------
 
-unsigned VvcUnit::extractUEGolombCode()
-{
-    unsigned cnt = 0;
-    for (; !m_reader.getBit(); cnt++);
-    if (cnt > INT_BIT)
-        THROW_BITSTREAM_ERR;
-    return (1 << cnt) - 1 + m_reader.getBits(cnt);
-}
+unsigned VvcUnit::extractUEGolombCode() { return m_reader.getUEGolombCode(); }
 
 int VvcUnit::extractSEGolombCode()
 {
@@ -33,9 +26,14 @@ int VvcUnit::extractSEGolombCode()
 
 void VvcUnit::decodeBuffer(const uint8_t* buffer, const uint8_t* end)
 {
-    delete[] m_nalBuffer;
-    m_nalBuffer = new uint8_t[end - buffer];
-    m_nalBufferLen = NALUnit::decodeNAL(buffer, end, m_nalBuffer, end - buffer);
+    const auto size = static_cast<int>(end - buffer);
+    if (size > m_nalBufferCapacity)
+    {
+        delete[] m_nalBuffer;
+        m_nalBuffer = new uint8_t[size];
+        m_nalBufferCapacity = size;
+    }
+    m_nalBufferLen = NALUnit::decodeNAL(buffer, end, m_nalBuffer, m_nalBufferCapacity);
 }
 
 int VvcUnit::deserialize()
@@ -43,9 +41,9 @@ int VvcUnit::deserialize()
     m_reader.setBuffer(m_nalBuffer, m_nalBuffer + m_nalBufferLen);
     try
     {
-        m_reader.skipBits(2);  // forbidden_zero_bit, nuh_reserved_zero_bit
+        m_reader.skipBits<2>();  // forbidden_zero_bit, nuh_reserved_zero_bit
         nuh_layer_id = m_reader.getBits<uint8_t>(6);
-        nal_unit_type = static_cast<NalType>(m_reader.getBits(5));
+        nal_unit_type = static_cast<NalType>(m_reader.getBits<5>());
         nuh_temporal_id_plus1 = m_reader.getBits<uint8_t>(3);
         if (nuh_temporal_id_plus1 == 0 ||
             (nuh_temporal_id_plus1 != 1 && ((nal_unit_type >= NalType::OPI && nal_unit_type <= NalType::SPS) ||
@@ -160,9 +158,9 @@ int VvcUnitWithProfile::profile_tier_level(const bool profileTierPresentFlag, co
         {                           // general_constraints_info()
             if (m_reader.getBit())  // gci_present_flag
             {
-                m_reader.skipBits(32);
-                m_reader.skipBits(32);
-                m_reader.skipBits(7);
+                m_reader.skipBits<32>();
+                m_reader.skipBits<32>();
+                m_reader.skipBits<7>();
                 const auto gci_num_reserved_bits = m_reader.getBits<uint8_t>(8);
                 for (int i = 0; i < gci_num_reserved_bits; i++) m_reader.skipBit();  // gci_reserved_zero_bit[i]
             }
@@ -177,12 +175,12 @@ int VvcUnitWithProfile::profile_tier_level(const bool profileTierPresentFlag, co
 
         for (int i = MaxNumSubLayersMinus1 - 1; i >= 0; i--)
             if (ptl_sublayer_level_present_flag[i])
-                m_reader.skipBits(8);  // sublayer_level_idc[i]
+                m_reader.skipBits<8>();  // sublayer_level_idc[i]
         if (profileTierPresentFlag)
         {
             ptl_num_sub_profiles = m_reader.getBits<uint8_t>(8);
             general_sub_profile_idc.resize(ptl_num_sub_profiles);
-            for (auto& i : general_sub_profile_idc) i = m_reader.getBits(32);
+            for (auto& i : general_sub_profile_idc) i = m_reader.getBits<32>();
         }
         return 0;
     }
@@ -250,7 +248,7 @@ int VvcVpsUnit::deserialize()
         int vps_all_independent_layers_flag = (vps_max_layers > 1) ? m_reader.getBit() : 1;
         for (int i = 0; i < vps_max_layers; i++)
         {
-            m_reader.skipBits(6);  // vps_layer_id[i]
+            m_reader.skipBits<6>();  // vps_layer_id[i]
             if (i > 0 && !vps_all_independent_layers_flag)
             {
                 if (!m_reader.getBit())  // vps_independent_layer_flag[i]
@@ -260,7 +258,7 @@ int VvcVpsUnit::deserialize()
                     {
                         vps_direct_ref_layer_flag[i][j] = m_reader.getBit();
                         if (vps_max_tid_ref_present_flag && vps_direct_ref_layer_flag[i][j])
-                            m_reader.skipBits(3);  // vps_max_tid_il_ref_pics_plus1[i][j]
+                            m_reader.skipBits<3>();  // vps_max_tid_il_ref_pics_plus1[i][j]
                     }
                 }
             }
@@ -316,7 +314,7 @@ int VvcVpsUnit::deserialize()
 
         for (int i = 0; i < TotalNumOlss; i++)
             if (vps_num_ptls > 1 && vps_num_ptls != TotalNumOlss)
-                m_reader.skipBits(8);  // vps_ols_ptl_idx[i]
+                m_reader.skipBits<8>();  // vps_ols_ptl_idx[i]
 
         if (!vps_each_layer_is_an_ols_flag)
         {
@@ -417,7 +415,7 @@ int VvcVpsUnit::deserialize()
             {
                 extractUEGolombCode();          // vps_ols_dpb_pic_width
                 extractUEGolombCode();          // vps_ols_dpb_pic_height
-                m_reader.skipBits(2);           // vps_ols_dpb_chroma_format
+                m_reader.skipBits<2>();         // vps_ols_dpb_chroma_format
                 if (extractUEGolombCode() > 2)  // vps_ols_dpb_bitdepth_minus8
                     return 1;
                 if (VpsNumDpbParams > 1 && VpsNumDpbParams != NumMultiLayerOlss)
@@ -610,7 +608,7 @@ int VvcSpsUnit::deserialize()
         if (bitdepth_minus8 > 2)
             return 1;
         const int QpBdOffset = static_cast<int>(6 * bitdepth_minus8);
-        m_reader.skipBits(2);  // sps_entropy_coding_sync_enabled_flag, vsps_entry_point_offsets_present_flag
+        m_reader.skipBits<2>();  // sps_entropy_coding_sync_enabled_flag, vsps_entry_point_offsets_present_flag
         log2_max_pic_order_cnt_lsb = m_reader.getBits<uint8_t>(4) + 4;
         if (log2_max_pic_order_cnt_lsb > 16)
             return 1;
@@ -620,9 +618,9 @@ int VvcSpsUnit::deserialize()
                 return 1;
         }
         const auto sps_num_extra_ph_bytes = m_reader.getBits<uint8_t>(2);
-        for (int i = 0; i < sps_num_extra_ph_bytes; i++) m_reader.skipBits(8);  // sps_extra_ph_bit_present_flag[i]
+        for (int i = 0; i < sps_num_extra_ph_bytes; i++) m_reader.skipBits<8>();  // sps_extra_ph_bit_present_flag[i]
         const auto sps_num_extra_sh_bytes = m_reader.getBits<uint8_t>(2);
-        for (int i = 0; i < sps_num_extra_sh_bytes; i++) m_reader.skipBits(8);  // sps_extra_sh_bit_present_flag[i]
+        for (int i = 0; i < sps_num_extra_sh_bytes; i++) m_reader.skipBits<8>();  // sps_extra_sh_bit_present_flag[i]
         if (sps_ptl_dpb_hrd_params_present_flag)
         {
             const bool sps_sublayer_dpb_params_flag = (max_sublayers_minus1 > 0) ? m_reader.getBit() : false;
@@ -695,8 +693,8 @@ int VvcSpsUnit::deserialize()
                 return 1;
             m_reader.skipBit();  // sps_bdpcm_enabled_flag
         }
-        if (m_reader.getBit())     // sps_mts_enabled_flag
-            m_reader.skipBits(2);  // sps_explicit_mts_intra_enabled_flag, sps_explicit_mts_inter_enabled_flag
+        if (m_reader.getBit())       // sps_mts_enabled_flag
+            m_reader.skipBits<2>();  // sps_explicit_mts_intra_enabled_flag, sps_explicit_mts_inter_enabled_flag
 
         const bool sps_lfnst_enabled_flag = m_reader.getBit();
         if (chroma_format_idc != 0)
@@ -763,7 +761,7 @@ int VvcSpsUnit::deserialize()
             if (m_reader.getBit())   // sps_affine_prof_enabled_flag
                 m_reader.skipBit();  // sps_prof_control_present_in_ph_flag
         }
-        m_reader.skipBits(2);  // sps_bcw_enabled_flag, sps_ciip_enabled_flag
+        m_reader.skipBits<2>();  // sps_bcw_enabled_flag, sps_ciip_enabled_flag
         if (MaxNumMergeCand >= 2)
         {
             if (m_reader.getBit() /* sps_gpm_enabled_flag */ && MaxNumMergeCand >= 3)
@@ -775,11 +773,11 @@ int VvcSpsUnit::deserialize()
         if (extractUEGolombCode() + 2 > static_cast<unsigned>(CtbLog2SizeY))  // sps_log2_parallel_merge_level_minus2
             return 1;
 
-        m_reader.skipBits(3);  // sps_isp_enabled_flag, sps_mrl_enabled_flag, sps_mip_enabled_flag
+        m_reader.skipBits<3>();  // sps_isp_enabled_flag, sps_mrl_enabled_flag, sps_mip_enabled_flag
         if (chroma_format_idc != 0)
             m_reader.skipBit();  // sps_cclm_enabled_flag
         if (chroma_format_idc == 1)
-            m_reader.skipBits(2);  // sps_chroma_horizontal_collocated_flag, sps_chroma_vertical_collocated_flag
+            m_reader.skipBits<2>();  // sps_chroma_horizontal_collocated_flag, sps_chroma_vertical_collocated_flag
 
         const bool sps_palette_enabled_flag = m_reader.getBit();
         const bool sps_act_enabled_flag =
@@ -816,7 +814,7 @@ int VvcSpsUnit::deserialize()
             (sps_act_enabled_flag && sps_explicit_scaling_list_enabled_flag) ? m_reader.getBit() : false;
         if (sps_scaling_matrix_for_alternative_colour_space_disabled_flag)
             m_reader.skipBit();  // sps_scaling_matrix_designated_colour_space_flag
-        m_reader.skipBits(2);    // sps_dep_quant_enabled_flag, sps_sign_data_hiding_enabled_flag
+        m_reader.skipBits<2>();  // sps_dep_quant_enabled_flag, sps_sign_data_hiding_enabled_flag
         if (m_reader.getBit())   // sps_virtual_boundaries_enabled_flag
         {
             if (m_reader.getBit())  // sps_virtual_boundaries_present_flag
@@ -928,8 +926,8 @@ int VvcSpsUnit::vui_parameters()
 
     if (m_reader.getBit())  // aspect_ratio_info_present_flag
     {
-        if (m_reader.getBits(8) == EXTENDED_SAR)  // aspect_ratio_idc
-            m_reader.skipBits(32);                // sar_width, sar_height
+        if (m_reader.getBits<8>() == EXTENDED_SAR)  // aspect_ratio_idc
+            m_reader.skipBits<32>();                // sar_width, sar_height
     }
 
     if (m_reader.getBit())   // overscan_info_present_flag
@@ -997,8 +995,8 @@ VvcHrdUnit::VvcHrdUnit()
 
 bool VvcUnit::general_timing_hrd_parameters(VvcHrdUnit& m_hrd)
 {
-    m_hrd.num_units_in_tick = m_reader.getBits(32);
-    m_hrd.time_scale = m_reader.getBits(32);
+    m_hrd.num_units_in_tick = m_reader.getBits<32>();
+    m_hrd.time_scale = m_reader.getBits<32>();
     m_hrd.general_nal_hrd_params_present_flag = m_reader.getBit();
     m_hrd.general_vcl_hrd_params_present_flag = m_reader.getBit();
     if (m_hrd.general_nal_hrd_params_present_flag || m_hrd.general_vcl_hrd_params_present_flag)
@@ -1006,10 +1004,10 @@ bool VvcUnit::general_timing_hrd_parameters(VvcHrdUnit& m_hrd)
         m_reader.skipBit();  // general_same_pic_timing_in_all_ols_flag
         m_hrd.general_du_hrd_params_present_flag = m_reader.getBit();
         if (m_hrd.general_du_hrd_params_present_flag)
-            m_reader.skipBits(8);  // tick_divisor_minus2
-        m_reader.skipBits(8);      // bit_rate_scale, cpb_size_scale
+            m_reader.skipBits<8>();  // tick_divisor_minus2
+        m_reader.skipBits<8>();      // bit_rate_scale, cpb_size_scale
         if (m_hrd.general_du_hrd_params_present_flag)
-            m_reader.skipBits(4);  // cpb_size_du_scale
+            m_reader.skipBits<4>();  // cpb_size_du_scale
         m_hrd.hrd_cpb_cnt_minus1 = extractUEGolombCode();
         if (m_hrd.hrd_cpb_cnt_minus1 > 31)
             return true;
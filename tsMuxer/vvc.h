@@ -17,7 +17,18 @@ struct VvcHrdUnit
 
 struct VvcUnit
 {
-    VvcUnit() : nal_unit_type(), nuh_layer_id(0), nuh_temporal_id_plus1(0), m_nalBuffer(nullptr), m_nalBufferLen(0) {}
+    VvcUnit()
+        : nal_unit_type(),
+          nuh_layer_id(0),
+          nuh_temporal_id_plus1(0),
+          m_nalBuffer(nullptr),
+          m_nalBufferLen(0),
+          m_nalBufferCapacity(0)
+    {
+    }
+    ~VvcUnit() { delete[] m_nalBuffer; }
+    VvcUnit(const VvcUnit&) = delete;
+    VvcUnit& operator=(const VvcUnit&) = delete;
 
     enum class NalType
     {
@@ -65,6 +76,7 @@ struct VvcUnit
 
     uint8_t* m_nalBuffer;
     int m_nalBufferLen;
+    int m_nalBufferCapacity;  // m_nalBuffer only grows, it is reused by the next decodeBuffer call
     BitStreamReader m_reader;
 };
 
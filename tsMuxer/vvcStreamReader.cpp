@@ -30,6 +30,7 @@ VVCStreamReader::VVCStreamReader()
       m_vpsCounter(0),
       m_vpsSizeDiff(0)
 {
+    m_nalIndexEnabled = true;
 }
 
 VVCStreamReader::~VVCStreamReader()
@@ -148,7 +149,8 @@ int VVCStreamReader::getTSDescriptor(uint8_t* dstBuff, bool blurayMode, const bo
         *dstBuff++ = static_cast<int>(StreamType::VIDEO_H266);  // stream_coding_type
         uint8_t video_format, frame_rate_index, aspect_ratio_index;
         M2TSStreamInfo::blurayStreamParams(getFPS(), getInterlaced(), getStreamWidth(), getStreamHeight(),
-                                           getStreamAR(), &video_format, &frame_rate_index, &aspect_ratio_index);
+                                           getStreamAR(), m_v3State->isV3(), &video_format, &frame_rate_index,
+                                           &aspect_ratio_index);
 
         *dstBuff++ = static_cast<uint8_t>(video_format << 4 | frame_rate_index);
         *dstBuff = static_cast<uint8_t>(aspect_ratio_index << 4 | 0xf);
@@ -196,15 +198,16 @@ void VVCStreamReader::updateStreamFps(void* nalUnit, uint8_t* buff, uint8_t* nex
     if (newSpsLen == -1)
         THROW(ERR_COMMON, "Not enough buffer")
 
-    if (m_bufEnd && newSpsLen != oldNalSize)
+    if (m_bufEnd)
     {
-        m_vpsSizeDiff = newSpsLen - oldNalSize;
-        if (m_bufEnd + m_vpsSizeDiff > m_tmpBuffer + TMP_BUFFER_SIZE)
-            THROW(ERR_COMMON, "Not enough buffer")
-        memmove(nextNal + m_vpsSizeDiff, nextNal, m_bufEnd - nextNal);
-        m_bufEnd += m_vpsSizeDiff;
+        m_vpsSizeDiff = static_cast<int>(newSpsLen) - oldNalSize;
+        replaceNal(buff, nextNal, tmpBuffer.get(), static_cast<int>(newSpsLen));
+    }
+    else
+    {
+        memcpy(buff, tmpBuffer.get(), newSpsLen);
+        updateNalIndex(buff, buff + newSpsLen, 0);
     }
-    memcpy(buff, tmpBuffer.get(), newSpsLen);
 }
 
 unsigned VVCStreamReader::getStreamWidth() const { return m_sps ? m_sps->pic_width_max_in_luma_samples : 0; }
@@ -341,7 +344,7 @@ int VVCStreamReader::intDecodeNAL(uint8_t* buff)
 
     const uint8_t* prevPos = nullptr;
     uint8_t* curPos = buff;
-    uint8_t* nextNal = NALUnit::findNextNAL(curPos, m_bufEnd);
+    uint8_t* nextNal = findNextNAL(curPos, m_bufEnd);
 
     if (!m_eof && nextNal == m_bufEnd)
         return NOT_ENOUGH_BUFFER;
@@ -423,7 +426,7 @@ int VVCStreamReader::intDecodeNAL(uint8_t* buff)
         }
         prevPos = curPos;
         curPos = nextNal;
-        nextNal = NALUnit::findNextNAL(curPos, m_bufEnd);
+        nextNal = findNextNAL(curPos, m_bufEnd);
 
         if (!m_eof && nextNal == m_bufEnd)
             return NOT_ENOUGH_BUFFER;